@@ -25,13 +25,25 @@
 #include <pwd.h>
 #include <linux/limits.h>
 #include <map>
+#include <algorithm>
+#include <vector>
+#include <atomic>
 
 #include "XV4LCamera.hpp"
 #include "XV4LCameraConfig.hpp"
 #include "XWebServer.hpp"
 #include "XVideoSourceToWeb.hpp"
+#include "XJpegEncoderPool.hpp"
+#include "XMotionDetectorConfig.hpp"
+#include "XVideoSourceDemandController.hpp"
+#include "XAsyncVideoSourceListener.hpp"
+#include "XVideoRecorder.hpp"
+#include "XVideoFrameDecorator.hpp"
+#include "XRecordingsRequestHandler.hpp"
 #include "XObjectConfigurationSerializer.hpp"
 #include "XObjectConfigurationRequestHandler.hpp"
+#include "XStatisticsRequestHandler.hpp"
+#include "XTraceRequestHandler.hpp"
 #include "XManualResetEvent.hpp"
 
 // Release build embeds web resources into executable
@@ -63,16 +75,38 @@ XManualResetEvent ExitEvent;
 // Different application settings
 struct
 {
-    uint32_t DeviceNumber;
+    vector<uint32_t> DeviceNumbers;
     uint32_t FrameWidth;
     uint32_t FrameHeight;
     uint32_t FrameRate;
+    XPixelFormat CaptureFormat;
+    bool     LowLatency;
+    uint32_t EncoderThreads;
+    uint32_t StripThreads;
+    XJpegProfile EncoderProfile;
+    XJpegProfile JpegProfile;
+    bool     JpegOwnProfile;
+    uint32_t BenchmarkIterations;
+    uint32_t IdleFrameRate;
+    uint32_t DuplicateKeepAlive;
+    uint32_t IdleTimeout;
+    uint32_t HistorySize;
+    uint32_t LowQuality;
+    string   RecordingDirectory;
+    uint32_t SegmentDuration;
+    uint32_t RecordingMaxSize;
+    uint32_t RecordingMaxAge;
+    string   TimeLapseDirectory;
+    uint32_t TimeLapseInterval;
     uint32_t WebPort;
     string   HtRealm;
     string   HtDigestFileName;
     string   CameraConfigFileName;
     string   CustomWebContent;
     string   CameraTitle;
+    bool     TimestampOverlay;
+    bool     TitleOverlay;
+    vector<XJpegOverlayArea> PrivacyMasks;
     UserGroup ViewersGroup;
     UserGroup ConfigGroup;
 }
@@ -84,32 +118,144 @@ void sigIntHandler( int s )
     ExitEvent.Signal( );
 }
 
+// Number of cameras, which are still running (not failed with fatal error)
+atomic<uint32_t> CamerasAlive( 0 );
+
 // Listener for camera errors
 class CameraErrorListener : public IVideoSourceListener
 {
 public:
+    CameraErrorListener( uint32_t deviceNumber ) : mDeviceNumber( deviceNumber ), mFailed( false ) { }
+
     // New video frame notification - ignore it
     virtual void OnNewImage( const std::shared_ptr<const XImage>& image ) { };
 
     // Video source error notification
     virtual void OnError( const std::string& errorMessage, bool fatal )
     {
-        printf( "[%s] : %s \n", ( ( fatal ) ? "Fatal" : "Error" ), errorMessage.c_str( ) );
-        if ( fatal )
+        printf( "[%s] video%u : %s \n", ( ( fatal ) ? "Fatal" : "Error" ), mDeviceNumber, errorMessage.c_str( ) );
+        // camera started on demand may fail again, but it is counted once
+        if ( ( fatal ) && ( !mFailed.exchange( true ) ) && ( --CamerasAlive == 0 ) )
         {
-            // time to exit if something has bad happened
+            // time to exit if something has bad happened to all cameras
             ExitEvent.Signal( );
         }
     }
+
+private:
+    uint32_t     mDeviceNumber;
+    atomic<bool> mFailed;
+};
+
+// Listener keeping a copy of the first uncompressed frame of camera to benchmark encoder profiles with
+class FirstFrameListener : public IVideoSourceListener
+{
+public:
+    FirstFrameListener( ) : mTaken( false ) { }
+
+    // New video frame notification - copy the first one not coming as JPEG
+    virtual void OnNewImage( const std::shared_ptr<const XImage>& image )
+    {
+        if ( ( image->Format( ) != XPixelFormat::JPEG ) && ( !mTaken.exchange( true ) ) )
+        {
+            mImage = image->Clone( );
+            mReady.Signal( );
+        }
+    }
+
+    // Video source error notification - ignore it
+    virtual void OnError( const std::string& errorMessage, bool fatal ) { }
+
+    // Wait for the first frame for the specified time - null if it did not come
+    shared_ptr<XImage> WaitFrame( uint32_t msec )
+    {
+        return ( mReady.Wait( msec ) ) ? mImage : shared_ptr<XImage>( );
+    }
+
+private:
+    atomic<bool>       mTaken;
+    XManualResetEvent  mReady;
+    shared_ptr<XImage> mImage;
+};
+
+// Encode the specified frame with every profile and print time/size of its images
+void BenchmarkEncoderProfiles( uint32_t deviceNumber, const shared_ptr<XImage>& frame )
+{
+    vector<XJpegProfileBenchmark> results;
+
+    if ( ( !frame ) || ( XJpegEncoder::BenchmarkProfiles( frame, 85, Settings.BenchmarkIterations, results ) != XError::Success ) )
+    {
+        printf( "[Info] video%u : no uncompressed frame to benchmark JPEG encoder profiles with \n", deviceNumber );
+    }
+    else
+    {
+        printf( "[Info] video%u : JPEG encoder profiles for %dx%d frames \n", deviceNumber, frame->Width( ), frame->Height( ) );
+
+        for ( const XJpegProfileBenchmark& result : results )
+        {
+            printf( "    %-16s %7.2f ms/frame %9u bytes/frame \n", XJpegEncoder::ProfileName( result.Profile ),
+                    result.EncodingTime, result.EncodedSize );
+        }
+    }
+}
+
+// Everything needed to serve a single camera
+struct CameraContext
+{
+    uint32_t                                DeviceNumber;
+    string                                  Title;
+    shared_ptr<XV4LCamera>                  Camera;
+    shared_ptr<IObjectConfigurator>         CameraConfig;
+    shared_ptr<XVideoSourceDemandController> DemandController;
+    shared_ptr<XEncodedFrameBuffer>         HistoryBuffer;
+    shared_ptr<XVideoRecorder>              Recorder;
+    shared_ptr<XVideoRecorder>              TimeLapseRecorder;
+    shared_ptr<XVideoFrameDecorator>        Decorator;
+    XObjectConfigurationSerializer          Serializer;
+    shared_ptr<XMotionDetector>             MotionDetector;
+    shared_ptr<IObjectConfigurator>         MotionConfig;
+    XObjectConfigurationSerializer          MotionSerializer;
+    shared_ptr<XAsyncVideoSourceListener>   MotionListener;
+    XVideoSourceToWeb                       Video2Web;
+    XVideoSourceListenerChain               ListenerChain;
+    CameraErrorListener                     ErrorListener;
+    FirstFrameListener                      BenchmarkListener;
+
+    CameraContext( uint32_t deviceNumber, const string& title, const string& configFileName ) :
+        DeviceNumber( deviceNumber ), Title( title ), Camera( XV4LCamera::Create( ) ),
+        CameraConfig( make_shared<XV4LCameraConfig>( Camera ) ), DemandController( ), HistoryBuffer( ), Recorder( ), TimeLapseRecorder( ), Decorator( ), Serializer( configFileName, CameraConfig ),
+        MotionDetector( make_shared<XMotionDetector>( ) ), MotionConfig( make_shared<XMotionDetectorConfig>( MotionDetector ) ),
+        MotionSerializer( configFileName + ".motion", MotionConfig ), MotionListener( ), Video2Web( ), ListenerChain( ), ErrorListener( deviceNumber ), BenchmarkListener( )
+    {
+    }
 };
 
 // Set default values for settings
 void SetDefaultSettings( )
 {
-    Settings.DeviceNumber = 0;
+    Settings.DeviceNumbers = { 0 };
     Settings.FrameWidth   = 640;
     Settings.FrameHeight  = 480;
     Settings.FrameRate    = 30;
+    Settings.CaptureFormat = XPixelFormat::Unknown;
+    Settings.LowLatency   = false;
+    Settings.EncoderThreads = 0;
+    Settings.StripThreads   = 1;
+    Settings.EncoderProfile = XJpegProfile::LiveFast;
+    Settings.JpegProfile    = XJpegProfile::LiveFast;
+    Settings.JpegOwnProfile = false;
+    Settings.BenchmarkIterations = 0;
+    Settings.IdleFrameRate  = 0;
+    Settings.DuplicateKeepAlive = 0;
+    Settings.IdleTimeout    = 0;
+    Settings.HistorySize    = 0;
+    Settings.LowQuality     = 0;
+    Settings.RecordingDirectory = "";
+    Settings.SegmentDuration    = 600;
+    Settings.RecordingMaxSize   = 0;
+    Settings.RecordingMaxAge    = 0;
+    Settings.TimeLapseDirectory = "";
+    Settings.TimeLapseInterval  = 60;
     Settings.WebPort      = 8000;
 
     Settings.HtRealm = "cam2web";
@@ -133,13 +279,32 @@ void SetDefaultSettings( )
 #endif
 
     Settings.CameraTitle = DEVICE_NAME;
+    Settings.TimestampOverlay = false;
+    Settings.TitleOverlay     = false;
+    Settings.PrivacyMasks.clear( );
 }
 
 // Parse command line and override default settings
 bool ParseCommandLine( int argc, char* argv[] )
 {
-    static const uint32_t SupportedWidth[]  = { 320, 480, 640, 800, 960, 1120, 1600, 1920, 2048, 2592, 3264, 3840, 4224 };
-    static const uint32_t SupportedHeight[] = { 240, 360, 480, 600, 720, 840,  1200, 1080, 1536, 1944, 2448, 2160, 3156 };
+    // sizes which could be set by index (kept for compatibility with older versions)
+    static const uint32_t IndexedWidth[]  = { 320, 480, 640, 800, 960, 1120, 1600, 1920, 2048, 2592, 3264, 3840, 4224 };
+    static const uint32_t IndexedHeight[] = { 240, 360, 480, 600, 720, 840,  1200, 1080, 1536, 1944, 2448, 2160, 3156 };
+    static const map<string, XPixelFormat> SupportedFormats =
+    {
+        { "auto",   XPixelFormat::Unknown },
+        { "mjpeg",  XPixelFormat::JPEG    },
+        { "nv12",   XPixelFormat::NV12    },
+        { "i420",   XPixelFormat::I420    },
+        { "yuyv",   XPixelFormat::YUYV    },
+        { "uyvy",   XPixelFormat::UYVY    },
+        { "grey",   XPixelFormat::Grayscale8  },
+        { "y16",    XPixelFormat::Grayscale16 },
+        { "rggb",   XPixelFormat::BayerRGGB8  },
+        { "grbg",   XPixelFormat::BayerGRBG8  },
+        { "gbrg",   XPixelFormat::BayerGBRG8  },
+        { "bggr",   XPixelFormat::BayerBGGR8  }
+    };
     static const map<string, UserGroup> SupportedUserGroups =
     {
         { "any",    UserGroup::Anyone   },
@@ -173,25 +338,65 @@ bool ParseCommandLine( int argc, char* argv[] )
 
         if ( key == "dev" )
         {
-            int scanned = sscanf( value.c_str( ), "%u", &(Settings.DeviceNumber) );
+            vector<uint32_t> deviceNumbers;
+            const char*      ptr = value.c_str( );
+            uint32_t         deviceNumber;
+            int              charsScanned;
 
-            if ( scanned != 1 )
+            // comma separated list of devices, like 0,2,4
+            while ( sscanf( ptr, "%u%n", &deviceNumber, &charsScanned ) == 1 )
+            {
+                if ( find( deviceNumbers.begin( ), deviceNumbers.end( ), deviceNumber ) != deviceNumbers.end( ) )
+                    break;
+
+                deviceNumbers.push_back( deviceNumber );
+                ptr += charsScanned;
+
+                if ( *ptr != ',' )
+                    break;
+                ptr++;
+            }
+
+            if ( ( deviceNumbers.empty( ) ) || ( *ptr != '\0' ) || ( value.back( ) == ',' ) )
                 break;
+
+            Settings.DeviceNumbers = deviceNumbers;
         }
         else if ( key == "size" )
         {
-            int size_index;
+            uint32_t width, height;
+            int      size_index;
 
-            int scanned = sscanf( value.c_str( ), "%u", &size_index );
+            if ( sscanf( value.c_str( ), "%ux%u", &width, &height ) == 2 )
+            {
+                if ( ( width == 0 ) || ( height == 0 ) )
+                    break;
 
-            if ( scanned != 1 )
-                break;
+                Settings.FrameWidth  = width;
+                Settings.FrameHeight = height;
+            }
+            else
+            {
+                int scanned = sscanf( value.c_str( ), "%u", &size_index );
+
+                if ( scanned != 1 )
+                    break;
+
+                if ( ( size_index < 0 ) || ( size_index > 12 ) )
+                    break;
+
+                Settings.FrameWidth  = IndexedWidth[size_index];
+                Settings.FrameHeight = IndexedHeight[size_index];
+            }
+        }
+        else if ( key == "format" )
+        {
+            map<string, XPixelFormat>::const_iterator itFormat = SupportedFormats.find( value );
 
-            if ( ( size_index < 0 ) || ( size_index > 12 ) )
+            if ( itFormat == SupportedFormats.end( ) )
                 break;
 
-            Settings.FrameWidth  = SupportedWidth[size_index];
-            Settings.FrameHeight = SupportedHeight[size_index];
+            Settings.CaptureFormat = itFormat->second;
         }
         else if ( key == "fps" )
         {
@@ -203,6 +408,150 @@ bool ParseCommandLine( int argc, char* argv[] )
             if ( ( Settings.FrameRate < 1 ) || ( Settings.FrameRate > 30 ) )
                 Settings.FrameRate = 30;
         }
+        else if ( key == "latency" )
+        {
+            if ( value == "low" )
+                Settings.LowLatency = true;
+            else if ( value == "normal" )
+                Settings.LowLatency = false;
+            else
+                break;
+        }
+        else if ( key == "enc" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.EncoderThreads) );
+
+            if ( scanned != 1 )
+                break;
+
+            if ( Settings.EncoderThreads > 64 )
+                Settings.EncoderThreads = 64;
+        }
+        else if ( key == "strips" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.StripThreads) );
+
+            if ( ( scanned != 1 ) || ( Settings.StripThreads == 0 ) )
+                break;
+
+            if ( Settings.StripThreads > 16 )
+                Settings.StripThreads = 16;
+        }
+        else if ( key == "profile" )
+        {
+            if ( !XJpegEncoder::ProfileFromName( value, &Settings.EncoderProfile ) )
+                break;
+        }
+        else if ( key == "jpegprofile" )
+        {
+            if ( !XJpegEncoder::ProfileFromName( value, &Settings.JpegProfile ) )
+                break;
+
+            Settings.JpegOwnProfile = true;
+        }
+        else if ( key == "encbench" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.BenchmarkIterations) );
+
+            if ( scanned != 1 )
+                break;
+
+            if ( Settings.BenchmarkIterations > 1000 )
+                Settings.BenchmarkIterations = 1000;
+        }
+        else if ( key == "idlefps" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.IdleFrameRate) );
+
+            if ( scanned != 1 )
+                break;
+
+            if ( Settings.IdleFrameRate > 30 )
+                Settings.IdleFrameRate = 30;
+        }
+        else if ( key == "keep" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.DuplicateKeepAlive) );
+
+            if ( scanned != 1 )
+                break;
+        }
+        else if ( key == "idle" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.IdleTimeout) );
+
+            if ( scanned != 1 )
+                break;
+
+            if ( Settings.IdleTimeout > 86400 )
+                Settings.IdleTimeout = 86400;
+        }
+        else if ( key == "history" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.HistorySize) );
+
+            if ( scanned != 1 )
+                break;
+
+            if ( Settings.HistorySize > 2048 )
+                Settings.HistorySize = 2048;
+        }
+        else if ( key == "lowq" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.LowQuality) );
+
+            if ( scanned != 1 )
+                break;
+
+            if ( Settings.LowQuality > 100 )
+                Settings.LowQuality = 100;
+        }
+        else if ( key == "rec" )
+        {
+            Settings.RecordingDirectory = value;
+        }
+        else if ( key == "recseg" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.SegmentDuration) );
+
+            if ( scanned != 1 )
+                break;
+
+            if ( Settings.SegmentDuration < 10 )
+                Settings.SegmentDuration = 10;
+            if ( Settings.SegmentDuration > 86400 )
+                Settings.SegmentDuration = 86400;
+        }
+        else if ( key == "recsize" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.RecordingMaxSize) );
+
+            if ( scanned != 1 )
+                break;
+        }
+        else if ( key == "recage" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.RecordingMaxAge) );
+
+            if ( scanned != 1 )
+                break;
+        }
+        else if ( key == "timelapse" )
+        {
+            Settings.TimeLapseDirectory = value;
+        }
+        else if ( key == "tlint" )
+        {
+            int scanned = sscanf( value.c_str( ), "%u", &(Settings.TimeLapseInterval) );
+
+            if ( scanned != 1 )
+                break;
+
+            if ( Settings.TimeLapseInterval < 1 )
+                Settings.TimeLapseInterval = 1;
+            if ( Settings.TimeLapseInterval > 3600 )
+                Settings.TimeLapseInterval = 3600;
+        }
         else if ( key == "port" )
         {
             int scanned = sscanf( value.c_str( ), "%u", &(Settings.WebPort) );
@@ -265,6 +614,25 @@ bool ParseCommandLine( int argc, char* argv[] )
         {
             Settings.CameraTitle = value;
         }
+        else if ( key == "overlay" )
+        {
+            if ( ( value != "none" ) && ( value != "time" ) && ( value != "title" ) && ( value != "both" ) )
+                break;
+
+            Settings.TimestampOverlay = ( ( value == "time" )  || ( value == "both" ) );
+            Settings.TitleOverlay     = ( ( value == "title" ) || ( value == "both" ) );
+        }
+        else if ( key == "mask" )
+        {
+            XJpegOverlayArea mask;
+            int              charsScanned = 0;
+
+            if ( ( sscanf( value.c_str( ), "%d,%d,%d,%d%n", &mask.X, &mask.Y, &mask.Width, &mask.Height, &charsScanned ) != 4 ) ||
+                 ( value[charsScanned] != '\0' ) || ( mask.Width <= 0 ) || ( mask.Height <= 0 ) )
+                break;
+
+            Settings.PrivacyMasks.push_back( mask );
+        }
         else
         {
             break;
@@ -294,26 +662,69 @@ bool ParseCommandLine( int argc, char* argv[] )
         printf( "cam2web - streaming camera to web \n" );
         printf( "Version: %s \n\n", STR_INFO_VERSION );
         printf( "Available command line options: \n" );
-        printf( "  -dev:<num>   Sets video device number to use. \n" );
+        printf( "  -dev:<num>   Sets video device number to use. Several cameras can be \n" );
+        printf( "               served by listing their numbers, like 0,2,4. All of them \n" );
+        printf( "               are provided as /camera/<num>/..., while the first one is \n" );
+        printf( "               also provided as /camera/... Other settings are common. \n" );
         printf( "               Default is 0. \n" );
-        printf( "  -size:<0-12> Sets video size to one from the list below: \n" );
-        printf( "               0: 320x240 \n" );
-        printf( "               1: 480x360 \n" );
-        printf( "               2: 640x480 (default) \n" );
-        printf( "               3: 800x600 \n" );
-        printf( "               4: 960x720 \n" );
-        printf( "               5: 1120x840 \n" );
-        printf( "               6: 1600x1200 \n" );
-        printf( "               7: 1920x1080 \n" );
-        printf( "               8: 2048x1536 \n" );
-        printf( "               9: 2592x1944 \n" );
-        printf( "               10: 3264x2448 \n" );
-        printf( "               11: 3840x2160 \n" );
-        printf( "               12: 4224x3156 \n" );
+        printf( "  -size:<WxH>  Sets video size, like 1280x720. \n" );
+        printf( "               Default is 640x480. \n" );
         printf( "               Note: video device may switch to a different frame size, \n" );
-        printf( "                     the one it supports. \n" );
+        printf( "                     the one it supports. Sizes supported by the camera \n" );
+        printf( "                     are listed by /camera/info. \n" );
+        printf( "               Note: size index (0-12) of older versions is accepted too. \n" );
+        printf( "  -format:<?>  Pixel format to capture video in: auto, mjpeg, nv12, i420, \n" );
+        printf( "               yuyv, uyvy, grey, y16 (16 bit grayscale), rggb, grbg, \n" );
+        printf( "               gbrg, bggr (raw Bayer). Automatic selection picks the \n" );
+        printf( "               format cheapest to handle out of those supported for the \n" );
+        printf( "               video size. \n" );
+        printf( "               Default is 'auto'. \n" );
         printf( "  -fps:<1-30>  Sets camera frame rate. Same is used for MJPEG stream. \n" );
         printf( "               Default is 30. \n" );
+        printf( "  -latency:<?> Capture latency mode: normal, low. In low latency mode only \n" );
+        printf( "               the newest frame is taken from camera's queue, while \n" );
+        printf( "               older frames are discarded. \n" );
+        printf( "               Default is 'normal'. \n" );
+        printf( "  -enc:<num>   Number of JPEG encoding threads shared by cameras. \n" );
+        printf( "               Default is 0 - one per CPU core. \n" );
+        printf( "  -strips:<n>  Number of threads to encode each frame of 1 megapixel or \n" );
+        printf( "               bigger with, splitting it into horizontal strips. \n" );
+        printf( "               Default is 1. \n" );
+        printf( "  -profile:<?> JPEG encoder profile used for MJPEG streams, history and \n" );
+        printf( "               recordings: live-fast, snapshot-small, archive-quality. \n" );
+        printf( "               Default is 'live-fast'. \n" );
+        printf( "  -jpegprofile:<?> Profile to encode images of /camera/jpeg requests with. \n" );
+        printf( "               Default is the one of -profile option. \n" );
+        printf( "  -encbench:<n> Encode the first frame of each camera <n> times with every \n" );
+        printf( "               profile on start-up and print time/size of images. \n" );
+        printf( "               Default is 0 - no benchmark. \n" );
+        printf( "  -idlefps:<n> Frame rate of MJPEG streams while no motion is detected. \n" );
+        printf( "               Full rate resumes as soon as something moves. \n" );
+        printf( "               Default is 0 - always stream at full rate. \n" );
+        printf( "  -keep:<ms>   Send only new frames to MJPEG clients, repeating the last one \n" );
+        printf( "               after the specified interval to keep connection alive. \n" );
+        printf( "               Default is 0 - send frames at full rate, even if unchanged. \n" );
+        printf( "  -idle:<sec>  Stop camera when its video was not requested for the specified \n" );
+        printf( "               number of seconds. It is started again on next request. \n" );
+        printf( "               Default is 0 - camera is always running. \n" );
+        printf( "  -history:<MB> Size of memory buffer keeping recent JPEG images of each camera \n" );
+        printf( "               for playback (jpeg?at=<time> and mjpeg?from=<time>&speed=<n>). \n" );
+        printf( "               Default is 0 - no history is kept. \n" );
+        printf( "  -lowq:<1-100> JPEG quality of low bandwidth images (jpeg?quality=low and \n" );
+        printf( "               mjpeg?quality=low), which are made of JPEG images by coarser \n" );
+        printf( "               quantization, without decoding them into pixels. \n" );
+        printf( "               Default is 0 - no low bandwidth images. \n" );
+        printf( "  -rec:<dir>   Directory to record MJPEG segment files of cameras into. \n" );
+        printf( "               Cameras are never stopped while recording (-idle is ignored). \n" );
+        printf( "  -recseg:<sec> Duration of recording segments. Default is 600. \n" );
+        printf( "  -recsize:<MB> Delete oldest segments of each camera while their total size \n" );
+        printf( "               is over the limit. Default is 0 - no limit. \n" );
+        printf( "  -recage:<hours> Delete segments older than the specified number of hours. \n" );
+        printf( "               Default is 0 - no limit. \n" );
+        printf( "  -timelapse:<dir> Directory to record daily time-lapses of cameras into. \n" );
+        printf( "               Size/age limits of recordings are applied to time-lapses as well. \n" );
+        printf( "               Cameras are never stopped while recording (-idle is ignored). \n" );
+        printf( "  -tlint:<sec> Interval between time-lapse images. Default is 60. \n" );
         printf( "  -port:<num>  Port number for web server to listen on. \n" );
         printf( "               Default is 8000. \n" );
         printf( "  -realm:<?>   HTTP digest authentication domain. \n" );
@@ -331,10 +742,19 @@ bool ParseCommandLine( int argc, char* argv[] )
         printf( "               or 'admin' otherwise. \n" );
         printf( "  -fcfg:<?>    Name of the file to store camera settings in. \n" );
         printf( "               Default is '~/.cam_config'. \n" );
+        printf( "               Note: motion detection settings go to '.motion' file next to it. \n" );
+        printf( "               Note: with several cameras '-<num>' is appended to it. \n" );
         printf( "  -web:<?>     Name of the folder to serve custom web content. \n" );
         printf( "               By default embedded web files are used. \n" );
         printf( "  -title:<?>   Name of the camera to be shown in WebUI. \n" );
         printf( "               Use double quotes if the name contains spaces. \n" );
+        printf( "               Note: with several cameras ' <num>' is appended to it. \n" );
+        printf( "  -overlay:<?> Text to put on camera images: none, time, title, both. \n" );
+        printf( "               Default is 'none'. \n" );
+        printf( "  -mask:<x,y,w,h> Privacy mask - rectangle to hide with black color. The \n" );
+        printf( "               option can be repeated to add several masks. \n" );
+        printf( "               Note: MJPEG video is decorated without re-encoding all of \n" );
+        printf( "                     it - only blocks under the text/masks are redrawn. \n" );
         printf( "\n" );
 
         ret = false;
@@ -365,11 +785,6 @@ int main( int argc, char* argv[] )
     sigaction( SIGABRT, &sigIntAction, NULL );
     sigaction( SIGTERM, &sigIntAction, NULL );
 
-    // create camera object
-    shared_ptr<XV4LCamera>           xcamera       = XV4LCamera::Create( );
-    shared_ptr<IObjectConfigurator>  xcameraConfig = make_shared<XV4LCameraConfig>( xcamera );
-    XObjectConfigurationSerializer   serializer( Settings.CameraConfigFileName, xcameraConfig );
-
     // some read-only information about the version
     PropertyMap versionInfo;
 
@@ -377,23 +792,11 @@ int main( int argc, char* argv[] )
     versionInfo.insert( PropertyMap::value_type( "version", STR_INFO_VERSION ) );
     versionInfo.insert( PropertyMap::value_type( "platform", STR_INFO_PLATFORM ) );
 
-    // prepare some read-only informational properties of the camera
-    PropertyMap cameraInfo;
-    char        strVideoSize[32];
-
-    sprintf( strVideoSize,      "%u", Settings.FrameWidth );
-    sprintf( strVideoSize + 16, "%u", Settings.FrameHeight );
-
-    cameraInfo.insert( PropertyMap::value_type( "device", DEVICE_NAME ) );
-    cameraInfo.insert( PropertyMap::value_type( "title",  Settings.CameraTitle ) );
-    cameraInfo.insert( PropertyMap::value_type( "width",  strVideoSize ) );
-    cameraInfo.insert( PropertyMap::value_type( "height", strVideoSize + 16 ) );
-
-    // create and configure web server
+    // create and configure web server, which is shared by all cameras
     XWebServer          server( "", Settings.WebPort );
-    XVideoSourceToWeb   video2web;
     UserGroup           viewersGroup = Settings.ViewersGroup;
     UserGroup           configGroup  = Settings.ConfigGroup;
+    bool                multiCamera  = ( Settings.DeviceNumbers.size( ) > 1 );
 
     if ( !Settings.HtRealm.empty( ) )
     {
@@ -404,21 +807,206 @@ int main( int argc, char* argv[] )
         server.LoadUsersFromFile( Settings.HtDigestFileName );
     }
 
-    // set camera configuration
-    xcamera->SetVideoDevice( Settings.DeviceNumber );
-    xcamera->SetVideoSize( Settings.FrameWidth, Settings.FrameHeight );
-    xcamera->SetFrameRate( Settings.FrameRate );
+    // pool of JPEG encoders shared by all cameras
+    shared_ptr<XJpegEncoderPool> encoderPool = make_shared<XJpegEncoderPool>( Settings.EncoderThreads, Settings.StripThreads );
+
+    // provide statistics of the video pipelines, encoders and web server
+    shared_ptr<XStatisticsRequestHandler> statsHandler = make_shared<XStatisticsRequestHandler>( "/stats" );
+    statsHandler->AddProvider( &server ).
+                  AddProvider( encoderPool.get( ) );
+
+    // create camera objects
+    vector<unique_ptr<CameraContext>> cameras;
+    PropertyMap                       camerasList;
+
+    for ( uint32_t deviceNumber : Settings.DeviceNumbers )
+    {
+        string         deviceId       = to_string( deviceNumber );
+        string         title          = ( multiCamera ) ? Settings.CameraTitle + " " + deviceId : Settings.CameraTitle;
+        string         configFileName = ( multiCamera ) ? Settings.CameraConfigFileName + "-" + deviceId : Settings.CameraConfigFileName;
+        CameraContext* context        = new CameraContext( deviceNumber, title, configFileName );
+
+        cameras.push_back( unique_ptr<CameraContext>( context ) );
+        camerasList.insert( PropertyMap::value_type( deviceId, title ) );
+
+        // set camera configuration
+        context->Camera->SetVideoDevice( deviceNumber );
+        context->Camera->SetVideoSize( Settings.FrameWidth, Settings.FrameHeight );
+        context->Camera->SetFrameRate( Settings.FrameRate );
+        context->Camera->SetCaptureFormat( Settings.CaptureFormat );
+        context->Camera->EnableLowLatency( Settings.LowLatency );
+        context->Camera->SetStatistics( context->Video2Web.Statistics( ) );
+        context->Video2Web.SetEncoderPool( encoderPool );
+        context->Video2Web.SetEncoderProfile( Settings.EncoderProfile );
+        context->Video2Web.SetMotionDetector( context->MotionDetector, Settings.IdleFrameRate );
+        context->Video2Web.SetDuplicateKeepAlive( Settings.DuplicateKeepAlive );
+
+        // run camera only while its video is requested, if configured so (and it is not recorded)
+        if ( ( Settings.IdleTimeout != 0 ) && ( Settings.RecordingDirectory.empty( ) ) && ( Settings.TimeLapseDirectory.empty( ) ) )
+        {
+            context->DemandController = make_shared<XVideoSourceDemandController>( context->Camera, Settings.IdleTimeout * 1000 );
+            context->Video2Web.SetDemandController( context->DemandController );
+        }
+
+        // keep recent images for playback, if configured so
+        if ( Settings.HistorySize != 0 )
+        {
+            context->HistoryBuffer = make_shared<XEncodedFrameBuffer>( Settings.HistorySize * 1024 * 1024 );
+            context->Video2Web.SetHistoryBuffer( context->HistoryBuffer );
+        }
+
+        // provide low bandwidth images, if configured so
+        context->Video2Web.SetLowQualityTier( static_cast<uint16_t>( Settings.LowQuality ) );
+
+        // record encoded images, if configured so
+        if ( !Settings.RecordingDirectory.empty( ) )
+        {
+            context->Recorder = make_shared<XVideoRecorder>( Settings.RecordingDirectory, "camera" + deviceId );
+            context->Recorder->SetSegmentDuration( Settings.SegmentDuration );
+            context->Recorder->SetRetention( Settings.RecordingMaxSize, Settings.RecordingMaxAge );
+
+            if ( !context->Recorder->Start( ) )
+            {
+                printf( "Failed starting recording into %s \n", Settings.RecordingDirectory.c_str( ) );
+                context->Recorder.reset( );
+            }
+            else
+            {
+                context->Video2Web.AddEncodedFrameListener( context->Recorder );
+            }
+        }
+
+        // record daily time-lapse, if configured so - images are only encoded for it once per interval
+        if ( !Settings.TimeLapseDirectory.empty( ) )
+        {
+            context->TimeLapseRecorder = make_shared<XVideoRecorder>( Settings.TimeLapseDirectory, "timelapse" + deviceId );
+            context->TimeLapseRecorder->SetSegmentDuration( 86400 );
+            context->TimeLapseRecorder->SetFrameInterval( Settings.TimeLapseInterval * 1000 );
+            context->TimeLapseRecorder->SetRetention( Settings.RecordingMaxSize, Settings.RecordingMaxAge );
+
+            if ( !context->TimeLapseRecorder->Start( ) )
+            {
+                printf( "Failed starting time-lapse recording into %s \n", Settings.TimeLapseDirectory.c_str( ) );
+                context->TimeLapseRecorder.reset( );
+            }
+            else
+            {
+                context->Video2Web.AddEncodedFrameListener( context->TimeLapseRecorder );
+            }
+        }
+
+        // put text overlay and privacy masks on images, if configured so - it is done right before encoding,
+        // so MJPEG video gets them too (motion detector sees the images as they come from camera)
+        if ( ( Settings.TimestampOverlay ) || ( Settings.TitleOverlay ) || ( !Settings.PrivacyMasks.empty( ) ) )
+        {
+            context->Decorator = make_shared<XVideoFrameDecorator>( );
+            context->Decorator->SetCameraTitle( title );
+            context->Decorator->SetTimestampOverlay( Settings.TimestampOverlay );
+            context->Decorator->SetCameraTitleOverlay( Settings.TitleOverlay );
+
+            for ( const XJpegOverlayArea& mask : Settings.PrivacyMasks )
+            {
+                context->Decorator->AddPrivacyMask( mask.X, mask.Y, mask.Width, mask.Height );
+            }
+
+            context->Video2Web.SetFrameDecorator( context->Decorator );
+        }
 
-    // restore camera settings
-    serializer.LoadConfiguration( );
+        // restore camera and motion detection settings
+        context->Serializer.LoadConfiguration( );
+        context->MotionSerializer.LoadConfiguration( );
+
+        // statistics of cameras are told apart by label, when there are several of them
+        XStatisticsLabels labels;
+
+        if ( multiCamera )
+        {
+            labels.insert( XStatisticsLabels::value_type( "camera", deviceId ) );
+        }
+
+        statsHandler->AddProvider( &context->Video2Web, labels ).
+                      AddProvider( context->Camera.get( ), labels );
+        if ( context->DemandController )
+        {
+            statsHandler->AddProvider( context->DemandController.get( ), labels );
+        }
+        if ( context->HistoryBuffer )
+        {
+            statsHandler->AddProvider( context->HistoryBuffer.get( ), labels );
+        }
+        if ( context->Recorder )
+        {
+            statsHandler->AddProvider( context->Recorder.get( ), labels );
+        }
+        if ( context->TimeLapseRecorder )
+        {
+            XStatisticsLabels timeLapseLabels = labels;
+
+            timeLapseLabels.insert( XStatisticsLabels::value_type( "recorder", "timelapse" ) );
+            statsHandler->AddProvider( context->TimeLapseRecorder.get( ), timeLapseLabels );
+        }
+
+        // prepare some read-only informational properties of the camera (video size and
+        // formats are provided by camera itself, once it negotiates them with the device)
+        PropertyMap cameraInfo;
+
+        cameraInfo.insert( PropertyMap::value_type( "device", DEVICE_NAME ) );
+        cameraInfo.insert( PropertyMap::value_type( "title",  title ) );
+
+        // every camera is provided as /camera/<num>/..., while the first one is also available
+        // as /camera/... for compatibility with single camera set-ups
+        vector<string> baseUris = { "/camera/" + deviceId };
+
+        if ( cameras.size( ) == 1 )
+        {
+            baseUris.push_back( "/camera" );
+        }
+
+        for ( const string& baseUri : baseUris )
+        {
+            server.AddHandler( make_shared<XObjectConfigurationRequestHandler>( baseUri + "/config", context->CameraConfig ), configGroup ).
+                   AddHandler( make_shared<XObjectInformationRequestHandler>( baseUri + "/properties", make_shared<XV4LCameraPropsInfo>( context->Camera ) ), configGroup ).
+                   AddHandler( make_shared<XObjectInformationRequestHandler>( baseUri + "/info", make_shared<XV4LCameraInfo>( context->Camera, cameraInfo ) ), viewersGroup ).
+                   AddHandler( ( Settings.JpegOwnProfile ) ? context->Video2Web.CreateJpegHandler( baseUri + "/jpeg", Settings.JpegProfile ) :
+                                                             context->Video2Web.CreateJpegHandler( baseUri + "/jpeg" ), viewersGroup ).
+                   AddHandler( context->Video2Web.CreateMjpegHandler( baseUri + "/mjpeg", Settings.FrameRate ), viewersGroup ).
+                   AddHandler( make_shared<XObjectInformationRequestHandler>( baseUri + "/motion", make_shared<XMotionDetectorInfo>( context->MotionDetector ) ), viewersGroup ).
+                   AddHandler( make_shared<XObjectConfigurationRequestHandler>( baseUri + "/motion/config", context->MotionConfig ), configGroup );
+
+            if ( context->Recorder )
+            {
+                server.AddHandler( make_shared<XRecordingsRequestHandler>( baseUri + "/recordings", context->Recorder->Directory( ),
+                                                                           context->Recorder->NamePrefix( ), Settings.FrameRate ), viewersGroup );
+            }
+            if ( context->TimeLapseRecorder )
+            {
+                server.AddHandler( make_shared<XRecordingsRequestHandler>( baseUri + "/timelapse", context->TimeLapseRecorder->Directory( ),
+                                                                           context->TimeLapseRecorder->NamePrefix( ), Settings.FrameRate ), viewersGroup );
+            }
+        }
+
+        // motion detector runs on its own thread, so capture does not wait for it; it analyses frames
+        // at most 10 times a second, so there is no need to copy every frame for it
+        context->MotionListener = make_shared<XAsyncVideoSourceListener>( context->MotionDetector.get( ), "motion",
+                                      XListenerQueuePolicy::EveryNthFrame, max( Settings.FrameRate / 10, 1u ) );
+        statsHandler->AddProvider( context->MotionListener.get( ), labels );
+
+        // set camera listeners
+        context->ListenerChain.Add( context->MotionListener.get( ) );
+        context->ListenerChain.Add( context->Video2Web.VideoSourceListener( ) );
+        context->ListenerChain.Add( &context->ErrorListener );
+        if ( Settings.BenchmarkIterations != 0 )
+        {
+            context->ListenerChain.Add( &context->BenchmarkListener );
+        }
+        context->Camera->SetListener( &context->ListenerChain );
+    }
 
     // add web handlers
     server.AddHandler( make_shared<XObjectInformationRequestHandler>( "/version", make_shared<XObjectInformationMap>( versionInfo ) ) ).
-           AddHandler( make_shared<XObjectConfigurationRequestHandler>( "/camera/config", xcameraConfig ), configGroup ).
-           AddHandler( make_shared<XObjectInformationRequestHandler>( "/camera/properties", make_shared<XV4LCameraPropsInfo>( xcamera ) ), configGroup ).
-           AddHandler( make_shared<XObjectInformationRequestHandler>( "/camera/info", make_shared<XObjectInformationMap>( cameraInfo ) ), viewersGroup ).
-           AddHandler( video2web.CreateJpegHandler( "/camera/jpeg" ), viewersGroup ).
-           AddHandler( video2web.CreateMjpegHandler( "/camera/mjpeg", Settings.FrameRate ), viewersGroup );
+           AddHandler( make_shared<XObjectInformationRequestHandler>( "/cameras", make_shared<XObjectInformationMap>( camerasList ) ), viewersGroup ).
+           AddHandler( statsHandler, configGroup ).
+           AddHandler( make_shared<XTraceRequestHandler>( "/debug/trace" ), UserGroup::Admin );
 
     // use custom or embedded web content
     if ( !Settings.CustomWebContent.empty( ) )
@@ -443,33 +1031,71 @@ int main( int argc, char* argv[] )
     #endif
     }
 
-    // set camera listeners
-    XVideoSourceListenerChain   listenerChain;
-    CameraErrorListener         cameraErrorListener;
-
-    listenerChain.Add( video2web.VideoSourceListener( ) );
-    listenerChain.Add( &cameraErrorListener );
-    xcamera->SetListener( &listenerChain );
-
     if ( server.Start( ) )
     {
         printf( "Web server started on port %d ...\n", server.Port( ) );
         printf( "Ctrl+C to stop.\n" );
 
-        xcamera->Start( );
+        CamerasAlive = static_cast<uint32_t>( cameras.size( ) );
+
+        for ( auto& context : cameras )
+        {
+            if ( context->DemandController )
+            {
+                context->DemandController->Start( );
+            }
+            else
+            {
+                context->Camera->Start( );
+            }
+        }
+
+        // cameras started on demand provide no frames until requested, so those are not waited for long
+        if ( Settings.BenchmarkIterations != 0 )
+        {
+            for ( auto& context : cameras )
+            {
+                BenchmarkEncoderProfiles( context->DeviceNumber, context->BenchmarkListener.WaitFrame( ( context->DemandController ) ? 0 : 10000 ) );
+            }
+        }
 
         while ( !ExitEvent.Wait( 60000 ) )
         {
             // save camera settings from time to time
-            serializer.SaveConfiguration( );
+            for ( auto& context : cameras )
+            {
+                context->Serializer.SaveConfiguration( );
+                context->MotionSerializer.SaveConfiguration( );
+            }
         }
 
-        serializer.SaveConfiguration( );
-
-        xcamera->SignalToStop( );
-        xcamera->WaitForStop( );
+        for ( auto& context : cameras )
+        {
+            context->Serializer.SaveConfiguration( );
+            context->MotionSerializer.SaveConfiguration( );
+            context->Camera->SignalToStop( );
+        }
+        // no more requests, which could start cameras on demand again
         server.Stop( );
 
+        for ( auto& context : cameras )
+        {
+            if ( context->DemandController )
+            {
+                context->DemandController->Stop( );
+            }
+            context->Camera->WaitForStop( );
+
+            if ( context->Recorder )
+            {
+                context->Recorder->Stop( );
+            }
+            if ( context->TimeLapseRecorder )
+            {
+                context->TimeLapseRecorder->Stop( );
+            }
+        }
+
         printf( "Done \n" );
     }
     else
@@ -32,6 +32,8 @@
 #include "XVideoSourceToWeb.hpp"
 #include "XObjectConfigurationSerializer.hpp"
 #include "XObjectConfigurationRequestHandler.hpp"
+#include "XStatisticsRequestHandler.hpp"
+#include "XTraceRequestHandler.hpp"
 #include "XManualResetEvent.hpp"
 
 // Release build embeds web resources into executable
@@ -406,13 +408,20 @@ int main( int argc, char* argv[] )
     // restore camera settings
     serializer.LoadConfiguration( );
 
+    // provide statistics of the video pipeline and web server
+    shared_ptr<XStatisticsRequestHandler> statsHandler = make_shared<XStatisticsRequestHandler>( "/stats" );
+    statsHandler->AddProvider( &server ).
+                  AddProvider( &video2web );
+
     // add web handlers
     server.AddHandler( make_shared<XObjectInformationRequestHandler>( "/version", make_shared<XObjectInformationMap>( versionInfo ) ) ).
            AddHandler( make_shared<XObjectConfigurationRequestHandler>( "/camera/config", xcameraConfig ), configGroup ).
            AddHandler( make_shared<XObjectInformationRequestHandler>( "/camera/properties", make_shared<XRaspiCameraPropsInfo>( xcamera ) ), configGroup ).
            AddHandler( make_shared<XObjectInformationRequestHandler>( "/camera/info", make_shared<XObjectInformationMap>( cameraInfo ) ), viewersGroup ).
            AddHandler( video2web.CreateJpegHandler( "/camera/jpeg" ), viewersGroup ).
-           AddHandler( video2web.CreateMjpegHandler( "/camera/mjpeg", Settings.FrameRate ), viewersGroup );
+           AddHandler( video2web.CreateMjpegHandler( "/camera/mjpeg", Settings.FrameRate ), viewersGroup ).
+           AddHandler( statsHandler, configGroup ).
+           AddHandler( make_shared<XTraceRequestHandler>( "/debug/trace" ), UserGroup::Admin );
 
     // use custom or embedded web content
     if ( !Settings.CustomWebContent.empty( ) )
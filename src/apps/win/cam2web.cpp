@@ -41,6 +41,8 @@
 #include <XVideoFrameDecorator.hpp>
 #include <XObjectConfigurationSerializer.hpp>
 #include <XObjectConfigurationRequestHandler.hpp>
+#include <XStatisticsRequestHandler.hpp>
+#include <XTraceRequestHandler.hpp>
 
 #include "resource.h"
 #include "Tools.hpp"
@@ -831,6 +833,11 @@ static bool StartVideoStreaming( )
                                                Authentication::Basic : Authentication::Digest );
         gData->server.LoadUsersFromFile( gData->appConfig->UsersFileName( ) );
 
+        // provide statistics of the video pipeline and web server
+        shared_ptr<XStatisticsRequestHandler> statsHandler = make_shared<XStatisticsRequestHandler>( "/stats" );
+        statsHandler->AddProvider( &gData->server ).
+                      AddProvider( &gData->video2web );
+
         // configure web server and handler
         gData->server.SetPort( gData->appConfig->HttpPort( ) ).
                       AddHandler( make_shared<XObjectInformationRequestHandler>( "/version", make_shared<XObjectInformationMap>( versionInfo ) ) ).
@@ -838,7 +845,8 @@ static bool StartVideoStreaming( )
                       AddHandler( make_shared<XObjectInformationRequestHandler>( "/camera/properties", make_shared<XLocalVideoDevicePropsInfo>( gData->camera ) ), configGroup ).
                       AddHandler( make_shared<XObjectInformationRequestHandler>( "/camera/info", make_shared<XObjectInformationMap>( cameraInfo ) ), viewersGroup ).
                       AddHandler( gData->video2web.CreateJpegHandler( "/camera/jpeg" ), viewersGroup ).
-                      AddHandler( gData->video2web.CreateMjpegHandler( "/camera/mjpeg", gData->appConfig->MjpegFrameRate( ) ), viewersGroup );
+                      AddHandler( gData->video2web.CreateMjpegHandler( "/camera/mjpeg", gData->appConfig->MjpegFrameRate( ) ), viewersGroup ).
+                      AddHandler( statsHandler, configGroup );
 
         // check if custom web content is available
         if ( !gData->appConfig->CustomWebContent( ).empty( ) )
@@ -1462,7 +1470,8 @@ void AppData::StartAdminServer( )
         // configure web server and handler
         adminServer.SetPort( adminPort ).
                     AddHandler( make_shared<XObjectInformationRequestHandler>( "/version", make_shared<XObjectInformationMap>( versionInfo ) ), UserGroup::Admin ).
-                    AddHandler( make_shared<XObjectConfigurationRequestHandler>( "/status", streamingStatus ), UserGroup::Admin );
+                    AddHandler( make_shared<XObjectConfigurationRequestHandler>( "/status", streamingStatus ), UserGroup::Admin ).
+                    AddHandler( make_shared<XTraceRequestHandler>( "/debug/trace" ), UserGroup::Admin );
 
 #ifdef _DEBUG
         // load web content from files in debug builds
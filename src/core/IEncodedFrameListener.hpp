@@ -0,0 +1,42 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef IENCODED_FRAME_LISTENER_HPP
+#define IENCODED_FRAME_LISTENER_HPP
+
+#include <stdint.h>
+
+// Interface for listeners of encoded (JPEG) video frames
+class IEncodedFrameListener
+{
+public:
+    virtual ~IEncodedFrameListener( ) { }
+
+    // New encoded frame notification - capture time is in milliseconds since Unix epoch. The data
+    // are valid only during the call, so listener must copy whatever it needs to keep.
+    virtual void OnEncodedFrame( const uint8_t* data, uint32_t size, int64_t timestamp ) = 0;
+
+    // Check if the listener needs a frame captured at the specified time. Video frames are not encoded
+    // for listeners, which don't need them (the ones sampling frames now and then, for example), but
+    // listeners still get all frames encoded for other reasons.
+    virtual bool IsFrameNeeded( int64_t /* timestamp */ ) const { return true; }
+};
+
+#endif // IENCODED_FRAME_LISTENER_HPP
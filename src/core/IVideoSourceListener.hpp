@@ -22,6 +22,7 @@
 #define IVIDEO_SOURCE_LISTENER_HPP
 
 #include "XImage.hpp"
+#include "XTracer.hpp"
 #include <string>
 #include <list>
 
@@ -45,6 +46,8 @@ public:
     // New video frame notification
     virtual void OnNewImage( const std::shared_ptr<const XImage>& image )
     {
+        XTraceScope trace( "Listeners" );
+
         for ( auto listener : chain )
         {
             listener->OnNewImage( image );
@@ -0,0 +1,320 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+
+#include "XAsyncVideoSourceListener.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    // Event queued for the listener - either new frame or error
+    struct ListenerEvent
+    {
+        shared_ptr<XImage>       Image;
+        uint64_t                 FrameId;
+        steady_clock::time_point QueuedTime;
+        string                   ErrorMessage;
+        bool                     Fatal;
+    };
+
+    class XAsyncVideoSourceListenerData
+    {
+    public:
+        IVideoSourceListener*       Listener;
+        XStatisticsLabels           Labels;
+        XListenerQueuePolicy        Policy;
+        uint32_t                    QueueLength;
+        uint32_t                    FrameStep;
+        uint64_t                    FramesCount;    // frames seen, used only by video source's thread
+
+        mutex                       Sync;
+        condition_variable          QueueChanged;
+        bool                        NeedToStop;
+        deque<ListenerEvent>        Queue;
+        uint32_t                    ImagesQueued;
+        vector<shared_ptr<XImage>>  FreeImages;
+
+        atomic<uint64_t>            FramesDelivered;
+        atomic<uint64_t>            FramesDropped;
+        atomic<uint64_t>            FramesSkipped;
+        XDurationHistogram          QueueTime;
+        XDurationHistogram          HandlingTime;
+
+        thread                      ListenerThread;
+
+    public:
+        XAsyncVideoSourceListenerData( IVideoSourceListener* listener, const string& name, XListenerQueuePolicy policy, uint32_t policyParameter ) :
+            Listener( listener ), Labels( ), Policy( policy ),
+            QueueLength( ( policy == XListenerQueuePolicy::BoundedQueue ) ? policyParameter : 1 ),
+            FrameStep( ( policy == XListenerQueuePolicy::EveryNthFrame ) ? policyParameter : 1 ),
+            FramesCount( 0 ), Sync( ), QueueChanged( ), NeedToStop( false ), Queue( ), ImagesQueued( 0 ), FreeImages( ),
+            FramesDelivered( 0 ), FramesDropped( 0 ), FramesSkipped( 0 ), QueueTime( ), HandlingTime( ),
+            ListenerThread( )
+        {
+            if ( QueueLength == 0 )
+            {
+                QueueLength = 1;
+            }
+            if ( FrameStep == 0 )
+            {
+                FrameStep = 1;
+            }
+
+            Labels.insert( pair<string, string>( "listener", name ) );
+
+            ListenerThread = thread( ListenerThreadHandler, this );
+        }
+
+        ~XAsyncVideoSourceListenerData( )
+        {
+            {
+                lock_guard<mutex> lock( Sync );
+                NeedToStop = true;
+            }
+            QueueChanged.notify_all( );
+
+            if ( ListenerThread.joinable( ) )
+            {
+                ListenerThread.join( );
+            }
+        }
+
+        void QueueImage( const shared_ptr<const XImage>& image );
+        void QueueError( const string& errorMessage, bool fatal );
+        void RemoveOldestImage( );
+
+        static void ListenerThreadHandler( XAsyncVideoSourceListenerData* me );
+    };
+}
+
+XAsyncVideoSourceListener::XAsyncVideoSourceListener( IVideoSourceListener* listener, const string& name,
+                                                      XListenerQueuePolicy policy, uint32_t policyParameter ) :
+    mData( new Private::XAsyncVideoSourceListenerData( listener, name, policy, policyParameter ) )
+{
+}
+
+XAsyncVideoSourceListener::~XAsyncVideoSourceListener( )
+{
+    delete mData;
+}
+
+// New video frame notification - queue copy of the frame for listener
+void XAsyncVideoSourceListener::OnNewImage( const shared_ptr<const XImage>& image )
+{
+    if ( ( mData->FramesCount++ % mData->FrameStep ) != 0 )
+    {
+        mData->FramesSkipped++;
+    }
+    else
+    {
+        mData->QueueImage( image );
+    }
+}
+
+// Video source error notification - queue error for listener
+void XAsyncVideoSourceListener::OnError( const string& errorMessage, bool fatal )
+{
+    mData->QueueError( errorMessage, fatal );
+}
+
+// Number of frames given to listener/dropped since they did not fit into queue/skipped by policy
+uint64_t XAsyncVideoSourceListener::FramesDelivered( ) const
+{
+    return mData->FramesDelivered;
+}
+uint64_t XAsyncVideoSourceListener::FramesDropped( ) const
+{
+    return mData->FramesDropped;
+}
+uint64_t XAsyncVideoSourceListener::FramesSkipped( ) const
+{
+    return mData->FramesSkipped;
+}
+
+// Put statistics of the adapter into the specified collector
+void XAsyncVideoSourceListener::CollectStatistics( XStatisticsCollector& collector ) const
+{
+    uint32_t queued;
+
+    {
+        lock_guard<mutex> lock( mData->Sync );
+        queued = mData->ImagesQueued;
+    }
+
+    collector.AddCounter( "cam2web_listener_frames_delivered_total", "Frames given to asynchronous listener", mData->FramesDelivered, mData->Labels );
+    collector.AddCounter( "cam2web_listener_frames_dropped_total", "Frames dropped, since asynchronous listener did not keep up", mData->FramesDropped, mData->Labels );
+    collector.AddCounter( "cam2web_listener_frames_skipped_total", "Frames skipped by queue policy of asynchronous listener", mData->FramesSkipped, mData->Labels );
+    collector.AddGauge( "cam2web_listener_queue_length", "Frames waiting for asynchronous listener", queued, mData->Labels );
+    collector.AddHistogram( "cam2web_listener_queue_seconds", "Time frames wait in queue of asynchronous listener", mData->QueueTime, mData->Labels );
+    collector.AddHistogram( "cam2web_listener_handling_seconds", "Time taken by asynchronous listener to handle frames", mData->HandlingTime, mData->Labels );
+}
+
+namespace Private
+{
+
+// Copy the image into a spare buffer and queue it for the listener
+void XAsyncVideoSourceListenerData::QueueImage( const shared_ptr<const XImage>& image )
+{
+    unique_lock<mutex>  lock( Sync );
+    shared_ptr<XImage>  copy;
+    bool                queue = true;
+
+    if ( ImagesQueued >= QueueLength )
+    {
+        if ( Policy == XListenerQueuePolicy::BoundedQueue )
+        {
+            // keep what is queued already and don't spend time on copying the new frame
+            queue = false;
+        }
+        else
+        {
+            RemoveOldestImage( );
+        }
+
+        FramesDropped++;
+    }
+
+    if ( queue )
+    {
+        if ( !FreeImages.empty( ) )
+        {
+            copy = FreeImages.back( );
+            FreeImages.pop_back( );
+        }
+
+        // video source's thread is the only one adding images, so the place in queue
+        // is not taken while copying
+        lock.unlock( );
+
+        if ( !image->CopyDataOrClone( copy ) )
+        {
+            FramesDropped++;
+        }
+        else
+        {
+            ListenerEvent event = { copy, XTracer::CurrentFrame( ), steady_clock::now( ), string( ), false };
+
+            lock.lock( );
+            Queue.push_back( event );
+            ImagesQueued++;
+            lock.unlock( );
+
+            QueueChanged.notify_one( );
+        }
+    }
+}
+
+// Queue error for the listener (errors are never dropped)
+void XAsyncVideoSourceListenerData::QueueError( const string& errorMessage, bool fatal )
+{
+    ListenerEvent event = { nullptr, 0, steady_clock::now( ), errorMessage, fatal };
+
+    {
+        lock_guard<mutex> lock( Sync );
+        Queue.push_back( event );
+    }
+
+    QueueChanged.notify_one( );
+}
+
+// Remove the oldest image from the queue and keep its buffer for reuse (the lock must be held)
+void XAsyncVideoSourceListenerData::RemoveOldestImage( )
+{
+    for ( auto it = Queue.begin( ); it != Queue.end( ); ++it )
+    {
+        if ( it->Image )
+        {
+            FreeImages.push_back( it->Image );
+            Queue.erase( it );
+            ImagesQueued--;
+            break;
+        }
+    }
+}
+
+// Thread giving queued frames/errors to the listener
+void XAsyncVideoSourceListenerData::ListenerThreadHandler( XAsyncVideoSourceListenerData* me )
+{
+    unique_lock<mutex> lock( me->Sync );
+
+    XTracer::SetThreadName( "Listener " + me->Labels["listener"] );
+
+    while ( true )
+    {
+        me->QueueChanged.wait( lock, [me] { return ( me->NeedToStop ) || ( !me->Queue.empty( ) ); } );
+
+        if ( me->NeedToStop )
+        {
+            break;
+        }
+
+        ListenerEvent event = me->Queue.front( );
+
+        me->Queue.pop_front( );
+
+        if ( event.Image )
+        {
+            me->ImagesQueued--;
+        }
+
+        lock.unlock( );
+
+        if ( event.Image )
+        {
+            steady_clock::time_point startTime = steady_clock::now( );
+
+            me->QueueTime.AddSince( event.QueuedTime );
+
+            XTracer::SetCurrentFrame( event.FrameId );
+            {
+                XTraceScope trace( "Async listener", event.FrameId );
+
+                me->Listener->OnNewImage( event.Image );
+            }
+            XTracer::SetCurrentFrame( 0 );
+
+            me->HandlingTime.AddSince( startTime );
+            me->FramesDelivered++;
+        }
+        else
+        {
+            me->Listener->OnError( event.ErrorMessage, event.Fatal );
+        }
+
+        lock.lock( );
+
+        // reuse the buffer for next frames, unless listener decided to keep it
+        if ( ( event.Image ) && ( event.Image.use_count( ) == 1 ) && ( me->FreeImages.size( ) <= me->QueueLength ) )
+        {
+            me->FreeImages.push_back( event.Image );
+        }
+    }
+}
+
+} // namespace Private
@@ -0,0 +1,78 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XASYNC_VIDEO_SOURCE_LISTENER_HPP
+#define XASYNC_VIDEO_SOURCE_LISTENER_HPP
+
+#include <stdint.h>
+#include <string>
+
+#include "XInterfaces.hpp"
+#include "IVideoSourceListener.hpp"
+#include "XStatistics.hpp"
+
+namespace Private
+{
+    class XAsyncVideoSourceListenerData;
+}
+
+// Policy of queuing frames for asynchronous listener, which does not keep up with video source
+enum class XListenerQueuePolicy
+{
+    LatestOnly,     // only the newest frame is kept, replacing the one not yet taken by listener
+    BoundedQueue,   // up to N frames are queued, new frames are dropped while the queue is full
+    EveryNthFrame   // only every N-th frame is given to listener (keeping the newest one of those)
+};
+
+/* ================================================================= */
+/* Adapter running video source listener on its own thread, so      */
+/* video source never waits for it. Frames are copied into buffers   */
+/* owned by the adapter (recycled between frames) and queued for the */
+/* listener according to the policy. Errors are queued as well and  */
+/* never dropped. Since listener gets a copy, it must not be used to */
+/* modify frames for listeners following it in a chain.              */
+/* ================================================================= */
+class XAsyncVideoSourceListener : public IVideoSourceListener, public IStatisticsProvider, private Uncopyable
+{
+public:
+    // Create adapter for the specified listener. The parameter is queue length for BoundedQueue policy and
+    // frame step for EveryNthFrame policy. Name is used as label of statistics.
+    XAsyncVideoSourceListener( IVideoSourceListener* listener, const std::string& name,
+                               XListenerQueuePolicy policy = XListenerQueuePolicy::LatestOnly, uint32_t policyParameter = 1 );
+    ~XAsyncVideoSourceListener( );
+
+    // New video frame notification - queue copy of the frame for listener
+    void OnNewImage( const std::shared_ptr<const XImage>& image ) override;
+    // Video source error notification - queue error for listener
+    void OnError( const std::string& errorMessage, bool fatal ) override;
+
+    // Number of frames given to listener/dropped since they did not fit into queue/skipped by policy
+    uint64_t FramesDelivered( ) const;
+    uint64_t FramesDropped( ) const;
+    uint64_t FramesSkipped( ) const;
+
+    // Put statistics of the adapter into the specified collector
+    void CollectStatistics( XStatisticsCollector& collector ) const;
+
+private:
+    Private::XAsyncVideoSourceListenerData* mData;
+};
+
+#endif // XASYNC_VIDEO_SOURCE_LISTENER_HPP
@@ -0,0 +1,149 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <algorithm>
+
+#include "XAutoGainMapper.hpp"
+#include "XImageConversion.hpp"
+
+using namespace std;
+
+// Histogram bins have width of 16 values
+#define HISTOGRAM_SHIFT     (4)
+#define HISTOGRAM_SIZE      (65536 >> HISTOGRAM_SHIFT)
+// Every image adds one row out of this many
+#define ROWS_STEP           (4)
+
+XAutoGainMapper::XAutoGainMapper( float lowPercentile, float highPercentile ) :
+    mLowPercentile( lowPercentile ), mHighPercentile( highPercentile ),
+    mHistogram( HISTOGRAM_SIZE, 0 ), mImageCounter( 0 ), mLow( 0 ), mHigh( 0xFFFF )
+{
+}
+
+// Forget collected histogram
+void XAutoGainMapper::Reset( )
+{
+    fill( mHistogram.begin( ), mHistogram.end( ), 0 );
+    mImageCounter = 0;
+    mLow          = 0;
+    mHigh         = 0xFFFF;
+}
+
+// Map the Grayscale16 source image into Grayscale8 destination image of the same size
+XError XAutoGainMapper::Map( const shared_ptr<const XImage>& src, const shared_ptr<XImage>& dst )
+{
+    XError ret = XError::Success;
+
+    if ( ( !src ) || ( !dst ) || ( src->Data( ) == nullptr ) || ( dst->Data( ) == nullptr ) )
+    {
+        ret = XError::NullPointer;
+    }
+    else if ( ( src->Format( ) != XPixelFormat::Grayscale16 ) || ( dst->Format( ) != XPixelFormat::Grayscale8 ) )
+    {
+        ret = XError::UnsupportedPixelFormat;
+    }
+    else if ( ( src->Width( ) != dst->Width( ) ) || ( src->Height( ) != dst->Height( ) ) )
+    {
+        ret = XError::ImageParametersMismatch;
+    }
+    else
+    {
+        UpdateHistogram( src );
+        UpdateRange( );
+
+        for ( int32_t y = 0; y < src->Height( ); y++ )
+        {
+            XImageConversion::MapGray16Row( reinterpret_cast<const uint16_t*>( src->Data( ) + y * src->Stride( ) ), src->Width( ),
+                                            mLow, mHigh, dst->Data( ) + y * dst->Stride( ) );
+        }
+    }
+
+    return ret;
+}
+
+// Decay histogram and add a subset of image's rows to it (the very first image is added completely)
+void XAutoGainMapper::UpdateHistogram( const shared_ptr<const XImage>& image )
+{
+    int32_t firstRow = 0;
+    int32_t rowsStep = 1;
+
+    if ( mImageCounter != 0 )
+    {
+        firstRow = static_cast<int32_t>( mImageCounter % ROWS_STEP );
+        rowsStep = ROWS_STEP;
+
+        for ( auto& count : mHistogram )
+        {
+            count = ( count * 7 ) >> 3;
+        }
+    }
+
+    for ( int32_t y = firstRow; y < image->Height( ); y += rowsStep )
+    {
+        const uint16_t* row = reinterpret_cast<const uint16_t*>( image->Data( ) + y * image->Stride( ) );
+
+        for ( int32_t x = 0; x < image->Width( ); x++ )
+        {
+            mHistogram[row[x] >> HISTOGRAM_SHIFT]++;
+        }
+    }
+
+    mImageCounter++;
+}
+
+// Find range of values between the low and high percentiles
+void XAutoGainMapper::UpdateRange( )
+{
+    uint64_t total = 0;
+
+    for ( auto count : mHistogram )
+    {
+        total += count;
+    }
+
+    if ( total != 0 )
+    {
+        uint64_t lowCount  = static_cast<uint64_t>( total * mLowPercentile / 100 );
+        uint64_t highCount = static_cast<uint64_t>( total * mHighPercentile / 100 );
+        uint64_t sum       = 0;
+        int      lowBin    = -1;
+        int      highBin   = HISTOGRAM_SIZE - 1;
+
+        for ( int i = 0; i < HISTOGRAM_SIZE; i++ )
+        {
+            sum += mHistogram[i];
+
+            if ( ( lowBin == -1 ) && ( sum > lowCount ) )
+            {
+                lowBin = i;
+            }
+            if ( sum >= highCount )
+            {
+                highBin = i;
+                break;
+            }
+        }
+
+        lowBin = max( lowBin, 0 );
+
+        mLow  = static_cast<uint16_t>( lowBin << HISTOGRAM_SHIFT );
+        mHigh = static_cast<uint16_t>( ( ( max( highBin, lowBin ) + 1 ) << HISTOGRAM_SHIFT ) - 1 );
+    }
+}
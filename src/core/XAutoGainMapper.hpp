@@ -0,0 +1,68 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XAUTO_GAIN_MAPPER_HPP
+#define XAUTO_GAIN_MAPPER_HPP
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "XInterfaces.hpp"
+#include "XImage.hpp"
+#include "XError.hpp"
+
+/* ================================================================= */
+/* Maps 16 bit grayscale images into 8 bit ones with automatic gain, */
+/* stretching the range of intensities actually present in images.   */
+/* The range is found from a histogram, which is updated             */
+/* incrementally - every image adds a quarter of its rows, while     */
+/* older counts decay, so the gain follows the scene smoothly.       */
+/* ================================================================= */
+class XAutoGainMapper : private Uncopyable
+{
+public:
+    // Percentiles of pixels to clip at the dark and at the bright ends of the range
+    XAutoGainMapper( float lowPercentile = 0.5f, float highPercentile = 99.5f );
+
+    // Map the Grayscale16 source image into Grayscale8 destination image of the same size
+    XError Map( const std::shared_ptr<const XImage>& src, const std::shared_ptr<XImage>& dst );
+
+    // Forget collected histogram, so the range is found from scratch on next image
+    void Reset( );
+
+    // Range of 16 bit values currently mapped to [0, 255]
+    uint16_t Low( )  const { return mLow;  }
+    uint16_t High( ) const { return mHigh; }
+
+private:
+    void UpdateHistogram( const std::shared_ptr<const XImage>& image );
+    void UpdateRange( );
+
+private:
+    float                   mLowPercentile;
+    float                   mHighPercentile;
+    std::vector<uint32_t>   mHistogram;
+    uint32_t                mImageCounter;
+    uint16_t                mLow;
+    uint16_t                mHigh;
+};
+
+#endif // XAUTO_GAIN_MAPPER_HPP
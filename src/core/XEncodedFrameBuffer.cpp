@@ -0,0 +1,188 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <mutex>
+#include <deque>
+#include <algorithm>
+
+#include "XEncodedFrameBuffer.hpp"
+
+using namespace std;
+
+namespace Private
+{
+    class XEncodedFrameBufferData
+    {
+    public:
+        uint32_t                            MaxSize;
+        mutable mutex                       Sync;
+        deque<shared_ptr<XEncodedFrame>>    Frames;
+        uint64_t                            TotalSize;
+        uint64_t                            LastSequence;
+        int64_t                             LastTimestamp;
+        shared_ptr<XEncodedFrame>           SpareFrame;     // removed frame, which memory can be reused
+
+    public:
+        XEncodedFrameBufferData( uint32_t maxSize ) :
+            MaxSize( maxSize ), Sync( ), Frames( ), TotalSize( 0 ), LastSequence( 0 ), LastTimestamp( 0 ), SpareFrame( )
+        {
+        }
+
+        shared_ptr<XEncodedFrame> FindFrame( int64_t timestamp ) const;
+    };
+}
+
+XEncodedFrameBuffer::XEncodedFrameBuffer( uint32_t maxSize ) :
+    mData( new Private::XEncodedFrameBufferData( maxSize ) )
+{
+}
+
+XEncodedFrameBuffer::~XEncodedFrameBuffer( )
+{
+    delete mData;
+}
+
+// Maximum size of frames kept in the buffer
+uint32_t XEncodedFrameBuffer::MaxSize( ) const
+{
+    return mData->MaxSize;
+}
+
+// Add new frame to the buffer
+void XEncodedFrameBuffer::Add( const uint8_t* data, uint32_t size, int64_t timestamp )
+{
+    if ( size <= mData->MaxSize )
+    {
+        unique_lock<mutex>        lock( mData->Sync );
+        shared_ptr<XEncodedFrame> frame;
+
+        swap( frame, mData->SpareFrame );
+        lock.unlock( );
+
+        // copy frame's data without holding the lock (nobody else uses spare frame)
+        if ( !frame )
+        {
+            frame = make_shared<XEncodedFrame>( );
+        }
+        frame->Data.assign( data, data + size );
+
+        lock.lock( );
+
+        // remove oldest frames to make space for the new one
+        while ( ( !mData->Frames.empty( ) ) && ( mData->TotalSize + size > mData->MaxSize ) )
+        {
+            const shared_ptr<XEncodedFrame>& oldest = mData->Frames.front( );
+
+            mData->TotalSize -= oldest->Data.size( );
+
+            // reuse memory of the frame, unless somebody is still sending it
+            if ( oldest.use_count( ) == 1 )
+            {
+                mData->SpareFrame = oldest;
+            }
+
+            mData->Frames.pop_front( );
+        }
+
+        // system clock may go back, but frames must stay sorted by time
+        mData->LastTimestamp = max( timestamp, mData->LastTimestamp );
+
+        frame->Timestamp = mData->LastTimestamp;
+        frame->Sequence  = ++mData->LastSequence;
+
+        mData->Frames.push_back( frame );
+        mData->TotalSize += size;
+    }
+}
+
+// Get the latest frame taken at or before the specified time
+shared_ptr<const XEncodedFrame> XEncodedFrameBuffer::FindFrame( int64_t timestamp ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+
+    return mData->FindFrame( timestamp );
+}
+
+// Get the latest frame taken at or before the specified time, but after the frame with the specified sequence number
+shared_ptr<const XEncodedFrame> XEncodedFrameBuffer::NextFrame( uint64_t sequence, int64_t timestamp ) const
+{
+    lock_guard<mutex>         lock( mData->Sync );
+    shared_ptr<XEncodedFrame> frame = mData->FindFrame( timestamp );
+
+    if ( ( frame ) && ( frame->Sequence <= sequence ) )
+    {
+        frame.reset( );
+    }
+
+    return frame;
+}
+
+// Get the oldest frame in the buffer
+shared_ptr<const XEncodedFrame> XEncodedFrameBuffer::OldestFrame( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+
+    return ( mData->Frames.empty( ) ) ? shared_ptr<const XEncodedFrame>( ) : mData->Frames.front( );
+}
+
+// Put statistics of the buffer into the specified collector
+void XEncodedFrameBuffer::CollectStatistics( XStatisticsCollector& collector ) const
+{
+    size_t   framesCount;
+    uint64_t totalSize;
+    int64_t  timeSpan = 0;
+
+    {
+        lock_guard<mutex> lock( mData->Sync );
+
+        framesCount = mData->Frames.size( );
+        totalSize   = mData->TotalSize;
+
+        if ( framesCount != 0 )
+        {
+            timeSpan = mData->Frames.back( )->Timestamp - mData->Frames.front( )->Timestamp;
+        }
+    }
+
+    collector.AddGauge( "cam2web_history_frames", "Encoded frames kept in history buffer", static_cast<double>( framesCount ) );
+    collector.AddGauge( "cam2web_history_bytes", "Size of encoded frames kept in history buffer", static_cast<double>( totalSize ) );
+    collector.AddGauge( "cam2web_history_seconds", "Time span of frames kept in history buffer", static_cast<double>( timeSpan ) / 1000 );
+}
+
+namespace Private
+{
+
+// Find the latest frame taken at or before the specified time (the lock must be held)
+shared_ptr<XEncodedFrame> XEncodedFrameBufferData::FindFrame( int64_t timestamp ) const
+{
+    shared_ptr<XEncodedFrame> frame;
+
+    auto it = upper_bound( Frames.begin( ), Frames.end( ), timestamp,
+                           [] ( int64_t time, const shared_ptr<XEncodedFrame>& f ) { return time < f->Timestamp; } );
+
+    if ( it != Frames.begin( ) )
+    {
+        frame = *( --it );
+    }
+
+    return frame;
+}
+
+} // namespace Private
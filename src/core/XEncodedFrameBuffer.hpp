@@ -0,0 +1,80 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XENCODED_FRAME_BUFFER_HPP
+#define XENCODED_FRAME_BUFFER_HPP
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "XInterfaces.hpp"
+#include "XStatistics.hpp"
+
+namespace Private
+{
+    class XEncodedFrameBufferData;
+}
+
+// Encoded (JPEG) frame kept in the buffer
+struct XEncodedFrame
+{
+    int64_t              Timestamp;     // capture time, milliseconds since Unix epoch
+    uint64_t             Sequence;      // number of the frame since buffer's creation (starting from 1)
+    std::vector<uint8_t> Data;
+};
+
+/* ================================================================= */
+/* Memory bounded ring of recent encoded frames with their capture   */
+/* times, which allows looking back in time without encoding frames */
+/* again. Oldest frames are removed once total size of frames gets  */
+/* over the limit (their memory is reused for new frames). Frames    */
+/* are shared with readers, so they can be sent without holding any */
+/* locks of the buffer.                                              */
+/* ================================================================= */
+class XEncodedFrameBuffer : public IStatisticsProvider, private Uncopyable
+{
+public:
+    // Create buffer keeping up to the specified number of bytes of encoded frames
+    XEncodedFrameBuffer( uint32_t maxSize );
+    ~XEncodedFrameBuffer( );
+
+    // Maximum size of frames kept in the buffer
+    uint32_t MaxSize( ) const;
+
+    // Add new frame to the buffer (timestamps are expected to grow, older ones are adjusted to the latest)
+    void Add( const uint8_t* data, uint32_t size, int64_t timestamp );
+
+    // Get the latest frame taken at or before the specified time (nullptr if the buffer has nothing that old)
+    std::shared_ptr<const XEncodedFrame> FindFrame( int64_t timestamp ) const;
+    // Get the latest frame taken at or before the specified time, but after the frame with the specified
+    // sequence number (nullptr if there is no such frame)
+    std::shared_ptr<const XEncodedFrame> NextFrame( uint64_t sequence, int64_t timestamp ) const;
+    // Get the oldest frame in the buffer
+    std::shared_ptr<const XEncodedFrame> OldestFrame( ) const;
+
+    // Put statistics of the buffer into the specified collector
+    void CollectStatistics( XStatisticsCollector& collector ) const;
+
+private:
+    Private::XEncodedFrameBufferData* mData;
+};
+
+#endif // XENCODED_FRAME_BUFFER_HPP
@@ -20,15 +20,20 @@
 
 #include <string.h>
 #include <new>
+#include <algorithm>
 
 #include "XImage.hpp"
 
 using namespace std;
 
+// Size of pixel data blocks sampled by image hash (bytes)
+#define XIMAGE_HASH_BLOCK (64)
+
 // Returns number of bits required for pixel in certain format
 uint32_t XImageBitsPerPixel( XPixelFormat format )
 {
-    static int sizes[]     = { 0, 8, 24, 32, 8 };
+    // planar formats are given bits per pixel of their first (Y) plane
+    static int sizes[]     = { 0, 8, 24, 32, 8, 16, 16, 8, 8, 16, 8, 8, 8, 8 };
     int        formatIndex = static_cast<int>( format );
 
     return ( formatIndex >= ( sizeof( sizes ) / sizeof( sizes[0] ) ) ) ? 0 : sizes[formatIndex];
@@ -46,6 +51,66 @@ static uint32_t XImageBytesPerLine( uint32_t bitsPerLine )
     return ( bitsPerLine + 7 ) >> 3;
 }
 
+// Returns number of bytes per line of the specified plane of an image
+static uint32_t XImagePlaneLineSize( int32_t width, XPixelFormat format, int32_t plane )
+{
+    uint32_t lineSize = XImageBytesPerLine( width * XImageBitsPerPixel( format ) );
+
+    if ( plane != 0 )
+    {
+        // chroma planes of 4:2:0 formats have half the width (U/V are interleaved in NV12)
+        lineSize = ( ( width + 1 ) / 2 ) * ( ( format == XPixelFormat::NV12 ) ? 2 : 1 );
+    }
+    else if ( ( format == XPixelFormat::YUYV ) || ( format == XPixelFormat::UYVY ) )
+    {
+        // packed 4:2:2 formats keep complete pairs of pixels
+        lineSize = ( ( width + 1 ) / 2 ) * 4;
+    }
+
+    return lineSize;
+}
+
+// Mix the specified bytes into 64 bit hash (8 bytes at a time)
+static uint64_t XImageHashBytes( uint64_t hash, const uint8_t* data, uint32_t size )
+{
+    const uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+    uint64_t       word;
+
+    for ( ; size >= 8; size -= 8, data += 8 )
+    {
+        memcpy( &word, data, 8 );
+        hash  = ( hash ^ word ) * multiplier;
+        hash ^= hash >> 32;
+    }
+
+    if ( size != 0 )
+    {
+        word = 0;
+        memcpy( &word, data, size );
+        hash  = ( hash ^ word ^ ( static_cast<uint64_t>( size ) << 56 ) ) * multiplier;
+        hash ^= hash >> 32;
+    }
+
+    return hash;
+}
+
+// Returns size of the buffer required to keep image of the specified height/stride/format (including all planes)
+static uint32_t XImageBufferSize( int32_t height, int32_t stride, XPixelFormat format )
+{
+    uint32_t size = height * stride;
+
+    if ( format == XPixelFormat::NV12 )
+    {
+        size += ( ( height + 1 ) / 2 ) * stride;
+    }
+    else if ( format == XPixelFormat::I420 )
+    {
+        size += ( ( height + 1 ) / 2 ) * ( stride / 2 ) * 2;
+    }
+
+    return size;
+}
+
 // Create empty image
 XImage::XImage( uint8_t* data, int32_t width, int32_t height, int32_t stride, XPixelFormat format, bool ownMemory ) :
     mData( data ), mWidth( width ), mHeight( height ), mStride( stride ), mFormat( format ), mOwnMemory( ownMemory )
@@ -65,16 +130,17 @@ XImage::~XImage( )
 shared_ptr<XImage> XImage::Allocate( int32_t width, int32_t height, XPixelFormat format, bool zeroInitialize )
 {
     int32_t  stride = (int32_t) XImageBytesPerStride( width * XImageBitsPerPixel( format ) );
+    uint32_t size   = XImageBufferSize( height, stride, format );
     XImage*  image  = nullptr;
     uint8_t* data   = nullptr;
 
     if ( zeroInitialize )
     {
-        data = (uint8_t*) calloc( 1, height * stride );
+        data = (uint8_t*) calloc( 1, size );
     }
     else
     {
-        data = (uint8_t*) malloc( height * stride );
+        data = (uint8_t*) malloc( size );
     }
 
     if ( data != nullptr )
@@ -134,16 +200,23 @@ XError XImage::CopyData( const shared_ptr<XImage>& copyTo ) const
     }
     else
     {
-        uint32_t lineSize  = XImageBytesPerLine( mWidth * XImageBitsPerPixel( mFormat ) );
-        uint8_t* srcPtr    = mData;
-        uint8_t* dstPtr    = copyTo->mData;
-        int32_t  dstStride = copyTo->mStride;
+        int32_t planes = Planes( );
 
-        for ( int y = 0; y < mHeight; y++ )
+        for ( int32_t plane = 0; plane < planes; plane++ )
         {
-            memcpy( dstPtr, srcPtr, lineSize );
-            srcPtr += mStride;
-            dstPtr += dstStride;
+            uint8_t* srcPtr      = PlaneData( plane );
+            uint8_t* dstPtr      = copyTo->PlaneData( plane );
+            int32_t  srcStride   = PlaneStride( plane );
+            int32_t  dstStride   = copyTo->PlaneStride( plane );
+            int32_t  planeHeight = PlaneHeight( plane );
+            uint32_t lineSize    = XImagePlaneLineSize( mWidth, mFormat, plane );
+
+            for ( int y = 0; y < planeHeight; y++ )
+            {
+                memcpy( dstPtr, srcPtr, lineSize );
+                srcPtr += srcStride;
+                dstPtr += dstStride;
+            }
         }
 
         if ( mFormat == XPixelFormat::JPEG )
@@ -181,3 +254,98 @@ XError XImage::CopyDataOrClone( std::shared_ptr<XImage>& copyTo ) const
 
     return ret;
 }
+
+// Calculate 64 bit hash of image's pixels taking every sampleStep-th block of each row of each plane
+uint64_t XImage::Hash( int32_t sampleStep ) const
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+
+    if ( mData != nullptr )
+    {
+        int32_t planes = Planes( );
+
+        hash = ( hash ^ ( static_cast<uint64_t>( mFormat ) << 48 ) ^ ( static_cast<uint64_t>( mHeight ) << 24 ) ^ mWidth ) * 0x100000001B3ull;
+
+        for ( int32_t plane = 0; plane < planes; plane++ )
+        {
+            const uint8_t* ptr         = PlaneData( plane );
+            int32_t        stride      = PlaneStride( plane );
+            int32_t        planeHeight = PlaneHeight( plane );
+            uint32_t       lineSize    = XImagePlaneLineSize( mWidth, mFormat, plane );
+
+            for ( int32_t y = 0; y < planeHeight; y++ )
+            {
+                const uint8_t* row = ptr + y * stride;
+
+                if ( sampleStep <= 1 )
+                {
+                    hash = XImageHashBytes( hash, row, lineSize );
+                }
+                else
+                {
+                    // blocks taken from this row are the ones skipped by the previous rows
+                    for ( uint32_t offset = ( y % sampleStep ) * XIMAGE_HASH_BLOCK; offset < lineSize; offset += sampleStep * XIMAGE_HASH_BLOCK )
+                    {
+                        hash = XImageHashBytes( hash, row + offset, min( lineSize - offset, static_cast<uint32_t>( XIMAGE_HASH_BLOCK ) ) );
+                    }
+                }
+            }
+        }
+    }
+
+    return hash;
+}
+
+// Number of planes in the image
+int32_t XImage::Planes( ) const
+{
+    return ( mFormat == XPixelFormat::NV12 ) ? 2 : ( ( mFormat == XPixelFormat::I420 ) ? 3 : 1 );
+}
+
+// Pointer to the specified plane's data
+uint8_t* XImage::PlaneData( int32_t plane ) const
+{
+    uint8_t* data = nullptr;
+
+    if ( ( mData != nullptr ) && ( plane >= 0 ) && ( plane < Planes( ) ) )
+    {
+        data = mData;
+
+        if ( plane >= 1 )
+        {
+            data += mHeight * mStride;
+        }
+        if ( plane == 2 )
+        {
+            data += PlaneHeight( 1 ) * PlaneStride( 1 );
+        }
+    }
+
+    return data;
+}
+
+// Stride of the specified plane
+int32_t XImage::PlaneStride( int32_t plane ) const
+{
+    int32_t stride = 0;
+
+    if ( ( plane >= 0 ) && ( plane < Planes( ) ) )
+    {
+        stride = ( ( plane == 0 ) || ( mFormat == XPixelFormat::NV12 ) ) ? mStride : mStride / 2;
+    }
+
+    return stride;
+}
+
+// Height of the specified plane
+int32_t XImage::PlaneHeight( int32_t plane ) const
+{
+    int32_t height = 0;
+
+    if ( ( plane >= 0 ) && ( plane < Planes( ) ) )
+    {
+        height = ( plane == 0 ) ? mHeight : ( mHeight + 1 ) / 2;
+    }
+
+    return height;
+}
@@ -34,7 +34,23 @@ enum class XPixelFormat
     RGBA32,
 
     JPEG,
-    // Enough for this project
+
+    // YUV formats provided by some cameras natively (BT.601 coefficients, as produced by most
+    // sensors). Packed 4:2:2 formats keep two pixels in four bytes. Planar 4:2:0 formats keep
+    // full size Y plane followed by chroma planes of half width and height: interleaved U/V
+    // plane for NV12 (same stride as Y) or U and V planes for I420 (half the stride of Y).
+    YUYV,
+    UYVY,
+    NV12,
+    I420,
+
+    // Formats of industrial/thermal sensors: 16 bit grayscale (little endian) and raw 8 bit Bayer
+    // patterns, named by colors of the top-left 2x2 block (row by row)
+    Grayscale16,
+    BayerRGGB8,
+    BayerGRBG8,
+    BayerGBRG8,
+    BayerBGGR8
 };
 
 enum
@@ -89,6 +105,11 @@ public:
     XError CopyData( const std::shared_ptr<XImage>& copyTo ) const;
     // Copy content of the image into the specified one if its size/format is same or make a clone
     XError CopyDataOrClone( std::shared_ptr<XImage>& copyTo ) const;
+    // Calculate 64 bit hash of image's pixels (of all planes) taking every sampleStep-th block of 64 bytes
+    // of each row only. Sampled blocks are shifted from row to row, so every part of image is sampled (a
+    // change of a single row or a thin column is still found), while repeated frames are found without
+    // reading all of their pixels.
+    uint64_t Hash( int32_t sampleStep = 1 ) const;
 
     // Image properties
     int32_t Width( )       const { return mWidth;  }
@@ -98,6 +119,14 @@ public:
     // Raw data of the image
     uint8_t* Data( )       const { return mData;   }
 
+    // Number of planes in the image (1 for all formats except planar YUV)
+    int32_t Planes( ) const;
+    // Pointer to the specified plane's data, its stride and height (plane 0 is the same as
+    // Data()/Stride()/Height(), while chroma planes follow it in the same memory buffer)
+    uint8_t* PlaneData( int32_t plane ) const;
+    int32_t PlaneStride( int32_t plane ) const;
+    int32_t PlaneHeight( int32_t plane ) const;
+
 private:
     uint8_t*     mData;
     int32_t      mWidth;
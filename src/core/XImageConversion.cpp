@@ -0,0 +1,541 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <algorithm>
+#include <vector>
+
+#include "XImageConversion.hpp"
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && ( _M_IX86_FP >= 2 ) )
+    #define XIMAGE_CONVERSION_SSE2
+    #include <emmintrin.h>
+#endif
+
+using namespace std;
+
+/*
+    YUV to RGB conversion is done using the next coefficients, which are multiplied
+    by 256 to get integer calculations.
+
+    r = y + (1.4065 * (cr - 128));
+    g = y - (0.3455 * (cb - 128)) - (0.7169 * (cr - 128));
+    b = y + (1.7790 * (cb - 128));
+*/
+#define YUV_COEF_RV  (360)
+#define YUV_COEF_GU  (-88)
+#define YUV_COEF_GV  (-184)
+#define YUV_COEF_BU  (455)
+
+static inline uint8_t ClampToByte( int value )
+{
+    return static_cast<uint8_t>( ( value > 255 ) ? 255 : ( ( value < 0 ) ? 0 : value ) );
+}
+
+// Average of two values, rounded up (same as SSE2 does it)
+static inline uint8_t Average( uint8_t a, uint8_t b )
+{
+    return static_cast<uint8_t>( ( a + b + 1 ) >> 1 );
+}
+
+// Index of a row/column mirrored at image's edges (keeps parity, so Bayer pattern is preserved)
+static inline int32_t MirrorIndex( int32_t i, int32_t size )
+{
+    return ( i < 0 ) ? min( -i, size - 1 ) : ( ( i >= size ) ? max( 2 * size - 2 - i, 0 ) : i );
+}
+
+#ifdef XIMAGE_CONVERSION_SSE2
+
+// Select bytes from the first vector where mask is set or from the second one otherwise
+static inline __m128i Select( __m128i mask, __m128i a, __m128i b )
+{
+    return _mm_or_si128( _mm_and_si128( mask, a ), _mm_andnot_si128( mask, b ) );
+}
+
+// Calculate R, G and B values (16 bit, not clamped yet) for 8 pixels
+static inline void YuvToRgb8( __m128i y, __m128i u, __m128i v, __m128i& r, __m128i& g, __m128i& b )
+{
+    const __m128i zero   = _mm_setzero_si128( );
+    const __m128i coefR  = _mm_setr_epi16( 256, YUV_COEF_RV, 256, YUV_COEF_RV, 256, YUV_COEF_RV, 256, YUV_COEF_RV );
+    const __m128i coefG1 = _mm_setr_epi16( 256, YUV_COEF_GU, 256, YUV_COEF_GU, 256, YUV_COEF_GU, 256, YUV_COEF_GU );
+    const __m128i coefG2 = _mm_setr_epi16( YUV_COEF_GV, 0, YUV_COEF_GV, 0, YUV_COEF_GV, 0, YUV_COEF_GV, 0 );
+    const __m128i coefB  = _mm_setr_epi16( 256, YUV_COEF_BU, 256, YUV_COEF_BU, 256, YUV_COEF_BU, 256, YUV_COEF_BU );
+
+    // interleave Y with chroma, so multiply-add gives 32 bit sums of both terms
+    __m128i yvLo = _mm_unpacklo_epi16( y, v );
+    __m128i yvHi = _mm_unpackhi_epi16( y, v );
+    __m128i yuLo = _mm_unpacklo_epi16( y, u );
+    __m128i yuHi = _mm_unpackhi_epi16( y, u );
+    __m128i v0Lo = _mm_unpacklo_epi16( v, zero );
+    __m128i v0Hi = _mm_unpackhi_epi16( v, zero );
+
+    r = _mm_packs_epi32( _mm_srai_epi32( _mm_madd_epi16( yvLo, coefR ), 8 ),
+                         _mm_srai_epi32( _mm_madd_epi16( yvHi, coefR ), 8 ) );
+    g = _mm_packs_epi32( _mm_srai_epi32( _mm_add_epi32( _mm_madd_epi16( yuLo, coefG1 ), _mm_madd_epi16( v0Lo, coefG2 ) ), 8 ),
+                         _mm_srai_epi32( _mm_add_epi32( _mm_madd_epi16( yuHi, coefG1 ), _mm_madd_epi16( v0Hi, coefG2 ) ), 8 ) );
+    b = _mm_packs_epi32( _mm_srai_epi32( _mm_madd_epi16( yuLo, coefB ), 8 ),
+                         _mm_srai_epi32( _mm_madd_epi16( yuHi, coefB ), 8 ) );
+}
+
+#endif
+
+// Check if the specified format is one of the YUV formats
+bool XImageConversion::IsYuvFormat( XPixelFormat format )
+{
+    return ( ( format == XPixelFormat::YUYV ) || ( format == XPixelFormat::UYVY ) ||
+             ( format == XPixelFormat::NV12 ) || ( format == XPixelFormat::I420 ) );
+}
+
+// Convert image in one of the YUV formats into RGB24 image of the same size
+XError XImageConversion::YuvToRgb24( const shared_ptr<const XImage>& src, const shared_ptr<XImage>& dst )
+{
+    XError ret = XError::Success;
+
+    if ( ( !src ) || ( !dst ) || ( src->Data( ) == nullptr ) || ( dst->Data( ) == nullptr ) )
+    {
+        ret = XError::NullPointer;
+    }
+    else if ( ( !IsYuvFormat( src->Format( ) ) ) || ( dst->Format( ) != XPixelFormat::RGB24 ) )
+    {
+        ret = XError::UnsupportedPixelFormat;
+    }
+    else if ( ( src->Width( ) != dst->Width( ) ) || ( src->Height( ) != dst->Height( ) ) )
+    {
+        ret = XError::ImageParametersMismatch;
+    }
+    else
+    {
+        XPixelFormat    format      = src->Format( );
+        int32_t         width       = src->Width( );
+        int32_t         height      = src->Height( );
+        int32_t         chromaWidth = ( width + 1 ) / 2;
+        vector<uint8_t> rowBuffer( width + chromaWidth * 2 );
+        uint8_t*        yTemp       = rowBuffer.data( );
+        uint8_t*        uTemp       = yTemp + width;
+        uint8_t*        vTemp       = uTemp + chromaWidth;
+        int32_t         lastUvRow   = -1;
+
+        for ( int32_t iy = 0; iy < height; iy++ )
+        {
+            const uint8_t* yRow = yTemp;
+            const uint8_t* uRow = uTemp;
+            const uint8_t* vRow = vTemp;
+
+            if ( ( format == XPixelFormat::YUYV ) || ( format == XPixelFormat::UYVY ) )
+            {
+                SplitPackedYuvRow( src->Data( ) + iy * src->Stride( ), width, format, yTemp, uTemp, vTemp );
+            }
+            else if ( format == XPixelFormat::NV12 )
+            {
+                yRow = src->Data( ) + iy * src->Stride( );
+
+                // chroma row is shared by two rows of pixels
+                if ( lastUvRow != iy / 2 )
+                {
+                    lastUvRow = iy / 2;
+                    SplitInterleavedUvRow( src->PlaneData( 1 ) + lastUvRow * src->PlaneStride( 1 ), chromaWidth, uTemp, vTemp );
+                }
+            }
+            else
+            {
+                yRow = src->Data( ) + iy * src->Stride( );
+                uRow = src->PlaneData( 1 ) + ( iy / 2 ) * src->PlaneStride( 1 );
+                vRow = src->PlaneData( 2 ) + ( iy / 2 ) * src->PlaneStride( 2 );
+            }
+
+            YuvRowToRgb24( yRow, uRow, vRow, width, dst->Data( ) + iy * dst->Stride( ) );
+        }
+    }
+
+    return ret;
+}
+
+// Split a row of packed 4:2:2 pixels (YUYV or UYVY) into Y, U and V rows
+void XImageConversion::SplitPackedYuvRow( const uint8_t* src, int32_t width, XPixelFormat format, uint8_t* y, uint8_t* u, uint8_t* v )
+{
+    int32_t pairs     = ( width + 1 ) / 2;
+    int32_t lumaIndex = ( format == XPixelFormat::UYVY ) ? 1 : 0;
+    int32_t i         = 0;
+
+#ifdef XIMAGE_CONVERSION_SSE2
+    const __m128i lowBytes = _mm_set1_epi16( 0x00FF );
+    int32_t       pairs16  = ( width / 16 ) * 8;
+
+    for ( ; i < pairs16; i += 8 )
+    {
+        __m128i chunk0 = _mm_loadu_si128( (const __m128i*) ( src + i * 4 ) );
+        __m128i chunk1 = _mm_loadu_si128( (const __m128i*) ( src + i * 4 + 16 ) );
+        __m128i luma, chroma;
+
+        if ( lumaIndex == 0 )
+        {
+            luma   = _mm_packus_epi16( _mm_and_si128( chunk0, lowBytes ), _mm_and_si128( chunk1, lowBytes ) );
+            chroma = _mm_packus_epi16( _mm_srli_epi16( chunk0, 8 ), _mm_srli_epi16( chunk1, 8 ) );
+        }
+        else
+        {
+            luma   = _mm_packus_epi16( _mm_srli_epi16( chunk0, 8 ), _mm_srli_epi16( chunk1, 8 ) );
+            chroma = _mm_packus_epi16( _mm_and_si128( chunk0, lowBytes ), _mm_and_si128( chunk1, lowBytes ) );
+        }
+
+        _mm_storeu_si128( (__m128i*) ( y + i * 2 ), luma );
+        _mm_storel_epi64( (__m128i*) ( u + i ), _mm_packus_epi16( _mm_and_si128( chroma, lowBytes ), _mm_setzero_si128( ) ) );
+        _mm_storel_epi64( (__m128i*) ( v + i ), _mm_packus_epi16( _mm_srli_epi16( chroma, 8 ), _mm_setzero_si128( ) ) );
+    }
+#endif
+
+    for ( ; i < pairs; i++ )
+    {
+        const uint8_t* pair = src + i * 4;
+
+        y[i * 2] = pair[lumaIndex];
+        if ( i * 2 + 1 < width )
+        {
+            y[i * 2 + 1] = pair[lumaIndex + 2];
+        }
+        u[i] = pair[1 - lumaIndex];
+        v[i] = pair[3 - lumaIndex];
+    }
+}
+
+// Split a row of interleaved chroma samples (as in NV12) into U and V rows
+void XImageConversion::SplitInterleavedUvRow( const uint8_t* src, int32_t count, uint8_t* u, uint8_t* v )
+{
+    int32_t i = 0;
+
+#ifdef XIMAGE_CONVERSION_SSE2
+    const __m128i lowBytes = _mm_set1_epi16( 0x00FF );
+    int32_t       count16  = count & ~15;
+
+    for ( ; i < count16; i += 16 )
+    {
+        __m128i chunk0 = _mm_loadu_si128( (const __m128i*) ( src + i * 2 ) );
+        __m128i chunk1 = _mm_loadu_si128( (const __m128i*) ( src + i * 2 + 16 ) );
+
+        _mm_storeu_si128( (__m128i*) ( u + i ), _mm_packus_epi16( _mm_and_si128( chunk0, lowBytes ), _mm_and_si128( chunk1, lowBytes ) ) );
+        _mm_storeu_si128( (__m128i*) ( v + i ), _mm_packus_epi16( _mm_srli_epi16( chunk0, 8 ), _mm_srli_epi16( chunk1, 8 ) ) );
+    }
+#endif
+
+    for ( ; i < count; i++ )
+    {
+        u[i] = src[i * 2];
+        v[i] = src[i * 2 + 1];
+    }
+}
+
+// Convert a row of planar YUV samples (U and V are horizontally subsampled by 2) into RGB24
+void XImageConversion::YuvRowToRgb24( const uint8_t* y, const uint8_t* u, const uint8_t* v, int32_t width, uint8_t* rgb )
+{
+    int32_t x = 0;
+
+#ifdef XIMAGE_CONVERSION_SSE2
+    const __m128i zero    = _mm_setzero_si128( );
+    const __m128i offset  = _mm_set1_epi16( 128 );
+    int32_t       width16 = width & ~15;
+    uint8_t       rBytes[16], gBytes[16], bBytes[16];
+
+    for ( ; x < width16; x += 16 )
+    {
+        __m128i luma  = _mm_loadu_si128( (const __m128i*) ( y + x ) );
+        __m128i u16   = _mm_sub_epi16( _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*) ( u + x / 2 ) ), zero ), offset );
+        __m128i v16   = _mm_sub_epi16( _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*) ( v + x / 2 ) ), zero ), offset );
+        __m128i rLo, gLo, bLo, rHi, gHi, bHi;
+
+        // each chroma sample is used for two neighbour pixels
+        YuvToRgb8( _mm_unpacklo_epi8( luma, zero ), _mm_unpacklo_epi16( u16, u16 ), _mm_unpacklo_epi16( v16, v16 ), rLo, gLo, bLo );
+        YuvToRgb8( _mm_unpackhi_epi8( luma, zero ), _mm_unpackhi_epi16( u16, u16 ), _mm_unpackhi_epi16( v16, v16 ), rHi, gHi, bHi );
+
+        _mm_storeu_si128( (__m128i*) rBytes, _mm_packus_epi16( rLo, rHi ) );
+        _mm_storeu_si128( (__m128i*) gBytes, _mm_packus_epi16( gLo, gHi ) );
+        _mm_storeu_si128( (__m128i*) bBytes, _mm_packus_epi16( bLo, bHi ) );
+
+        for ( int32_t i = 0; i < 16; i++ )
+        {
+            rgb[RedIndex]   = rBytes[i];
+            rgb[GreenIndex] = gBytes[i];
+            rgb[BlueIndex]  = bBytes[i];
+            rgb += 3;
+        }
+    }
+#endif
+
+    for ( ; x < width; x++ )
+    {
+        int yv = y[x] << 8;
+        int uv = u[x / 2] - 128;
+        int vv = v[x / 2] - 128;
+
+        rgb[RedIndex]   = ClampToByte( ( yv + YUV_COEF_RV * vv ) >> 8 );
+        rgb[GreenIndex] = ClampToByte( ( yv + YUV_COEF_GU * uv + YUV_COEF_GV * vv ) >> 8 );
+        rgb[BlueIndex]  = ClampToByte( ( yv + YUV_COEF_BU * uv ) >> 8 );
+        rgb += 3;
+    }
+}
+
+// Check if the specified format is one of the Bayer formats
+bool XImageConversion::IsBayerFormat( XPixelFormat format )
+{
+    return ( ( format == XPixelFormat::BayerRGGB8 ) || ( format == XPixelFormat::BayerGRBG8 ) ||
+             ( format == XPixelFormat::BayerGBRG8 ) || ( format == XPixelFormat::BayerBGGR8 ) );
+}
+
+// Convert raw Bayer image into RGB24 image of the same size using bilinear interpolation
+XError XImageConversion::BayerToRgb24( const shared_ptr<const XImage>& src, const shared_ptr<XImage>& dst )
+{
+    XError ret = XError::Success;
+
+    if ( ( !src ) || ( !dst ) || ( src->Data( ) == nullptr ) || ( dst->Data( ) == nullptr ) )
+    {
+        ret = XError::NullPointer;
+    }
+    else if ( ( !IsBayerFormat( src->Format( ) ) ) || ( dst->Format( ) != XPixelFormat::RGB24 ) )
+    {
+        ret = XError::UnsupportedPixelFormat;
+    }
+    else if ( ( src->Width( ) != dst->Width( ) ) || ( src->Height( ) != dst->Height( ) ) )
+    {
+        ret = XError::ImageParametersMismatch;
+    }
+    else
+    {
+        XPixelFormat format = src->Format( );
+        int32_t      width  = src->Width( );
+        int32_t      height = src->Height( );
+        int32_t      stride = src->Stride( );
+
+        // every row has either red or blue samples mixed with green; find parity of rows with red
+        // samples and parity of green columns in those rows (it is opposite in rows with blue)
+        int32_t      redRowParity   = ( ( format == XPixelFormat::BayerRGGB8 ) || ( format == XPixelFormat::BayerGRBG8 ) ) ? 0 : 1;
+        int32_t      redGreenParity = ( ( format == XPixelFormat::BayerRGGB8 ) || ( format == XPixelFormat::BayerGBRG8 ) ) ? 1 : 0;
+
+        /*
+            Each pixel gets its own color from the sample, while the other two are interpolated from
+            neighbours: green samples get the missing colors from the two horizontal/vertical neighbours,
+            red/blue samples get green from the four cross neighbours and blue/red from the four diagonal.
+        */
+        for ( int32_t iy = 0; iy < height; iy++ )
+        {
+            const uint8_t* above       = src->Data( ) + MirrorIndex( iy - 1, height ) * stride;
+            const uint8_t* row         = src->Data( ) + iy * stride;
+            const uint8_t* below       = src->Data( ) + MirrorIndex( iy + 1, height ) * stride;
+            uint8_t*       rgb         = dst->Data( ) + iy * dst->Stride( );
+            bool           redRow      = ( ( iy & 1 ) == redRowParity );
+            int32_t        greenParity = ( redRow ) ? redGreenParity : 1 - redGreenParity;
+            int32_t        x           = 0;
+
+            // demosaic single pixel with plain code, which handles mirroring at image edges
+            auto demosaicPixel = [&]( int32_t ix )
+            {
+                int32_t  left  = MirrorIndex( ix - 1, width );
+                int32_t  right = MirrorIndex( ix + 1, width );
+                uint8_t  c     = row[ix];
+                uint8_t  h2    = Average( row[left], row[right] );
+                uint8_t  v2    = Average( above[ix], below[ix] );
+                uint8_t  cross = Average( h2, v2 );
+                uint8_t  diag  = Average( Average( above[left], above[right] ), Average( below[left], below[right] ) );
+                bool     green = ( ( ix & 1 ) == greenParity );
+                uint8_t* pixel = rgb + ix * 3;
+
+                if ( green )
+                {
+                    pixel[RedIndex]   = ( redRow ) ? h2 : v2;
+                    pixel[GreenIndex] = c;
+                    pixel[BlueIndex]  = ( redRow ) ? v2 : h2;
+                }
+                else
+                {
+                    pixel[RedIndex]   = ( redRow ) ? c : diag;
+                    pixel[GreenIndex] = cross;
+                    pixel[BlueIndex]  = ( redRow ) ? diag : c;
+                }
+            };
+
+            demosaicPixel( x++ );
+
+        #ifdef XIMAGE_CONVERSION_SSE2
+            const __m128i evenBytes = _mm_set1_epi16( 0x00FF );
+            const __m128i oddBytes  = _mm_slli_epi16( evenBytes, 8 );
+            uint8_t       rBytes[16], gBytes[16], bBytes[16];
+
+            // blocks of 16 pixels which have both neighbours inside the image
+            for ( ; x + 17 <= width; x += 16 )
+            {
+                __m128i c     = _mm_loadu_si128( (const __m128i*) ( row + x ) );
+                __m128i h2    = _mm_avg_epu8( _mm_loadu_si128( (const __m128i*) ( row + x - 1 ) ),
+                                              _mm_loadu_si128( (const __m128i*) ( row + x + 1 ) ) );
+                __m128i v2    = _mm_avg_epu8( _mm_loadu_si128( (const __m128i*) ( above + x ) ),
+                                              _mm_loadu_si128( (const __m128i*) ( below + x ) ) );
+                __m128i cross = _mm_avg_epu8( h2, v2 );
+                __m128i diag  = _mm_avg_epu8( _mm_avg_epu8( _mm_loadu_si128( (const __m128i*) ( above + x - 1 ) ),
+                                                            _mm_loadu_si128( (const __m128i*) ( above + x + 1 ) ) ),
+                                              _mm_avg_epu8( _mm_loadu_si128( (const __m128i*) ( below + x - 1 ) ),
+                                                            _mm_loadu_si128( (const __m128i*) ( below + x + 1 ) ) ) );
+                __m128i green = ( ( ( x ^ greenParity ) & 1 ) == 0 ) ? evenBytes : oddBytes;
+
+                if ( redRow )
+                {
+                    _mm_storeu_si128( (__m128i*) rBytes, Select( green, h2, c ) );
+                    _mm_storeu_si128( (__m128i*) bBytes, Select( green, v2, diag ) );
+                }
+                else
+                {
+                    _mm_storeu_si128( (__m128i*) rBytes, Select( green, v2, diag ) );
+                    _mm_storeu_si128( (__m128i*) bBytes, Select( green, h2, c ) );
+                }
+                _mm_storeu_si128( (__m128i*) gBytes, Select( green, c, cross ) );
+
+                uint8_t* pixel = rgb + x * 3;
+
+                for ( int32_t i = 0; i < 16; i++ )
+                {
+                    pixel[RedIndex]   = rBytes[i];
+                    pixel[GreenIndex] = gBytes[i];
+                    pixel[BlueIndex]  = bBytes[i];
+                    pixel += 3;
+                }
+            }
+        #endif
+
+            for ( ; x < width; x++ )
+            {
+                demosaicPixel( x );
+            }
+        }
+    }
+
+    return ret;
+}
+
+// Map a row of 16 bit grayscale values into 8 bit values, stretching [low, high] range to [0, 255]
+void XImageConversion::MapGray16Row( const uint16_t* src, int32_t width, uint16_t low, uint16_t high, uint8_t* dst )
+{
+    // the gain is chosen so that multiplication of a value in the range does not overflow 16 bits
+    uint16_t range = ( high > low ) ? high - low : 1;
+    uint16_t gain  = static_cast<uint16_t>( 0xFF00 / range );
+    int32_t  x     = 0;
+
+#ifdef XIMAGE_CONVERSION_SSE2
+    const __m128i lowV    = _mm_set1_epi16( static_cast<short>( low ) );
+    const __m128i rangeV  = _mm_set1_epi16( static_cast<short>( range ) );
+    const __m128i gainV   = _mm_set1_epi16( static_cast<short>( gain ) );
+    int32_t       width16 = width & ~15;
+
+    for ( ; x < width16; x += 16 )
+    {
+        __m128i v0 = _mm_subs_epu16( _mm_loadu_si128( (const __m128i*) ( src + x ) ), lowV );
+        __m128i v1 = _mm_subs_epu16( _mm_loadu_si128( (const __m128i*) ( src + x + 8 ) ), lowV );
+
+        // min( v, range ) without SSE4.1
+        v0 = _mm_sub_epi16( v0, _mm_subs_epu16( v0, rangeV ) );
+        v1 = _mm_sub_epi16( v1, _mm_subs_epu16( v1, rangeV ) );
+
+        _mm_storeu_si128( (__m128i*) ( dst + x ), _mm_packus_epi16( _mm_srli_epi16( _mm_mullo_epi16( v0, gainV ), 8 ),
+                                                                    _mm_srli_epi16( _mm_mullo_epi16( v1, gainV ), 8 ) ) );
+    }
+#endif
+
+    for ( ; x < width; x++ )
+    {
+        uint32_t value = ( src[x] > low ) ? src[x] - low : 0;
+
+        dst[x] = static_cast<uint8_t>( ( min<uint32_t>( value, range ) * gain ) >> 8 );
+    }
+}
+
+// Average blocks of 8x8 pixels of an 8 bit plane (8 rows starting from the specified one are used)
+void XImageConversion::AverageBlocks8( const uint8_t* src, int32_t stride, int32_t blocks, uint8_t* dst )
+{
+    int32_t x = 0;
+
+#ifdef XIMAGE_CONVERSION_SSE2
+    const __m128i zero = _mm_setzero_si128( );
+
+    // sum of absolute differences with zero gives sum of 8 bytes in each 64 bit lane
+    for ( ; x + 2 <= blocks; x += 2 )
+    {
+        __m128i sum = _mm_setzero_si128( );
+
+        for ( int32_t y = 0; y < 8; y++ )
+        {
+            sum = _mm_add_epi64( sum, _mm_sad_epu8( _mm_loadu_si128( (const __m128i*) ( src + y * stride + x * 8 ) ), zero ) );
+        }
+
+        dst[x]     = static_cast<uint8_t>( ( _mm_cvtsi128_si32( sum ) + 32 ) >> 6 );
+        dst[x + 1] = static_cast<uint8_t>( ( _mm_extract_epi16( sum, 4 ) + 32 ) >> 6 );
+    }
+#endif
+
+    for ( ; x < blocks; x++ )
+    {
+        uint32_t sum = 0;
+
+        for ( int32_t y = 0; y < 8; y++ )
+        {
+            const uint8_t* row = src + y * stride + x * 8;
+
+            for ( int32_t i = 0; i < 8; i++ )
+            {
+                sum += row[i];
+            }
+        }
+
+        dst[x] = static_cast<uint8_t>( ( sum + 32 ) >> 6 );
+    }
+}
+
+// Count values, which differ by more than the threshold in the two arrays (only where mask is set)
+uint32_t XImageConversion::CountDifferences( const uint8_t* a, const uint8_t* b, const uint8_t* mask, int32_t count, uint8_t threshold )
+{
+    uint32_t changed = 0;
+    int32_t  i       = 0;
+
+#ifdef XIMAGE_CONVERSION_SSE2
+    const __m128i zero       = _mm_setzero_si128( );
+    const __m128i one        = _mm_set1_epi8( 1 );
+    const __m128i thresholdV = _mm_set1_epi8( static_cast<char>( threshold ) );
+    __m128i       total      = _mm_setzero_si128( );
+
+    for ( ; i + 16 <= count; i += 16 )
+    {
+        __m128i va   = _mm_loadu_si128( (const __m128i*) ( a + i ) );
+        __m128i vb   = _mm_loadu_si128( (const __m128i*) ( b + i ) );
+        __m128i diff = _mm_or_si128( _mm_subs_epu8( va, vb ), _mm_subs_epu8( vb, va ) );
+        // difference is above threshold if saturated subtraction of it leaves non zero
+        __m128i over = _mm_andnot_si128( _mm_cmpeq_epi8( _mm_subs_epu8( diff, thresholdV ), zero ),
+                                         _mm_loadu_si128( (const __m128i*) ( mask + i ) ) );
+
+        total = _mm_add_epi64( total, _mm_sad_epu8( _mm_and_si128( over, one ), zero ) );
+    }
+
+    changed = static_cast<uint32_t>( _mm_cvtsi128_si32( total ) ) + static_cast<uint32_t>( _mm_cvtsi128_si32( _mm_srli_si128( total, 8 ) ) );
+#endif
+
+    for ( ; i < count; i++ )
+    {
+        int diff = static_cast<int>( a[i] ) - b[i];
+
+        if ( ( mask[i] != 0 ) && ( ( diff > threshold ) || ( -diff > threshold ) ) )
+        {
+            changed++;
+        }
+    }
+
+    return changed;
+}
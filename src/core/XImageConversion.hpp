@@ -0,0 +1,69 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#pragma once
+#ifndef XIMAGE_CONVERSION_HPP
+#define XIMAGE_CONVERSION_HPP
+
+#include "XImage.hpp"
+#include "XError.hpp"
+
+// Conversion of images between pixel formats. SSE2 is used when available, with plain C
+// fallback for other platforms (both give exactly the same results).
+class XImageConversion
+{
+public:
+    XImageConversion( ) = delete;
+
+public:
+
+    // Check if the specified format is one of the YUV formats
+    static bool IsYuvFormat( XPixelFormat format );
+
+    // Convert image in one of the YUV formats (YUYV, UYVY, NV12, I420) into RGB24 image of the same size
+    static XError YuvToRgb24( const std::shared_ptr<const XImage>& src, const std::shared_ptr<XImage>& dst );
+
+    // Split a row of packed 4:2:2 pixels (YUYV or UYVY) into Y, U and V rows
+    // (U and V rows get (width+1)/2 samples)
+    static void SplitPackedYuvRow( const uint8_t* src, int32_t width, XPixelFormat format, uint8_t* y, uint8_t* u, uint8_t* v );
+
+    // Split a row of interleaved chroma samples (as in NV12) into U and V rows
+    static void SplitInterleavedUvRow( const uint8_t* src, int32_t count, uint8_t* u, uint8_t* v );
+
+    // Convert a row of planar YUV samples (U and V are horizontally subsampled by 2) into RGB24
+    static void YuvRowToRgb24( const uint8_t* y, const uint8_t* u, const uint8_t* v, int32_t width, uint8_t* rgb );
+
+    // Check if the specified format is one of the Bayer formats
+    static bool IsBayerFormat( XPixelFormat format );
+
+    // Convert raw Bayer image into RGB24 image of the same size using bilinear interpolation
+    static XError BayerToRgb24( const std::shared_ptr<const XImage>& src, const std::shared_ptr<XImage>& dst );
+
+    // Map a row of 16 bit grayscale values into 8 bit values, stretching [low, high] range to [0, 255]
+    static void MapGray16Row( const uint16_t* src, int32_t width, uint16_t low, uint16_t high, uint8_t* dst );
+
+    // Average blocks of 8x8 pixels of an 8 bit plane, taking 8 rows starting from the specified one
+    static void AverageBlocks8( const uint8_t* src, int32_t stride, int32_t blocks, uint8_t* dst );
+
+    // Count values, which differ by more than the threshold in the two arrays (only where mask is not zero)
+    static uint32_t CountDifferences( const uint8_t* a, const uint8_t* b, const uint8_t* mask, int32_t count, uint8_t threshold );
+};
+
+#endif // XIMAGE_CONVERSION_HPP
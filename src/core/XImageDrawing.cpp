@@ -18,8 +18,15 @@
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 */
 
+#include <string.h>
+#include <algorithm>
+
 #include "XImageDrawing.hpp"
-#include <algorithm> 
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && ( _M_IX86_FP >= 2 ) )
+    #define XIMAGE_DRAWING_SSE2
+    #include <emmintrin.h>
+#endif
 
 using namespace std;
 
@@ -285,491 +292,731 @@ static const uint8_t font8x8ext[] =
 };
 // ================================================
 
-// forward declaration ----
-static void XDrawingText8( const shared_ptr<const XImage>& src, const string& text, int32_t x, int32_t y, xargb color, xargb background );
-static void XDrawingText24( const shared_ptr<const XImage>& src, const string& text, int32_t x, int32_t y, xargb color, xargb background );
-// ------------------------
+/*
+    Drawing is done by filling horizontal spans of pixels. Every supported pixel format has its
+    painter, which knows how a span maps to image's bytes (and planes), while shapes are templates
+    built on top of painters' spans. Color of a span is prepared as a repeated pattern of bytes
+    (premultiplied by alpha) together with their inverse alpha, so any span is filled by the same
+    byte kernel - copy for opaque colors or multiply-add for translucent ones.
 
-// Draw horizontal line on the specified image
-XError XImageDrawing::HLine( const shared_ptr<const XImage>& image, int32_t x1, int32_t x2, int32_t y, xargb color )
-{
-    XError  ret = XError::Success;
+    RGB colors are converted to YUV using BT.601 full range coefficients (multiplied by 256):
 
-    if ( ( !image ) || ( image->Data( ) == nullptr ) )
-    {
-        ret = XError::NullPointer;
-    }
-    else if ( ( image->Format( ) != XPixelFormat::Grayscale8 ) &&
-              ( image->Format( ) != XPixelFormat::RGB24 ) &&
-              ( image->Format( ) != XPixelFormat::RGBA32 ) )
+    y =  0.2990 * r + 0.5870 * g + 0.1140 * b
+    u = -0.1687 * r - 0.3313 * g + 0.5000 * b + 128
+    v =  0.5000 * r - 0.4187 * g - 0.0813 * b + 128
+*/
+
+// Size of span color's pattern - multiple of 16 and of all pixel/chroma sizes (1, 2, 3 and 4 bytes)
+#define PATTERN_SIZE (48)
+
+// Maximum scale factor of text
+#define MAX_TEXT_SCALE (32)
+
+namespace Private
+{
+    // Divide the specified value (up to 255 * 255) by 255 with rounding
+    static inline uint8_t Div255( uint32_t value )
     {
-        ret = XError::UnsupportedPixelFormat;
+        // same as ( v + ( v >> 8 ) ) >> 8 for v = value + 128, but one operation less
+        return static_cast<uint8_t>( ( ( value + 128 ) * 257 ) >> 16 );
     }
-    else
+
+    // Color of spans prepared for bytes of some pixel format - every byte becomes value + byte * inverse / 255
+    struct XSpanColor
     {
-        if ( ( y >= 0 ) && ( y < image->Height( ) ) && ( color.components.a != 0 ) )
+        uint8_t Value[PATTERN_SIZE];    // color bytes premultiplied by alpha
+        uint8_t Inverse[PATTERN_SIZE];  // 255 - alpha (255 for bytes left as is)
+        bool    Opaque;                 // bytes are either replaced or kept
+        bool    KeepsBytes;             // some bytes are left as is
+        bool    Transparent;            // nothing to draw
+
+        // Prepare color out of the specified bytes of a pixel (or a group of pixels)
+        void Init( const uint8_t* bytes, const bool* keep, int32_t period, uint8_t alpha )
         {
-            int stride = image->Stride( );
-            int left   = min( x1, x2 );
-            int right  = max( x1, x2 );
-            int x;
+            Opaque      = ( alpha == 255 );
+            KeepsBytes  = false;
+            Transparent = ( alpha == 0 );
+
+            for ( int32_t i = 0; i < PATTERN_SIZE; i++ )
+            {
+                int32_t j = i % period;
+
+                if ( ( keep != nullptr ) && ( keep[j] ) )
+                {
+                    Value[i]   = 0;
+                    Inverse[i] = 255;
+                    KeepsBytes = true;
+                }
+                else
+                {
+                    Value[i]   = Div255( bytes[j] * alpha );
+                    Inverse[i] = 255 - alpha;
+                }
+            }
+        }
+    };
 
-            uint8_t fillA       = color.components.a;
-            float   fillAlpha   = 0;
-            float   fill1mAlpha = 0;
+    // Paint the specified number of bytes, which start at the beginning of color's pattern
+    static void PaintBytes( uint8_t* dst, int32_t count, const XSpanColor& color )
+    {
+        int32_t i = 0;
 
-            if ( fillA != 255 )
+        if ( ( color.Opaque ) && ( !color.KeepsBytes ) )
+        {
+            for ( ; i + PATTERN_SIZE <= count; i += PATTERN_SIZE )
             {
-                fillAlpha   = static_cast<float>( fillA ) / 255.0f;
-                fill1mAlpha = 1.0f - fillAlpha;
+                memcpy( dst + i, color.Value, PATTERN_SIZE );
             }
 
-            uint8_t* ptr = image->Data( ) + y * stride;
+            memcpy( dst + i, color.Value, count - i );
+            i = count;
+        }
+#ifdef XIMAGE_DRAWING_SSE2
+        else if ( color.Opaque )
+        {
+            int32_t count16 = count & ~15;
 
-            left  = max( 0, left );
-            right = min( image->Width( ) - 1, right );
+            for ( ; i < count16; i += 16 )
+            {
+                int32_t j     = i % PATTERN_SIZE;
+                __m128i bytes = _mm_loadu_si128( (const __m128i*) ( dst + i ) );
+                __m128i keep  = _mm_loadu_si128( (const __m128i*) ( color.Inverse + j ) );
 
-            if ( image->Format( ) == XPixelFormat::Grayscale8 )
+                _mm_storeu_si128( (__m128i*) ( dst + i ),
+                                  _mm_or_si128( _mm_and_si128( bytes, keep ), _mm_loadu_si128( (const __m128i*) ( color.Value + j ) ) ) );
+            }
+        }
+        else
+        {
+            const __m128i zero    = _mm_setzero_si128( );
+            const __m128i half    = _mm_set1_epi16( 128 );
+            int32_t       count16 = count & ~15;
+
+            for ( ; i < count16; i += 16 )
             {
-                uint8_t fillValue = static_cast<uint8_t>( RGB_TO_GRAY( color.components.r, color.components.g, color.components.b ) );
+                int32_t j     = i % PATTERN_SIZE;
+                __m128i bytes = _mm_loadu_si128( (const __m128i*) ( dst + i ) );
+                __m128i inv   = _mm_loadu_si128( (const __m128i*) ( color.Inverse + j ) );
+                __m128i low   = _mm_add_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( bytes, zero ), _mm_unpacklo_epi8( inv, zero ) ), half );
+                __m128i high  = _mm_add_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( bytes, zero ), _mm_unpackhi_epi8( inv, zero ) ), half );
+
+                // same division by 255 as Div255() does
+                low  = _mm_srli_epi16( _mm_add_epi16( low, _mm_srli_epi16( low, 8 ) ), 8 );
+                high = _mm_srli_epi16( _mm_add_epi16( high, _mm_srli_epi16( high, 8 ) ), 8 );
+
+                _mm_storeu_si128( (__m128i*) ( dst + i ),
+                                  _mm_add_epi8( _mm_packus_epi16( low, high ), _mm_loadu_si128( (const __m128i*) ( color.Value + j ) ) ) );
+            }
+        }
+#endif
 
-                ptr += left;
+        for ( ; i < count; i++ )
+        {
+            int32_t j = i % PATTERN_SIZE;
 
-                if ( fillA == 255 )
-                {
-                    // the fill color has no transparency, so just fill
-                    for ( x = left; x <= right; x++ )
-                    {
-                        *ptr = fillValue;
-                        ptr++;
-                    }
-                }
-                else
-                {
-                    float fillValueA = fillAlpha * fillValue;
+            dst[i] = static_cast<uint8_t>( color.Value[j] + Div255( dst[i] * color.Inverse[j] ) );
+        }
+    }
 
-                    // do alpha blending
-                    for ( x = left; x <= right; x++ )
-                    {
-                        *ptr = static_cast<uint8_t>( fillValueA + ( *ptr * fill1mAlpha ) );
-                        ptr++;
-                    }
+    // Paint single byte, which corresponds to the specified byte of color's pattern
+    static inline void PaintByte( uint8_t* dst, int32_t index, const XSpanColor& color )
+    {
+        *dst = static_cast<uint8_t>( color.Value[index] + Div255( *dst * color.Inverse[index] ) );
+    }
 
-                }
+    // Get YUV values of the specified color
+    static void RgbToYuv( xargb color, uint8_t* y, uint8_t* u, uint8_t* v )
+    {
+        int r = color.components.r;
+        int g = color.components.g;
+        int b = color.components.b;
+
+        // pure blue/red would get chroma of 256 after rounding
+        *y = static_cast<uint8_t>( (   77 * r + 150 * g +  29 * b + 128 ) >> 8 );
+        *u = static_cast<uint8_t>( min( 255, ( ( -43 * r -  85 * g + 128 * b + 128 ) >> 8 ) + 128 ) );
+        *v = static_cast<uint8_t>( min( 255, ( ( 128 * r - 107 * g -  21 * b + 128 ) >> 8 ) + 128 ) );
+    }
+
+    // Painter of spans on Grayscale8, RGB24 and RGBA32 images (alpha channel of RGBA32 images is left as is,
+    // unless it is a raw painter, which sets all 4 bytes of a pixel including its alpha)
+    template <int32_t PixelSize> class XPackedPainter
+    {
+    public:
+        int32_t Width;
+        int32_t Height;
+
+    public:
+        XPackedPainter( const XImage* image, xargb color, bool raw = false ) :
+            Width( image->Width( ) ), Height( image->Height( ) ),
+            mData( image->Data( ) ), mStride( image->Stride( ) ), mColor( )
+        {
+            uint8_t bytes[4] = { 0, 0, 0, 0 };
+            bool    keep[4]  = { false, false, false, true };
+
+            if ( PixelSize == 1 )
+            {
+                bytes[0] = static_cast<uint8_t>( RGB_TO_GRAY( color.components.r, color.components.g, color.components.b ) );
+            }
+            else
+            {
+                bytes[RedIndex]   = color.components.r;
+                bytes[GreenIndex] = color.components.g;
+                bytes[BlueIndex]  = color.components.b;
+            }
+
+            if ( raw )
+            {
+                bytes[3] = color.components.a;
+                mColor.Init( bytes, nullptr, PixelSize, 255 );
             }
             else
             {
-                uint8_t fillR     = color.components.r;
-                uint8_t fillG     = color.components.g;
-                uint8_t fillB     = color.components.b;
-                int     pixelSize = ( image->Format( ) == XPixelFormat::RGB24 ) ? 3 : 4;
+                mColor.Init( bytes, keep, PixelSize, color.components.a );
+            }
+        }
 
-                ptr += left * pixelSize;
+        bool IsTransparent( ) const { return mColor.Transparent; }
 
-                // NOTE: for 32 bpp images we leave their alpha as is and don't take it into account for alpha blending
+        // Fill spans of the specified rows (coordinates are inclusive and are inside the image)
+        void Fill( int32_t y1, int32_t y2, int32_t x1, int32_t x2 ) const
+        {
+            uint8_t* row   = mData + y1 * mStride + x1 * PixelSize;
+            int32_t  count = x2 - x1 + 1;
 
-                if ( fillA == 255 )
+            if ( count * PixelSize > 16 )
+            {
+                for ( int32_t y = y1; y <= y2; y++, row += mStride )
                 {
-                    // the fill color has no transparency, so just fill
-                    for ( x = left; x <= right; x++ )
+                    PaintBytes( row, count * PixelSize, mColor );
+                }
+            }
+            else
+            {
+                // short spans (vertical lines, runs of glyph pixels, etc) are done in place, with color
+                // kept in locals instead of reloading it after every write to the image
+                uint32_t value0   = mColor.Value[0],   value1   = mColor.Value[1],   value2   = mColor.Value[2];
+                uint32_t inverse0 = mColor.Inverse[0], inverse1 = mColor.Inverse[1], inverse2 = mColor.Inverse[2];
+                bool     setAlpha = ( ( PixelSize == 4 ) && ( !mColor.KeepsBytes ) );
+                uint8_t  alpha    = mColor.Value[3];
+
+                for ( int32_t y = y1; y <= y2; y++, row += mStride )
+                {
+                    uint8_t* ptr = row;
+
+                    if ( mColor.Opaque )
+                    {
+                        for ( int32_t x = 0; x < count; x++, ptr += PixelSize )
+                        {
+                            ptr[0] = static_cast<uint8_t>( value0 );
+                            if ( PixelSize != 1 )
+                            {
+                                ptr[1] = static_cast<uint8_t>( value1 );
+                                ptr[2] = static_cast<uint8_t>( value2 );
+                            }
+                            if ( setAlpha )
+                            {
+                                ptr[3] = alpha;
+                            }
+                        }
+                    }
+                    else
                     {
-                        ptr[RedIndex]   = fillR;
-                        ptr[GreenIndex] = fillG;
-                        ptr[BlueIndex]  = fillB;
-                        ptr            += pixelSize;
+                        // alpha of RGBA32 images is kept by translucent colors
+                        for ( int32_t x = 0; x < count; x++, ptr += PixelSize )
+                        {
+                            ptr[0] = static_cast<uint8_t>( value0 + Div255( ptr[0] * inverse0 ) );
+                            if ( PixelSize != 1 )
+                            {
+                                ptr[1] = static_cast<uint8_t>( value1 + Div255( ptr[1] * inverse1 ) );
+                                ptr[2] = static_cast<uint8_t>( value2 + Div255( ptr[2] * inverse2 ) );
+                            }
+                        }
                     }
                 }
-                else
+            }
+        }
+
+        // Fill the specified rows with a line of glyph - pixels of set bits get this painter's color, while others
+        // get background painter's color (glyph's bits are scaled and start at glyphX, span is clipped to x1-x2)
+        void FillGlyph( const XPackedPainter& background, int32_t y1, int32_t y2, int32_t x1, int32_t x2,
+                        int32_t glyphX, uint8_t glyphLine, int32_t scale ) const
+        {
+            uint32_t value[2][4], inverse[2][4];
+            bool     opaque     = ( ( mColor.Opaque ) && ( background.mColor.Opaque ) );
+            bool     keepsBytes = ( ( mColor.KeepsBytes ) || ( background.mColor.KeepsBytes ) );
+            uint8_t* row        = mData + y1 * mStride + x1 * PixelSize;
+
+            // 0 - background, 1 - text
+            for ( int32_t i = 0; i < PixelSize; i++ )
+            {
+                value[0][i]   = background.mColor.Value[i];
+                inverse[0][i] = background.mColor.Inverse[i];
+                value[1][i]   = mColor.Value[i];
+                inverse[1][i] = mColor.Inverse[i];
+            }
+
+            for ( int32_t y = y1; y <= y2; y++, row += mStride )
+            {
+                uint8_t* ptr = row;
+
+                for ( int32_t bit = 0; bit < 8; bit++ )
                 {
-                    float fillRA = fillAlpha * fillR;
-                    float fillGA = fillAlpha * fillG;
-                    float fillBA = fillAlpha * fillB;
+                    int32_t         c     = ( glyphLine >> ( 7 - bit ) ) & 1;
+                    const uint32_t* v     = value[c];
+                    const uint32_t* inv   = inverse[c];
+                    int32_t         count = min( x2, glyphX + ( bit + 1 ) * scale - 1 ) - max( x1, glyphX + bit * scale ) + 1;
 
-                    // do alpha blending
-                    for ( x = left; x <= right; x++ )
+                    for ( ; count > 0; count--, ptr += PixelSize )
                     {
-                        ptr[RedIndex]   = static_cast<uint8_t>( fillRA + ( ptr[RedIndex]   * fill1mAlpha ) );
-                        ptr[GreenIndex] = static_cast<uint8_t>( fillGA + ( ptr[GreenIndex] * fill1mAlpha ) );
-                        ptr[BlueIndex]  = static_cast<uint8_t>( fillBA + ( ptr[BlueIndex]  * fill1mAlpha ) );
-                        ptr            += pixelSize;
+                        if ( ( opaque ) && ( !keepsBytes ) )
+                        {
+                            for ( int32_t i = 0; i < PixelSize; i++ )
+                            {
+                                ptr[i] = static_cast<uint8_t>( v[i] );
+                            }
+                        }
+                        else if ( opaque )
+                        {
+                            // inverse is 255 for bytes, which are kept (alpha of RGBA32 images)
+                            for ( int32_t i = 0; i < PixelSize; i++ )
+                            {
+                                ptr[i] = ( inv[i] == 0 ) ? static_cast<uint8_t>( v[i] ) : ptr[i];
+                            }
+                        }
+                        else
+                        {
+                            for ( int32_t i = 0; i < PixelSize; i++ )
+                            {
+                                ptr[i] = static_cast<uint8_t>( v[i] + Div255( ptr[i] * inv[i] ) );
+                            }
+                        }
                     }
                 }
             }
         }
-    }
-
-    return ret;
-}
 
-// Draw vertical line on the specified image
-XError XImageDrawing::VLine( const shared_ptr<const XImage>& image, int32_t y1, int32_t y2, int32_t x, xargb color )
-{
-    XError  ret = XError::Success;
+    private:
+        uint8_t*   mData;
+        int32_t    mStride;
+        XSpanColor mColor;
+    };
 
-    if ( ( !image ) || ( image->Data( ) == nullptr ) )
+    // Painter of spans on packed YUV 4:2:2 images (YUYV/UYVY) - pixel pairs share their chroma, so painting
+    // a pixel sets chroma of its pair
+    class XPackedYuvPainter
     {
-        ret = XError::NullPointer;
-    }
-    else if ( ( image->Format( ) != XPixelFormat::Grayscale8 ) &&
-              ( image->Format( ) != XPixelFormat::RGB24 ) &&
-              ( image->Format( ) != XPixelFormat::RGBA32 ) )
-    {
-        ret = XError::UnsupportedPixelFormat;
-    }
-    else
-    {
-        if ( ( x >= 0 ) && ( x < image->Width( ) ) )
+    public:
+        int32_t Width;
+        int32_t Height;
+
+    public:
+        XPackedYuvPainter( const XImage* image, xargb color ) :
+            Width( image->Width( ) ), Height( image->Height( ) ),
+            mData( image->Data( ) ), mStride( image->Stride( ) ),
+            mLumaIndex( ( image->Format( ) == XPixelFormat::UYVY ) ? 1 : 0 ), mColor( )
+        {
+            uint8_t bytes[4];
+
+            RgbToYuv( color, &bytes[mLumaIndex], &bytes[1 - mLumaIndex], &bytes[3 - mLumaIndex] );
+            bytes[mLumaIndex + 2] = bytes[mLumaIndex];
+
+            mColor.Init( bytes, nullptr, 4, color.components.a );
+        }
+
+        bool IsTransparent( ) const { return mColor.Transparent; }
+
+        // Fill spans of the specified rows (coordinates are inclusive and are inside the image)
+        void Fill( int32_t y1, int32_t y2, int32_t x1, int32_t x2 ) const
         {
-            int stride = image->Stride( );
-            int top    = min( y1, y2 );
-            int bottom = max( y1, y2 );
-            int y;
+            for ( int32_t y = y1; y <= y2; y++ )
+            {
+                FillRow( mData + y * mStride, x1, x2 );
+            }
+        }
 
-            uint8_t fillA       = color.components.a;
-            float   fillAlpha   = 0;
-            float   fill1mAlpha = 0;
+    private:
+        void FillRow( uint8_t* row, int32_t x1, int32_t x2 ) const
+        {
+            // pixels, which don't have their pair in the span
+            if ( x1 & 1 )
+            {
+                PaintPixel( row, x1 );
+                x1++;
+            }
+            if ( ( x2 >= x1 ) && ( ( x2 & 1 ) == 0 ) )
+            {
+                PaintPixel( row, x2 );
+                x2--;
+            }
 
-            if ( fillA != 255 )
+            if ( x2 > x1 )
             {
-                fillAlpha   = static_cast<float>( fillA / 255.0f );
-                fill1mAlpha = 1.0f - fillAlpha;
+                PaintBytes( row + x1 * 2, ( x2 - x1 + 1 ) * 2, mColor );
             }
+        }
 
-            uint8_t* ptr = image->Data( );
+        void PaintPixel( uint8_t* row, int32_t x ) const
+        {
+            uint8_t* pair       = row + ( x & ~1 ) * 2;
+            int32_t  lumaOffset = mLumaIndex + ( x & 1 ) * 2;
 
-            top    = max( 0, top );
-            bottom = min( image->Height( ) - 1, bottom );
+            PaintByte( pair + lumaOffset, lumaOffset, mColor );
+            PaintByte( pair + 1 - mLumaIndex, 1 - mLumaIndex, mColor );
+            PaintByte( pair + 3 - mLumaIndex, 3 - mLumaIndex, mColor );
+        }
 
-            ptr += top * stride;
+    private:
+        uint8_t*   mData;
+        int32_t    mStride;
+        int32_t    mLumaIndex;
+        XSpanColor mColor;
+    };
 
-            if ( image->Format( ) == XPixelFormat::Grayscale8 )
-            {
-                uint8_t fillValue = static_cast<uint8_t>( RGB_TO_GRAY( color.components.r, color.components.g, color.components.b ) );
+    // Painter of spans on planar YUV 4:2:0 images (NV12/I420) - 2x2 pixel blocks share their chroma. Translucent
+    // colors blend chroma on even rows only, so it is not blended twice for shapes covering both rows of a block.
+    class XPlanarYuvPainter
+    {
+    public:
+        int32_t Width;
+        int32_t Height;
+
+    public:
+        XPlanarYuvPainter( const XImage* image, xargb color ) :
+            Width( image->Width( ) ), Height( image->Height( ) ),
+            mInterleaved( image->Format( ) == XPixelFormat::NV12 ),
+            mLumaData( image->PlaneData( 0 ) ), mLumaStride( image->PlaneStride( 0 ) ),
+            mUData( image->PlaneData( 1 ) ), mUStride( image->PlaneStride( 1 ) ),
+            mVData( ( mInterleaved ) ? nullptr : image->PlaneData( 2 ) ), mVStride( ( mInterleaved ) ? 0 : image->PlaneStride( 2 ) ),
+            mLuma( ), mU( ), mV( )
+        {
+            uint8_t y, uv[2];
 
-                ptr += x;
+            RgbToYuv( color, &y, &uv[0], &uv[1] );
 
-                if ( fillA == 255 )
-                {
-                    // the fill color has no transparency, so just fill
-                    for ( y = top; y <= bottom; y++ )
-                    {
-                        *ptr = fillValue;
-                        ptr += stride;
-                    }
-                }
-                else
-                {
-                    float fillValueA = fillAlpha * fillValue;
+            mLuma.Init( &y, nullptr, 1, color.components.a );
 
-                    // do alpha blending
-                    for ( y = top; y <= bottom; y++ )
-                    {
-                        *ptr = static_cast<uint8_t>( fillValueA + ( *ptr * fill1mAlpha ) );
-                        ptr += stride;
-                    }
-                }
+            if ( mInterleaved )
+            {
+                mU.Init( uv, nullptr, 2, color.components.a );
             }
             else
             {
-                uint8_t fillR     = color.components.r;
-                uint8_t fillG     = color.components.g;
-                uint8_t fillB     = color.components.b;
-                int     pixelSize = ( image->Format( ) == XPixelFormat::RGB24 ) ? 3 : 4;
+                mU.Init( &uv[0], nullptr, 1, color.components.a );
+                mV.Init( &uv[1], nullptr, 1, color.components.a );
+            }
+        }
 
-                ptr += x * pixelSize;
+        bool IsTransparent( ) const { return mLuma.Transparent; }
 
-                // NOTE: for 32 bpp images we leave their alpha as is and don't take it into account for alpha blending
+        // Fill spans of the specified rows (coordinates are inclusive and are inside the image)
+        void Fill( int32_t y1, int32_t y2, int32_t x1, int32_t x2 ) const
+        {
+            int32_t cx1 = x1 / 2;
+            int32_t cx2 = x2 / 2;
+
+            for ( int32_t y = y1; y <= y2; y++ )
+            {
+                PaintBytes( mLumaData + y * mLumaStride + x1, x2 - x1 + 1, mLuma );
 
-                if ( fillA == 255 )
+                if ( ( mLuma.Opaque ) || ( ( y & 1 ) == 0 ) )
                 {
-                    // the fill color has no transparency, so just fill
-                    for ( y = top; y <= bottom; y++ )
+                    if ( mInterleaved )
                     {
-                        ptr[RedIndex]   = fillR;
-                        ptr[GreenIndex] = fillG;
-                        ptr[BlueIndex]  = fillB;
-                        ptr += stride;
+                        PaintBytes( mUData + ( y / 2 ) * mUStride + cx1 * 2, ( cx2 - cx1 + 1 ) * 2, mU );
                     }
-                }
-                else
-                {
-                    float fillRA = fillAlpha * fillR;
-                    float fillGA = fillAlpha * fillG;
-                    float fillBA = fillAlpha * fillB;
-
-                    // do alpha blending
-                    for ( y = top; y <= bottom; y++ )
+                    else
                     {
-                        ptr[RedIndex]   = static_cast<uint8_t>( fillRA + ( ptr[RedIndex]   * fill1mAlpha ) );
-                        ptr[GreenIndex] = static_cast<uint8_t>( fillGA + ( ptr[GreenIndex] * fill1mAlpha ) );
-                        ptr[BlueIndex]  = static_cast<uint8_t>( fillBA + ( ptr[BlueIndex]  * fill1mAlpha ) );
-                        ptr += stride;
+                        PaintBytes( mUData + ( y / 2 ) * mUStride + cx1, cx2 - cx1 + 1, mU );
+                        PaintBytes( mVData + ( y / 2 ) * mVStride + cx1, cx2 - cx1 + 1, mV );
                     }
                 }
             }
         }
-    }
-
-    return ret;
-}
 
-// Draw rectangle on the specified image with the specfied color (all coordinates are inclusive)
-XError XImageDrawing::Rectangle( const shared_ptr<const XImage>& image, int32_t x1, int32_t y1, int32_t x2, int32_t y2, xargb color )
-{
-    XError  ret = XError::Success;
-
-    if ( ( !image ) || ( image->Data( ) == nullptr ) )
+    private:
+        bool       mInterleaved;
+        uint8_t*   mLumaData;
+        int32_t    mLumaStride;
+        uint8_t*   mUData;          // U plane or interleaved U/V plane of NV12
+        int32_t    mUStride;
+        uint8_t*   mVData;
+        int32_t    mVStride;
+        XSpanColor mLuma;
+        XSpanColor mU;              // U or interleaved U/V
+        XSpanColor mV;
+    };
+
+    // Fill rectangle (coordinates are inclusive and may go out of the image)
+    template <typename TPainter> void FillSpans( const TPainter& painter, int32_t x1, int32_t y1, int32_t x2, int32_t y2 )
     {
-        ret = XError::NullPointer;
+        int32_t left   = max( 0, min( x1, x2 ) );
+        int32_t right  = min( painter.Width - 1, max( x1, x2 ) );
+        int32_t top    = max( 0, min( y1, y2 ) );
+        int32_t bottom = min( painter.Height - 1, max( y1, y2 ) );
+
+        if ( ( !painter.IsTransparent( ) ) && ( left <= right ) && ( top <= bottom ) )
+        {
+            painter.Fill( top, bottom, left, right );
+        }
     }
-    else if ( ( image->Format( ) != XPixelFormat::Grayscale8 ) &&
-              ( image->Format( ) != XPixelFormat::RGB24 ) &&
-              ( image->Format( ) != XPixelFormat::RGBA32 ) )
+
+    // Draw frame of rectangle
+    template <typename TPainter> void DrawFrame( const TPainter& painter, int32_t x1, int32_t y1, int32_t x2, int32_t y2 )
     {
-        ret = XError::UnsupportedPixelFormat;
+        FillSpans( painter, x1, y1, x2, y1 );
+        FillSpans( painter, x1, y2, x2, y2 );
+
+        FillSpans( painter, x1, y1 + 1, x1, y2 - 1 );
+        FillSpans( painter, x2, y1 + 1, x2, y2 - 1 );
     }
-    else
+
+    // Draw line of a glyph on the specified rows - it is split into runs of text/background pixels, which are
+    // painted as spans (scaled glyphs make longer spans)
+    template <typename TPainter> void DrawGlyphLine( const TPainter& painter, const TPainter& background, int32_t y1, int32_t y2,
+                                                     int32_t glyphX, uint8_t glyphLine, int32_t scale )
     {
-        XImageDrawing::HLine( image, x1, x2, y1, color );
-        XImageDrawing::HLine( image, x1, x2, y2, color );
+        int32_t bit = 0;
 
-        XImageDrawing::VLine( image, y1 + 1, y2 - 1, x1, color );
-        XImageDrawing::VLine( image, y1 + 1, y2 - 1, x2, color );
-    }
+        while ( bit < 8 )
+        {
+            bool    isText = ( ( glyphLine & ( 0x80 >> bit ) ) != 0 );
+            int32_t runEnd = bit + 1;
 
-    return ret;
-}
+            while ( ( runEnd < 8 ) && ( ( ( glyphLine & ( 0x80 >> runEnd ) ) != 0 ) == isText ) )
+            {
+                runEnd++;
+            }
 
-// Draw ASCII text on the image at the specified location
-XError XImageDrawing::PutText( const shared_ptr<const XImage>& image, const string& text, int32_t x, int32_t y, xargb color, xargb background, bool addBorder )
-{
-    XError  ret = XError::Success;
+            const TPainter& runPainter = ( isText ) ? painter : background;
+            int32_t         x1         = max( 0, glyphX + bit * scale );
+            int32_t         x2         = min( painter.Width - 1, glyphX + runEnd * scale - 1 );
 
-    if ( ( !image ) || ( image->Data( ) == nullptr ) )
-    {
-        ret = XError::NullPointer;
+            if ( ( !runPainter.IsTransparent( ) ) && ( x1 <= x2 ) )
+            {
+                runPainter.Fill( y1, y2, x1, x2 );
+            }
+
+            bit = runEnd;
+        }
     }
-    else if ( ( image->Format( ) != XPixelFormat::Grayscale8 ) &&
-              ( image->Format( ) != XPixelFormat::RGB24 ) &&
-              ( image->Format( ) != XPixelFormat::RGBA32 ) )
+
+    // Draw line of a glyph on RGB/grayscale images - its pixels are blitted directly, picking text or background color
+    template <int32_t PixelSize> void DrawGlyphLine( const XPackedPainter<PixelSize>& painter, const XPackedPainter<PixelSize>& background,
+                                                     int32_t y1, int32_t y2, int32_t glyphX, uint8_t glyphLine, int32_t scale )
     {
-        ret = XError::UnsupportedPixelFormat;
+        int32_t x1 = max( 0, glyphX );
+        int32_t x2 = min( painter.Width - 1, glyphX + 8 * scale - 1 );
+
+        if ( x1 <= x2 )
+        {
+            painter.FillGlyph( background, y1, y2, x1, x2, glyphX, glyphLine, scale );
+        }
     }
-    else
+
+    // Draw text line by line of its glyphs, each covering as many image rows as the scale factor says
+    template <typename TPainter> void DrawText( const TPainter& painter, const TPainter& background, const string& text,
+                                                int32_t x, int32_t y, bool addBorder, int32_t scale )
     {
         int32_t len        = static_cast<int32_t>( text.length( ) );
-        int32_t borderSize = ( addBorder ) ? 2 : 0;
-        int32_t b;
-
-        // do nothing if ...
-        if ( ( len != 0 ) &&                                                       // if nothing to print
-            ( y + 8 + borderSize * 2 > 0 ) && ( y < image->Height( ) ) &&          // if text is out in Y direction
-            ( x + 8 * len + borderSize * 2 > 0 ) && ( x < image->Width( ) ) &&     // if text is out in X direction
-            ( ( color.components.a != 0 ) || ( background.components.a != 0 ) ) )  // if it is all transparent
+        int32_t borderSize = ( addBorder ) ? 2 * scale : 0;
+        int32_t glyphSize  = 8 * scale;
+        int32_t textWidth  = len * glyphSize;
+
+        // border is done as four strips, so every pixel is painted once
+        if ( borderSize != 0 )
         {
-            for ( b = 0; b < borderSize; b++ )
-            {
-                XImageDrawing::Rectangle( image, x + b, y + b, x + len * 8 + borderSize * 2 - b - 1, y + 8 + borderSize * 2 - b - 1, background );
-            }
+            int32_t right  = x + textWidth + borderSize * 2 - 1;
+            int32_t bottom = y + glyphSize + borderSize * 2 - 1;
+
+            FillSpans( background, x, y, right, y + borderSize - 1 );
+            FillSpans( background, x, bottom - borderSize + 1, right, bottom );
+            FillSpans( background, x, y + borderSize, x + borderSize - 1, bottom - borderSize );
+            FillSpans( background, right - borderSize + 1, y + borderSize, right, bottom - borderSize );
 
             x += borderSize;
             y += borderSize;
+        }
+
+        int32_t firstChar = max( 0, -x / glyphSize );
+        int32_t lastChar  = min( len - 1, ( painter.Width - 1 - x ) / glyphSize );
 
-            // re-check coordinates without border
-            if ( ( y + 8 > 0 ) && ( y < image->Height( ) ) &&          // if text is out in Y direction
-                 ( x + 8 * len > 0 ) && ( x < image->Width( ) ) )      // if text is out in X direction
+        for ( int32_t glyphRow = 0; glyphRow < 8; glyphRow++ )
+        {
+            int32_t y1 = max( 0, y + glyphRow * scale );
+            int32_t y2 = min( painter.Height - 1, y + ( glyphRow + 1 ) * scale - 1 );
+
+            for ( int32_t c = firstChar; ( c <= lastChar ) && ( y1 <= y2 ); c++ )
             {
-                if ( image->Format( ) == XPixelFormat::Grayscale8 )
-                {
-                    XDrawingText8( image, text, x, y, color, background );
-                }
-                else
-                {
-                    XDrawingText24( image, text, x, y, color, background );
-                }
+                uint8_t glyphLine = font8x8ext[static_cast<uint8_t>( text[c] ) * 8 + glyphRow];
+                int32_t glyphX    = x + c * glyphSize;
+
+                DrawGlyphLine( painter, background, y1, y2, glyphX, glyphLine, scale );
             }
         }
     }
 
-    return ret;
-}
+    // Shapes to draw with painter of any pixel format
+    struct XRectangleShape
+    {
+        int32_t X1, Y1, X2, Y2;
+        bool    Fill;
 
-// Draw the specified text on 8 bpp grayscale images
-void XDrawingText8( const shared_ptr<const XImage>& src, const string& text, int32_t x, int32_t y, xargb color, xargb background )
-{
-    int         width       = src->Width( );
-    int         height      = src->Height( );
-    int         stride      = src->Stride( );
-    int         yOffset     = ( y >= 0 ) ? 0 : -y;
-    int         endY        = ( y + 8 <= height ) ? 8 : height - y;
-    uint8_t*    basePtr     = src->Data( ) + y * stride + x;
-
-    uint8_t     textValue   = static_cast<uint8_t>( RGB_TO_GRAY( color.components.r, color.components.g, color.components.b ) );
-    uint8_t     textA       = color.components.a;
-    float       textAlpha   = static_cast<float>( textA ) / 255.0f;
-    float       text1mAlpha = 1.0f - textAlpha;
-    float       textValueA  = textAlpha * textValue;
-    uint8_t     bgValue     = static_cast<uint8_t> RGB_TO_GRAY( background.components.r, background.components.g, background.components.b );
-    uint8_t     bgA         = background.components.a;
-    float       bgAlpha     = static_cast<float>( bgA ) / 255.0f;
-    float       bg1mAlpha   = 1.0f - bgAlpha;
-    float       bgValueA    = bgAlpha * bgValue;
-
-    const char* textPtr     = text.c_str( );
-
-    while ( *textPtr )
+        template <typename TPainter> void operator()( const TPainter& painter, const TPainter& /* background */ ) const
+        {
+            if ( Fill )
+            {
+                FillSpans( painter, X1, Y1, X2, Y2 );
+            }
+            else
+            {
+                DrawFrame( painter, X1, Y1, X2, Y2 );
+            }
+        }
+    };
+
+    struct XTextShape
     {
-        if ( x >= width )
+        const string& Text;
+        int32_t       X, Y;
+        bool          AddBorder;
+        int32_t       Scale;
+
+        template <typename TPainter> void operator()( const TPainter& painter, const TPainter& background ) const
         {
-            break;
+            DrawText( painter, background, Text, X, Y, AddBorder, Scale );
         }
+    };
+
+    // Check if the image can be drawn on
+    static XError CheckImage( const shared_ptr<const XImage>& image )
+    {
+        XError ret = XError::Success;
 
-        if ( x > -8 )
+        if ( ( !image ) || ( image->Data( ) == nullptr ) )
+        {
+            ret = XError::NullPointer;
+        }
+        else if ( ( image->Format( ) != XPixelFormat::Grayscale8 ) &&
+                  ( image->Format( ) != XPixelFormat::RGB24 ) &&
+                  ( image->Format( ) != XPixelFormat::RGBA32 ) &&
+                  ( image->Format( ) != XPixelFormat::YUYV ) &&
+                  ( image->Format( ) != XPixelFormat::UYVY ) &&
+                  ( image->Format( ) != XPixelFormat::NV12 ) &&
+                  ( image->Format( ) != XPixelFormat::I420 ) )
         {
-            const uint8_t* symbolPtr = &( font8x8ext[*textPtr * 8] );
+            ret = XError::UnsupportedPixelFormat;
+        }
 
-            int      xOffset = ( x >= 0 ) ? 0 : -x;
-            uint8_t  mask    = 1 << ( 7 - xOffset );
-            int      sx, sy, tx;
+        return ret;
+    }
 
-            for ( sy = yOffset; sy < endY; sy++ )
-            {
-                uint8_t  tempMask   = mask;
-                uint8_t  symbolLine = symbolPtr[sy];
-                uint8_t* imagePtr   = basePtr + sy * stride + xOffset;
+    // Draw the shape with painters matching pixel format of the image
+    template <typename TShape> void DrawShape( const XImage* image, const TShape& shape, xargb color, xargb background )
+    {
+        switch ( image->Format( ) )
+        {
+        case XPixelFormat::YUYV:
+        case XPixelFormat::UYVY:
+            shape( XPackedYuvPainter( image, color ), XPackedYuvPainter( image, background ) );
+            break;
 
-                for ( sx = xOffset, tx = x + xOffset; ( sx < 8 ) && ( tx < width ); sx++, tx++ )
-                {
-                    if ( symbolLine & tempMask )
-                    {
-                        if ( textA == 255 )
-                        {
-                            *imagePtr = textValue;
-                        }
-                        else
-                        {
-                            *imagePtr = static_cast<uint8_t>( textValueA + ( *imagePtr * text1mAlpha ) );
-                        }
-                    }
-                    else
-                    {
-                        if ( bgA == 255 )
-                        {
-                            *imagePtr = bgValue;
-                        }
-                        else
-                        {
-                            *imagePtr = static_cast<uint8_t>( bgValueA + ( *imagePtr * bg1mAlpha ) );
-                        }
-                    }
+        case XPixelFormat::NV12:
+        case XPixelFormat::I420:
+            shape( XPlanarYuvPainter( image, color ), XPlanarYuvPainter( image, background ) );
+            break;
 
-                    tempMask >>= 1;
-                    imagePtr++;
-                }
-            }
+        case XPixelFormat::RGB24:
+            shape( XPackedPainter<3>( image, color ), XPackedPainter<3>( image, background ) );
+            break;
+
+        case XPixelFormat::RGBA32:
+            shape( XPackedPainter<4>( image, color ), XPackedPainter<4>( image, background ) );
+            break;
+
+        default:
+            shape( XPackedPainter<1>( image, color ), XPackedPainter<1>( image, background ) );
+            break;
         }
+    }
+}
+
+// Draw horizontal line on the specified image
+XError XImageDrawing::HLine( const shared_ptr<const XImage>& image, int32_t x1, int32_t x2, int32_t y, xargb color )
+{
+    return FillRectangle( image, x1, y, x2, y, color );
+}
+
+// Draw vertical line on the specified image
+XError XImageDrawing::VLine( const shared_ptr<const XImage>& image, int32_t y1, int32_t y2, int32_t x, xargb color )
+{
+    return FillRectangle( image, x, y1, x, y2, color );
+}
 
-        x       += 8;
-        basePtr += 8;
-        textPtr++;
+// Draw rectangle on the specified image with the specfied color (all coordinates are inclusive)
+XError XImageDrawing::Rectangle( const shared_ptr<const XImage>& image, int32_t x1, int32_t y1, int32_t x2, int32_t y2, xargb color )
+{
+    XError ret = Private::CheckImage( image );
+
+    if ( ret == XError::Success )
+    {
+        Private::DrawShape( image.get( ), Private::XRectangleShape( { x1, y1, x2, y2, false } ), color, color );
     }
+
+    return ret;
 }
 
-// Draw the specified text on 24/32 bpp color images
-void XDrawingText24( const shared_ptr<const XImage>& src, const string& text, int32_t x, int32_t y, xargb color, xargb background )
+// Fill rectangle on the specified image with the specified color (all coordinates are inclusive)
+XError XImageDrawing::FillRectangle( const shared_ptr<const XImage>& image, int32_t x1, int32_t y1, int32_t x2, int32_t y2, xargb color )
 {
-    int         width       = src->Width( );
-    int         height      = src->Height( );
-    int         stride      = src->Stride( );
-    int         yOffset     = ( y >= 0 ) ? 0 : -y;
-    int         endY        = ( y + 8 <= height ) ? 8 : height - y;
-    int         pixelSize   = ( src->Format( ) == XPixelFormat::RGB24 ) ? 3 : 4;
-    uint8_t*    basePtr     = src->Data( ) + y * stride + x * pixelSize;
-
-    uint8_t     textR       = color.components.r;
-    uint8_t     textG       = color.components.g;
-    uint8_t     textB       = color.components.b;
-    uint8_t     textA       = color.components.a;
-    float       textAlpha   = static_cast<float>( textA ) / 255.0f;
-    float       text1mAlpha = 1.0f - textAlpha;
-    float       textRA      = textAlpha * textR;
-    float       textGA      = textAlpha * textG;
-    float       textBA      = textAlpha * textB;
-
-    uint8_t     bgR         = background.components.r;
-    uint8_t     bgG         = background.components.g;
-    uint8_t     bgB         = background.components.b;
-    uint8_t     bgA         = background.components.a;
-    float       bgAlpha     = static_cast<float>( bgA ) / 255.0f;
-    float       bg1mAlpha   = 1.0f - bgAlpha;
-    float       bgRA        = bgAlpha * bgR;
-    float       bgGA        = bgAlpha * bgG;
-    float       bgBA        = bgAlpha * bgB;
-
-    const char* textPtr     = text.c_str( );
-
-    while ( *textPtr )
+    XError ret = Private::CheckImage( image );
+
+    if ( ret == XError::Success )
     {
-        if ( x >= width )
-        {
-            break;
-        }
+        Private::DrawShape( image.get( ), Private::XRectangleShape( { x1, y1, x2, y2, true } ), color, color );
+    }
 
-        if ( x > -8 )
+    return ret;
+}
+
+// Draw ASCII text on the image at the specified location
+XError XImageDrawing::PutText( const shared_ptr<const XImage>& image, const string& text, int32_t x, int32_t y, xargb color, xargb background, bool addBorder, int32_t scale )
+{
+    XError ret = Private::CheckImage( image );
+
+    if ( ret == XError::Success )
+    {
+        scale = max( 1, min( MAX_TEXT_SCALE, scale ) );
+
+        if ( ( !text.empty( ) ) && ( ( color.components.a != 0 ) || ( background.components.a != 0 ) ) )
         {
-            const uint8_t* symbolPtr = &( font8x8ext[*textPtr * 8] );
+            Private::DrawShape( image.get( ), Private::XTextShape( { text, x, y, addBorder, scale } ), color, background );
+        }
+    }
 
-            int      xOffset = ( x >= 0 ) ? 0 : -x;
-            uint8_t  mask    = 1 << ( 7 - xOffset );
-            int      sx, sy, tx;
+    return ret;
+}
 
-            for ( sy = yOffset; sy < endY; sy++ )
-            {
-                uint8_t  tempMask   = mask;
-                uint8_t  symbolLine = symbolPtr[sy];
-                uint8_t* imagePtr   = basePtr + sy * stride + xOffset * pixelSize;
+// Render ASCII text into a new RGBA32 image, which alpha channel keeps transparency of text/background
+shared_ptr<XImage> XImageDrawing::RenderText( const string& text, xargb color, xargb background, bool addBorder, int32_t scale )
+{
+    int32_t            len        = static_cast<int32_t>( text.length( ) );
+    int32_t            borderSize;
+    shared_ptr<XImage> image;
 
-                for ( sx = xOffset, tx = x + xOffset; ( sx < 8 ) && ( tx < width ); sx++, tx++ )
-                {
-                    if ( symbolLine & tempMask )
-                    {
-                        if ( textA == 255 )
-                        {
-                            imagePtr[RedIndex]   = textR;
-                            imagePtr[GreenIndex] = textG;
-                            imagePtr[BlueIndex]  = textB;
-                        }
-                        else
-                        {
-                            imagePtr[RedIndex]   = (uint8_t) ( textRA + ( imagePtr[RedIndex]   * text1mAlpha ) );
-                            imagePtr[GreenIndex] = (uint8_t) ( textGA + ( imagePtr[GreenIndex] * text1mAlpha ) );
-                            imagePtr[BlueIndex]  = (uint8_t) ( textBA + ( imagePtr[BlueIndex]  * text1mAlpha ) );
-                        }
-                    }
-                    else
-                    {
-                        if ( bgA == 255 )
-                        {
-                            imagePtr[RedIndex]   = bgR;
-                            imagePtr[GreenIndex] = bgG;
-                            imagePtr[BlueIndex]  = bgB;
-                        }
-                        else
-                        {
-                            imagePtr[RedIndex]   = (uint8_t) ( bgRA + ( imagePtr[RedIndex]   * bg1mAlpha ) );
-                            imagePtr[GreenIndex] = (uint8_t) ( bgGA + ( imagePtr[GreenIndex] * bg1mAlpha ) );
-                            imagePtr[BlueIndex]  = (uint8_t) ( bgBA + ( imagePtr[BlueIndex]  * bg1mAlpha ) );
-                        }
-                    }
+    scale      = max( 1, min( MAX_TEXT_SCALE, scale ) );
+    borderSize = ( addBorder ) ? 2 * scale : 0;
 
-                    tempMask >>= 1;
-                    imagePtr  += pixelSize;
-                }
-            }
-        }
+    if ( len != 0 )
+    {
+        image = XImage::Allocate( len * 8 * scale + borderSize * 2, 8 * scale + borderSize * 2, XPixelFormat::RGBA32 );
+    }
 
-        x       += 8;
-        basePtr += ( 8 * pixelSize );
-        textPtr++;
+    if ( image )
+    {
+        // raw painters set alpha of pixels as well, so the image gets transparency of the colors
+        Private::DrawText( Private::XPackedPainter<4>( image.get( ), color, true ), Private::XPackedPainter<4>( image.get( ), background, true ),
+                           text, 0, 0, addBorder, scale );
     }
+
+    return image;
 }
@@ -26,6 +26,8 @@
 #include "XImage.hpp"
 #include "XError.hpp"
 
+// Drawing on images of Grayscale8, RGB24, RGBA32, YUYV, UYVY, NV12 and I420 formats - YUV images are drawn
+// on directly, without converting them to RGB. Colors with alpha below 255 are blended with image's pixels.
 class XImageDrawing
 {
 public:
@@ -42,8 +44,16 @@ public:
     // Draw rectangle on the specified image with the specfied color (all coordinates are inclusive)
     static XError Rectangle( const std::shared_ptr<const XImage>& image, int32_t x1, int32_t y1, int32_t x2, int32_t y2, xargb color );
 
-    // Draw ASCII text on the image at the specified location
-    static XError PutText( const std::shared_ptr<const XImage>& image, const std::string& text, int32_t x, int32_t y, xargb color, xargb background, bool addBorder = true );
+    // Fill rectangle on the specified image with the specified color (all coordinates are inclusive)
+    static XError FillRectangle( const std::shared_ptr<const XImage>& image, int32_t x1, int32_t y1, int32_t x2, int32_t y2, xargb color );
+
+    // Draw ASCII text on the image at the specified location (8x8 font is scaled by the specified factor, up to 32)
+    static XError PutText( const std::shared_ptr<const XImage>& image, const std::string& text, int32_t x, int32_t y, xargb color, xargb background,
+                           bool addBorder = true, int32_t scale = 1 );
+
+    // Render ASCII text into a new RGBA32 image, which alpha channel keeps transparency of text/background
+    // (same look as PutText() gives, but the result can be cached and put on many images)
+    static std::shared_ptr<XImage> RenderText( const std::string& text, xargb color, xargb background, bool addBorder = true, int32_t scale = 1 );
 };
 
 #endif // XIMAGE_DRAWING_HPP
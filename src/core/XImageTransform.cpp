@@ -0,0 +1,373 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <string.h>
+#include <algorithm>
+
+#include "XImageTransform.hpp"
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && ( _M_IX86_FP >= 2 ) )
+    #define XIMAGE_TRANSFORM_SSE2
+    #include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// Size of tiles (in pixels) images are transposed in, so source and destination rows stay in cache
+#define TILE_SIZE (16)
+
+// Pixel of 3 bytes (RGB24) - only copied around
+struct XPixel24
+{
+    uint8_t Bytes[3];
+};
+
+// Transpose a rectangle of plane (with mirroring of source's axes) - dst( X, Y ) = src( x( Y ), y( X ) )
+template <typename Pixel> static void TransposeRect( const uint8_t* src, int32_t srcStride, int32_t width, int32_t height,
+                                                     uint8_t* dst, int32_t dstStride, bool mirrorX, bool mirrorY,
+                                                     int32_t x1, int32_t y1, int32_t x2, int32_t y2 )
+{
+    for ( int32_t ty = y1; ty < y2; ty += TILE_SIZE )
+    {
+        int32_t tyEnd = min( ty + TILE_SIZE, y2 );
+
+        for ( int32_t tx = x1; tx < x2; tx += TILE_SIZE )
+        {
+            int32_t txEnd = min( tx + TILE_SIZE, x2 );
+
+            for ( int32_t x = tx; x < txEnd; x++ )
+            {
+                Pixel* dstRow = reinterpret_cast<Pixel*>( dst + ( ( mirrorX ) ? width - 1 - x : x ) * dstStride );
+
+                for ( int32_t y = ty; y < tyEnd; y++ )
+                {
+                    dstRow[( mirrorY ) ? height - 1 - y : y] = reinterpret_cast<const Pixel*>( src + y * srcStride )[x];
+                }
+            }
+        }
+    }
+}
+
+template <typename Pixel> static void TransposePlane( const uint8_t* src, int32_t srcStride, int32_t width, int32_t height,
+                                                      uint8_t* dst, int32_t dstStride, bool mirrorX, bool mirrorY )
+{
+    TransposeRect<Pixel>( src, srcStride, width, height, dst, dstStride, mirrorX, mirrorY, 0, 0, width, height );
+}
+
+#ifdef XIMAGE_TRANSFORM_SSE2
+
+// Transpose block of 8x8 bytes - its columns are written to rows of destination, one step apart (negative step
+// mirrors source in X direction), while source rows are taken bottom up to mirror it in Y direction
+static inline void TransposeBlock8( const uint8_t* src, int32_t srcStride, uint8_t* dst, int32_t dstStep, bool mirrorY )
+{
+    __m128i r[8];
+
+    for ( int i = 0; i < 8; i++ )
+    {
+        r[i] = _mm_loadl_epi64( reinterpret_cast<const __m128i*>( src + ( ( mirrorY ) ? 7 - i : i ) * srcStride ) );
+    }
+
+    // pairs of rows, then quads - every 4 bytes of b0-b3 are a column of 4 rows
+    __m128i a0 = _mm_unpacklo_epi8( r[0], r[1] );
+    __m128i a1 = _mm_unpacklo_epi8( r[2], r[3] );
+    __m128i a2 = _mm_unpacklo_epi8( r[4], r[5] );
+    __m128i a3 = _mm_unpacklo_epi8( r[6], r[7] );
+    __m128i b0 = _mm_unpacklo_epi16( a0, a1 );
+    __m128i b1 = _mm_unpackhi_epi16( a0, a1 );
+    __m128i b2 = _mm_unpacklo_epi16( a2, a3 );
+    __m128i b3 = _mm_unpackhi_epi16( a2, a3 );
+    // complete columns - two per vector
+    __m128i c0 = _mm_unpacklo_epi32( b0, b2 );
+    __m128i c1 = _mm_unpackhi_epi32( b0, b2 );
+    __m128i c2 = _mm_unpacklo_epi32( b1, b3 );
+    __m128i c3 = _mm_unpackhi_epi32( b1, b3 );
+
+    _mm_storel_epi64( reinterpret_cast<__m128i*>( dst ), c0 );
+    _mm_storel_epi64( reinterpret_cast<__m128i*>( dst + dstStep ), _mm_srli_si128( c0, 8 ) );
+    _mm_storel_epi64( reinterpret_cast<__m128i*>( dst + 2 * dstStep ), c1 );
+    _mm_storel_epi64( reinterpret_cast<__m128i*>( dst + 3 * dstStep ), _mm_srli_si128( c1, 8 ) );
+    _mm_storel_epi64( reinterpret_cast<__m128i*>( dst + 4 * dstStep ), c2 );
+    _mm_storel_epi64( reinterpret_cast<__m128i*>( dst + 5 * dstStep ), _mm_srli_si128( c2, 8 ) );
+    _mm_storel_epi64( reinterpret_cast<__m128i*>( dst + 6 * dstStep ), c3 );
+    _mm_storel_epi64( reinterpret_cast<__m128i*>( dst + 7 * dstStep ), _mm_srli_si128( c3, 8 ) );
+}
+
+// 8 bit planes are transposed in 8x8 blocks (tile by tile), while the remaining right/bottom edges are done pixel by pixel
+template <> void TransposePlane<uint8_t>( const uint8_t* src, int32_t srcStride, int32_t width, int32_t height,
+                                          uint8_t* dst, int32_t dstStride, bool mirrorX, bool mirrorY )
+{
+    int32_t blocksWidth  = width  & ~7;
+    int32_t blocksHeight = height & ~7;
+    int32_t dstStep      = ( mirrorX ) ? -dstStride : dstStride;
+
+    for ( int32_t ty = 0; ty < blocksHeight; ty += TILE_SIZE )
+    {
+        int32_t tyEnd = min( ty + TILE_SIZE, blocksHeight );
+
+        for ( int32_t tx = 0; tx < blocksWidth; tx += TILE_SIZE )
+        {
+            int32_t txEnd = min( tx + TILE_SIZE, blocksWidth );
+
+            for ( int32_t y = ty; y < tyEnd; y += 8 )
+            {
+                int32_t dstX = ( mirrorY ) ? height - 8 - y : y;
+
+                for ( int32_t x = tx; x < txEnd; x += 8 )
+                {
+                    int32_t dstY = ( mirrorX ) ? width - 1 - x : x;
+
+                    TransposeBlock8( src + y * srcStride + x, srcStride, dst + dstY * dstStride + dstX, dstStep, mirrorY );
+                }
+            }
+        }
+    }
+
+    TransposeRect<uint8_t>( src, srcStride, width, height, dst, dstStride, mirrorX, mirrorY, blocksWidth, 0, width, height );
+    TransposeRect<uint8_t>( src, srcStride, width, height, dst, dstStride, mirrorX, mirrorY, 0, blocksHeight, blocksWidth, height );
+}
+
+#endif
+
+// Copy plane row by row (with mirroring in X and/or Y direction) - dst( X, Y ) = src( x( X ), y( Y ) )
+template <typename Pixel> static void CopyPlane( const uint8_t* src, int32_t srcStride, int32_t width, int32_t height,
+                                                 uint8_t* dst, int32_t dstStride, bool mirrorX, bool mirrorY )
+{
+    for ( int32_t y = 0; y < height; y++ )
+    {
+        const Pixel* srcRow = reinterpret_cast<const Pixel*>( src + ( ( mirrorY ) ? height - 1 - y : y ) * srcStride );
+        Pixel*       dstRow = reinterpret_cast<Pixel*>( dst + y * dstStride );
+
+        if ( !mirrorX )
+        {
+            memcpy( dstRow, srcRow, width * sizeof( Pixel ) );
+        }
+        else
+        {
+            for ( int32_t x = 0, sx = width - 1; x < width; x++, sx-- )
+            {
+                dstRow[x] = srcRow[sx];
+            }
+        }
+    }
+}
+
+// Transform region of a plane, which starts at the specified pointer
+template <typename Pixel> static void TransformPlane( const uint8_t* src, int32_t srcStride, int32_t width, int32_t height,
+                                                      uint8_t* dst, int32_t dstStride, bool transpose, bool mirrorX, bool mirrorY )
+{
+    if ( transpose )
+    {
+        TransposePlane<Pixel>( src, srcStride, width, height, dst, dstStride, mirrorX, mirrorY );
+    }
+    else
+    {
+        CopyPlane<Pixel>( src, srcStride, width, height, dst, dstStride, mirrorX, mirrorY );
+    }
+}
+
+// Copy rows of packed 4:2:2 image (pairs of pixels in 4 bytes) - mirroring in X direction reverses order of pairs
+// and swaps luma values inside of them
+static void CopyPackedYuvPlane( const uint8_t* src, int32_t srcStride, int32_t width, int32_t height,
+                                uint8_t* dst, int32_t dstStride, XPixelFormat format, bool mirrorX, bool mirrorY )
+{
+    int32_t pairs    = width / 2;
+    int32_t lumaBase = ( format == XPixelFormat::YUYV ) ? 0 : 1;
+
+    for ( int32_t y = 0; y < height; y++ )
+    {
+        const uint8_t* srcRow = src + ( ( mirrorY ) ? height - 1 - y : y ) * srcStride;
+        uint8_t*       dstRow = dst + y * dstStride;
+
+        if ( !mirrorX )
+        {
+            memcpy( dstRow, srcRow, pairs * 4 );
+        }
+        else
+        {
+            for ( int32_t i = 0; i < pairs; i++ )
+            {
+                const uint8_t* srcPair = srcRow + ( pairs - 1 - i ) * 4;
+                uint8_t*       dstPair = dstRow + i * 4;
+
+                dstPair[0] = srcPair[0];
+                dstPair[1] = srcPair[1];
+                dstPair[2] = srcPair[2];
+                dstPair[3] = srcPair[3];
+                dstPair[lumaBase]     = srcPair[lumaBase + 2];
+                dstPair[lumaBase + 2] = srcPair[lumaBase];
+            }
+        }
+    }
+}
+
+// Get orientation of transformed image in terms of source image's axes
+void XImageTransform::GetOrientation( XImageRotation rotation, bool flipHorizontal, bool* transpose, bool* mirrorX, bool* mirrorY )
+{
+    bool t  = ( ( rotation == XImageRotation::Rotate90 ) || ( rotation == XImageRotation::Rotate270 ) );
+    bool mx = ( ( rotation == XImageRotation::Rotate180 ) || ( rotation == XImageRotation::Rotate270 ) );
+    bool my = ( ( rotation == XImageRotation::Rotate90 ) || ( rotation == XImageRotation::Rotate180 ) );
+
+    // horizontal flip of transposed image mirrors source's Y axis
+    if ( flipHorizontal )
+    {
+        if ( t )
+        {
+            my = !my;
+        }
+        else
+        {
+            mx = !mx;
+        }
+    }
+
+    *transpose = t;
+    *mirrorX   = mx;
+    *mirrorY   = my;
+}
+
+// Check if images of the specified format can be transformed as requested
+bool XImageTransform::IsSupported( XPixelFormat format, const XImageTransformation& transformation )
+{
+    bool transpose = ( ( transformation.Rotation == XImageRotation::Rotate90 ) || ( transformation.Rotation == XImageRotation::Rotate270 ) );
+
+    return ( ( format == XPixelFormat::Grayscale8 ) || ( format == XPixelFormat::RGB24 ) || ( format == XPixelFormat::RGBA32 ) ||
+             ( format == XPixelFormat::I420 ) || ( format == XPixelFormat::NV12 ) ||
+             ( ( !transpose ) && ( ( format == XPixelFormat::YUYV ) || ( format == XPixelFormat::UYVY ) ) ) );
+}
+
+// Transform image - crop it to the region of interest, rotate and flip it
+XError XImageTransform::Transform( const shared_ptr<const XImage>& src, const XImageTransformation& transformation, shared_ptr<XImage>& dst )
+{
+    XError ret = XError::Success;
+
+    if ( ( !src ) || ( src->Data( ) == nullptr ) )
+    {
+        ret = XError::NullPointer;
+    }
+    else if ( !IsSupported( src->Format( ), transformation ) )
+    {
+        ret = XError::UnsupportedPixelFormat;
+    }
+    else
+    {
+        XPixelFormat format   = src->Format( );
+        bool         isYuv    = ( ( format == XPixelFormat::I420 ) || ( format == XPixelFormat::NV12 ) ||
+                                  ( format == XPixelFormat::YUYV ) || ( format == XPixelFormat::UYVY ) );
+        bool         is420    = ( ( format == XPixelFormat::I420 ) || ( format == XPixelFormat::NV12 ) );
+        int32_t      alignX   = ( isYuv ) ? 2 : 1;
+        int32_t      alignY   = ( is420 ) ? 2 : 1;
+        int32_t      width    = ( transformation.Width  <= 0 ) ? src->Width( )  : transformation.Width;
+        int32_t      height   = ( transformation.Height <= 0 ) ? src->Height( ) : transformation.Height;
+        // clip region to image and align it to chroma samples (rounding size down at image's edges)
+        int32_t      x1       = min( max( transformation.X, 0 ), src->Width( ) )  / alignX * alignX;
+        int32_t      y1       = min( max( transformation.Y, 0 ), src->Height( ) ) / alignY * alignY;
+        int32_t      x2       = min( max( transformation.X, 0 ) + width,  src->Width( ) );
+        int32_t      y2       = min( max( transformation.Y, 0 ) + height, src->Height( ) );
+        bool         transpose, mirrorX, mirrorY;
+
+        x2     = min( ( x2 + alignX - 1 ) / alignX * alignX, src->Width( )  / alignX * alignX );
+        y2     = min( ( y2 + alignY - 1 ) / alignY * alignY, src->Height( ) / alignY * alignY );
+        width  = x2 - x1;
+        height = y2 - y1;
+
+        GetOrientation( transformation.Rotation, transformation.FlipHorizontal, &transpose, &mirrorX, &mirrorY );
+
+        if ( ( width <= 0 ) || ( height <= 0 ) )
+        {
+            ret = XError::ImageParametersMismatch;
+        }
+        else
+        {
+            int32_t dstWidth  = ( transpose ) ? height : width;
+            int32_t dstHeight = ( transpose ) ? width  : height;
+
+            if ( ( !dst ) || ( dst->Width( ) != dstWidth ) || ( dst->Height( ) != dstHeight ) || ( dst->Format( ) != format ) )
+            {
+                dst = XImage::Allocate( dstWidth, dstHeight, format );
+            }
+
+            if ( !dst )
+            {
+                ret = XError::OutOfMemory;
+            }
+            else
+            {
+                const uint8_t* srcData   = src->PlaneData( 0 );
+                int32_t        srcStride = src->PlaneStride( 0 );
+                uint8_t*       dstData   = dst->PlaneData( 0 );
+                int32_t        dstStride = dst->PlaneStride( 0 );
+
+                switch ( format )
+                {
+                case XPixelFormat::Grayscale8:
+                    TransformPlane<uint8_t>( srcData + y1 * srcStride + x1, srcStride, width, height,
+                                             dstData, dstStride, transpose, mirrorX, mirrorY );
+                    break;
+
+                case XPixelFormat::RGB24:
+                    TransformPlane<XPixel24>( srcData + y1 * srcStride + x1 * 3, srcStride, width, height,
+                                              dstData, dstStride, transpose, mirrorX, mirrorY );
+                    break;
+
+                case XPixelFormat::RGBA32:
+                    TransformPlane<uint32_t>( srcData + y1 * srcStride + x1 * 4, srcStride, width, height,
+                                              dstData, dstStride, transpose, mirrorX, mirrorY );
+                    break;
+
+                case XPixelFormat::YUYV:
+                case XPixelFormat::UYVY:
+                    CopyPackedYuvPlane( srcData + y1 * srcStride + x1 * 2, srcStride, width, height,
+                                        dstData, dstStride, format, mirrorX, mirrorY );
+                    break;
+
+                case XPixelFormat::I420:
+                case XPixelFormat::NV12:
+                    TransformPlane<uint8_t>( srcData + y1 * srcStride + x1, srcStride, width, height,
+                                             dstData, dstStride, transpose, mirrorX, mirrorY );
+
+                    // chroma planes are half the size of luma plane - U/V are interleaved in NV12 (2 bytes per sample)
+                    for ( int32_t plane = 1; plane < src->Planes( ); plane++ )
+                    {
+                        const uint8_t* srcChroma       = src->PlaneData( plane );
+                        int32_t        srcChromaStride = src->PlaneStride( plane );
+
+                        if ( format == XPixelFormat::I420 )
+                        {
+                            TransformPlane<uint8_t>( srcChroma + y1 / 2 * srcChromaStride + x1 / 2, srcChromaStride, width / 2, height / 2,
+                                                     dst->PlaneData( plane ), dst->PlaneStride( plane ), transpose, mirrorX, mirrorY );
+                        }
+                        else
+                        {
+                            TransformPlane<uint16_t>( srcChroma + y1 / 2 * srcChromaStride + x1, srcChromaStride, width / 2, height / 2,
+                                                      dst->PlaneData( plane ), dst->PlaneStride( plane ), transpose, mirrorX, mirrorY );
+                        }
+                    }
+                    break;
+
+                default:
+                    ret = XError::UnsupportedPixelFormat;
+                    break;
+                }
+            }
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,79 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XIMAGE_TRANSFORM_HPP
+#define XIMAGE_TRANSFORM_HPP
+
+#include "XImage.hpp"
+#include "XError.hpp"
+
+// Rotation of images (clockwise)
+enum class XImageRotation
+{
+    None      = 0,
+    Rotate90  = 90,
+    Rotate180 = 180,
+    Rotate270 = 270
+};
+
+// Transformation of images - region of interest to crop (in coordinates of source image; zero
+// width/height means entire image), followed by rotation and then by horizontal flip
+struct XImageTransformation
+{
+    int32_t        X;
+    int32_t        Y;
+    int32_t        Width;
+    int32_t        Height;
+    XImageRotation Rotation;
+    bool           FlipHorizontal;
+};
+
+// Cropping, rotation and flipping of uncompressed images. Rotations by 90/270 degrees are done
+// in cache sized tiles (blocks of 8x8 bytes are transposed with SSE2, when available).
+class XImageTransform
+{
+public:
+    XImageTransform( ) = delete;
+
+public:
+    /* Get orientation of transformed image in terms of source image's axes
+
+       Any rotation/flip is a transposition (swap of X and Y axes), done
+       after mirroring source image in X and/or Y direction. If transposed,
+       column X of transformed image is row X of source image (mirrored or
+       not), so source's width becomes height.
+    */
+    static void GetOrientation( XImageRotation rotation, bool flipHorizontal, bool* transpose, bool* mirrorX, bool* mirrorY );
+
+    // Check if images of the specified format can be transformed as requested (packed YUV
+    // formats can not be transposed, while Bayer/16 bit formats are not supported at all)
+    static bool IsSupported( XPixelFormat format, const XImageTransformation& transformation );
+
+    /* Transform image - crop it to the region of interest, rotate and flip it
+
+       Region of interest is clipped to image's size and aligned to 2 pixels
+       for YUV formats (chroma subsampling). Destination image is allocated
+       only if it is null or its size/format does not match.
+    */
+    static XError Transform( const std::shared_ptr<const XImage>& src, const XImageTransformation& transformation,
+                             std::shared_ptr<XImage>& dst );
+};
+
+#endif // XIMAGE_TRANSFORM_HPP
@@ -0,0 +1,410 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "XJpegDecoder.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <exception>
+#include <jpeglib.h>
+
+using namespace std;
+
+namespace Private
+{
+    // Maximum number of rows to read from decompressor at once
+    #define MAX_READ_ROWS   (16)
+
+    class JpegDecodeException : public exception
+    {
+    public:
+        virtual const char* what( ) const throw( )
+        {
+            return "JPEG decoding failure";
+        }
+    };
+
+    static void decoder_error_exit( j_common_ptr /* cinfo */ )
+    {
+        throw JpegDecodeException( );
+    }
+
+    static void decoder_output_message( j_common_ptr /* cinfo */ )
+    {
+        // do nothing - kill the message
+    }
+
+    class XJpegDecoderData
+    {
+    public:
+        bool                          FasterDecompression;
+    private:
+        struct jpeg_decompress_struct dinfo;
+        struct jpeg_error_mgr         jerr;
+        vector<uint8_t>               RowsBuffer;   // YCbCr rows to make I420 image of
+
+    public:
+        XJpegDecoderData( bool fasterDecompression ) :
+            FasterDecompression( fasterDecompression ), RowsBuffer( )
+        {
+            // allocate and initialize JPEG decompression object
+            dinfo.err           = jpeg_std_error( &jerr );
+            jerr.error_exit     = decoder_error_exit;
+            jerr.output_message = decoder_output_message;
+
+            jpeg_create_decompress( &dinfo );
+        }
+
+        ~XJpegDecoderData( )
+        {
+            jpeg_destroy_decompress( &dinfo );
+        }
+
+        XError Decode( const uint8_t* jpegData, uint32_t jpegSize, shared_ptr<XImage>& image, XPixelFormat format, XJpegScale scale );
+
+    private:
+        void ReadRows( const shared_ptr<XImage>& image );
+        void ReadYuvRows( const shared_ptr<XImage>& image );
+        void ReadRawYuvRows( const shared_ptr<XImage>& image );
+        bool IsYuv420( ) const;
+    };
+}
+
+XJpegDecoder::XJpegDecoder( bool fasterDecompression ) :
+    mData( new Private::XJpegDecoderData( fasterDecompression ) )
+{
+
+}
+
+XJpegDecoder::~XJpegDecoder( )
+{
+    delete mData;
+}
+
+// Set/get faster decompression flag
+bool XJpegDecoder::FasterDecompression( ) const
+{
+    return mData->FasterDecompression;
+}
+void XJpegDecoder::SetFasterDecompression( bool faster )
+{
+    mData->FasterDecompression = faster;
+}
+
+// Decode JPEG image into image of the specified format
+XError XJpegDecoder::Decode( const uint8_t* jpegData, uint32_t jpegSize, shared_ptr<XImage>& image, XPixelFormat format, XJpegScale scale )
+{
+    return mData->Decode( jpegData, jpegSize, image, format, scale );
+}
+
+// Decode JPEG image, which is kept in XImage of JPEG format
+XError XJpegDecoder::Decode( const shared_ptr<const XImage>& jpegImage, shared_ptr<XImage>& image, XPixelFormat format, XJpegScale scale )
+{
+    XError ret = XError::Success;
+
+    if ( ( !jpegImage ) || ( jpegImage->Data( ) == nullptr ) )
+    {
+        ret = XError::NullPointer;
+    }
+    else if ( jpegImage->Format( ) != XPixelFormat::JPEG )
+    {
+        ret = XError::UnsupportedPixelFormat;
+    }
+    else
+    {
+        // width of JPEG image is the size of its data
+        ret = mData->Decode( jpegImage->Data( ), static_cast<uint32_t>( jpegImage->Width( ) ), image, format, scale );
+    }
+
+    return ret;
+}
+
+namespace Private
+{
+
+// Decode JPEG image, allocating new image only if size/format of the provided one does not match
+XError XJpegDecoderData::Decode( const uint8_t* jpegData, uint32_t jpegSize, shared_ptr<XImage>& image, XPixelFormat format, XJpegScale scale )
+{
+    XError ret = XError::Success;
+
+    if ( jpegData == nullptr )
+    {
+        ret = XError::NullPointer;
+    }
+    else if ( ( format != XPixelFormat::Grayscale8 ) && ( format != XPixelFormat::RGB24 ) && ( format != XPixelFormat::I420 ) )
+    {
+        ret = XError::UnsupportedPixelFormat;
+    }
+    else
+    {
+        try
+        {
+            jpeg_mem_src( &dinfo, const_cast<uint8_t*>( jpegData ), static_cast<unsigned long>( jpegSize ) );
+            jpeg_read_header( &dinfo, TRUE );
+
+            dinfo.scale_num           = 1;
+            dinfo.scale_denom         = static_cast<unsigned int>( scale );
+            dinfo.dct_method          = ( FasterDecompression ) ? JDCT_IFAST : JDCT_ISLOW;
+            dinfo.do_fancy_upsampling = ( FasterDecompression ) ? FALSE : TRUE;
+
+            // YUV images are made of YCbCr rows (grayscale JPEGs give luma only)
+            if ( format == XPixelFormat::Grayscale8 )
+            {
+                dinfo.out_color_space = JCS_GRAYSCALE;
+            }
+            else if ( format == XPixelFormat::RGB24 )
+            {
+                dinfo.out_color_space = JCS_RGB;
+            }
+            else
+            {
+                dinfo.out_color_space = ( dinfo.jpeg_color_space == JCS_GRAYSCALE ) ? JCS_GRAYSCALE : JCS_YCbCr;
+                // 4:2:0 JPEGs (most of MJPEG cameras) are I420 already - take their planes as they are
+                dinfo.raw_data_out    = ( IsYuv420( ) ) ? TRUE : FALSE;
+            }
+
+            jpeg_start_decompress( &dinfo );
+
+            int32_t width  = static_cast<int32_t>( dinfo.output_width );
+            int32_t height = static_cast<int32_t>( dinfo.output_height );
+
+            if ( ( !image ) || ( image->Width( ) != width ) || ( image->Height( ) != height ) || ( image->Format( ) != format ) )
+            {
+                image = XImage::Allocate( width, height, format );
+            }
+
+            if ( !image )
+            {
+                jpeg_abort_decompress( &dinfo );
+                ret = XError::OutOfMemory;
+            }
+            else
+            {
+                if ( dinfo.raw_data_out )
+                {
+                    ReadRawYuvRows( image );
+                }
+                else if ( format == XPixelFormat::I420 )
+                {
+                    ReadYuvRows( image );
+                }
+                else
+                {
+                    ReadRows( image );
+                }
+
+                jpeg_finish_decompress( &dinfo );
+            }
+        }
+        catch ( const JpegDecodeException& )
+        {
+            jpeg_abort_decompress( &dinfo );
+            ret = XError::FailedImageDecoding;
+        }
+    }
+
+    return ret;
+}
+
+// Read decoded rows straight into grayscale/RGB image
+void XJpegDecoderData::ReadRows( const shared_ptr<XImage>& image )
+{
+    JSAMPROW rows[MAX_READ_ROWS];
+    uint8_t* data   = image->Data( );
+    int32_t  stride = image->Stride( );
+
+    while ( dinfo.output_scanline < dinfo.output_height )
+    {
+        JDIMENSION rowsCount = min( dinfo.output_height - dinfo.output_scanline, static_cast<JDIMENSION>( MAX_READ_ROWS ) );
+
+        for ( JDIMENSION i = 0; i < rowsCount; i++ )
+        {
+            rows[i] = data + ( dinfo.output_scanline + i ) * stride;
+        }
+
+        jpeg_read_scanlines( &dinfo, rows, rowsCount );
+    }
+}
+
+// Read decoded rows in pairs and make I420 image of them - luma is copied as is, while
+// chroma is averaged over 2x2 pixels (it is set to 128 for grayscale JPEGs)
+void XJpegDecoderData::ReadYuvRows( const shared_ptr<XImage>& image )
+{
+    int32_t  width       = image->Width( );
+    int32_t  height      = image->Height( );
+    int32_t  components  = dinfo.output_components;
+    int32_t  rowSize     = width * components;
+    uint8_t* yPlane      = image->PlaneData( 0 );
+    uint8_t* uPlane      = image->PlaneData( 1 );
+    uint8_t* vPlane      = image->PlaneData( 2 );
+    int32_t  yStride     = image->PlaneStride( 0 );
+    int32_t  uvStride    = image->PlaneStride( 1 );
+    int32_t  chromaWidth = ( width + 1 ) / 2;
+
+    RowsBuffer.resize( 2 * rowSize );
+
+    for ( int32_t y = 0; y < height; y += 2 )
+    {
+        JSAMPROW rows[2] = { RowsBuffer.data( ), RowsBuffer.data( ) + rowSize };
+        bool     hasPair = ( y + 1 < height );
+
+        jpeg_read_scanlines( &dinfo, &rows[0], 1 );
+
+        if ( hasPair )
+        {
+            jpeg_read_scanlines( &dinfo, &rows[1], 1 );
+        }
+        else
+        {
+            // the last row of odd height image is paired with itself
+            rows[1] = rows[0];
+        }
+
+        uint8_t* uRow = uPlane + ( y / 2 ) * uvStride;
+        uint8_t* vRow = vPlane + ( y / 2 ) * uvStride;
+
+        if ( components == 1 )
+        {
+            memcpy( yPlane + y * yStride, rows[0], width );
+            if ( hasPair )
+            {
+                memcpy( yPlane + ( y + 1 ) * yStride, rows[1], width );
+            }
+
+            memset( uRow, 128, chromaWidth );
+            memset( vRow, 128, chromaWidth );
+        }
+        else
+        {
+            for ( int r = 0; r < ( hasPair ? 2 : 1 ); r++ )
+            {
+                const uint8_t* src = rows[r];
+                uint8_t*       dst = yPlane + ( y + r ) * yStride;
+
+                for ( int32_t x = 0; x < width; x++, src += 3 )
+                {
+                    dst[x] = src[0];
+                }
+            }
+
+            for ( int32_t cx = 0; cx < chromaWidth; cx++ )
+            {
+                // the last column of odd width image is paired with itself
+                int32_t x1 = 2 * cx * 3;
+                int32_t x2 = ( 2 * cx + 1 < width ) ? x1 + 3 : x1;
+
+                uRow[cx] = static_cast<uint8_t>( ( rows[0][x1 + 1] + rows[0][x2 + 1] + rows[1][x1 + 1] + rows[1][x2 + 1] + 2 ) >> 2 );
+                vRow[cx] = static_cast<uint8_t>( ( rows[0][x1 + 2] + rows[0][x2 + 2] + rows[1][x1 + 2] + rows[1][x2 + 2] + 2 ) >> 2 );
+            }
+        }
+    }
+}
+
+// Check if JPEG image is YCbCr with chroma subsampled 2x in both directions
+bool XJpegDecoderData::IsYuv420( ) const
+{
+    return ( ( dinfo.jpeg_color_space == JCS_YCbCr ) && ( dinfo.num_components == 3 ) &&
+             ( dinfo.comp_info[0].h_samp_factor == 2 ) && ( dinfo.comp_info[0].v_samp_factor == 2 ) &&
+             ( dinfo.comp_info[1].h_samp_factor == 1 ) && ( dinfo.comp_info[1].v_samp_factor == 1 ) &&
+             ( dinfo.comp_info[2].h_samp_factor == 1 ) && ( dinfo.comp_info[2].v_samp_factor == 1 ) );
+}
+
+// Read raw (not upsampled and not color converted) planes of 4:2:0 JPEG image into I420 image.
+// Decompressor gives complete MCU rows of all components, which are cropped to image size. When
+// decoding at reduced scale, chroma may be given at luma's resolution - it is averaged over 2x2 then.
+void XJpegDecoderData::ReadRawYuvRows( const shared_ptr<XImage>& image )
+{
+#if JPEG_LIB_VERSION >= 70
+    int32_t    lumaBlockSize   = dinfo.min_DCT_h_scaled_size;
+    int32_t    chromaBlockSize = dinfo.comp_info[1].DCT_h_scaled_size;
+#else
+    int32_t    lumaBlockSize   = dinfo.min_DCT_scaled_size;
+    int32_t    chromaBlockSize = dinfo.comp_info[1].DCT_scaled_size;
+#endif
+    int32_t    width           = image->Width( );
+    int32_t    height          = image->Height( );
+    int32_t    chromaWidth     = ( width + 1 ) / 2;
+    bool       fullChroma      = ( chromaBlockSize != lumaBlockSize );
+    int32_t    lumaRowSize     = dinfo.comp_info[0].width_in_blocks * lumaBlockSize;
+    int32_t    chromaRowSize   = dinfo.comp_info[1].width_in_blocks * chromaBlockSize;
+    int32_t    lumaLines       = 2 * lumaBlockSize;
+    int32_t    chromaLines     = chromaBlockSize;
+    JSAMPROW   yRows[2 * DCTSIZE];
+    JSAMPROW   uRows[DCTSIZE];
+    JSAMPROW   vRows[DCTSIZE];
+    JSAMPARRAY planes[3]       = { yRows, uRows, vRows };
+    uint8_t*   buffer;
+
+    RowsBuffer.resize( lumaLines * lumaRowSize + 2 * chromaLines * chromaRowSize );
+    buffer = RowsBuffer.data( );
+
+    for ( int32_t i = 0; i < lumaLines; i++ )
+    {
+        yRows[i] = buffer + i * lumaRowSize;
+    }
+    for ( int32_t i = 0; i < chromaLines; i++ )
+    {
+        uRows[i] = buffer + lumaLines * lumaRowSize + i * chromaRowSize;
+        vRows[i] = uRows[i] + chromaLines * chromaRowSize;
+    }
+
+    while ( dinfo.output_scanline < dinfo.output_height )
+    {
+        int32_t y          = static_cast<int32_t>( dinfo.output_scanline );
+        int32_t linesCount = min( height - y, lumaLines );
+
+        jpeg_read_raw_data( &dinfo, planes, static_cast<JDIMENSION>( lumaLines ) );
+
+        for ( int32_t i = 0; i < linesCount; i++ )
+        {
+            memcpy( image->PlaneData( 0 ) + ( y + i ) * image->PlaneStride( 0 ), yRows[i], width );
+        }
+
+        for ( int32_t i = 0; i < ( linesCount + 1 ) / 2; i++ )
+        {
+            uint8_t* uRow = image->PlaneData( 1 ) + ( y / 2 + i ) * image->PlaneStride( 1 );
+            uint8_t* vRow = image->PlaneData( 2 ) + ( y / 2 + i ) * image->PlaneStride( 2 );
+
+            if ( !fullChroma )
+            {
+                memcpy( uRow, uRows[i], chromaWidth );
+                memcpy( vRow, vRows[i], chromaWidth );
+            }
+            else
+            {
+                // padding of MCU rows lets to average the last row/column of odd size image as well
+                const uint8_t* u1 = uRows[i * 2];
+                const uint8_t* u2 = uRows[i * 2 + 1];
+                const uint8_t* v1 = vRows[i * 2];
+                const uint8_t* v2 = vRows[i * 2 + 1];
+
+                for ( int32_t x = 0, x2 = 0; x < chromaWidth; x++, x2 += 2 )
+                {
+                    uRow[x] = static_cast<uint8_t>( ( u1[x2] + u1[x2 + 1] + u2[x2] + u2[x2 + 1] + 2 ) >> 2 );
+                    vRow[x] = static_cast<uint8_t>( ( v1[x2] + v1[x2 + 1] + v2[x2] + v2[x2 + 1] + 2 ) >> 2 );
+                }
+            }
+        }
+    }
+}
+
+} // namespace Private
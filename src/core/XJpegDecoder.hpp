@@ -0,0 +1,73 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XJPEG_DECODER_HPP
+#define XJPEG_DECODER_HPP
+
+#include <stdint.h>
+
+#include "XInterfaces.hpp"
+#include "XImage.hpp"
+#include "XError.hpp"
+
+namespace Private
+{
+    class XJpegDecoderData;
+}
+
+// Scale factor to decode JPEG images at - scaling is done by inverse DCT, so
+// smaller images are decoded faster and don't need resizing afterwards
+enum class XJpegScale
+{
+    Full    = 1,
+    Half    = 2,
+    Quarter = 4,
+    Eighth  = 8
+};
+
+class XJpegDecoder : private Uncopyable
+{
+public:
+    XJpegDecoder( bool fasterDecompression = false );
+    ~XJpegDecoder( );
+
+    // Set/get faster decompression (less accurate inverse DCT and no smooth upsampling of chroma)
+    bool FasterDecompression( ) const;
+    void SetFasterDecompression( bool faster );
+
+    /* Decode JPEG image into image of the specified format (Grayscale8, RGB24 or I420)
+
+       Decoding context is kept between calls and so is the decoded
+       image - it is allocated only if it is null or its size/format
+       does not match the decoded one. Size of the decoded image is
+       size of JPEG image divided by the scale factor (rounded up).
+    */
+    XError Decode( const uint8_t* jpegData, uint32_t jpegSize, std::shared_ptr<XImage>& image,
+                   XPixelFormat format = XPixelFormat::RGB24, XJpegScale scale = XJpegScale::Full );
+
+    // Decode JPEG image, which is kept in XImage of JPEG format
+    XError Decode( const std::shared_ptr<const XImage>& jpegImage, std::shared_ptr<XImage>& image,
+                   XPixelFormat format = XPixelFormat::RGB24, XJpegScale scale = XJpegScale::Full );
+
+private:
+    Private::XJpegDecoderData* mData;
+};
+
+#endif // XJPEG_DECODER_HPP
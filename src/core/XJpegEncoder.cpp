@@ -21,12 +21,33 @@
 #include "XJpegEncoder.hpp"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include <jpeglib.h>
 
+#include "XImageConversion.hpp"
+#include "XAutoGainMapper.hpp"
+#include "XTracer.hpp"
+
 using namespace std;
+using namespace std::chrono;
 
 namespace Private
 {
+    // Images of at least this many pixels are encoded in strips, if more than one thread is allowed
+    #define STRIPS_MIN_PIXELS   (1000000)
+    // Height of strips must be a multiple of MCU height, which is 16 at most
+    #define STRIP_HEIGHT_ALIGN  (16)
+    // Initial size of the buffer to encode images into while benchmarking profiles
+    #define JPEG_BENCHMARK_BUFFER (1024 * 1024)
+
     class JpegException : public exception
     {
     public:
@@ -51,13 +72,38 @@ namespace Private
     public:
         uint16_t                    Quality;
         bool                        FasterCompression;
+        uint32_t                    ThreadCount;
+        XJpegSubsampling            Subsampling;
+        bool                        OptimizeCoding;
+        uint16_t                    RestartInterval;
     private:
         struct jpeg_compress_struct cinfo;
         struct jpeg_error_mgr       jerr;
+        vector<uint8_t>             RawBuffer;
+        shared_ptr<XImage>          ConvertedImage;
+        XAutoGainMapper             AutoGain;
+        vector<unique_ptr<XJpegEncoderData>> StripEncoders;
+        uint8_t*                    StripBuffer;    // encoded strip, when used as strip encoder
+        uint32_t                    StripBufferSize;
+        uint32_t                    StripSize;
+        // worker thread of strip encoder, which is kept running between frames, waiting for the next strip
+        thread                      StripThread;
+        mutex                       StripSync;
+        condition_variable          StripSignal;
+        shared_ptr<const XImage>    StripImage;
+        int32_t                     StripFirstRow;
+        int32_t                     StripRowCount;
+        bool                        StripPending;
+        bool                        StripExit;
+        XError                      StripResult;
 
     public:
         XJpegEncoderData( uint16_t quality, bool fasterCompression) :
-            Quality( quality ), FasterCompression( fasterCompression  )
+            Quality( quality ), FasterCompression( fasterCompression  ), ThreadCount( 1 ),
+            Subsampling( XJpegSubsampling::Yuv420 ), OptimizeCoding( false ), RestartInterval( 0 ), RawBuffer( ), ConvertedImage( ), AutoGain( ),
+            StripEncoders( ), StripBuffer( nullptr ), StripBufferSize( 0 ), StripSize( 0 ),
+            StripThread( ), StripSync( ), StripSignal( ), StripImage( ), StripFirstRow( 0 ), StripRowCount( 0 ),
+            StripPending( false ), StripExit( false ), StripResult( XError::Success )
         {
             if ( Quality > 100 )
             {
@@ -74,11 +120,57 @@ namespace Private
 
         ~XJpegEncoderData( )
         {
+            if ( StripThread.joinable( ) )
+            {
+                {
+                    lock_guard<mutex> lock( StripSync );
+                    StripExit = true;
+                }
+                StripSignal.notify_all( );
+                StripThread.join( );
+            }
+
             jpeg_destroy_compress( &cinfo );
+
+            if ( StripBuffer != nullptr )
+            {
+                free( StripBuffer );
+            }
         }
 
-        XError EncodeToMemory( const shared_ptr<const XImage>& image, uint8_t** buffer, uint32_t* bufferSize );
+        XError Encode( const shared_ptr<const XImage>& image, uint8_t** buffer, uint32_t* bufferSize );
+
+    private:
+        XError EncodeToMemory( const shared_ptr<const XImage>& image, int32_t firstRow, int32_t rowCount, uint8_t** buffer, uint32_t* bufferSize );
+        void WriteRawData( const shared_ptr<const XImage>& image, int32_t firstRow, int32_t rowCount );
+        XError EncodeInStrips( const shared_ptr<const XImage>& image, int32_t stripHeight, uint8_t** buffer, uint32_t* bufferSize );
+        XError EncodeStrip( const shared_ptr<const XImage>& image, int32_t firstRow, int32_t rowCount );
+        void StartStrip( const shared_ptr<const XImage>& image, int32_t firstRow, int32_t rowCount );
+        XError WaitStrip( );
+        void StripThreadHandler( );
     };
+
+    // Location of the parts of an encoded JPEG image, which are needed to join strips
+    struct JpegLayout
+    {
+        uint32_t HeightOffset;  // offset of image height in SOF segment
+        uint32_t SosOffset;     // offset of SOS marker
+        uint32_t DataOffset;    // offset of entropy coded data following SOS segment
+        uint32_t DataEnd;       // end of entropy coded data (EOI marker)
+        uint32_t McuWidth;
+        uint32_t McuHeight;
+    };
+
+    static bool ParseJpegLayout( const uint8_t* jpeg, uint32_t size, JpegLayout* layout );
+
+    // Copy a row of samples into the provided buffer and pad it to the required size by repeating the last sample
+    static uint8_t* PadRow( const uint8_t* src, int32_t size, int32_t paddedSize, uint8_t* dst )
+    {
+        copy( src, src + size, dst );
+        fill( dst + size, dst + paddedSize, src[size - 1] );
+
+        return dst;
+    }
 }
 
 XJpegEncoder::XJpegEncoder( uint16_t quality, bool fasterCompression ) :
@@ -104,6 +196,16 @@ void XJpegEncoder::SetQuality( uint16_t quality )
     if ( mData->Quality < 1   ) mData->Quality = 1;
 }
 
+// Set/get number of threads used to encode large images
+uint32_t XJpegEncoder::ThreadCount( ) const
+{
+    return mData->ThreadCount;
+}
+void XJpegEncoder::SetThreadCount( uint32_t threadCount )
+{
+    mData->ThreadCount = ( threadCount == 0 ) ? 1 : threadCount;
+}
+
 // Set/get faster compression (but less accurate) flag
 bool XJpegEncoder::FasterCompression( ) const
 {
@@ -114,16 +216,496 @@ void XJpegEncoder::SetFasterCompression( bool faster )
     mData->FasterCompression = faster;
 }
 
+// Set/get chroma subsampling of RGB images
+XJpegSubsampling XJpegEncoder::Subsampling( ) const
+{
+    return mData->Subsampling;
+}
+void XJpegEncoder::SetSubsampling( XJpegSubsampling subsampling )
+{
+    mData->Subsampling = subsampling;
+}
+
+// Set/get optimization of Huffman tables
+bool XJpegEncoder::OptimizeCoding( ) const
+{
+    return mData->OptimizeCoding;
+}
+void XJpegEncoder::SetOptimizeCoding( bool optimize )
+{
+    mData->OptimizeCoding = optimize;
+}
+
+// Set/get number of MCU rows between restart markers
+uint16_t XJpegEncoder::RestartInterval( ) const
+{
+    return mData->RestartInterval;
+}
+void XJpegEncoder::SetRestartInterval( uint16_t mcuRows )
+{
+    mData->RestartInterval = mcuRows;
+}
+
+// Set encoder parameters as defined by the specified profile
+void XJpegEncoder::SetProfile( XJpegProfile profile )
+{
+    switch ( profile )
+    {
+    case XJpegProfile::SnapshotSmall:
+        mData->Subsampling       = XJpegSubsampling::Yuv420;
+        mData->FasterCompression = false;
+        mData->OptimizeCoding    = true;
+        mData->RestartInterval   = 0;
+        break;
+
+    case XJpegProfile::ArchiveQuality:
+        mData->Subsampling       = XJpegSubsampling::Yuv444;
+        mData->FasterCompression = false;
+        mData->OptimizeCoding    = true;
+        mData->RestartInterval   = 1;
+        break;
+
+    default:
+        mData->Subsampling       = XJpegSubsampling::Yuv420;
+        mData->FasterCompression = true;
+        mData->OptimizeCoding    = false;
+        mData->RestartInterval   = 0;
+        break;
+    }
+}
+
+// Get name of the profile
+const char* XJpegEncoder::ProfileName( XJpegProfile profile )
+{
+    const char* name = "live-fast";
+
+    if ( profile == XJpegProfile::SnapshotSmall )
+    {
+        name = "snapshot-small";
+    }
+    else if ( profile == XJpegProfile::ArchiveQuality )
+    {
+        name = "archive-quality";
+    }
+
+    return name;
+}
+
+// Find the profile by its name
+bool XJpegEncoder::ProfileFromName( const string& name, XJpegProfile* profile )
+{
+    static const XJpegProfile profiles[] = { XJpegProfile::LiveFast, XJpegProfile::SnapshotSmall, XJpegProfile::ArchiveQuality };
+    bool found = false;
+
+    for ( XJpegProfile p : profiles )
+    {
+        if ( name == ProfileName( p ) )
+        {
+            *profile = p;
+            found    = true;
+            break;
+        }
+    }
+
+    return found;
+}
+
+// Encode the specified image with every profile and measure average time and size
+XError XJpegEncoder::BenchmarkProfiles( const shared_ptr<const XImage>& image, uint16_t quality, uint32_t iterations,
+                                        vector<XJpegProfileBenchmark>& results )
+{
+    static const XJpegProfile profiles[] = { XJpegProfile::LiveFast, XJpegProfile::SnapshotSmall, XJpegProfile::ArchiveQuality };
+    XJpegEncoder encoder( quality );
+    uint32_t     bufferSize = JPEG_BENCHMARK_BUFFER;
+    uint8_t*     buffer     = static_cast<uint8_t*>( malloc( bufferSize ) );
+    XError       ret        = ( buffer == nullptr ) ? XError::OutOfMemory : XError::Success;
+
+    results.clear( );
+
+    if ( iterations == 0 )
+    {
+        iterations = 1;
+    }
+
+    for ( size_t i = 0; ( i < sizeof( profiles ) / sizeof( profiles[0] ) ) && ( ret ); i++ )
+    {
+        XJpegProfileBenchmark result = { profiles[i], 0.0f, 0 };
+        steady_clock::time_point startTime;
+
+        encoder.SetProfile( profiles[i] );
+
+        // the first run is not measured - it allocates buffers of the encoder
+        for ( uint32_t run = 0; ( run <= iterations ) && ( ret ); run++ )
+        {
+            uint8_t* oldBuffer   = buffer;
+            uint32_t encodedSize = bufferSize;
+
+            if ( run == 1 )
+            {
+                startTime = steady_clock::now( );
+            }
+
+            ret = encoder.EncodeToMemory( image, &buffer, &encodedSize );
+
+            // encoder allocates new buffer if provided one is too small
+            if ( buffer != oldBuffer )
+            {
+                free( oldBuffer );
+                bufferSize = encodedSize;
+            }
+
+            result.EncodedSize = encodedSize;
+        }
+
+        if ( ret )
+        {
+            result.EncodingTime = static_cast<float>( duration_cast<microseconds>( steady_clock::now( ) - startTime ).count( ) ) / 1000.0f / iterations;
+            results.push_back( result );
+        }
+    }
+
+    if ( buffer != nullptr )
+    {
+        free( buffer );
+    }
+
+    return ret;
+}
+
 // Compress the specified image into provided buffer
 XError XJpegEncoder::EncodeToMemory( const shared_ptr<const XImage>& image, uint8_t** buffer, uint32_t* bufferSize )
 {
-    return mData->EncodeToMemory( image, buffer, bufferSize );
+    return mData->Encode( image, buffer, bufferSize );
 }
 
 namespace Private
 {
 
-XError XJpegEncoderData::EncodeToMemory( const shared_ptr<const XImage>& image, uint8_t** buffer, uint32_t* bufferSize )
+// Compress the specified image, converting it first if the compressor can not take its format
+XError XJpegEncoderData::Encode( const shared_ptr<const XImage>& image, uint8_t** buffer, uint32_t* bufferSize )
+{
+    shared_ptr<const XImage> imageToEncode = image;
+    XError                   ret           = XError::Success;
+
+    if ( ( image ) && ( image->Data( ) != nullptr ) &&
+         ( ( XImageConversion::IsBayerFormat( image->Format( ) ) ) || ( image->Format( ) == XPixelFormat::Grayscale16 ) ) )
+    {
+        // Bayer images are demosaiced into RGB, while 16 bit grayscale ones are mapped into 8 bit with automatic gain
+        XPixelFormat convertedFormat = ( image->Format( ) == XPixelFormat::Grayscale16 ) ? XPixelFormat::Grayscale8 : XPixelFormat::RGB24;
+
+        if ( ( !ConvertedImage ) || ( ConvertedImage->Format( ) != convertedFormat ) ||
+             ( ConvertedImage->Width( ) != image->Width( ) ) || ( ConvertedImage->Height( ) != image->Height( ) ) )
+        {
+            ConvertedImage = XImage::Allocate( image->Width( ), image->Height( ), convertedFormat );
+        }
+
+        if ( !ConvertedImage )
+        {
+            ret = XError::OutOfMemory;
+        }
+        else
+        {
+            ret = ( convertedFormat == XPixelFormat::RGB24 ) ? XImageConversion::BayerToRgb24( image, ConvertedImage ) :
+                                                               AutoGain.Map( image, ConvertedImage );
+            imageToEncode = ConvertedImage;
+        }
+    }
+
+    if ( ret )
+    {
+        int32_t width       = ( imageToEncode ) ? imageToEncode->Width( )  : 0;
+        int32_t height      = ( imageToEncode ) ? imageToEncode->Height( ) : 0;
+        int32_t stripsCount = static_cast<int32_t>( min( ThreadCount, static_cast<uint32_t>( height / STRIP_HEIGHT_ALIGN ) ) );
+        int32_t stripHeight = ( stripsCount > 1 ) ? ( ( height + stripsCount - 1 ) / stripsCount + STRIP_HEIGHT_ALIGN - 1 ) & ~( STRIP_HEIGHT_ALIGN - 1 ) : height;
+
+        // large images are split into strips, unless restart interval would not fit into DRI segment (assuming 8x8 MCUs)
+        // or Huffman tables are optimized (strips would get different tables, while only the first strip's ones are kept)
+        if ( ( stripsCount > 1 ) && ( width * height >= STRIPS_MIN_PIXELS ) && ( imageToEncode->Data( ) != nullptr ) && ( !OptimizeCoding ) &&
+             ( ( ( width + 7 ) / 8 ) * ( stripHeight / 8 ) <= 0xFFFF ) )
+        {
+            ret = EncodeInStrips( imageToEncode, stripHeight, buffer, bufferSize );
+        }
+        else
+        {
+            ret = EncodeToMemory( imageToEncode, 0, height, buffer, bufferSize );
+        }
+    }
+
+    return ret;
+}
+
+// Encode image in horizontal strips of the specified height concurrently and join them into single baseline JPEG.
+// Each strip is encoded as a separate image - their entropy coded data is then joined with restart markers, while
+// headers of the first strip are used for the whole image (having height updated and restart interval set).
+XError XJpegEncoderData::EncodeInStrips( const shared_ptr<const XImage>& image, int32_t stripHeight, uint8_t** buffer, uint32_t* bufferSize )
+{
+    int32_t        height      = image->Height( );
+    size_t         stripsCount = static_cast<size_t>( ( height + stripHeight - 1 ) / stripHeight );
+    vector<XError> results( stripsCount, XError::Success );
+    XError         ret = XError::Success;
+
+    if ( ( buffer == nullptr ) || ( *buffer == nullptr ) || ( bufferSize == nullptr ) )
+    {
+        ret = XError::NullPointer;
+    }
+    else
+    {
+        while ( StripEncoders.size( ) < stripsCount )
+        {
+            StripEncoders.push_back( unique_ptr<XJpegEncoderData>( new XJpegEncoderData( Quality, FasterCompression ) ) );
+        }
+
+        for ( size_t i = 0; i < stripsCount; i++ )
+        {
+            StripEncoders[i]->Quality           = Quality;
+            StripEncoders[i]->FasterCompression = FasterCompression;
+            StripEncoders[i]->Subsampling       = Subsampling;
+        }
+
+        // the first strip is encoded by the calling thread, while others go to threads of strip encoders
+        for ( size_t i = 1; i < stripsCount; i++ )
+        {
+            int32_t firstRow = static_cast<int32_t>( i ) * stripHeight;
+
+            StripEncoders[i]->StartStrip( image, firstRow, min( stripHeight, height - firstRow ) );
+        }
+
+        results[0] = StripEncoders[0]->EncodeStrip( image, 0, stripHeight );
+
+        for ( size_t i = 1; i < stripsCount; i++ )
+        {
+            results[i] = StripEncoders[i]->WaitStrip( );
+        }
+
+        for ( size_t i = 0; ( i < stripsCount ) && ( ret ); i++ )
+        {
+            ret = results[i];
+        }
+    }
+
+    if ( ret )
+    {
+        vector<JpegLayout> layouts( stripsCount );
+        uint32_t           totalSize = 0;
+
+        for ( size_t i = 0; ( i < stripsCount ) && ( ret ); i++ )
+        {
+            if ( !ParseJpegLayout( StripEncoders[i]->StripBuffer, StripEncoders[i]->StripSize, &layouts[i] ) )
+            {
+                ret = XError::FailedImageEncoding;
+            }
+            else
+            {
+                // restart marker is put before each strip, except the first one, which comes with headers instead
+                totalSize += ( i == 0 ) ? layouts[i].DataEnd + 6 : layouts[i].DataEnd - layouts[i].DataOffset + 2;
+            }
+        }
+        totalSize += 2;
+
+        if ( ret )
+        {
+            const JpegLayout& header          = layouts[0];
+            const uint8_t*    headerData      = StripEncoders[0]->StripBuffer;
+            uint32_t          mcusPerRow      = ( image->Width( ) + header.McuWidth - 1 ) / header.McuWidth;
+            uint32_t          restartInterval = mcusPerRow * ( stripHeight / header.McuHeight );
+            uint8_t*          output          = *buffer;
+
+            // provided buffer is not freed if a bigger one is allocated, same as done by JPEG compressor
+            if ( totalSize > *bufferSize )
+            {
+                output = static_cast<uint8_t*>( malloc( totalSize ) );
+            }
+
+            if ( output == nullptr )
+            {
+                ret = XError::OutOfMemory;
+            }
+            else
+            {
+                uint8_t* ptr = output;
+                uint8_t  dri[6] = { 0xFF, 0xDD, 0x00, 0x04, static_cast<uint8_t>( restartInterval >> 8 ), static_cast<uint8_t>( restartInterval ) };
+
+                // headers of the first strip with updated height, restart interval and then its data
+                memcpy( ptr, headerData, header.SosOffset );
+                ptr[header.HeightOffset]     = static_cast<uint8_t>( image->Height( ) >> 8 );
+                ptr[header.HeightOffset + 1] = static_cast<uint8_t>( image->Height( ) );
+                ptr += header.SosOffset;
+
+                memcpy( ptr, dri, sizeof( dri ) );
+                ptr += sizeof( dri );
+
+                memcpy( ptr, headerData + header.SosOffset, header.DataEnd - header.SosOffset );
+                ptr += header.DataEnd - header.SosOffset;
+
+                for ( size_t i = 1; i < stripsCount; i++ )
+                {
+                    uint32_t dataSize = layouts[i].DataEnd - layouts[i].DataOffset;
+
+                    *ptr++ = 0xFF;
+                    *ptr++ = static_cast<uint8_t>( 0xD0 + ( ( i - 1 ) & 7 ) );
+
+                    memcpy( ptr, StripEncoders[i]->StripBuffer + layouts[i].DataOffset, dataSize );
+                    ptr += dataSize;
+                }
+
+                *ptr++ = 0xFF;
+                *ptr++ = 0xD9;
+
+                *buffer     = output;
+                *bufferSize = totalSize;
+            }
+        }
+    }
+
+    return ret;
+}
+
+// Encode the specified rows of image as a separate JPEG into own strip buffer
+XError XJpegEncoderData::EncodeStrip( const shared_ptr<const XImage>& image, int32_t firstRow, int32_t rowCount )
+{
+    XError ret = XError::Success;
+
+    if ( StripBuffer == nullptr )
+    {
+        StripBufferSize = static_cast<uint32_t>( image->Width( ) ) * rowCount;
+        StripBuffer     = static_cast<uint8_t*>( malloc( StripBufferSize ) );
+    }
+
+    if ( StripBuffer == nullptr )
+    {
+        ret = XError::OutOfMemory;
+    }
+    else
+    {
+        uint8_t* oldStripBuffer = StripBuffer;
+
+        StripSize = StripBufferSize;
+        ret       = EncodeToMemory( image, firstRow, rowCount, &StripBuffer, &StripSize );
+
+        // compressor allocates new buffer if provided one is too small
+        if ( StripBuffer != oldStripBuffer )
+        {
+            free( oldStripBuffer );
+            StripBufferSize = StripSize;
+        }
+    }
+
+    return ret;
+}
+
+// Give strip to encode to the worker thread of strip encoder (starting it on first use)
+void XJpegEncoderData::StartStrip( const shared_ptr<const XImage>& image, int32_t firstRow, int32_t rowCount )
+{
+    {
+        lock_guard<mutex> lock( StripSync );
+
+        StripImage    = image;
+        StripFirstRow = firstRow;
+        StripRowCount = rowCount;
+        StripPending  = true;
+    }
+
+    if ( !StripThread.joinable( ) )
+    {
+        StripThread = thread( &XJpegEncoderData::StripThreadHandler, this );
+    }
+    else
+    {
+        StripSignal.notify_all( );
+    }
+}
+
+// Wait till worker thread of strip encoder is done with the strip
+XError XJpegEncoderData::WaitStrip( )
+{
+    unique_lock<mutex> lock( StripSync );
+
+    StripSignal.wait( lock, [this] { return !StripPending; } );
+
+    return StripResult;
+}
+
+// Worker thread of strip encoder - encodes strips given to it until the encoder is destroyed
+void XJpegEncoderData::StripThreadHandler( )
+{
+    unique_lock<mutex> lock( StripSync );
+
+    XTracer::SetThreadName( "JPEG strip encoder" );
+
+    for ( ; ; )
+    {
+        StripSignal.wait( lock, [this] { return ( StripPending ) || ( StripExit ); } );
+
+        if ( StripExit )
+        {
+            break;
+        }
+
+        lock.unlock( );
+        XError result = EncodeStrip( StripImage, StripFirstRow, StripRowCount );
+        lock.lock( );
+
+        // image is not kept till the next frame
+        StripImage.reset( );
+        StripResult  = result;
+        StripPending = false;
+        StripSignal.notify_all( );
+    }
+}
+
+// Find segments of the encoded JPEG image, which are needed to join strips
+bool ParseJpegLayout( const uint8_t* jpeg, uint32_t size, JpegLayout* layout )
+{
+    uint32_t pos   = 2;
+    bool     found = false;
+
+    layout->HeightOffset = 0;
+    layout->McuWidth     = 0;
+    layout->McuHeight    = 0;
+
+    // must start with SOI and end with EOI markers
+    if ( ( size < 4 ) || ( jpeg[0] != 0xFF ) || ( jpeg[1] != 0xD8 ) || ( jpeg[size - 2] != 0xFF ) || ( jpeg[size - 1] != 0xD9 ) )
+    {
+        pos = size;
+    }
+
+    while ( ( !found ) && ( pos + 4 <= size ) && ( jpeg[pos] == 0xFF ) )
+    {
+        uint8_t  marker = jpeg[pos + 1];
+        uint32_t length = ( static_cast<uint32_t>( jpeg[pos + 2] ) << 8 ) | jpeg[pos + 3];
+
+        if ( ( ( marker == 0xC0 ) || ( marker == 0xC1 ) ) && ( pos + 10 <= size ) )
+        {
+            uint32_t components = jpeg[pos + 9];
+            uint32_t maxH = 1, maxV = 1;
+
+            for ( uint32_t i = 0; ( i < components ) && ( pos + 12 + i * 3 <= size ); i++ )
+            {
+                uint8_t sampling = jpeg[pos + 11 + i * 3];
+
+                maxH = max( maxH, static_cast<uint32_t>( sampling >> 4 ) );
+                maxV = max( maxV, static_cast<uint32_t>( sampling & 0x0F ) );
+            }
+
+            layout->HeightOffset = pos + 5;
+            layout->McuWidth     = maxH * DCTSIZE;
+            layout->McuHeight    = maxV * DCTSIZE;
+        }
+        else if ( marker == 0xDA )
+        {
+            layout->SosOffset  = pos;
+            layout->DataOffset = pos + 2 + length;
+            layout->DataEnd    = size - 2;
+            found = true;
+        }
+
+        pos += 2 + length;
+    }
+
+    return ( ( found ) && ( layout->HeightOffset != 0 ) && ( layout->DataOffset <= layout->DataEnd ) );
+}
+
+XError XJpegEncoderData::EncodeToMemory( const shared_ptr<const XImage>& image, int32_t firstRow, int32_t rowCount, uint8_t** buffer, uint32_t* bufferSize )
 {
     JSAMPROW    row_pointer[1];
     XError      ret = XError::Success;
@@ -132,7 +714,8 @@ XError XJpegEncoderData::EncodeToMemory( const shared_ptr<const XImage>& image,
     {
         ret = XError::NullPointer;
     }
-    else if ( ( image->Format( ) != XPixelFormat::RGB24 ) && ( image->Format( ) != XPixelFormat::Grayscale8 ) )
+    else if ( ( image->Format( ) != XPixelFormat::RGB24 ) && ( image->Format( ) != XPixelFormat::Grayscale8 ) &&
+              ( !XImageConversion::IsYuvFormat( image->Format( ) ) ) )
     {
         ret = XError::UnsupportedPixelFormat;
     }
@@ -146,13 +729,18 @@ XError XJpegEncoderData::EncodeToMemory( const shared_ptr<const XImage>& image,
 
             // 2 - set parameters for compression
             cinfo.image_width  = image->Width( );
-            cinfo.image_height = image->Height( );
+            cinfo.image_height = rowCount;
 
             if ( image->Format( ) == XPixelFormat::RGB24 )
             {
                 cinfo.input_components = 3;
                 cinfo.in_color_space   = JCS_RGB;
             }
+            else if ( image->Format( ) != XPixelFormat::Grayscale8 )
+            {
+                cinfo.input_components = 3;
+                cinfo.in_color_space   = JCS_YCbCr;
+            }
             else
             {
                 cinfo.input_components = 1;
@@ -167,15 +755,52 @@ XError XJpegEncoderData::EncodeToMemory( const shared_ptr<const XImage>& image,
             // use faster, but less accurate compressions
             cinfo.dct_method = ( FasterCompression ) ? JDCT_FASTEST : JDCT_DEFAULT;
 
+            // optimize Huffman tables and/or put restart markers (not set for strip encoders)
+            cinfo.optimize_coding = ( OptimizeCoding ) ? TRUE : FALSE;
+            cinfo.restart_in_rows = RestartInterval;
+
+            if ( cinfo.in_color_space == JCS_RGB )
+            {
+                // chroma is downsampled by compressor
+                cinfo.comp_info[0].h_samp_factor = ( Subsampling == XJpegSubsampling::Yuv444 ) ? 1 : 2;
+                cinfo.comp_info[0].v_samp_factor = ( Subsampling == XJpegSubsampling::Yuv420 ) ? 2 : 1;
+            }
+
+            if ( cinfo.in_color_space == JCS_YCbCr )
+            {
+                // YUV images are already in JPEG's color space and chroma is downsampled,
+                // so color conversion and downsampling steps of the compressor are skipped
+                bool is420 = ( ( image->Format( ) == XPixelFormat::NV12 ) || ( image->Format( ) == XPixelFormat::I420 ) );
+
+                cinfo.raw_data_in = TRUE;
+            #if JPEG_LIB_VERSION >= 70
+                cinfo.do_fancy_downsampling = FALSE;
+            #endif
+
+                cinfo.comp_info[0].h_samp_factor = 2;
+                cinfo.comp_info[0].v_samp_factor = ( is420 ) ? 2 : 1;
+                cinfo.comp_info[1].h_samp_factor = 1;
+                cinfo.comp_info[1].v_samp_factor = 1;
+                cinfo.comp_info[2].h_samp_factor = 1;
+                cinfo.comp_info[2].v_samp_factor = 1;
+            }
+
             // 3 - start compressor
             jpeg_start_compress( &cinfo, TRUE );
 
             // 4 - do compression
-            while ( cinfo.next_scanline < cinfo.image_height )
+            if ( cinfo.raw_data_in )
             {
-                row_pointer[0] = image->Data( ) + image->Stride( ) * cinfo.next_scanline;
+                WriteRawData( image, firstRow, rowCount );
+            }
+            else
+            {
+                while ( cinfo.next_scanline < cinfo.image_height )
+                {
+                    row_pointer[0] = image->Data( ) + image->Stride( ) * ( firstRow + cinfo.next_scanline );
 
-                jpeg_write_scanlines( &cinfo, row_pointer, 1 );
+                    jpeg_write_scanlines( &cinfo, row_pointer, 1 );
+                }
             }
 
             // 5 - finish compression
@@ -192,4 +817,95 @@ XError XJpegEncoderData::EncodeToMemory( const shared_ptr<const XImage>& image,
     return ret;
 }
 
+// Feed image in one of the YUV formats to the compressor as raw (downsampled) data. Rows of each
+// component must be padded to complete DCT blocks, so those are copied into temporary buffer when
+// width is not a multiple of block size (packed and interleaved formats are always split into it).
+// Only the specified rows are fed, which must start at a multiple of MCU height.
+void XJpegEncoderData::WriteRawData( const shared_ptr<const XImage>& image, int32_t firstImageRow, int32_t rowCount )
+{
+    XPixelFormat format        = image->Format( );
+    bool         isPacked      = ( ( format == XPixelFormat::YUYV ) || ( format == XPixelFormat::UYVY ) );
+    int32_t      width         = image->Width( );
+    int32_t      height        = firstImageRow + rowCount;
+    int32_t      chromaWidth   = ( width + 1 ) / 2;
+    int32_t      chromaHeight  = ( isPacked ) ? height : ( height + 1 ) / 2;
+    int32_t      lumaRowSize   = ( width + 7 ) & ~7;
+    int32_t      chromaRowSize = ( chromaWidth + 7 ) & ~7;
+    int32_t      lumaLines     = cinfo.max_v_samp_factor * DCTSIZE;
+    JSAMPROW     yRows[2 * DCTSIZE];
+    JSAMPROW     uRows[DCTSIZE];
+    JSAMPROW     vRows[DCTSIZE];
+    JSAMPARRAY   planes[3] = { yRows, uRows, vRows };
+
+    RawBuffer.resize( lumaLines * lumaRowSize + 2 * DCTSIZE * chromaRowSize );
+
+    uint8_t* yBuffer = RawBuffer.data( );
+    uint8_t* uBuffer = yBuffer + lumaLines * lumaRowSize;
+    uint8_t* vBuffer = uBuffer + DCTSIZE * chromaRowSize;
+
+    while ( cinfo.next_scanline < cinfo.image_height )
+    {
+        int32_t firstRow       = firstImageRow + static_cast<int32_t>( cinfo.next_scanline );
+        int32_t firstChromaRow = ( isPacked ) ? firstRow : firstRow / 2;
+
+        // rows below the image are filled with the last row
+        for ( int32_t i = 0; i < lumaLines; i++ )
+        {
+            int32_t  row     = min( firstRow + i, height - 1 );
+            uint8_t* yTarget = yBuffer + i * lumaRowSize;
+
+            if ( isPacked )
+            {
+                uint8_t* uTarget = uBuffer + i * chromaRowSize;
+                uint8_t* vTarget = vBuffer + i * chromaRowSize;
+
+                XImageConversion::SplitPackedYuvRow( image->Data( ) + row * image->Stride( ), width, format, yTarget, uTarget, vTarget );
+                fill( yTarget + width, yTarget + lumaRowSize, yTarget[width - 1] );
+                fill( uTarget + chromaWidth, uTarget + chromaRowSize, uTarget[chromaWidth - 1] );
+                fill( vTarget + chromaWidth, vTarget + chromaRowSize, vTarget[chromaWidth - 1] );
+
+                yRows[i] = yTarget;
+                uRows[i] = uTarget;
+                vRows[i] = vTarget;
+            }
+            else
+            {
+                const uint8_t* yRow = image->Data( ) + row * image->Stride( );
+
+                yRows[i] = ( width == lumaRowSize ) ? const_cast<uint8_t*>( yRow ) : PadRow( yRow, width, lumaRowSize, yTarget );
+            }
+        }
+
+        if ( !isPacked )
+        {
+            for ( int32_t i = 0; i < DCTSIZE; i++ )
+            {
+                int32_t  row     = min( firstChromaRow + i, chromaHeight - 1 );
+                uint8_t* uTarget = uBuffer + i * chromaRowSize;
+                uint8_t* vTarget = vBuffer + i * chromaRowSize;
+
+                if ( format == XPixelFormat::NV12 )
+                {
+                    XImageConversion::SplitInterleavedUvRow( image->PlaneData( 1 ) + row * image->PlaneStride( 1 ), chromaWidth, uTarget, vTarget );
+                    fill( uTarget + chromaWidth, uTarget + chromaRowSize, uTarget[chromaWidth - 1] );
+                    fill( vTarget + chromaWidth, vTarget + chromaRowSize, vTarget[chromaWidth - 1] );
+
+                    uRows[i] = uTarget;
+                    vRows[i] = vTarget;
+                }
+                else
+                {
+                    const uint8_t* uRow = image->PlaneData( 1 ) + row * image->PlaneStride( 1 );
+                    const uint8_t* vRow = image->PlaneData( 2 ) + row * image->PlaneStride( 2 );
+
+                    uRows[i] = ( chromaWidth == chromaRowSize ) ? const_cast<uint8_t*>( uRow ) : PadRow( uRow, chromaWidth, chromaRowSize, uTarget );
+                    vRows[i] = ( chromaWidth == chromaRowSize ) ? const_cast<uint8_t*>( vRow ) : PadRow( vRow, chromaWidth, chromaRowSize, vTarget );
+                }
+            }
+        }
+
+        jpeg_write_raw_data( &cinfo, planes, lumaLines );
+    }
+}
+
 } // namespace Private
@@ -22,6 +22,7 @@
 #define XJPEG_ENCODER_HPP
 
 #include <stdint.h>
+#include <vector>
 
 #include "XInterfaces.hpp"
 #include "XImage.hpp"
@@ -32,6 +33,31 @@ namespace Private
     class XJpegEncoderData;
 }
 
+// Chroma subsampling of encoded images (only RGB images can be subsampled as configured, while
+// YUV images are encoded with the subsampling they have - 4:2:0 or 4:2:2)
+enum class XJpegSubsampling
+{
+    Yuv420,
+    Yuv422,
+    Yuv444
+};
+
+// Named sets of encoder parameters (quality is set separately), trading encoding time for size/quality of images
+enum class XJpegProfile
+{
+    LiveFast,       // 4:2:0, fast integer DCT, standard Huffman tables - least encoding time (default)
+    SnapshotSmall,  // 4:2:0, accurate DCT, optimized Huffman tables - smaller images, slower to encode
+    ArchiveQuality  // 4:4:4, accurate DCT, optimized Huffman tables, restart markers every MCU row
+};
+
+// Result of encoding an image with one of the profiles
+struct XJpegProfileBenchmark
+{
+    XJpegProfile Profile;
+    float        EncodingTime;  // average time taken to encode the image (ms)
+    uint32_t     EncodedSize;   // size of the encoded image
+};
+
 class XJpegEncoder : private Uncopyable
 {
 public:
@@ -42,10 +68,48 @@ public:
     uint16_t Quality( ) const;
     void SetQuality( uint16_t quality );
 
+    // Set/get number of threads used to encode large images (1 by default). Images of 1 megapixel and bigger
+    // are split into horizontal strips, which are encoded concurrently and joined into single baseline JPEG
+    // using restart markers.
+    uint32_t ThreadCount( ) const;
+    void SetThreadCount( uint32_t threadCount );
+
     // Set/get faster compression (but less accurate) flag
     bool FasterCompression( ) const;
     void SetFasterCompression( bool faster );
 
+    // Set/get chroma subsampling of RGB images (4:2:0 by default)
+    XJpegSubsampling Subsampling( ) const;
+    void SetSubsampling( XJpegSubsampling subsampling );
+
+    // Set/get optimization of Huffman tables (off by default). It takes an extra pass over image's DCT
+    // coefficients to make images a few percent smaller. Images are not split into strips then, since
+    // those would need to share the tables.
+    bool OptimizeCoding( ) const;
+    void SetOptimizeCoding( bool optimize );
+
+    // Set/get number of MCU rows between restart markers (0 by default - no markers), which limit damage
+    // done by corrupted data. Images encoded in strips get restart markers between strips instead.
+    uint16_t RestartInterval( ) const;
+    void SetRestartInterval( uint16_t mcuRows );
+
+    // Set all of the above parameters as defined by the specified profile
+    void SetProfile( XJpegProfile profile );
+
+    // Get name of the profile (as used in configuration - "live-fast", "snapshot-small", "archive-quality")
+    // or find the profile by its name
+    static const char* ProfileName( XJpegProfile profile );
+    static bool ProfileFromName( const std::string& name, XJpegProfile* profile );
+
+    /* Encode the specified image with every profile and measure average time and size
+
+       Every profile encodes the image the specified number of times (after one
+       warm-up run) on the calling thread. Results are provided in the order of
+       profiles' declaration.
+    */
+    static XError BenchmarkProfiles( const std::shared_ptr<const XImage>& image, uint16_t quality, uint32_t iterations,
+                                     std::vector<XJpegProfileBenchmark>& results );
+
     /* Compress the specified image into provided buffer
 
        On input, buffer size must be set to the size of provided buffer.
@@ -0,0 +1,254 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+
+#include "XJpegEncoderPool.hpp"
+#include "XTracer.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    #define PRIORITIES_COUNT (3)
+
+    // Job waiting in a queue
+    struct QueuedJob
+    {
+        XJpegEncoderPool::Job    Function;
+        steady_clock::time_point SubmitTime;
+    };
+
+    // Worker thread with its own encoder and queues of jobs (one per priority)
+    class Worker
+    {
+    public:
+        mutex            Sync;
+        deque<QueuedJob> Queues[PRIORITIES_COUNT];
+        XJpegEncoder     Encoder;
+        thread           Thread;
+
+    public:
+        Worker( ) : Sync( ), Queues( ), Encoder( 85, true ), Thread( ) { }
+    };
+
+    // Private details of the implementation
+    class XJpegEncoderPoolData
+    {
+    public:
+        vector<unique_ptr<Worker>> Workers;
+        mutex                      WakeSync;
+        condition_variable         WakeUp;
+        bool                       NeedToStop;
+        atomic<int32_t>            PendingJobs;
+
+        XRateCounter               JobsDone;
+        atomic<uint64_t>           JobsStolen;
+        XDurationHistogram         QueueTime;
+
+    public:
+        XJpegEncoderPoolData( uint32_t threadCount, uint32_t encoderThreadCount ) :
+            Workers( ), WakeSync( ), WakeUp( ), NeedToStop( false ), PendingJobs( 0 ),
+            JobsDone( ), JobsStolen( 0 ), QueueTime( )
+        {
+            if ( threadCount == 0 )
+            {
+                threadCount = thread::hardware_concurrency( );
+            }
+            if ( threadCount == 0 )
+            {
+                threadCount = 1;
+            }
+
+            for ( uint32_t i = 0; i < threadCount; i++ )
+            {
+                Workers.push_back( unique_ptr<Worker>( new Worker( ) ) );
+                Workers.back( )->Encoder.SetThreadCount( encoderThreadCount );
+            }
+            for ( uint32_t i = 0; i < threadCount; i++ )
+            {
+                Workers[i]->Thread = thread( WorkerThreadHandler, this, i );
+            }
+        }
+
+        ~XJpegEncoderPoolData( )
+        {
+            {
+                lock_guard<mutex> lock( WakeSync );
+                NeedToStop = true;
+            }
+            WakeUp.notify_all( );
+
+            for ( auto& worker : Workers )
+            {
+                worker->Thread.join( );
+            }
+        }
+
+        void Submit( const XJpegEncoderPool::Job& job, XEncodePriority priority, uint32_t affinity );
+
+    private:
+        bool TakeJob( uint32_t workerIndex, QueuedJob& job, bool* pStolen );
+        static void WorkerThreadHandler( XJpegEncoderPoolData* me, uint32_t workerIndex );
+    };
+}
+
+XJpegEncoderPool::XJpegEncoderPool( uint32_t threadCount, uint32_t encoderThreadCount ) :
+    mData( new Private::XJpegEncoderPoolData( threadCount, encoderThreadCount ) )
+{
+}
+
+XJpegEncoderPool::~XJpegEncoderPool( )
+{
+    delete mData;
+}
+
+// Number of worker threads in the pool
+uint32_t XJpegEncoderPool::ThreadCount( ) const
+{
+    return static_cast<uint32_t>( mData->Workers.size( ) );
+}
+
+// Submit a job to be run on one of the worker threads
+void XJpegEncoderPool::Submit( const Job& job, XEncodePriority priority, uint32_t affinity )
+{
+    mData->Submit( job, priority, affinity );
+}
+
+// Put statistics of the pool into the specified collector
+void XJpegEncoderPool::CollectStatistics( XStatisticsCollector& collector ) const
+{
+    collector.AddGauge( "cam2web_encoder_threads", "Number of threads in JPEG encoder pool", static_cast<double>( mData->Workers.size( ) ) );
+    collector.AddGauge( "cam2web_encoder_queued_jobs", "Jobs waiting in JPEG encoder pool", static_cast<double>( max( mData->PendingJobs.load( ), 0 ) ) );
+    collector.AddRate( "cam2web_encoder_jobs", "Jobs done by JPEG encoder pool", mData->JobsDone );
+    collector.AddCounter( "cam2web_encoder_jobs_stolen_total", "Jobs taken from queues of other workers", mData->JobsStolen );
+    collector.AddHistogram( "cam2web_encoder_queue_seconds", "Time jobs wait in JPEG encoder pool", mData->QueueTime );
+}
+
+namespace Private
+{
+
+// Put the job into the queue of the worker chosen by affinity and wake up one of the workers
+void XJpegEncoderPoolData::Submit( const XJpegEncoderPool::Job& job, XEncodePriority priority, uint32_t affinity )
+{
+    Worker*   worker = Workers[affinity % Workers.size( )].get( );
+    QueuedJob queuedJob = { job, steady_clock::now( ) };
+
+    {
+        lock_guard<mutex> wakeLock( WakeSync );
+        lock_guard<mutex> queueLock( worker->Sync );
+
+        worker->Queues[static_cast<int>( priority )].push_back( queuedJob );
+        PendingJobs++;
+    }
+
+    WakeUp.notify_one( );
+}
+
+// Take a job of the highest priority available - own jobs are taken from the front of the queue,
+// while jobs of other workers are stolen from the back
+bool XJpegEncoderPoolData::TakeJob( uint32_t workerIndex, QueuedJob& job, bool* pStolen )
+{
+    uint32_t workersCount = static_cast<uint32_t>( Workers.size( ) );
+    bool     found        = false;
+
+    for ( int priority = 0; ( priority < PRIORITIES_COUNT ) && ( !found ); priority++ )
+    {
+        for ( uint32_t i = 0; ( i < workersCount ) && ( !found ); i++ )
+        {
+            Worker*           worker = Workers[( workerIndex + i ) % workersCount].get( );
+            lock_guard<mutex> lock( worker->Sync );
+            deque<QueuedJob>& queue  = worker->Queues[priority];
+
+            if ( !queue.empty( ) )
+            {
+                if ( i == 0 )
+                {
+                    job = queue.front( );
+                    queue.pop_front( );
+                }
+                else
+                {
+                    job = queue.back( );
+                    queue.pop_back( );
+                }
+
+                *pStolen = ( i != 0 );
+                found    = true;
+            }
+        }
+    }
+
+    if ( found )
+    {
+        PendingJobs--;
+    }
+
+    return found;
+}
+
+// Worker thread - runs jobs until pool is destroyed
+void XJpegEncoderPoolData::WorkerThreadHandler( XJpegEncoderPoolData* me, uint32_t workerIndex )
+{
+    Worker*   worker = me->Workers[workerIndex].get( );
+    QueuedJob job;
+    bool      stolen;
+
+    XTracer::SetThreadName( "JPEG encoder " + to_string( workerIndex ) );
+
+    for ( ; ; )
+    {
+        if ( me->TakeJob( workerIndex, job, &stolen ) )
+        {
+            me->QueueTime.AddSince( job.SubmitTime );
+            if ( stolen )
+            {
+                me->JobsStolen++;
+            }
+
+            job.Function( worker->Encoder );
+            job.Function = nullptr;
+
+            me->JobsDone.Add( );
+        }
+        else
+        {
+            unique_lock<mutex> lock( me->WakeSync );
+
+            // finish remaining jobs before exiting
+            if ( ( me->NeedToStop ) && ( me->PendingJobs <= 0 ) )
+            {
+                break;
+            }
+
+            me->WakeUp.wait( lock, [me] { return ( me->NeedToStop ) || ( me->PendingJobs > 0 ); } );
+        }
+    }
+}
+
+} // namespace Private
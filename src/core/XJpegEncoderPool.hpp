@@ -0,0 +1,77 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XJPEG_ENCODER_POOL_HPP
+#define XJPEG_ENCODER_POOL_HPP
+
+#include <stdint.h>
+#include <functional>
+
+#include "XInterfaces.hpp"
+#include "XJpegEncoder.hpp"
+#include "XStatistics.hpp"
+
+namespace Private
+{
+    class XJpegEncoderPoolData;
+}
+
+// Priority of encoding jobs - jobs of higher priority are always taken first
+enum class XEncodePriority
+{
+    Live      = 0,  // frames for live view (JPEG/MJPEG clients)
+    Thumbnail = 1,
+    Recording = 2
+};
+
+/* ================================================================= */
+/* Pool of threads encoding JPEG images, which is shared by video    */
+/* sources. Every worker has its own encoder (libjpeg compression    */
+/* context) and its own queues of jobs. Jobs are put into the queue  */
+/* of the worker chosen by job's affinity, so jobs of one source     */
+/* tend to run on the same thread, while idle workers steal jobs     */
+/* from the other end of busy workers' queues.                       */
+/* ================================================================= */
+class XJpegEncoderPool : public IStatisticsProvider, private Uncopyable
+{
+public:
+    typedef std::function<void( XJpegEncoder& encoder )> Job;
+
+public:
+    // Create pool with the specified number of worker threads (0 - one per CPU core). Encoders of workers
+    // may use extra threads to encode large images in strips (see XJpegEncoder::SetThreadCount()).
+    XJpegEncoderPool( uint32_t threadCount = 0, uint32_t encoderThreadCount = 1 );
+    ~XJpegEncoderPool( );
+
+    // Number of worker threads in the pool
+    uint32_t ThreadCount( ) const;
+
+    // Submit a job to be run on one of the worker threads, which provides its encoder to the job.
+    // Jobs with the same affinity are queued to the same worker (unless it is stolen by an idle one).
+    void Submit( const Job& job, XEncodePriority priority = XEncodePriority::Live, uint32_t affinity = 0 );
+
+    // Put statistics of the pool into the specified collector
+    void CollectStatistics( XStatisticsCollector& collector ) const;
+
+private:
+    Private::XJpegEncoderPoolData* mData;
+};
+
+#endif // XJPEG_ENCODER_POOL_HPP
@@ -0,0 +1,539 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "XJpegOverlay.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <jpeglib.h>
+
+using namespace std;
+
+namespace Private
+{
+    #define COLOR_COMPONENTS    (3)
+
+    class JpegException : public exception
+    {
+    public:
+        virtual const char* what( ) const throw( )
+        {
+            return "JPEG coding failure";
+        }
+    };
+
+    static void my_error_exit( j_common_ptr /* cinfo */ )
+    {
+        throw JpegException( );
+    }
+
+    static void my_output_message( j_common_ptr /* cinfo */ )
+    {
+        // do nothing - kill the message
+    }
+
+    // Basis of 8 point DCT - Cos[u][x] = C(u) / 2 * cos( ( 2x + 1 ) * u * PI / 16 ), where C(0) = 1 / sqrt(2) and 1 otherwise.
+    // Same basis is used for forward and inverse transforms, which are done for rows first and then for columns (inner
+    // loops go along rows of blocks, so compiler can vectorize them).
+    struct XDctBasis
+    {
+        float Cos[DCTSIZE][DCTSIZE];
+        float Transposed[DCTSIZE][DCTSIZE];
+
+        XDctBasis( )
+        {
+            for ( int u = 0; u < DCTSIZE; u++ )
+            {
+                for ( int x = 0; x < DCTSIZE; x++ )
+                {
+                    Cos[u][x] = static_cast<float>( ( ( u == 0 ) ? sqrt( 0.5 ) : 1.0 ) / 2 * cos( ( 2 * x + 1 ) * u * 3.14159265358979323846 / 16 ) );
+                    Transposed[x][u] = Cos[u][x];
+                }
+            }
+        }
+    };
+
+    static const XDctBasis DctBasis;
+
+    // Dequantize block of coefficients and transform it into samples (most of coefficients are zero usually, so those are skipped)
+    static void InverseDct( const JCOEF* block, const UINT16* quantTable, uint8_t* dst, int32_t dstStride )
+    {
+        float tmp[DCTSIZE2] = { 0 };
+        float out[DCTSIZE];
+
+        for ( int v = 0; v < DCTSIZE; v++ )
+        {
+            for ( int u = 0; u < DCTSIZE; u++ )
+            {
+                if ( block[v * DCTSIZE + u] != 0 )
+                {
+                    float coef = static_cast<float>( block[v * DCTSIZE + u] * quantTable[v * DCTSIZE + u] );
+
+                    for ( int x = 0; x < DCTSIZE; x++ )
+                    {
+                        tmp[v * DCTSIZE + x] += DctBasis.Cos[u][x] * coef;
+                    }
+                }
+            }
+        }
+
+        for ( int y = 0; y < DCTSIZE; y++, dst += dstStride )
+        {
+            for ( int x = 0; x < DCTSIZE; x++ )
+            {
+                out[x] = 128.5f;
+            }
+
+            for ( int v = 0; v < DCTSIZE; v++ )
+            {
+                for ( int x = 0; x < DCTSIZE; x++ )
+                {
+                    out[x] += DctBasis.Transposed[y][v] * tmp[v * DCTSIZE + x];
+                }
+            }
+
+            for ( int x = 0; x < DCTSIZE; x++ )
+            {
+                dst[x] = static_cast<uint8_t>( max( 0.0f, min( 255.0f, out[x] ) ) );
+            }
+        }
+    }
+
+    // Transform block of samples into coefficients and quantize them
+    static void ForwardDct( const uint8_t* src, int32_t srcStride, const UINT16* quantTable, JCOEF* block )
+    {
+        float tmp[DCTSIZE2] = { 0 };
+        float out[DCTSIZE];
+
+        for ( int y = 0; y < DCTSIZE; y++, src += srcStride )
+        {
+            for ( int x = 0; x < DCTSIZE; x++ )
+            {
+                float sample = static_cast<float>( static_cast<int>( src[x] ) - 128 );
+
+                for ( int u = 0; u < DCTSIZE; u++ )
+                {
+                    tmp[y * DCTSIZE + u] += DctBasis.Transposed[x][u] * sample;
+                }
+            }
+        }
+
+        for ( int v = 0; v < DCTSIZE; v++ )
+        {
+            for ( int u = 0; u < DCTSIZE; u++ )
+            {
+                out[u] = 0;
+            }
+
+            for ( int y = 0; y < DCTSIZE; y++ )
+            {
+                for ( int u = 0; u < DCTSIZE; u++ )
+                {
+                    out[u] += DctBasis.Cos[v][y] * tmp[y * DCTSIZE + u];
+                }
+            }
+
+            for ( int u = 0; u < DCTSIZE; u++ )
+            {
+                float value = out[u] / quantTable[v * DCTSIZE + u];
+
+                block[v * DCTSIZE + u] = static_cast<JCOEF>( ( value >= 0 ) ? static_cast<int>( value + 0.5f ) : -static_cast<int>( 0.5f - value ) );
+            }
+        }
+    }
+
+    static inline uint8_t ClampSample( float value )
+    {
+        return static_cast<uint8_t>( max( 0.0f, min( 255.0f, value + 0.5f ) ) );
+    }
+
+    class XJpegOverlayData
+    {
+    public:
+        XJpegOverlayData( ) :
+            Marks( ), Planes( ), Region( )
+        {
+            // allocate and initialize JPEG decompression/compression objects
+            dinfo.err            = jpeg_std_error( &djerr );
+            djerr.error_exit     = my_error_exit;
+            djerr.output_message = my_output_message;
+
+            cinfo.err            = jpeg_std_error( &cjerr );
+            cjerr.error_exit     = my_error_exit;
+            cjerr.output_message = my_output_message;
+
+            jpeg_create_decompress( &dinfo );
+            jpeg_create_compress( &cinfo );
+        }
+
+        ~XJpegOverlayData( )
+        {
+            jpeg_destroy_compress( &cinfo );
+            jpeg_destroy_decompress( &dinfo );
+        }
+
+        XError Apply( const uint8_t* jpegData, uint32_t jpegSize, const vector<XJpegOverlayArea>& areas,
+                      const XJpegOverlay::DrawFunction& draw, uint8_t** buffer, uint32_t* bufferSize );
+
+    private:
+        bool IsSupported( ) const;
+        void MarkAreas( const vector<XJpegOverlayArea>& areas, int32_t mcuWidth, int32_t mcuHeight, int32_t mcuCols );
+        void DecodeRegion( jvirt_barray_ptr* coefArrays, int32_t mcuRow, int32_t firstMcu, int32_t mcuCount );
+        void EncodeRegion( jvirt_barray_ptr* coefArrays, int32_t mcuRow, int32_t firstMcu, int32_t mcuCount );
+
+    private:
+        struct jpeg_decompress_struct dinfo;
+        struct jpeg_compress_struct   cinfo;
+        struct jpeg_error_mgr         djerr;
+        struct jpeg_error_mgr         cjerr;
+        vector<uint8_t>               Marks;                      // MCUs to draw on
+        vector<uint8_t>               Planes[COLOR_COMPONENTS];   // samples of components for the MCUs being drawn on
+        shared_ptr<XImage>            Region;                     // the same MCUs as pixels
+    };
+}
+
+XJpegOverlay::XJpegOverlay( ) :
+    mData( new Private::XJpegOverlayData( ) )
+{
+
+}
+
+XJpegOverlay::~XJpegOverlay( )
+{
+    delete mData;
+}
+
+// Draw on the specified areas of JPEG image and write the result into provided buffer
+XError XJpegOverlay::Apply( const uint8_t* jpegData, uint32_t jpegSize, const vector<XJpegOverlayArea>& areas,
+                            const DrawFunction& draw, uint8_t** buffer, uint32_t* bufferSize )
+{
+    return mData->Apply( jpegData, jpegSize, areas, draw, buffer, bufferSize );
+}
+
+namespace Private
+{
+
+// Read coefficients of JPEG image, redraw MCUs covering the areas and write coefficients as new JPEG image
+XError XJpegOverlayData::Apply( const uint8_t* jpegData, uint32_t jpegSize, const vector<XJpegOverlayArea>& areas,
+                                const XJpegOverlay::DrawFunction& draw, uint8_t** buffer, uint32_t* bufferSize )
+{
+    XError ret = XError::Success;
+
+    if ( ( jpegData == nullptr ) || ( buffer == nullptr ) || ( *buffer == nullptr ) || ( bufferSize == nullptr ) || ( !draw ) )
+    {
+        ret = XError::NullPointer;
+    }
+    else
+    {
+        try
+        {
+            jvirt_barray_ptr* coefArrays;
+
+            jpeg_mem_src( &dinfo, const_cast<uint8_t*>( jpegData ), jpegSize );
+            jpeg_read_header( &dinfo, TRUE );
+
+            coefArrays = jpeg_read_coefficients( &dinfo );
+
+            if ( !IsSupported( ) )
+            {
+                ret = XError::UnsupportedPixelFormat;
+            }
+            else
+            {
+                int32_t mcuWidth  = dinfo.max_h_samp_factor * DCTSIZE;
+                int32_t mcuHeight = dinfo.max_v_samp_factor * DCTSIZE;
+                int32_t mcuCols   = ( static_cast<int32_t>( dinfo.image_width )  + mcuWidth  - 1 ) / mcuWidth;
+                int32_t mcuRows   = ( static_cast<int32_t>( dinfo.image_height ) + mcuHeight - 1 ) / mcuHeight;
+
+                MarkAreas( areas, mcuWidth, mcuHeight, mcuCols );
+
+                // redraw every horizontal run of marked MCUs
+                for ( int32_t mcuRow = 0; mcuRow < mcuRows; mcuRow++ )
+                {
+                    const uint8_t* marks = Marks.data( ) + mcuRow * mcuCols;
+                    int32_t        col   = 0;
+
+                    while ( col < mcuCols )
+                    {
+                        int32_t firstMcu = col;
+
+                        while ( ( col < mcuCols ) && ( marks[col] != 0 ) )
+                        {
+                            col++;
+                        }
+
+                        if ( col == firstMcu )
+                        {
+                            col++;
+                        }
+                        else
+                        {
+                            DecodeRegion( coefArrays, mcuRow, firstMcu, col - firstMcu );
+                            draw( Region, firstMcu * mcuWidth, mcuRow * mcuHeight );
+                            EncodeRegion( coefArrays, mcuRow, firstMcu, col - firstMcu );
+                        }
+                    }
+                }
+
+                // write all coefficients as new image - only entropy coding is done
+                unsigned long mem_buffer_size = *bufferSize;
+                jpeg_mem_dest( &cinfo, buffer, &mem_buffer_size );
+
+                jpeg_copy_critical_parameters( &dinfo, &cinfo );
+                jpeg_write_coefficients( &cinfo, coefArrays );
+                jpeg_finish_compress( &cinfo );
+
+                *bufferSize = static_cast<uint32_t>( mem_buffer_size );
+            }
+
+            jpeg_finish_decompress( &dinfo );
+        }
+        catch ( const JpegException& )
+        {
+            jpeg_abort_compress( &cinfo );
+            jpeg_abort_decompress( &dinfo );
+            ret = XError::FailedImageEncoding;
+        }
+    }
+
+    return ret;
+}
+
+// Check if image's components can be converted to/from pixels - grayscale or YCbCr images with
+// sampling factors of chroma being divisors of the luma's
+bool XJpegOverlayData::IsSupported( ) const
+{
+    bool ret = ( ( dinfo.num_components == 1 ) ||
+                 ( ( dinfo.num_components == 3 ) && ( dinfo.jpeg_color_space == JCS_YCbCr ) ) );
+
+    for ( int ci = 0; ( ret ) && ( ci < dinfo.num_components ); ci++ )
+    {
+        const jpeg_component_info* comp = &dinfo.comp_info[ci];
+
+        ret = ( ( dinfo.max_h_samp_factor % comp->h_samp_factor == 0 ) &&
+                ( dinfo.max_v_samp_factor % comp->v_samp_factor == 0 ) &&
+                ( dinfo.quant_tbl_ptrs[comp->quant_tbl_no] != nullptr ) );
+    }
+
+    return ret;
+}
+
+// Mark MCUs covering any of the areas (clipped to image)
+void XJpegOverlayData::MarkAreas( const vector<XJpegOverlayArea>& areas, int32_t mcuWidth, int32_t mcuHeight, int32_t mcuCols )
+{
+    int32_t mcuRows = ( static_cast<int32_t>( dinfo.image_height ) + mcuHeight - 1 ) / mcuHeight;
+
+    Marks.assign( mcuCols * mcuRows, 0 );
+
+    for ( const XJpegOverlayArea& area : areas )
+    {
+        int32_t x1 = max( 0, area.X );
+        int32_t y1 = max( 0, area.Y );
+        int32_t x2 = min( static_cast<int32_t>( dinfo.image_width ),  area.X + area.Width )  - 1;
+        int32_t y2 = min( static_cast<int32_t>( dinfo.image_height ), area.Y + area.Height ) - 1;
+
+        if ( ( x1 <= x2 ) && ( y1 <= y2 ) )
+        {
+            for ( int32_t row = y1 / mcuHeight; row <= y2 / mcuHeight; row++ )
+            {
+                fill( Marks.begin( ) + row * mcuCols + x1 / mcuWidth, Marks.begin( ) + row * mcuCols + x2 / mcuWidth + 1, 1 );
+            }
+        }
+    }
+}
+
+// Transform coefficients of the specified run of MCUs into samples of components and convert those into pixels
+void XJpegOverlayData::DecodeRegion( jvirt_barray_ptr* coefArrays, int32_t mcuRow, int32_t firstMcu, int32_t mcuCount )
+{
+    int32_t      width  = mcuCount * dinfo.max_h_samp_factor * DCTSIZE;
+    int32_t      height = dinfo.max_v_samp_factor * DCTSIZE;
+    XPixelFormat format = ( dinfo.num_components == 1 ) ? XPixelFormat::Grayscale8 : XPixelFormat::RGB24;
+
+    if ( ( !Region ) || ( Region->Width( ) != width ) || ( Region->Height( ) != height ) || ( Region->Format( ) != format ) )
+    {
+        Region = XImage::Allocate( width, height, format );
+
+        if ( !Region )
+        {
+            throw JpegException( );
+        }
+    }
+
+    for ( int ci = 0; ci < dinfo.num_components; ci++ )
+    {
+        const jpeg_component_info* comp        = &dinfo.comp_info[ci];
+        const UINT16*              quantTable  = dinfo.quant_tbl_ptrs[comp->quant_tbl_no]->quantval;
+        int32_t                    blocksCount = mcuCount * comp->h_samp_factor;
+        int32_t                    stride      = blocksCount * DCTSIZE;
+        JBLOCKARRAY                blocks      = ( *dinfo.mem->access_virt_barray )( reinterpret_cast<j_common_ptr>( &dinfo ), coefArrays[ci],
+                                                     mcuRow * comp->v_samp_factor, comp->v_samp_factor, FALSE );
+
+        Planes[ci].resize( stride * comp->v_samp_factor * DCTSIZE );
+
+        for ( int by = 0; by < comp->v_samp_factor; by++ )
+        {
+            JDIMENSION blockRow = static_cast<JDIMENSION>( mcuRow * comp->v_samp_factor + by );
+
+            for ( int32_t bx = 0; bx < blocksCount; bx++ )
+            {
+                JDIMENSION blockCol = static_cast<JDIMENSION>( firstMcu * comp->h_samp_factor + bx );
+                uint8_t*   samples  = Planes[ci].data( ) + by * DCTSIZE * stride + bx * DCTSIZE;
+
+                // blocks past image's edge (padding of the last MCU) are left blank
+                if ( ( blockRow < comp->height_in_blocks ) && ( blockCol < comp->width_in_blocks ) )
+                {
+                    InverseDct( blocks[by][blockCol], quantTable, samples, stride );
+                }
+                else
+                {
+                    for ( int y = 0; y < DCTSIZE; y++ )
+                    {
+                        memset( samples + y * stride, 128, DCTSIZE );
+                    }
+                }
+            }
+        }
+    }
+
+    if ( format == XPixelFormat::Grayscale8 )
+    {
+        for ( int32_t y = 0; y < height; y++ )
+        {
+            memcpy( Region->Data( ) + y * Region->Stride( ), Planes[0].data( ) + y * width, width );
+        }
+    }
+    else
+    {
+        int32_t hDiv[COLOR_COMPONENTS], vDiv[COLOR_COMPONENTS], stride[COLOR_COMPONENTS];
+
+        for ( int ci = 0; ci < COLOR_COMPONENTS; ci++ )
+        {
+            hDiv[ci]   = dinfo.max_h_samp_factor / dinfo.comp_info[ci].h_samp_factor;
+            vDiv[ci]   = dinfo.max_v_samp_factor / dinfo.comp_info[ci].v_samp_factor;
+            stride[ci] = width / hDiv[ci];
+        }
+
+        // YCbCr to RGB as defined by JFIF, chroma is upsampled by repeating samples
+        for ( int32_t y = 0; y < height; y++ )
+        {
+            const uint8_t* yRow  = Planes[0].data( ) + ( y / vDiv[0] ) * stride[0];
+            const uint8_t* cbRow = Planes[1].data( ) + ( y / vDiv[1] ) * stride[1];
+            const uint8_t* crRow = Planes[2].data( ) + ( y / vDiv[2] ) * stride[2];
+            uint8_t*       ptr   = Region->Data( ) + y * Region->Stride( );
+
+            for ( int32_t x = 0; x < width; x++, ptr += 3 )
+            {
+                float luma = yRow[x / hDiv[0]];
+                float cb   = static_cast<float>( cbRow[x / hDiv[1]] ) - 128;
+                float cr   = static_cast<float>( crRow[x / hDiv[2]] ) - 128;
+
+                ptr[RedIndex]   = ClampSample( luma + 1.402f * cr );
+                ptr[GreenIndex] = ClampSample( luma - 0.344136f * cb - 0.714136f * cr );
+                ptr[BlueIndex]  = ClampSample( luma + 1.772f * cb );
+            }
+        }
+    }
+}
+
+// Convert pixels of the specified run of MCUs into samples of components and transform those into coefficients
+void XJpegOverlayData::EncodeRegion( jvirt_barray_ptr* coefArrays, int32_t mcuRow, int32_t firstMcu, int32_t mcuCount )
+{
+    int32_t width  = Region->Width( );
+    int32_t height = Region->Height( );
+
+    if ( dinfo.num_components == 1 )
+    {
+        for ( int32_t y = 0; y < height; y++ )
+        {
+            memcpy( Planes[0].data( ) + y * width, Region->Data( ) + y * Region->Stride( ), width );
+        }
+    }
+    else
+    {
+        // RGB to YCbCr as defined by JFIF, chroma is downsampled by averaging pixels
+        static const float Weights[COLOR_COMPONENTS][3] =
+        {
+            {  0.299f,     0.587f,     0.114f    },
+            { -0.168736f, -0.331264f,  0.5f      },
+            {  0.5f,      -0.418688f, -0.081312f }
+        };
+
+        for ( int ci = 0; ci < COLOR_COMPONENTS; ci++ )
+        {
+            int32_t      hDiv    = dinfo.max_h_samp_factor / dinfo.comp_info[ci].h_samp_factor;
+            int32_t      vDiv    = dinfo.max_v_samp_factor / dinfo.comp_info[ci].v_samp_factor;
+            int32_t      stride  = width / hDiv;
+            float        offset  = ( ci == 0 ) ? 0.0f : 128.0f;
+            float        scale   = 1.0f / ( hDiv * vDiv );
+            const float* weights = Weights[ci];
+
+            for ( int32_t cy = 0; cy < height / vDiv; cy++ )
+            {
+                uint8_t* samples = Planes[ci].data( ) + cy * stride;
+
+                for ( int32_t cx = 0; cx < stride; cx++ )
+                {
+                    float sum = 0;
+
+                    for ( int32_t y = cy * vDiv; y < ( cy + 1 ) * vDiv; y++ )
+                    {
+                        const uint8_t* ptr = Region->Data( ) + y * Region->Stride( ) + cx * hDiv * 3;
+
+                        for ( int32_t x = 0; x < hDiv; x++, ptr += 3 )
+                        {
+                            sum += weights[0] * ptr[RedIndex] + weights[1] * ptr[GreenIndex] + weights[2] * ptr[BlueIndex];
+                        }
+                    }
+
+                    samples[cx] = ClampSample( sum * scale + offset );
+                }
+            }
+        }
+    }
+
+    for ( int ci = 0; ci < dinfo.num_components; ci++ )
+    {
+        const jpeg_component_info* comp        = &dinfo.comp_info[ci];
+        const UINT16*              quantTable  = dinfo.quant_tbl_ptrs[comp->quant_tbl_no]->quantval;
+        int32_t                    blocksCount = mcuCount * comp->h_samp_factor;
+        int32_t                    stride      = blocksCount * DCTSIZE;
+        JBLOCKARRAY                blocks      = ( *dinfo.mem->access_virt_barray )( reinterpret_cast<j_common_ptr>( &dinfo ), coefArrays[ci],
+                                                     mcuRow * comp->v_samp_factor, comp->v_samp_factor, TRUE );
+
+        for ( int by = 0; by < comp->v_samp_factor; by++ )
+        {
+            JDIMENSION blockRow = static_cast<JDIMENSION>( mcuRow * comp->v_samp_factor + by );
+
+            for ( int32_t bx = 0; bx < blocksCount; bx++ )
+            {
+                JDIMENSION blockCol = static_cast<JDIMENSION>( firstMcu * comp->h_samp_factor + bx );
+
+                if ( ( blockRow < comp->height_in_blocks ) && ( blockCol < comp->width_in_blocks ) )
+                {
+                    ForwardDct( Planes[ci].data( ) + by * DCTSIZE * stride + bx * DCTSIZE, stride, quantTable, blocks[by][blockCol] );
+                }
+            }
+        }
+    }
+}
+
+} // namespace Private
@@ -0,0 +1,83 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XJPEG_OVERLAY_HPP
+#define XJPEG_OVERLAY_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <functional>
+
+#include "XInterfaces.hpp"
+#include "XImage.hpp"
+#include "XError.hpp"
+
+namespace Private
+{
+    class XJpegOverlayData;
+}
+
+// Area of JPEG image to draw on
+struct XJpegOverlayArea
+{
+    int32_t X;
+    int32_t Y;
+    int32_t Width;
+    int32_t Height;
+};
+
+/* ================================================================= */
+/* Draws on JPEG images (overlays, privacy masks) without decoding   */
+/* and encoding them completely. Only DCT coefficients are read from */
+/* the image; MCUs covering the areas to draw on are then decoded    */
+/* into pixels, drawn on, transformed back and quantized with the    */
+/* image's own tables. Coefficients of all other MCUs are written    */
+/* into the new image as they are, so they don't lose any quality    */
+/* and only entropy coding is done for them.                         */
+/* ================================================================= */
+class XJpegOverlay : private Uncopyable
+{
+public:
+    // Function drawing on a part of JPEG image - it gets the part decoded as RGB24 image (Grayscale8 for
+    // grayscale JPEGs) and position of its top-left corner in the JPEG image
+    typedef std::function<void( const std::shared_ptr<const XImage>& image, int32_t x, int32_t y )> DrawFunction;
+
+public:
+    XJpegOverlay( );
+    ~XJpegOverlay( );
+
+    /* Draw on the specified areas of JPEG image and write the result into provided buffer
+
+       The drawing function is called for every horizontal run of MCUs
+       covering the areas, so it may get a part of an area only. Buffer
+       is handled same way as by XJpegEncoder::EncodeToMemory() - on
+       input, buffer size must be set to the size of provided buffer.
+       On output, it is set to the size of the new JPEG image. If the
+       provided buffer is too small, a new one is allocated (malloc),
+       while the provided one is not freed.
+    */
+    XError Apply( const uint8_t* jpegData, uint32_t jpegSize, const std::vector<XJpegOverlayArea>& areas,
+                  const DrawFunction& draw, uint8_t** buffer, uint32_t* bufferSize );
+
+private:
+    Private::XJpegOverlayData* mData;
+};
+
+#endif // XJPEG_OVERLAY_HPP
@@ -0,0 +1,260 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "XJpegRequantizer.hpp"
+
+#include <stdio.h>
+#include <exception>
+#include <algorithm>
+#include <jpeglib.h>
+
+using namespace std;
+
+namespace Private
+{
+    class JpegRequantizeException : public exception
+    {
+    public:
+        virtual const char* what( ) const throw( )
+        {
+            return "JPEG requantization failure";
+        }
+    };
+
+    static void requantizer_error_exit( j_common_ptr /* cinfo */ )
+    {
+        throw JpegRequantizeException( );
+    }
+
+    static void requantizer_output_message( j_common_ptr /* cinfo */ )
+    {
+        // do nothing - kill the message
+    }
+
+    // Standard quantization tables from JPEG specification (Annex K), same as libjpeg scales for its quality setting
+    static const uint16_t StdLuminanceTable[DCTSIZE2] =
+    {
+        16,  11,  10,  16,  24,  40,  51,  61,
+        12,  12,  14,  19,  26,  58,  60,  55,
+        14,  13,  16,  24,  40,  57,  69,  56,
+        14,  17,  22,  29,  51,  87,  80,  62,
+        18,  22,  37,  56,  68, 109, 103,  77,
+        24,  35,  55,  64,  81, 104, 113,  92,
+        49,  64,  78,  87, 103, 121, 120, 101,
+        72,  92,  95,  98, 112, 100, 103,  99
+    };
+    static const uint16_t StdChrominanceTable[DCTSIZE2] =
+    {
+        17,  18,  24,  47,  99,  99,  99,  99,
+        18,  21,  26,  66,  99,  99,  99,  99,
+        24,  26,  56,  99,  99,  99,  99,  99,
+        47,  66,  99,  99,  99,  99,  99,  99,
+        99,  99,  99,  99,  99,  99,  99,  99,
+        99,  99,  99,  99,  99,  99,  99,  99,
+        99,  99,  99,  99,  99,  99,  99,  99,
+        99,  99,  99,  99,  99,  99,  99,  99
+    };
+
+    class XJpegRequantizerData
+    {
+    public:
+        uint16_t Quality;
+
+    public:
+        XJpegRequantizerData( uint16_t quality ) :
+            Quality( quality )
+        {
+            Quality = max( static_cast<uint16_t>( 1 ), min( static_cast<uint16_t>( 100 ), Quality ) );
+
+            // allocate and initialize JPEG decompression/compression objects
+            dinfo.err            = jpeg_std_error( &djerr );
+            djerr.error_exit     = requantizer_error_exit;
+            djerr.output_message = requantizer_output_message;
+
+            cinfo.err            = jpeg_std_error( &cjerr );
+            cjerr.error_exit     = requantizer_error_exit;
+            cjerr.output_message = requantizer_output_message;
+
+            jpeg_create_decompress( &dinfo );
+            jpeg_create_compress( &cinfo );
+        }
+
+        ~XJpegRequantizerData( )
+        {
+            jpeg_destroy_compress( &cinfo );
+            jpeg_destroy_decompress( &dinfo );
+        }
+
+        XError Requantize( const uint8_t* jpegData, uint32_t jpegSize, uint8_t** buffer, uint32_t* bufferSize );
+
+    private:
+        void SetTargetTables( );
+        void RequantizeComponent( jvirt_barray_ptr coefArray, int ci );
+
+    private:
+        struct jpeg_decompress_struct dinfo;
+        struct jpeg_compress_struct   cinfo;
+        struct jpeg_error_mgr         djerr;
+        struct jpeg_error_mgr         cjerr;
+    };
+}
+
+XJpegRequantizer::XJpegRequantizer( uint16_t quality ) :
+    mData( new Private::XJpegRequantizerData( quality ) )
+{
+
+}
+
+XJpegRequantizer::~XJpegRequantizer( )
+{
+    delete mData;
+}
+
+// Get/Set target quality (1-100)
+uint16_t XJpegRequantizer::Quality( ) const
+{
+    return mData->Quality;
+}
+void XJpegRequantizer::SetQuality( uint16_t quality )
+{
+    mData->Quality = quality;
+    if ( mData->Quality > 100 ) mData->Quality = 100;
+    if ( mData->Quality < 1   ) mData->Quality = 1;
+}
+
+// Requantize JPEG image and write the result into provided buffer
+XError XJpegRequantizer::Requantize( const uint8_t* jpegData, uint32_t jpegSize, uint8_t** buffer, uint32_t* bufferSize )
+{
+    return mData->Requantize( jpegData, jpegSize, buffer, bufferSize );
+}
+
+namespace Private
+{
+
+// Read coefficients of JPEG image, quantize them with coarser tables and write as new JPEG image
+XError XJpegRequantizerData::Requantize( const uint8_t* jpegData, uint32_t jpegSize, uint8_t** buffer, uint32_t* bufferSize )
+{
+    XError ret = XError::Success;
+
+    if ( ( jpegData == nullptr ) || ( buffer == nullptr ) || ( *buffer == nullptr ) || ( bufferSize == nullptr ) )
+    {
+        ret = XError::NullPointer;
+    }
+    else
+    {
+        try
+        {
+            jvirt_barray_ptr* coefArrays;
+            unsigned long     mem_buffer_size = *bufferSize;
+
+            jpeg_mem_src( &dinfo, const_cast<uint8_t*>( jpegData ), jpegSize );
+            jpeg_read_header( &dinfo, TRUE );
+
+            coefArrays = jpeg_read_coefficients( &dinfo );
+
+            // tables of the source image are copied into the new one and then made coarser
+            jpeg_mem_dest( &cinfo, buffer, &mem_buffer_size );
+            jpeg_copy_critical_parameters( &dinfo, &cinfo );
+
+            SetTargetTables( );
+
+            for ( int ci = 0; ci < dinfo.num_components; ci++ )
+            {
+                RequantizeComponent( coefArrays[ci], ci );
+            }
+
+            jpeg_write_coefficients( &cinfo, coefArrays );
+            jpeg_finish_compress( &cinfo );
+            jpeg_finish_decompress( &dinfo );
+
+            *bufferSize = static_cast<uint32_t>( mem_buffer_size );
+        }
+        catch ( const JpegRequantizeException& )
+        {
+            jpeg_abort_compress( &cinfo );
+            jpeg_abort_decompress( &dinfo );
+            ret = XError::FailedImageEncoding;
+        }
+    }
+
+    return ret;
+}
+
+// Replace tables copied from the source image with standard ones scaled for target quality, keeping
+// source's steps where those are coarser already (table 0 is treated as luma's, all others as chroma's)
+void XJpegRequantizerData::SetTargetTables( )
+{
+    int scale = jpeg_quality_scaling( Quality );
+
+    for ( int tbl = 0; tbl < NUM_QUANT_TBLS; tbl++ )
+    {
+        JQUANT_TBL* table = cinfo.quant_tbl_ptrs[tbl];
+
+        if ( table != nullptr )
+        {
+            const uint16_t* stdTable = ( tbl == 0 ) ? StdLuminanceTable : StdChrominanceTable;
+
+            for ( int k = 0; k < DCTSIZE2; k++ )
+            {
+                // limit steps to 255, so the image stays baseline
+                long step = ( static_cast<long>( stdTable[k] ) * scale + 50 ) / 100;
+
+                step = max( 1L, min( 255L, step ) );
+                table->quantval[k] = static_cast<UINT16>( max( static_cast<long>( table->quantval[k] ), step ) );
+            }
+        }
+    }
+}
+
+// Quantize coefficients of the component with its new table - dequantized value is divided by new step and rounded
+// (ratios of steps are used instead, so there is no integer division for every coefficient)
+void XJpegRequantizerData::RequantizeComponent( jvirt_barray_ptr coefArray, int ci )
+{
+    const jpeg_component_info* comp     = &dinfo.comp_info[ci];
+    const UINT16*              oldSteps = comp->quant_table->quantval;
+    const UINT16*              newSteps = cinfo.quant_tbl_ptrs[cinfo.comp_info[ci].quant_tbl_no]->quantval;
+    float                      ratios[DCTSIZE2];
+    bool                       changed  = false;
+
+    for ( int k = 0; k < DCTSIZE2; k++ )
+    {
+        ratios[k] = static_cast<float>( oldSteps[k] ) / newSteps[k];
+        changed  |= ( oldSteps[k] != newSteps[k] );
+    }
+
+    for ( JDIMENSION row = 0; ( changed ) && ( row < comp->height_in_blocks ); row++ )
+    {
+        JBLOCKARRAY blockRow = ( *dinfo.mem->access_virt_barray )( reinterpret_cast<j_common_ptr>( &dinfo ), coefArray, row, 1, TRUE );
+
+        for ( JDIMENSION col = 0; col < comp->width_in_blocks; col++ )
+        {
+            JCOEF* coefs = blockRow[0][col];
+
+            for ( int k = 0; k < DCTSIZE2; k++ )
+            {
+                float value = coefs[k] * ratios[k];
+
+                coefs[k] = static_cast<JCOEF>( ( value >= 0 ) ? value + 0.5f : value - 0.5f );
+            }
+        }
+    }
+}
+
+} // namespace Private
@@ -0,0 +1,69 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XJPEG_REQUANTIZER_HPP
+#define XJPEG_REQUANTIZER_HPP
+
+#include <stdint.h>
+
+#include "XInterfaces.hpp"
+#include "XError.hpp"
+
+namespace Private
+{
+    class XJpegRequantizerData;
+}
+
+/* ================================================================= */
+/* Makes smaller JPEG images of lower quality out of existing ones,  */
+/* without decoding them into pixels. DCT coefficients are read from */
+/* the image, quantized again with coarser tables (standard tables   */
+/* scaled for the target quality) and entropy coded. There is no     */
+/* inverse/forward DCT, upsampling or color conversion, so it is     */
+/* much cheaper than decoding and encoding the image again.          */
+/* ================================================================= */
+class XJpegRequantizer : private Uncopyable
+{
+public:
+    XJpegRequantizer( uint16_t quality = 50 );
+    ~XJpegRequantizer( );
+
+    // Get/Set target quality (1-100)
+    uint16_t Quality( ) const;
+    void SetQuality( uint16_t quality );
+
+    /* Requantize JPEG image and write the result into provided buffer
+
+       Quantization steps of the new image are never finer than those
+       of the source, so coefficients of images having lower quality
+       already are written as they are. Buffer is handled same way as
+       by XJpegEncoder::EncodeToMemory() - on input, buffer size must
+       be set to the size of provided buffer. On output, it is set to
+       the size of the new JPEG image. If the provided buffer is too
+       small, a new one is allocated (malloc), while the provided one
+       is not freed.
+    */
+    XError Requantize( const uint8_t* jpegData, uint32_t jpegSize, uint8_t** buffer, uint32_t* bufferSize );
+
+private:
+    Private::XJpegRequantizerData* mData;
+};
+
+#endif // XJPEG_REQUANTIZER_HPP
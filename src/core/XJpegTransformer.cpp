@@ -0,0 +1,353 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "XJpegTransformer.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <exception>
+#include <algorithm>
+#include <vector>
+#include <jpeglib.h>
+
+using namespace std;
+
+namespace Private
+{
+    class JpegTransformException : public exception
+    {
+    public:
+        virtual const char* what( ) const throw( )
+        {
+            return "JPEG transformation failure";
+        }
+    };
+
+    static void transformer_error_exit( j_common_ptr /* cinfo */ )
+    {
+        throw JpegTransformException( );
+    }
+
+    static void transformer_output_message( j_common_ptr /* cinfo */ )
+    {
+        // do nothing - kill the message
+    }
+
+    class XJpegTransformerData
+    {
+    public:
+        XJpegTransformerData( )
+        {
+            // allocate and initialize JPEG decompression/compression objects
+            dinfo.err            = jpeg_std_error( &djerr );
+            djerr.error_exit     = transformer_error_exit;
+            djerr.output_message = transformer_output_message;
+
+            cinfo.err            = jpeg_std_error( &cjerr );
+            cjerr.error_exit     = transformer_error_exit;
+            cjerr.output_message = transformer_output_message;
+
+            jpeg_create_decompress( &dinfo );
+            jpeg_create_compress( &cinfo );
+        }
+
+        ~XJpegTransformerData( )
+        {
+            jpeg_destroy_compress( &cinfo );
+            jpeg_destroy_decompress( &dinfo );
+        }
+
+        XError Transform( const uint8_t* jpegData, uint32_t jpegSize, const XImageTransformation& transformation,
+                          uint8_t** buffer, uint32_t* bufferSize );
+
+    private:
+        void PrepareCoefficientMap( bool transpose, bool mirrorX, bool mirrorY );
+        void TransposeQuantTables( );
+        void TransformComponent( int ci, jvirt_barray_ptr srcArray, jvirt_barray_ptr dstArray,
+                                 JDIMENSION bx0, JDIMENSION by0, JDIMENSION nbx, JDIMENSION nby,
+                                 bool transpose, bool mirrorX, bool mirrorY );
+
+    private:
+        struct jpeg_decompress_struct dinfo;
+        struct jpeg_compress_struct   cinfo;
+        struct jpeg_error_mgr         djerr;
+        struct jpeg_error_mgr         cjerr;
+
+        // source index and sign for every coefficient of transformed block
+        int      CoefIndex[DCTSIZE2];
+        int      CoefSign[DCTSIZE2];
+        bool     CopyBlocks;
+
+        vector<JBLOCKROW> SrcRows;
+    };
+}
+
+XJpegTransformer::XJpegTransformer( ) :
+    mData( new Private::XJpegTransformerData( ) )
+{
+
+}
+
+XJpegTransformer::~XJpegTransformer( )
+{
+    delete mData;
+}
+
+// Transform JPEG image and write the result into provided buffer
+XError XJpegTransformer::Transform( const uint8_t* jpegData, uint32_t jpegSize, const XImageTransformation& transformation,
+                                    uint8_t** buffer, uint32_t* bufferSize )
+{
+    return mData->Transform( jpegData, jpegSize, transformation, buffer, bufferSize );
+}
+
+namespace Private
+{
+
+// Read coefficients of JPEG image, move its blocks into their new places and write as new JPEG image
+XError XJpegTransformerData::Transform( const uint8_t* jpegData, uint32_t jpegSize, const XImageTransformation& transformation,
+                                        uint8_t** buffer, uint32_t* bufferSize )
+{
+    XError ret = XError::Success;
+
+    if ( ( jpegData == nullptr ) || ( buffer == nullptr ) || ( *buffer == nullptr ) || ( bufferSize == nullptr ) )
+    {
+        ret = XError::NullPointer;
+    }
+    else
+    {
+        try
+        {
+            jvirt_barray_ptr* srcArrays;
+            jvirt_barray_ptr  dstArrays[MAX_COMPONENTS];
+            unsigned long     mem_buffer_size = *bufferSize;
+            bool              transpose, mirrorX, mirrorY;
+
+            XImageTransform::GetOrientation( transformation.Rotation, transformation.FlipHorizontal, &transpose, &mirrorX, &mirrorY );
+
+            jpeg_mem_src( &dinfo, const_cast<uint8_t*>( jpegData ), jpegSize );
+            jpeg_read_header( &dinfo, TRUE );
+
+            srcArrays = jpeg_read_coefficients( &dinfo );
+
+            // region of interest expanded to MCU boundaries (clipped to image's size)
+            int32_t mcuWidth    = dinfo.max_h_samp_factor * DCTSIZE;
+            int32_t mcuHeight   = dinfo.max_v_samp_factor * DCTSIZE;
+            int32_t imageWidth  = static_cast<int32_t>( dinfo.image_width );
+            int32_t imageHeight = static_cast<int32_t>( dinfo.image_height );
+            int32_t x1          = transformation.X;
+            int32_t y1          = transformation.Y;
+            int32_t x2          = ( transformation.Width  <= 0 ) ? imageWidth  : x1 + transformation.Width;
+            int32_t y2          = ( transformation.Height <= 0 ) ? imageHeight : y1 + transformation.Height;
+
+            x1 = max( 0, min( imageWidth,  x1 ) ) / mcuWidth  * mcuWidth;
+            y1 = max( 0, min( imageHeight, y1 ) ) / mcuHeight * mcuHeight;
+            x2 = min( imageWidth,  ( max( 0, x2 ) + mcuWidth  - 1 ) / mcuWidth  * mcuWidth  );
+            y2 = min( imageHeight, ( max( 0, y2 ) + mcuHeight - 1 ) / mcuHeight * mcuHeight );
+
+            int32_t cropWidth  = max( 0, x2 - x1 );
+            int32_t cropHeight = max( 0, y2 - y1 );
+
+            // partial MCUs can not be mirrored, since their padding would become visible
+            if ( mirrorX )
+            {
+                cropWidth -= cropWidth % mcuWidth;
+            }
+            if ( mirrorY )
+            {
+                cropHeight -= cropHeight % mcuHeight;
+            }
+
+            if ( ( cropWidth == 0 ) || ( cropHeight == 0 ) )
+            {
+                jpeg_abort_decompress( &dinfo );
+                ret = XError::ImageParametersMismatch;
+            }
+            else
+            {
+                jpeg_mem_dest( &cinfo, buffer, &mem_buffer_size );
+                jpeg_copy_critical_parameters( &dinfo, &cinfo );
+
+                JDIMENSION dstWidth  = static_cast<JDIMENSION>( ( transpose ) ? cropHeight : cropWidth );
+                JDIMENSION dstHeight = static_cast<JDIMENSION>( ( transpose ) ? cropWidth  : cropHeight );
+
+            #if JPEG_LIB_VERSION >= 80
+                cinfo.jpeg_width   = dstWidth;
+                cinfo.jpeg_height  = dstHeight;
+            #else
+                cinfo.image_width  = dstWidth;
+                cinfo.image_height = dstHeight;
+            #endif
+
+                if ( transpose )
+                {
+                    for ( int ci = 0; ci < cinfo.num_components; ci++ )
+                    {
+                        swap( cinfo.comp_info[ci].h_samp_factor, cinfo.comp_info[ci].v_samp_factor );
+                    }
+                    TransposeQuantTables( );
+                }
+
+                // destination arrays cover entire MCUs, so padding blocks are there as well (zeroed)
+                int dstMcuWidth  = ( ( transpose ) ? dinfo.max_v_samp_factor : dinfo.max_h_samp_factor ) * DCTSIZE;
+                int dstMcuHeight = ( ( transpose ) ? dinfo.max_h_samp_factor : dinfo.max_v_samp_factor ) * DCTSIZE;
+
+                for ( int ci = 0; ci < cinfo.num_components; ci++ )
+                {
+                    const jpeg_component_info* comp = &cinfo.comp_info[ci];
+
+                    dstArrays[ci] = ( *dinfo.mem->request_virt_barray )( reinterpret_cast<j_common_ptr>( &dinfo ), JPOOL_IMAGE, TRUE,
+                        static_cast<JDIMENSION>( ( dstWidth  + dstMcuWidth  - 1 ) / dstMcuWidth  * comp->h_samp_factor ),
+                        static_cast<JDIMENSION>( ( dstHeight + dstMcuHeight - 1 ) / dstMcuHeight * comp->v_samp_factor ),
+                        static_cast<JDIMENSION>( comp->v_samp_factor ) );
+                }
+                ( *dinfo.mem->realize_virt_arrays )( reinterpret_cast<j_common_ptr>( &dinfo ) );
+
+                PrepareCoefficientMap( transpose, mirrorX, mirrorY );
+
+                for ( int ci = 0; ci < dinfo.num_components; ci++ )
+                {
+                    const jpeg_component_info* comp = &dinfo.comp_info[ci];
+
+                    // blocks of the component covering the cropped region in source image
+                    JDIMENSION bx0 = static_cast<JDIMENSION>( x1 / mcuWidth  * comp->h_samp_factor );
+                    JDIMENSION by0 = static_cast<JDIMENSION>( y1 / mcuHeight * comp->v_samp_factor );
+                    JDIMENSION nbx = static_cast<JDIMENSION>( ( cropWidth  * comp->h_samp_factor + mcuWidth  - 1 ) / mcuWidth  );
+                    JDIMENSION nby = static_cast<JDIMENSION>( ( cropHeight * comp->v_samp_factor + mcuHeight - 1 ) / mcuHeight );
+
+                    TransformComponent( ci, srcArrays[ci], dstArrays[ci], bx0, by0, nbx, nby, transpose, mirrorX, mirrorY );
+                }
+
+                jpeg_write_coefficients( &cinfo, dstArrays );
+                jpeg_finish_compress( &cinfo );
+                jpeg_finish_decompress( &dinfo );
+
+                *bufferSize = static_cast<uint32_t>( mem_buffer_size );
+            }
+        }
+        catch ( const JpegTransformException& )
+        {
+            jpeg_abort_compress( &cinfo );
+            jpeg_abort_decompress( &dinfo );
+            ret = XError::FailedImageEncoding;
+        }
+    }
+
+    return ret;
+}
+
+// Find where every coefficient of transformed block comes from - mirroring a block changes signs
+// of its odd horizontal/vertical frequencies, while transposing it swaps its rows and columns
+void XJpegTransformerData::PrepareCoefficientMap( bool transpose, bool mirrorX, bool mirrorY )
+{
+    for ( int v = 0; v < DCTSIZE; v++ )
+    {
+        for ( int u = 0; u < DCTSIZE; u++ )
+        {
+            int su = ( transpose ) ? v : u;
+            int sv = ( transpose ) ? u : v;
+            int sign = 1;
+
+            if ( ( mirrorX ) && ( su & 1 ) ) sign = -sign;
+            if ( ( mirrorY ) && ( sv & 1 ) ) sign = -sign;
+
+            CoefIndex[v * DCTSIZE + u] = sv * DCTSIZE + su;
+            CoefSign[v * DCTSIZE + u]  = sign;
+        }
+    }
+
+    CopyBlocks = ( ( !transpose ) && ( !mirrorX ) && ( !mirrorY ) );
+}
+
+// Transpose quantization tables of the new image (those are copied from source image)
+void XJpegTransformerData::TransposeQuantTables( )
+{
+    for ( int tbl = 0; tbl < NUM_QUANT_TBLS; tbl++ )
+    {
+        JQUANT_TBL* table = cinfo.quant_tbl_ptrs[tbl];
+
+        if ( table != nullptr )
+        {
+            for ( int v = 0; v < DCTSIZE; v++ )
+            {
+                for ( int u = v + 1; u < DCTSIZE; u++ )
+                {
+                    swap( table->quantval[v * DCTSIZE + u], table->quantval[u * DCTSIZE + v] );
+                }
+            }
+        }
+    }
+}
+
+// Fill blocks of the transformed component from the region of source component
+void XJpegTransformerData::TransformComponent( int ci, jvirt_barray_ptr srcArray, jvirt_barray_ptr dstArray,
+                                               JDIMENSION bx0, JDIMENSION by0, JDIMENSION nbx, JDIMENSION nby,
+                                               bool transpose, bool mirrorX, bool mirrorY )
+{
+    j_common_ptr               common    = reinterpret_cast<j_common_ptr>( &dinfo );
+    const jpeg_component_info* dstComp   = &cinfo.comp_info[ci];
+    JDIMENSION                 dstRowsV  = static_cast<JDIMENSION>( dstComp->v_samp_factor );
+    JDIMENSION                 dstWidth  = ( ( transpose ) ? nby : nbx );
+    JDIMENSION                 dstHeight = ( ( transpose ) ? nbx : nby );
+    JDIMENSION                 dstArrayH = ( dstHeight + dstRowsV - 1 ) / dstRowsV * dstRowsV;
+
+    // coefficients read by jpeg_read_coefficients() are kept in memory entirely, so pointers to
+    // rows of the source region stay valid while destination rows are accessed
+    SrcRows.resize( nby );
+    for ( JDIMENSION row = 0; row < nby; row++ )
+    {
+        SrcRows[row] = ( *dinfo.mem->access_virt_barray )( common, srcArray, by0 + row, 1, FALSE )[0];
+    }
+
+    for ( JDIMENSION dby = 0; dby < dstArrayH; dby += dstRowsV )
+    {
+        JBLOCKARRAY dstRows = ( *dinfo.mem->access_virt_barray )( common, dstArray, dby, dstRowsV, TRUE );
+
+        for ( JDIMENSION row = 0; ( row < dstRowsV ) && ( dby + row < dstHeight ); row++ )
+        {
+            JBLOCKROW dstRow = dstRows[row];
+
+            for ( JDIMENSION dbx = 0; dbx < dstWidth; dbx++ )
+            {
+                // position of the block in source region (before mirroring)
+                JDIMENSION relX = ( transpose ) ? dby + row : dbx;
+                JDIMENSION relY = ( transpose ) ? dbx : dby + row;
+                JDIMENSION sbx  = bx0 + ( ( mirrorX ) ? nbx - 1 - relX : relX );
+                JDIMENSION sby  =       ( ( mirrorY ) ? nby - 1 - relY : relY );
+
+                const JCOEF* srcCoefs = SrcRows[sby][sbx];
+                JCOEF*       dstCoefs = dstRow[dbx];
+
+                if ( CopyBlocks )
+                {
+                    memcpy( dstCoefs, srcCoefs, sizeof( JBLOCK ) );
+                }
+                else
+                {
+                    for ( int k = 0; k < DCTSIZE2; k++ )
+                    {
+                        dstCoefs[k] = static_cast<JCOEF>( srcCoefs[CoefIndex[k]] * CoefSign[k] );
+                    }
+                }
+            }
+        }
+    }
+}
+
+} // namespace Private
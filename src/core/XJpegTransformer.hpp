@@ -0,0 +1,65 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XJPEG_TRANSFORMER_HPP
+#define XJPEG_TRANSFORMER_HPP
+
+#include <stdint.h>
+
+#include "XInterfaces.hpp"
+#include "XImageTransform.hpp"
+#include "XError.hpp"
+
+namespace Private
+{
+    class XJpegTransformerData;
+}
+
+/* ================================================================= */
+/* Lossless cropping, rotation and flipping of JPEG images, done on  */
+/* their DCT coefficients (same way as jpegtran does it). Blocks are */
+/* moved around, while coefficients inside of blocks are transposed  */
+/* and/or have signs of odd frequencies changed. Since it can only   */
+/* be done for entire MCUs, region of interest is expanded to MCU    */
+/* boundaries, while partial MCUs at the right/bottom edge of image  */
+/* are dropped when those would end up on the other side.            */
+/* ================================================================= */
+class XJpegTransformer : private Uncopyable
+{
+public:
+    XJpegTransformer( );
+    ~XJpegTransformer( );
+
+    /* Transform JPEG image and write the result into provided buffer
+
+       Buffer is handled same way as by XJpegEncoder::EncodeToMemory() -
+       on input, buffer size must be set to the size of provided buffer.
+       On output, it is set to the size of the new JPEG image. If the
+       provided buffer is too small, a new one is allocated (malloc),
+       while the provided one is not freed.
+    */
+    XError Transform( const uint8_t* jpegData, uint32_t jpegSize, const XImageTransformation& transformation,
+                      uint8_t** buffer, uint32_t* bufferSize );
+
+private:
+    Private::XJpegTransformerData* mData;
+};
+
+#endif // XJPEG_TRANSFORMER_HPP
@@ -0,0 +1,382 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+#include <chrono>
+
+#include "XMotionDetector.hpp"
+#include "XImageConversion.hpp"
+#include "XJpegDecoder.hpp"
+#include "XTracer.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    // Frames are analysed not more often than this (ms)
+    #define ANALYSIS_INTERVAL   (100)
+
+    class XMotionDetectorData
+    {
+    public:
+        mutable mutex               Sync;
+        uint8_t                     Threshold;
+        float                       MinArea;
+        uint32_t                    HoldTime;
+        vector<XMotionZone>         Zones;
+
+        float                       Level;
+        bool                        MotionWasDetected;
+        steady_clock::time_point    LastMotionTime;
+        steady_clock::time_point    LastAnalysisTime;
+
+    private:
+        vector<uint8_t>             BlocksMap;
+        vector<uint8_t>             PreviousBlocksMap;
+        vector<uint8_t>             ZonesMask;
+        int32_t                     MapWidth;
+        int32_t                     MapHeight;
+        bool                        HavePreviousMap;
+        bool                        ZonesMaskValid;
+
+        XJpegDecoder                Decoder;
+        shared_ptr<XImage>          DecodedImage;
+
+    public:
+        XMotionDetectorData( ) :
+            Sync( ), Threshold( 20 ), MinArea( 1.0f ), HoldTime( 2000 ), Zones( ),
+            Level( 0 ), MotionWasDetected( false ), LastMotionTime( ), LastAnalysisTime( ),
+            BlocksMap( ), PreviousBlocksMap( ), ZonesMask( ), MapWidth( 0 ), MapHeight( 0 ),
+            HavePreviousMap( false ), ZonesMaskValid( false ), Decoder( true ), DecodedImage( )
+        {
+        }
+
+        void Analyse( const shared_ptr<const XImage>& image );
+        void InvalidateZones( ) { ZonesMaskValid = false; }
+
+    private:
+        bool BuildBlocksMap( const shared_ptr<const XImage>& image );
+        void BuildBlocksMap( const uint8_t* data, int32_t stride, int32_t width, int32_t height, int32_t pixelStep );
+        bool DecodeBlocksMap( const shared_ptr<const XImage>& image );
+        void BuildZonesMask( );
+    };
+}
+
+XMotionDetector::XMotionDetector( ) :
+    mData( new Private::XMotionDetectorData( ) )
+{
+}
+
+XMotionDetector::~XMotionDetector( )
+{
+    delete mData;
+}
+
+// New video frame notification - analyse it, unless previous one was analysed very recently
+void XMotionDetector::OnNewImage( const shared_ptr<const XImage>& image )
+{
+    lock_guard<mutex>        lock( mData->Sync );
+    steady_clock::time_point now = steady_clock::now( );
+
+    if ( duration_cast<milliseconds>( now - mData->LastAnalysisTime ).count( ) >= ANALYSIS_INTERVAL )
+    {
+        XTraceScope trace( "Detect motion" );
+
+        mData->LastAnalysisTime = now;
+        mData->Analyse( image );
+    }
+}
+
+// Check if motion is detected at the moment (or was detected within hold time)
+bool XMotionDetector::IsMotionDetected( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+
+    return ( ( mData->MotionWasDetected ) &&
+             ( duration_cast<milliseconds>( steady_clock::now( ) - mData->LastMotionTime ).count( ) < mData->HoldTime ) );
+}
+
+// Percentage of changed blocks found in the last analysed frame
+float XMotionDetector::MotionLevel( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->Level;
+}
+
+// Milliseconds passed since motion was detected last time
+int64_t XMotionDetector::TimeSinceMotion( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    int64_t           ret = -1;
+
+    if ( mData->MotionWasDetected )
+    {
+        ret = duration_cast<milliseconds>( steady_clock::now( ) - mData->LastMotionTime ).count( );
+    }
+
+    return ret;
+}
+
+// Get/Set difference of block's intensity to treat it as changed
+uint8_t XMotionDetector::Threshold( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->Threshold;
+}
+void XMotionDetector::SetThreshold( uint8_t threshold )
+{
+    lock_guard<mutex> lock( mData->Sync );
+    mData->Threshold = threshold;
+}
+
+// Get/Set percentage of changed blocks to treat as motion
+float XMotionDetector::MinArea( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->MinArea;
+}
+void XMotionDetector::SetMinArea( float minArea )
+{
+    lock_guard<mutex> lock( mData->Sync );
+    mData->MinArea = min( max( minArea, 0.0f ), 100.0f );
+}
+
+// Get/Set time (ms) to keep motion state after motion has stopped
+uint32_t XMotionDetector::HoldTime( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->HoldTime;
+}
+void XMotionDetector::SetHoldTime( uint32_t holdTime )
+{
+    lock_guard<mutex> lock( mData->Sync );
+    mData->HoldTime = holdTime;
+}
+
+// Get/Set zones to detect motion in
+vector<XMotionZone> XMotionDetector::Zones( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+    return mData->Zones;
+}
+void XMotionDetector::SetZones( const vector<XMotionZone>& zones )
+{
+    lock_guard<mutex> lock( mData->Sync );
+
+    mData->Zones = zones;
+    mData->InvalidateZones( );
+}
+
+namespace Private
+{
+
+// Compare blocks map of the image with the previous one and update motion state
+void XMotionDetectorData::Analyse( const shared_ptr<const XImage>& image )
+{
+    int32_t oldMapWidth  = MapWidth;
+    int32_t oldMapHeight = MapHeight;
+
+    swap( BlocksMap, PreviousBlocksMap );
+
+    if ( !BuildBlocksMap( image ) )
+    {
+        // start from scratch on the next frame, since the map may be partially updated
+        HavePreviousMap = false;
+    }
+    else
+    {
+        int32_t mapSize = MapWidth * MapHeight;
+
+        if ( ( MapWidth != oldMapWidth ) || ( MapHeight != oldMapHeight ) )
+        {
+            HavePreviousMap = false;
+            ZonesMaskValid  = false;
+        }
+
+        if ( !ZonesMaskValid )
+        {
+            BuildZonesMask( );
+        }
+
+        if ( HavePreviousMap )
+        {
+            uint32_t zoneSize = static_cast<uint32_t>( count_if( ZonesMask.begin( ), ZonesMask.end( ), []( uint8_t v ) { return v != 0; } ) );
+            uint32_t changed  = XImageConversion::CountDifferences( BlocksMap.data( ), PreviousBlocksMap.data( ), ZonesMask.data( ), mapSize, Threshold );
+
+            Level = ( zoneSize == 0 ) ? 0.0f : static_cast<float>( changed ) * 100 / zoneSize;
+
+            if ( ( changed != 0 ) && ( Level >= MinArea ) )
+            {
+                MotionWasDetected = true;
+                LastMotionTime    = steady_clock::now( );
+            }
+        }
+
+        HavePreviousMap = true;
+    }
+}
+
+// Build map of 8x8 blocks' average intensities for the image
+bool XMotionDetectorData::BuildBlocksMap( const shared_ptr<const XImage>& image )
+{
+    bool ret = true;
+
+    switch ( image->Format( ) )
+    {
+    case XPixelFormat::Grayscale8:
+    case XPixelFormat::NV12:
+    case XPixelFormat::I420:
+    case XPixelFormat::BayerRGGB8:
+    case XPixelFormat::BayerGRBG8:
+    case XPixelFormat::BayerGBRG8:
+    case XPixelFormat::BayerBGGR8:
+        // luma plane or raw sensor's values
+        BuildBlocksMap( image->Data( ), image->Stride( ), image->Width( ), image->Height( ), 1 );
+        break;
+
+    case XPixelFormat::RGB24:
+        // green channel is a good enough approximation of intensity
+        BuildBlocksMap( image->Data( ) + GreenIndex, image->Stride( ), image->Width( ), image->Height( ), 3 );
+        break;
+
+    case XPixelFormat::RGBA32:
+        BuildBlocksMap( image->Data( ) + GreenIndex, image->Stride( ), image->Width( ), image->Height( ), 4 );
+        break;
+
+    case XPixelFormat::YUYV:
+        BuildBlocksMap( image->Data( ), image->Stride( ), image->Width( ), image->Height( ), 2 );
+        break;
+
+    case XPixelFormat::UYVY:
+        BuildBlocksMap( image->Data( ) + 1, image->Stride( ), image->Width( ), image->Height( ), 2 );
+        break;
+
+    case XPixelFormat::Grayscale16:
+        // most significant bytes of little endian values
+        BuildBlocksMap( image->Data( ) + 1, image->Stride( ), image->Width( ), image->Height( ), 2 );
+        break;
+
+    case XPixelFormat::JPEG:
+        ret = DecodeBlocksMap( image );
+        break;
+
+    default:
+        ret = false;
+        break;
+    }
+
+    return ret;
+}
+
+// Build map of 8x8 blocks' average intensities for the 8 bit plane with the specified distance between pixels
+void XMotionDetectorData::BuildBlocksMap( const uint8_t* data, int32_t stride, int32_t width, int32_t height, int32_t pixelStep )
+{
+    MapWidth  = width  / 8;
+    MapHeight = height / 8;
+
+    BlocksMap.resize( MapWidth * MapHeight );
+
+    for ( int32_t by = 0; by < MapHeight; by++ )
+    {
+        const uint8_t* src = data + by * 8 * stride;
+        uint8_t*       dst = BlocksMap.data( ) + by * MapWidth;
+
+        if ( pixelStep == 1 )
+        {
+            XImageConversion::AverageBlocks8( src, stride, MapWidth, dst );
+        }
+        else
+        {
+            for ( int32_t bx = 0; bx < MapWidth; bx++ )
+            {
+                uint32_t sum = 0;
+
+                for ( int32_t y = 0; y < 8; y++ )
+                {
+                    const uint8_t* ptr = src + y * stride + bx * 8 * pixelStep;
+
+                    for ( int32_t x = 0; x < 8; x++, ptr += pixelStep )
+                    {
+                        sum += *ptr;
+                    }
+                }
+
+                dst[bx] = static_cast<uint8_t>( ( sum + 32 ) >> 6 );
+            }
+        }
+    }
+}
+
+// Decode JPEG image at 1/8 scale, which gives average intensities of 8x8 blocks directly
+bool XMotionDetectorData::DecodeBlocksMap( const shared_ptr<const XImage>& image )
+{
+    bool ret = Decoder.Decode( image, DecodedImage, XPixelFormat::Grayscale8, XJpegScale::Eighth );
+
+    if ( ret )
+    {
+        MapWidth  = DecodedImage->Width( );
+        MapHeight = DecodedImage->Height( );
+
+        BlocksMap.resize( MapWidth * MapHeight );
+
+        for ( int32_t y = 0; y < MapHeight; y++ )
+        {
+            memcpy( BlocksMap.data( ) + y * MapWidth, DecodedImage->Data( ) + y * DecodedImage->Stride( ), MapWidth );
+        }
+    }
+
+    return ret;
+}
+
+// Mark blocks, which belong to any of the zones (all blocks if there are no zones)
+void XMotionDetectorData::BuildZonesMask( )
+{
+    ZonesMask.assign( MapWidth * MapHeight, ( Zones.empty( ) ) ? 1 : 0 );
+
+    for ( const XMotionZone& zone : Zones )
+    {
+        // blocks are taken if their centers are inside of a zone (compared in units of 1/200 of a block)
+        for ( int32_t y = 0; y < MapHeight; y++ )
+        {
+            int32_t cy = ( 2 * y + 1 ) * 100;
+
+            if ( ( cy >= 2 * zone.Y * MapHeight ) && ( cy < 2 * ( zone.Y + zone.Height ) * MapHeight ) )
+            {
+                for ( int32_t x = 0; x < MapWidth; x++ )
+                {
+                    int32_t cx = ( 2 * x + 1 ) * 100;
+
+                    if ( ( cx >= 2 * zone.X * MapWidth ) && ( cx < 2 * ( zone.X + zone.Width ) * MapWidth ) )
+                    {
+                        ZonesMask[y * MapWidth + x] = 1;
+                    }
+                }
+            }
+        }
+    }
+
+    ZonesMaskValid = true;
+}
+
+} // namespace Private
@@ -0,0 +1,91 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XMOTION_DETECTOR_HPP
+#define XMOTION_DETECTOR_HPP
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "XInterfaces.hpp"
+#include "IVideoSourceListener.hpp"
+
+namespace Private
+{
+    class XMotionDetectorData;
+}
+
+// Rectangular zone of an image to look for motion in (percents of image's width/height)
+struct XMotionZone
+{
+    uint8_t X;
+    uint8_t Y;
+    uint8_t Width;
+    uint8_t Height;
+};
+
+/* ================================================================= */
+/* Motion detector listening to video source. Every frame is reduced */
+/* to a map of 8x8 blocks' average intensities (JPEG frames are      */
+/* decoded at 1/8 scale for that), which is compared with the map of */
+/* the previously analysed frame. Motion is reported while the       */
+/* percentage of changed blocks within zones is above minimum area   */
+/* and for some hold time after that.                                */
+/* ================================================================= */
+class XMotionDetector : public IVideoSourceListener, private Uncopyable
+{
+public:
+    XMotionDetector( );
+    ~XMotionDetector( );
+
+    // New video frame notification
+    void OnNewImage( const std::shared_ptr<const XImage>& image ) override;
+    // Video source error notification
+    void OnError( const std::string& /* errorMessage */, bool /* fatal */ ) override { }
+
+    // Check if motion is detected at the moment (or was detected within hold time)
+    bool IsMotionDetected( ) const;
+    // Percentage of changed blocks found in the last analysed frame
+    float MotionLevel( ) const;
+    // Milliseconds passed since motion was detected last time (-1 if it was never detected)
+    int64_t TimeSinceMotion( ) const;
+
+    // Get/Set difference of block's intensity to treat it as changed
+    uint8_t Threshold( ) const;
+    void SetThreshold( uint8_t threshold );
+
+    // Get/Set percentage of changed blocks to treat as motion
+    float MinArea( ) const;
+    void SetMinArea( float minArea );
+
+    // Get/Set time (ms) to keep motion state after motion has stopped
+    uint32_t HoldTime( ) const;
+    void SetHoldTime( uint32_t holdTime );
+
+    // Get/Set zones to detect motion in (empty list - entire image)
+    std::vector<XMotionZone> Zones( ) const;
+    void SetZones( const std::vector<XMotionZone>& zones );
+
+private:
+    Private::XMotionDetectorData* mData;
+};
+
+#endif // XMOTION_DETECTOR_HPP
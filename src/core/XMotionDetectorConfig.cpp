@@ -0,0 +1,261 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include <map>
+
+#include "XMotionDetectorConfig.hpp"
+
+using namespace std;
+
+#define PROP_THRESHOLD  "threshold"
+#define PROP_MIN_AREA   "minArea"
+#define PROP_HOLD_TIME  "holdTime"
+#define PROP_ZONES      "zones"
+
+#define PROP_MOTION     "motion"
+#define PROP_LEVEL      "level"
+#define PROP_SINCE      "sinceMotion"
+
+// Parse list of zones like "0,0,50,100;50,50,50,50"
+static bool ParseZones( const string& value, vector<XMotionZone>& zones )
+{
+    const char* ptr = value.c_str( );
+    bool        ret = true;
+    uint32_t    x, y, width, height;
+    int         charsScanned;
+
+    zones.clear( );
+
+    while ( ( ret ) && ( *ptr != '\0' ) )
+    {
+        if ( ( sscanf( ptr, "%u,%u,%u,%u%n", &x, &y, &width, &height, &charsScanned ) != 4 ) ||
+             ( x + width > 100 ) || ( y + height > 100 ) || ( width == 0 ) || ( height == 0 ) )
+        {
+            ret = false;
+        }
+        else
+        {
+            XMotionZone zone = { static_cast<uint8_t>( x ), static_cast<uint8_t>( y ),
+                                 static_cast<uint8_t>( width ), static_cast<uint8_t>( height ) };
+
+            zones.push_back( zone );
+            ptr += charsScanned;
+
+            if ( *ptr == ';' )
+            {
+                ptr++;
+            }
+            else if ( *ptr != '\0' )
+            {
+                ret = false;
+            }
+        }
+    }
+
+    return ret;
+}
+
+// Make string out of list of zones
+static string ZonesToString( const vector<XMotionZone>& zones )
+{
+    string ret;
+    char   buffer[32];
+
+    for ( const XMotionZone& zone : zones )
+    {
+        sprintf( buffer, "%s%u,%u,%u,%u", ( ret.empty( ) ) ? "" : ";", zone.X, zone.Y, zone.Width, zone.Height );
+        ret += buffer;
+    }
+
+    return ret;
+}
+
+// ------------------------------------------------------------------------------------------
+
+XMotionDetectorConfig::XMotionDetectorConfig( const shared_ptr<XMotionDetector>& detector ) :
+    mDetector( detector )
+{
+}
+
+// Set the specified property of motion detector
+XError XMotionDetectorConfig::SetProperty( const string& propertyName, const string& value )
+{
+    XError   ret = XError::Success;
+    uint32_t intValue;
+    float    floatValue;
+
+    if ( propertyName == PROP_THRESHOLD )
+    {
+        if ( ( sscanf( value.c_str( ), "%u", &intValue ) != 1 ) || ( intValue < 1 ) || ( intValue > 255 ) )
+        {
+            ret = XError::InvalidPropertyValue;
+        }
+        else
+        {
+            mDetector->SetThreshold( static_cast<uint8_t>( intValue ) );
+        }
+    }
+    else if ( propertyName == PROP_MIN_AREA )
+    {
+        if ( ( sscanf( value.c_str( ), "%f", &floatValue ) != 1 ) || ( floatValue < 0 ) || ( floatValue > 100 ) )
+        {
+            ret = XError::InvalidPropertyValue;
+        }
+        else
+        {
+            mDetector->SetMinArea( floatValue );
+        }
+    }
+    else if ( propertyName == PROP_HOLD_TIME )
+    {
+        if ( sscanf( value.c_str( ), "%u", &intValue ) != 1 )
+        {
+            ret = XError::InvalidPropertyValue;
+        }
+        else
+        {
+            mDetector->SetHoldTime( intValue );
+        }
+    }
+    else if ( propertyName == PROP_ZONES )
+    {
+        vector<XMotionZone> zones;
+
+        if ( !ParseZones( value, zones ) )
+        {
+            ret = XError::InvalidPropertyValue;
+        }
+        else
+        {
+            mDetector->SetZones( zones );
+        }
+    }
+    else
+    {
+        ret = XError::UnknownProperty;
+    }
+
+    return ret;
+}
+
+// Get the specified property of motion detector
+XError XMotionDetectorConfig::GetProperty( const string& propertyName, string& value ) const
+{
+    XError ret = XError::Success;
+    char   buffer[32];
+
+    if ( propertyName == PROP_THRESHOLD )
+    {
+        sprintf( buffer, "%u", mDetector->Threshold( ) );
+        value = buffer;
+    }
+    else if ( propertyName == PROP_MIN_AREA )
+    {
+        sprintf( buffer, "%g", mDetector->MinArea( ) );
+        value = buffer;
+    }
+    else if ( propertyName == PROP_HOLD_TIME )
+    {
+        sprintf( buffer, "%u", mDetector->HoldTime( ) );
+        value = buffer;
+    }
+    else if ( propertyName == PROP_ZONES )
+    {
+        value = ZonesToString( mDetector->Zones( ) );
+    }
+    else
+    {
+        ret = XError::UnknownProperty;
+    }
+
+    return ret;
+}
+
+// Get all properties of motion detector
+map<string, string> XMotionDetectorConfig::GetAllProperties( ) const
+{
+    static const char* propertyNames[] = { PROP_THRESHOLD, PROP_MIN_AREA, PROP_HOLD_TIME, PROP_ZONES };
+    map<string, string> properties;
+    string              value;
+
+    for ( const char* name : propertyNames )
+    {
+        if ( GetProperty( name, value ) )
+        {
+            properties.insert( pair<string, string>( name, value ) );
+        }
+    }
+
+    return properties;
+}
+
+// ------------------------------------------------------------------------------------------
+
+XMotionDetectorInfo::XMotionDetectorInfo( const shared_ptr<const XMotionDetector>& detector ) :
+    mDetector( detector )
+{
+}
+
+// Get the specified property of motion detector's state
+XError XMotionDetectorInfo::GetProperty( const string& propertyName, string& value ) const
+{
+    XError ret = XError::Success;
+    char   buffer[32];
+
+    if ( propertyName == PROP_MOTION )
+    {
+        value = ( mDetector->IsMotionDetected( ) ) ? "true" : "false";
+    }
+    else if ( propertyName == PROP_LEVEL )
+    {
+        sprintf( buffer, "%.1f", mDetector->MotionLevel( ) );
+        value = buffer;
+    }
+    else if ( propertyName == PROP_SINCE )
+    {
+        sprintf( buffer, "%lld", static_cast<long long>( mDetector->TimeSinceMotion( ) ) );
+        value = buffer;
+    }
+    else
+    {
+        ret = XError::UnknownProperty;
+    }
+
+    return ret;
+}
+
+// Get all properties of motion detector's state
+map<string, string> XMotionDetectorInfo::GetAllProperties( ) const
+{
+    static const char* propertyNames[] = { PROP_MOTION, PROP_LEVEL, PROP_SINCE };
+    map<string, string> properties;
+    string              value;
+
+    for ( const char* name : propertyNames )
+    {
+        if ( GetProperty( name, value ) )
+        {
+            properties.insert( pair<string, string>( name, value ) );
+        }
+    }
+
+    return properties;
+}
@@ -0,0 +1,57 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XMOTION_DETECTOR_CONFIG_HPP
+#define XMOTION_DETECTOR_CONFIG_HPP
+
+#include "IObjectConfigurator.hpp"
+#include "XMotionDetector.hpp"
+
+// The class is to get/set motion detector's settings - threshold, minimum area, hold time and zones.
+// Zones are provided as list of "x,y,width,height" rectangles (percents) separated by ';'.
+class XMotionDetectorConfig : public IObjectConfigurator
+{
+public:
+    XMotionDetectorConfig( const std::shared_ptr<XMotionDetector>& detector );
+
+    XError SetProperty( const std::string& propertyName, const std::string& value );
+    XError GetProperty( const std::string& propertyName, std::string& value ) const;
+
+    std::map<std::string, std::string> GetAllProperties( ) const;
+
+private:
+    std::shared_ptr<XMotionDetector> mDetector;
+};
+
+// The class is to get current state of motion detector - if motion is detected, its level, etc.
+class XMotionDetectorInfo : public IObjectInformation
+{
+public:
+    XMotionDetectorInfo( const std::shared_ptr<const XMotionDetector>& detector );
+
+    XError GetProperty( const std::string& propertyName, std::string& value ) const;
+
+    std::map<std::string, std::string> GetAllProperties( ) const;
+
+private:
+    std::shared_ptr<const XMotionDetector> mDetector;
+};
+
+#endif // XMOTION_DETECTOR_CONFIG_HPP
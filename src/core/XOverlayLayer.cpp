@@ -0,0 +1,277 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#include "XOverlayLayer.hpp"
+#include "XImageDrawing.hpp"
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && ( _M_IX86_FP >= 2 ) )
+    #define XOVERLAY_LAYER_SSE2
+    #include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace Private
+{
+    class XOverlayLayerData
+    {
+    public:
+        shared_ptr<XImage> Image;           // RGBA32 source of the layer
+        XPixelFormat       PreparedFormat;  // pixel format the below is prepared for
+        int32_t            PixelSize;
+        bool               Opaque;          // all pixels are opaque, so they just replace image's pixels
+        vector<uint8_t>    Premultiplied;   // pixels in prepared format, multiplied by their alpha
+        vector<uint8_t>    InverseAlpha;    // 255 - alpha, for every byte of the above
+
+    public:
+        XOverlayLayerData( const shared_ptr<XImage>& image ) :
+            Image( image ), PreparedFormat( XPixelFormat::Unknown ), PixelSize( 0 ), Opaque( false ),
+            Premultiplied( ), InverseAlpha( )
+        {
+        }
+
+        void Prepare( XPixelFormat format );
+    };
+
+    // Divide the specified value (up to 255 * 255) by 255 with rounding
+    static inline uint8_t Div255( uint32_t value )
+    {
+        value += 128;
+        return static_cast<uint8_t>( ( value + ( value >> 8 ) ) >> 8 );
+    }
+
+    static void BlendRow( uint8_t* dst, const uint8_t* premultiplied, const uint8_t* inverseAlpha, int32_t count );
+}
+
+XOverlayLayer::XOverlayLayer( const shared_ptr<XImage>& image ) :
+    mData( new Private::XOverlayLayerData( image ) )
+{
+}
+
+XOverlayLayer::~XOverlayLayer( )
+{
+    delete mData;
+}
+
+// Create layer out of RGBA32 image
+shared_ptr<XOverlayLayer> XOverlayLayer::Create( const shared_ptr<const XImage>& image )
+{
+    shared_ptr<XOverlayLayer> layer;
+
+    if ( ( image ) && ( image->Format( ) == XPixelFormat::RGBA32 ) )
+    {
+        shared_ptr<XImage> copy = image->Clone( );
+
+        if ( copy )
+        {
+            layer.reset( new XOverlayLayer( copy ) );
+        }
+    }
+
+    return layer;
+}
+
+// Create layer with ASCII text
+shared_ptr<XOverlayLayer> XOverlayLayer::CreateText( const string& text, xargb color, xargb background, bool addBorder )
+{
+    shared_ptr<XImage>        image = XImageDrawing::RenderText( text, color, background, addBorder );
+    shared_ptr<XOverlayLayer> layer;
+
+    if ( image )
+    {
+        layer.reset( new XOverlayLayer( image ) );
+    }
+
+    return layer;
+}
+
+// Size of the layer
+int32_t XOverlayLayer::Width( ) const
+{
+    return mData->Image->Width( );
+}
+int32_t XOverlayLayer::Height( ) const
+{
+    return mData->Image->Height( );
+}
+
+// Put the layer on the specified image at the specified location
+XError XOverlayLayer::Draw( const shared_ptr<const XImage>& image, int32_t x, int32_t y )
+{
+    XError ret = XError::Success;
+
+    if ( ( !image ) || ( image->Data( ) == nullptr ) )
+    {
+        ret = XError::NullPointer;
+    }
+    else if ( ( image->Format( ) != XPixelFormat::Grayscale8 ) &&
+              ( image->Format( ) != XPixelFormat::RGB24 ) &&
+              ( image->Format( ) != XPixelFormat::RGBA32 ) )
+    {
+        ret = XError::UnsupportedPixelFormat;
+    }
+    else
+    {
+        int32_t layerWidth = mData->Image->Width( );
+        int32_t startX     = max( 0, -x );
+        int32_t startY     = max( 0, -y );
+        int32_t endX       = min( layerWidth, image->Width( ) - x );
+        int32_t endY       = min( mData->Image->Height( ), image->Height( ) - y );
+
+        if ( ( startX < endX ) && ( startY < endY ) )
+        {
+            if ( mData->PreparedFormat != image->Format( ) )
+            {
+                mData->Prepare( image->Format( ) );
+            }
+
+            int32_t        pixelSize = mData->PixelSize;
+            int32_t        rowSize   = ( endX - startX ) * pixelSize;
+            int32_t        stride    = image->Stride( );
+            const uint8_t* prePtr    = mData->Premultiplied.data( ) + ( startY * layerWidth + startX ) * pixelSize;
+            const uint8_t* invPtr    = mData->InverseAlpha.data( ) + ( startY * layerWidth + startX ) * pixelSize;
+            uint8_t*       dstPtr    = image->Data( ) + ( y + startY ) * stride + ( x + startX ) * pixelSize;
+
+            for ( int32_t row = startY; row < endY; row++ )
+            {
+                if ( mData->Opaque )
+                {
+                    memcpy( dstPtr, prePtr, rowSize );
+                }
+                else
+                {
+                    Private::BlendRow( dstPtr, prePtr, invPtr, rowSize );
+                }
+
+                prePtr += layerWidth * pixelSize;
+                invPtr += layerWidth * pixelSize;
+                dstPtr += stride;
+            }
+        }
+    }
+
+    return ret;
+}
+
+namespace Private
+{
+
+// Prepare pixels of the layer for drawing on images of the specified format
+void XOverlayLayerData::Prepare( XPixelFormat format )
+{
+    int32_t width    = Image->Width( );
+    int32_t height   = Image->Height( );
+    int32_t stride   = Image->Stride( );
+    size_t  dstIndex = 0;
+
+    PixelSize = ( format == XPixelFormat::Grayscale8 ) ? 1 : ( format == XPixelFormat::RGB24 ) ? 3 : 4;
+    Opaque    = true;
+
+    Premultiplied.resize( static_cast<size_t>( width ) * height * PixelSize );
+    InverseAlpha.resize( Premultiplied.size( ) );
+
+    for ( int32_t y = 0; y < height; y++ )
+    {
+        const uint8_t* srcPtr = Image->Data( ) + y * stride;
+
+        for ( int32_t x = 0; x < width; x++, srcPtr += 4 )
+        {
+            uint8_t alpha = srcPtr[3];
+
+            if ( alpha != 255 )
+            {
+                Opaque = false;
+            }
+
+            if ( format == XPixelFormat::Grayscale8 )
+            {
+                Premultiplied[dstIndex] = Div255( RGB_TO_GRAY( srcPtr[RedIndex], srcPtr[GreenIndex], srcPtr[BlueIndex] ) * alpha );
+                InverseAlpha[dstIndex]  = 255 - alpha;
+            }
+            else
+            {
+                Premultiplied[dstIndex + RedIndex]   = Div255( srcPtr[RedIndex]   * alpha );
+                Premultiplied[dstIndex + GreenIndex] = Div255( srcPtr[GreenIndex] * alpha );
+                Premultiplied[dstIndex + BlueIndex]  = Div255( srcPtr[BlueIndex]  * alpha );
+                InverseAlpha[dstIndex + RedIndex]    = 255 - alpha;
+                InverseAlpha[dstIndex + GreenIndex]  = 255 - alpha;
+                InverseAlpha[dstIndex + BlueIndex]   = 255 - alpha;
+
+                if ( PixelSize == 4 )
+                {
+                    // alpha channel of images is left as is by translucent layers (opaque ones set it to 255)
+                    Premultiplied[dstIndex + 3] = 255;
+                    InverseAlpha[dstIndex + 3]  = 255;
+                }
+            }
+
+            dstIndex += PixelSize;
+        }
+    }
+
+    if ( ( !Opaque ) && ( PixelSize == 4 ) )
+    {
+        for ( dstIndex = 3; dstIndex < Premultiplied.size( ); dstIndex += 4 )
+        {
+            Premultiplied[dstIndex] = 0;
+        }
+    }
+
+    PreparedFormat = format;
+}
+
+// Blend bytes of image's row with the layer's row - dst = premultiplied + dst * inverseAlpha / 255 (the sum
+// never gets over 255, since layer's pixel and its alpha were rounded same way)
+void BlendRow( uint8_t* dst, const uint8_t* premultiplied, const uint8_t* inverseAlpha, int32_t count )
+{
+    int32_t i = 0;
+
+#ifdef XOVERLAY_LAYER_SSE2
+    const __m128i zero    = _mm_setzero_si128( );
+    const __m128i half    = _mm_set1_epi16( 128 );
+    int32_t       count16 = count & ~15;
+
+    for ( ; i < count16; i += 16 )
+    {
+        __m128i dstBytes = _mm_loadu_si128( (const __m128i*) ( dst + i ) );
+        __m128i invBytes = _mm_loadu_si128( (const __m128i*) ( inverseAlpha + i ) );
+        __m128i low      = _mm_add_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( dstBytes, zero ), _mm_unpacklo_epi8( invBytes, zero ) ), half );
+        __m128i high     = _mm_add_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( dstBytes, zero ), _mm_unpackhi_epi8( invBytes, zero ) ), half );
+
+        // same division by 255 as Div255() does
+        low  = _mm_srli_epi16( _mm_add_epi16( low, _mm_srli_epi16( low, 8 ) ), 8 );
+        high = _mm_srli_epi16( _mm_add_epi16( high, _mm_srli_epi16( high, 8 ) ), 8 );
+
+        _mm_storeu_si128( (__m128i*) ( dst + i ),
+                          _mm_add_epi8( _mm_packus_epi16( low, high ), _mm_loadu_si128( (const __m128i*) ( premultiplied + i ) ) ) );
+    }
+#endif
+
+    for ( ; i < count; i++ )
+    {
+        dst[i] = static_cast<uint8_t>( premultiplied[i] + Div255( dst[i] * inverseAlpha[i] ) );
+    }
+}
+
+} // namespace Private
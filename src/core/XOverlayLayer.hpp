@@ -0,0 +1,69 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XOVERLAY_LAYER_HPP
+#define XOVERLAY_LAYER_HPP
+
+#include <string>
+#include <memory>
+
+#include "XImage.hpp"
+#include "XError.hpp"
+
+namespace Private
+{
+    class XOverlayLayerData;
+}
+
+/* ================================================================= */
+/* Overlay layer (text, logo, watermark, etc), which is put on video */
+/* frames. Pixels of the layer are pre-blended for the pixel format of */
+/* frames once (premultiplied by their alpha and kept together with  */
+/* inverse alpha), so drawing it is just a copy of rows for opaque   */
+/* layers or a multiply-add of bytes for translucent ones. Layer's   */
+/* content never changes - a new layer is created for new content.   */
+/* ================================================================= */
+class XOverlayLayer : private Uncopyable
+{
+private:
+    XOverlayLayer( const std::shared_ptr<XImage>& image );
+
+public:
+    ~XOverlayLayer( );
+
+    // Create layer out of RGBA32 image, which alpha channel sets transparency of its pixels
+    // (the image is copied, nullptr is returned for other pixel formats)
+    static std::shared_ptr<XOverlayLayer> Create( const std::shared_ptr<const XImage>& image );
+    // Create layer with ASCII text, which looks same as XImageDrawing::PutText() draws it
+    static std::shared_ptr<XOverlayLayer> CreateText( const std::string& text, xargb color, xargb background, bool addBorder = true );
+
+    // Size of the layer
+    int32_t Width( ) const;
+    int32_t Height( ) const;
+
+    // Put the layer on the specified image (Grayscale8, RGB24 or RGBA32) at the specified location. Pixels
+    // are prepared for the image's format on the first call, so layer must not be drawn by several threads.
+    XError Draw( const std::shared_ptr<const XImage>& image, int32_t x, int32_t y );
+
+private:
+    Private::XOverlayLayerData* mData;
+};
+
+#endif // XOVERLAY_LAYER_HPP
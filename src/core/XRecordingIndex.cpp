@@ -0,0 +1,263 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "XRecordingIndex.hpp"
+
+using namespace std;
+
+namespace Private
+{
+    #define INDEX_EXTENSION     ".idx"
+    #define PART_BOUNDARY       "--myboundary\r\n"
+    // Maximum size of part's boundary line and headers
+    #define MAX_PART_HEADER     (256)
+
+    class XRecordingIndexData
+    {
+    public:
+        int                          IndexFile;
+        uint32_t                     IndexedCount;  // frames found in index file
+        vector<XRecordingIndexEntry> TailEntries;   // frames found by parsing segment's tail
+        uint64_t                     SegmentSize;
+
+    public:
+        XRecordingIndexData( ) :
+            IndexFile( -1 ), IndexedCount( 0 ), TailEntries( ), SegmentSize( 0 )
+        {
+        }
+
+        ~XRecordingIndexData( )
+        {
+            if ( IndexFile != -1 )
+            {
+                close( IndexFile );
+            }
+        }
+
+        bool Open( const string& segmentFileName );
+        bool ReadIndexEntry( uint32_t frameIndex, XRecordingIndexEntry* entry ) const;
+        void ParseSegmentTail( int segmentFile, uint64_t offset, uint64_t fileSize, int64_t lastTimestamp );
+    };
+}
+
+XRecordingIndex::XRecordingIndex( ) :
+    mData( new Private::XRecordingIndexData( ) )
+{
+}
+
+XRecordingIndex::~XRecordingIndex( )
+{
+    delete mData;
+}
+
+// Open index of the specified segment file
+shared_ptr<XRecordingIndex> XRecordingIndex::Open( const string& segmentFileName )
+{
+    shared_ptr<XRecordingIndex> index( new XRecordingIndex( ) );
+
+    if ( !index->mData->Open( segmentFileName ) )
+    {
+        index.reset( );
+    }
+
+    return index;
+}
+
+// Get name of the index file for the specified segment file
+string XRecordingIndex::IndexFileName( const string& segmentFileName )
+{
+    return segmentFileName + INDEX_EXTENSION;
+}
+
+// Number of frames in the segment
+uint32_t XRecordingIndex::FramesCount( ) const
+{
+    return mData->IndexedCount + static_cast<uint32_t>( mData->TailEntries.size( ) );
+}
+
+// Size of the segment's part covered by the index
+uint64_t XRecordingIndex::SegmentSize( ) const
+{
+    return mData->SegmentSize;
+}
+
+// Get index record of the specified frame
+bool XRecordingIndex::GetEntry( uint32_t frameIndex, XRecordingIndexEntry* entry ) const
+{
+    bool ret = false;
+
+    if ( frameIndex < mData->IndexedCount )
+    {
+        ret = mData->ReadIndexEntry( frameIndex, entry );
+    }
+    else if ( frameIndex < FramesCount( ) )
+    {
+        *entry = mData->TailEntries[frameIndex - mData->IndexedCount];
+        ret    = true;
+    }
+
+    return ret;
+}
+
+// Find the latest frame captured at or before the specified time
+bool XRecordingIndex::FindFrame( int64_t timestamp, uint32_t* frameIndex ) const
+{
+    XRecordingIndexEntry entry;
+    uint32_t             first = 0;
+    uint32_t             count = FramesCount( );
+
+    // find the first frame captured after the specified time
+    while ( count != 0 )
+    {
+        uint32_t step = count / 2;
+
+        if ( ( GetEntry( first + step, &entry ) ) && ( entry.Timestamp <= timestamp ) )
+        {
+            first += step + 1;
+            count -= step + 1;
+        }
+        else
+        {
+            count = step;
+        }
+    }
+
+    if ( first != 0 )
+    {
+        *frameIndex = first - 1;
+    }
+
+    return ( first != 0 );
+}
+
+namespace Private
+{
+
+// Open index file of the segment and find frames it does not cover yet
+bool XRecordingIndexData::Open( const string& segmentFileName )
+{
+    int  segmentFile = open( segmentFileName.c_str( ), O_RDONLY | O_CLOEXEC );
+    bool ret         = ( segmentFile != -1 );
+
+    if ( ret )
+    {
+        XRecordingIndexEntry lastEntry = { 0, 0, 0, 0 };
+        struct stat          info;
+        uint64_t             fileSize  = ( fstat( segmentFile, &info ) == 0 ) ? static_cast<uint64_t>( info.st_size ) : 0;
+
+        IndexFile = open( XRecordingIndex::IndexFileName( segmentFileName ).c_str( ), O_RDONLY | O_CLOEXEC );
+
+        if ( ( IndexFile != -1 ) && ( fstat( IndexFile, &info ) == 0 ) )
+        {
+            // partially written record at the end is ignored
+            IndexedCount = static_cast<uint32_t>( info.st_size / sizeof( XRecordingIndexEntry ) );
+
+            // frames are written into segment before getting into index, so it is not supposed to happen,
+            // but don't trust records pointing past the end of the segment
+            while ( ( IndexedCount != 0 ) &&
+                    ( ( !ReadIndexEntry( IndexedCount - 1, &lastEntry ) ) || ( lastEntry.Offset + lastEntry.PartSize > fileSize ) ) )
+            {
+                IndexedCount--;
+            }
+
+            if ( IndexedCount == 0 )
+            {
+                lastEntry = { 0, 0, 0, 0 };
+            }
+        }
+
+        SegmentSize = lastEntry.Offset + lastEntry.PartSize;
+
+        if ( SegmentSize < fileSize )
+        {
+            ParseSegmentTail( segmentFile, SegmentSize, fileSize, lastEntry.Timestamp );
+        }
+
+        close( segmentFile );
+    }
+
+    return ret;
+}
+
+// Read the specified record of the index file
+bool XRecordingIndexData::ReadIndexEntry( uint32_t frameIndex, XRecordingIndexEntry* entry ) const
+{
+    return ( pread( IndexFile, entry, sizeof( XRecordingIndexEntry ),
+                    static_cast<off_t>( frameIndex ) * sizeof( XRecordingIndexEntry ) ) == sizeof( XRecordingIndexEntry ) );
+}
+
+// Find parts of the segment, starting from the specified offset, by reading their headers only
+void XRecordingIndexData::ParseSegmentTail( int segmentFile, uint64_t offset, uint64_t fileSize, int64_t lastTimestamp )
+{
+    char    header[MAX_PART_HEADER + 1];
+    ssize_t headerLength;
+
+    while ( ( headerLength = pread( segmentFile, header, MAX_PART_HEADER, static_cast<off_t>( offset ) ) ) > 0 )
+    {
+        const char* headerEnd;
+        const char* lengthHeader;
+        const char* timestampHeader;
+        unsigned    dataSize;
+        long long   timestamp;
+
+        header[headerLength] = '\0';
+
+        if ( ( strncmp( header, PART_BOUNDARY, strlen( PART_BOUNDARY ) ) != 0 ) ||
+             ( ( headerEnd       = strstr( header, "\r\n\r\n" ) ) == nullptr ) ||
+             ( ( lengthHeader    = strstr( header, "Content-Length: " ) ) == nullptr ) || ( lengthHeader > headerEnd ) ||
+             ( ( timestampHeader = strstr( header, "X-Timestamp: " ) ) == nullptr ) || ( timestampHeader > headerEnd ) ||
+             ( sscanf( lengthHeader + 16, "%u", &dataSize ) != 1 ) ||
+             ( sscanf( timestampHeader + 13, "%lld", &timestamp ) != 1 ) )
+        {
+            break;
+        }
+
+        XRecordingIndexEntry entry;
+
+        entry.HeaderSize = static_cast<uint32_t>( headerEnd + 4 - header );
+        entry.PartSize   = entry.HeaderSize + dataSize + 2;
+        entry.Offset     = offset;
+        // keep frames sorted by time
+        entry.Timestamp  = max( static_cast<int64_t>( timestamp ), lastTimestamp );
+
+        // the last part may not be written completely
+        if ( offset + entry.PartSize > fileSize )
+        {
+            break;
+        }
+
+        TailEntries.push_back( entry );
+
+        lastTimestamp = entry.Timestamp;
+        offset       += entry.PartSize;
+        SegmentSize   = offset;
+    }
+}
+
+} // namespace Private
@@ -0,0 +1,86 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XRECORDING_INDEX_HPP
+#define XRECORDING_INDEX_HPP
+
+#include <stdint.h>
+#include <string>
+#include <memory>
+
+#include "XInterfaces.hpp"
+
+namespace Private
+{
+    class XRecordingIndexData;
+}
+
+// Record of recording segment's index file - position of a frame in the segment
+struct XRecordingIndexEntry
+{
+    int64_t  Timestamp;     // capture time, milliseconds since Unix epoch
+    uint64_t Offset;        // offset of the frame's part in segment file (starting with boundary line)
+    uint32_t PartSize;      // size of the part, including its headers and trailing CRLF
+    uint32_t HeaderSize;    // size of the boundary line and headers, which are followed by JPEG data
+
+    // Size of JPEG data of the frame
+    uint32_t DataSize( ) const { return PartSize - HeaderSize - 2; }
+};
+
+/* ================================================================= */
+/* Index of a recording segment, which allows finding frames by time */
+/* without reading the segment itself. It is kept next to segment    */
+/* file (with .idx added to its name) as an array of fixed size      */
+/* records sorted by time, so frames are found by binary search over */
+/* the index file. Frames written to segment after the last indexed  */
+/* one (the segment is still recorded, the recorder has crashed or   */
+/* there is no index at all) are found by parsing the segment's tail */
+/* when index is opened. (POSIX systems only.)                       */
+/* ================================================================= */
+class XRecordingIndex : private Uncopyable
+{
+private:
+    XRecordingIndex( );
+
+public:
+    ~XRecordingIndex( );
+
+    // Open index of the specified segment file (nullptr if the segment does not exist)
+    static std::shared_ptr<XRecordingIndex> Open( const std::string& segmentFileName );
+
+    // Get name of the index file for the specified segment file
+    static std::string IndexFileName( const std::string& segmentFileName );
+
+    // Number of frames in the segment
+    uint32_t FramesCount( ) const;
+    // Size of the segment's part covered by the index (frames added after opening are not included)
+    uint64_t SegmentSize( ) const;
+
+    // Get index record of the specified frame
+    bool GetEntry( uint32_t frameIndex, XRecordingIndexEntry* entry ) const;
+
+    // Find the latest frame captured at or before the specified time (false if the segment has nothing that old)
+    bool FindFrame( int64_t timestamp, uint32_t* frameIndex ) const;
+
+private:
+    Private::XRecordingIndexData* mData;
+};
+
+#endif // XRECORDING_INDEX_HPP
@@ -0,0 +1,719 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <memory>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "XRecordingsRequestHandler.hpp"
+#include "XRecordingIndex.hpp"
+#include "XVideoRecorder.hpp"
+#include "XStringTools.hpp"
+#include "XTracer.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    // Size of segment file's windows mapped into memory
+    #define MAPPING_WINDOW_SIZE (8 * 1024 * 1024)
+    // Size of segment file's pieces queued for sending at once
+    #define SEND_CHUNK_SIZE     (256 * 1024)
+    // Segment file is sent while there is less than this queued for sending
+    #define MAX_PENDING_SIZE    (2 * SEND_CHUNK_SIZE)
+    // Timer interval used while sending segment files (ms)
+    #define TRANSFER_INTERVAL   (10)
+    // Maximum speed of playing recordings
+    #define MAX_PLAYBACK_SPEED  (100.0f)
+    // Maximum frame rate of playing recordings frame by frame
+    #define MAX_PLAYBACK_FPS    (100.0f)
+
+    // Segment file mapped into memory window by window, so that its data are sent without reading it into buffers
+    class MappedSegment : private Uncopyable
+    {
+    public:
+        MappedSegment( ) :
+            File( -1 ), FileSize( 0 ), Window( nullptr ), WindowOffset( 0 ), WindowSize( 0 )
+        {
+        }
+
+        ~MappedSegment( )
+        {
+            Unmap( );
+
+            if ( File != -1 )
+            {
+                close( File );
+            }
+        }
+
+        // Open segment file (its size is fixed at this point - anything appended later is not mapped)
+        bool Open( const string& fileName );
+        // Get memory of the specified piece of the file, mapping new window if needed
+        const uint8_t* Map( uint64_t offset, uint32_t length );
+
+        uint64_t Size( ) const
+        {
+            return FileSize;
+        }
+
+    private:
+        void Unmap( );
+
+    private:
+        int      File;
+        uint64_t FileSize;
+        uint8_t* Window;
+        uint64_t WindowOffset;
+        size_t   WindowSize;
+    };
+
+    // State of a connection sending segment file or playing its frames
+    class RecordingStream : private Uncopyable
+    {
+    public:
+        MappedSegment               Segment;
+        bool                        Playback;
+        bool                        Finished;       // all data are queued for sending
+
+        // sending segment file
+        uint64_t                    Position;
+        uint64_t                    End;
+
+        // playing frames
+        shared_ptr<XRecordingIndex> Index;
+        uint32_t                    NextFrame;
+        int64_t                     StartPosition;  // time of the first played frame
+        int64_t                     EndPosition;    // time to stop playback at
+        steady_clock::time_point    StartTime;
+        float                       Speed;
+        float                       FrameRate;      // frames are played one by one at this rate, if set (time-lapses)
+        uint32_t                    StartFrame;
+
+    public:
+        RecordingStream( ) :
+            Segment( ), Playback( false ), Finished( false ), Position( 0 ), End( 0 ),
+            Index( ), NextFrame( 0 ), StartPosition( 0 ), EndPosition( 0 ), StartTime( ), Speed( 1.0f ),
+            FrameRate( 0.0f ), StartFrame( 0 )
+        {
+        }
+    };
+
+    static void ContinueTransfer( RecordingStream* stream, IWebResponse& response );
+    static void ContinuePlayback( RecordingStream* stream, uint32_t frameInterval, IWebResponse& response );
+    static int ParseRange( const string& range, uint64_t size, uint64_t* first, uint64_t* last );
+}
+
+using namespace Private;
+
+XRecordingsRequestHandler::XRecordingsRequestHandler( const string& uri, const string& directory, const string& namePrefix,
+                                                      uint32_t frameRate ) :
+    IWebRequestHandler( uri, true ),
+    mDirectory( directory ), mNamePrefix( namePrefix ), mFrameInterval( 1000 / ( ( frameRate == 0 ) ? 30 : frameRate ) ),
+    mSegmentsCache( )
+{
+}
+
+// Handle request for the list of segments or for a segment
+void XRecordingsRequestHandler::HandleHttpRequest( const IWebRequest& request, IWebResponse& response )
+{
+    string uri      = request.Uri( );
+    string fileName = ( uri.length( ) > Uri( ).length( ) + 1 ) ? uri.substr( Uri( ).length( ) + 1 ) : string( );
+
+    if ( uri == Uri( ) )
+    {
+        SendSegmentsList( response );
+    }
+    else if ( ( uri[Uri( ).length( )] != '/' ) || ( !XVideoRecorder::IsSegmentFileName( fileName, mNamePrefix ) ) )
+    {
+        response.SendError( 404 );
+    }
+    else
+    {
+        string at   = request.GetVariable( "t" );
+        string from = request.GetVariable( "from" );
+        string fps  = request.GetVariable( "fps" );
+
+        if ( !at.empty( ) )
+        {
+            SendFrame( fileName, at, response );
+        }
+        else if ( ( !from.empty( ) ) || ( !fps.empty( ) ) )
+        {
+            StartPlayback( fileName, request, response );
+        }
+        else
+        {
+            SendSegmentFile( fileName, request, response );
+        }
+    }
+}
+
+// Timer event for a connection sending segment file or playing its frames
+void XRecordingsRequestHandler::HandleTimer( IWebResponse& response )
+{
+    shared_ptr<RecordingStream> stream = static_pointer_cast<RecordingStream>( response.StreamState( ) );
+
+    if ( !stream )
+    {
+        response.CloseConnection( );
+    }
+    else if ( stream->Finished )
+    {
+        // close the connection once everything is sent
+        if ( response.ToSendDataLength( ) == 0 )
+        {
+            response.CloseConnection( );
+        }
+        else
+        {
+            response.SetTimer( TRANSFER_INTERVAL );
+        }
+    }
+    else if ( stream->Playback )
+    {
+        ContinuePlayback( stream.get( ), mFrameInterval, response );
+    }
+    else
+    {
+        ContinueTransfer( stream.get( ), response );
+        response.SetTimer( TRANSFER_INTERVAL );
+    }
+}
+
+// Provide list of segments with their size, number of frames and time of the first/last frame. Index is only
+// opened for segments, which changed since the previous listing (the one being recorded, normally).
+void XRecordingsRequestHandler::SendSegmentsList( IWebResponse& response )
+{
+    DIR*                        dir   = opendir( mDirectory.c_str( ) );
+    string                      reply = "{\"status\":\"OK\",\"segments\":[";
+    vector<string>              fileNames;
+    map<string, SegmentSummary> segments;
+    bool                        first = true;
+
+    if ( dir != nullptr )
+    {
+        struct dirent* entry;
+
+        while ( ( entry = readdir( dir ) ) != nullptr )
+        {
+            if ( XVideoRecorder::IsSegmentFileName( entry->d_name, mNamePrefix ) )
+            {
+                fileNames.push_back( entry->d_name );
+            }
+        }
+        closedir( dir );
+
+        // segments' names sort in time order
+        sort( fileNames.begin( ), fileNames.end( ) );
+    }
+
+    for ( const string& fileName : fileNames )
+    {
+        string      segmentFileName = mDirectory + "/" + fileName;
+        struct stat info;
+
+        if ( stat( segmentFileName.c_str( ), &info ) != 0 )
+        {
+            continue;
+        }
+
+        auto           cached  = mSegmentsCache.find( fileName );
+        SegmentSummary summary = { static_cast<uint64_t>( info.st_size ), static_cast<int64_t>( info.st_mtime ), 0, 0, 0, 0 };
+        bool           valid   = ( ( cached != mSegmentsCache.end( ) ) &&
+                                   ( cached->second.FileSize == summary.FileSize ) &&
+                                   ( cached->second.ModificationTime == summary.ModificationTime ) );
+
+        if ( valid )
+        {
+            summary = cached->second;
+        }
+        else
+        {
+            shared_ptr<XRecordingIndex> index = XRecordingIndex::Open( segmentFileName );
+
+            if ( index )
+            {
+                XRecordingIndexEntry firstFrame = { 0, 0, 0, 0 };
+                XRecordingIndexEntry lastFrame  = { 0, 0, 0, 0 };
+
+                summary.Size   = index->SegmentSize( );
+                summary.Frames = index->FramesCount( );
+
+                if ( summary.Frames != 0 )
+                {
+                    index->GetEntry( 0, &firstFrame );
+                    index->GetEntry( summary.Frames - 1, &lastFrame );
+                }
+
+                summary.Start = firstFrame.Timestamp;
+                summary.End   = lastFrame.Timestamp;
+                valid         = true;
+            }
+        }
+
+        if ( valid )
+        {
+            char buffer[128];
+
+            snprintf( buffer, sizeof( buffer ), "\",\"size\":%llu,\"frames\":%u,\"start\":%lld,\"end\":%lld}",
+                      static_cast<unsigned long long>( summary.Size ), summary.Frames,
+                      static_cast<long long>( summary.Start ), static_cast<long long>( summary.End ) );
+
+            if ( !first )
+            {
+                reply += ',';
+            }
+
+            reply += "{\"name\":\"";
+            reply += fileName;
+            reply += buffer;
+            first  = false;
+
+            segments[fileName] = summary;
+        }
+    }
+
+    // segments deleted since the previous listing are dropped from the cache
+    mSegmentsCache.swap( segments );
+
+    reply += "]}";
+
+    response.Printf( "HTTP/1.1 200 OK\r\n"
+                     "Content-Type: application/json\r\n"
+                     "Content-Length: %u\r\n"
+                     "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
+                     "\r\n", static_cast<uint32_t>( reply.length( ) ) );
+    response.Send( reinterpret_cast<const uint8_t*>( reply.c_str( ) ), reply.length( ) );
+}
+
+// Provide segment file or the requested range of it
+void XRecordingsRequestHandler::SendSegmentFile( const string& fileName, const IWebRequest& request, IWebResponse& response )
+{
+    shared_ptr<RecordingStream> stream = make_shared<RecordingStream>( );
+
+    if ( !stream->Segment.Open( mDirectory + "/" + fileName ) )
+    {
+        response.SendError( 404, "Segment not found" );
+    }
+    else
+    {
+        map<string, string> headers = request.Headers( );
+        uint64_t            size    = stream->Segment.Size( );
+        uint64_t            first   = 0;
+        uint64_t            last    = ( size == 0 ) ? 0 : size - 1;
+        int                 range   = 0;
+
+        for ( const auto& header : headers )
+        {
+            if ( strcasecmp( header.first.c_str( ), "Range" ) == 0 )
+            {
+                range = ParseRange( header.second, size, &first, &last );
+            }
+        }
+
+        if ( range < 0 )
+        {
+            response.Printf( "HTTP/1.1 416 Range Not Satisfiable\r\n"
+                             "Content-Range: bytes */%llu\r\n"
+                             "Content-Length: 0\r\n"
+                             "\r\n", static_cast<unsigned long long>( size ) );
+        }
+        else
+        {
+            XTraceScope trace( "Send recording", 0 );
+
+            stream->Position = first;
+            stream->End      = ( size == 0 ) ? 0 : last + 1;
+            stream->Finished = ( stream->Position == stream->End );
+
+            if ( range > 0 )
+            {
+                response.Printf( "HTTP/1.1 206 Partial Content\r\n"
+                                 "Content-Range: bytes %llu-%llu/%llu\r\n",
+                                 static_cast<unsigned long long>( first ), static_cast<unsigned long long>( last ),
+                                 static_cast<unsigned long long>( size ) );
+            }
+            else
+            {
+                response.Printf( "HTTP/1.1 200 OK\r\n" );
+            }
+
+            // it is a file to download (or a range of it), not a stream to be displayed as it comes
+            response.Printf( "Content-Type: video/x-motion-jpeg\r\n"
+                             "Content-Length: %llu\r\n"
+                             "Accept-Ranges: bytes\r\n"
+                             "\r\n", static_cast<unsigned long long>( stream->End - stream->Position ) );
+
+            ContinueTransfer( stream.get( ), response );
+
+            // keep sending the rest on timer events, so that only a small part of the file is queued at a time
+            if ( !stream->Finished )
+            {
+                response.SetStreamState( stream );
+                response.SetTimer( TRANSFER_INTERVAL );
+            }
+        }
+    }
+}
+
+// Provide frame of the segment captured at (or just before) the specified time
+void XRecordingsRequestHandler::SendFrame( const string& fileName, const string& at, IWebResponse& response )
+{
+    string                      path  = mDirectory + "/" + fileName;
+    shared_ptr<XRecordingIndex> index = XRecordingIndex::Open( path );
+    MappedSegment               segment;
+    XRecordingIndexEntry        entry;
+    uint32_t                    frameIndex;
+    int64_t                     timestamp;
+
+    if ( !StringToTimestamp( at, &timestamp ) )
+    {
+        response.SendError( 400, "Invalid time of image" );
+    }
+    else if ( ( !index ) || ( !segment.Open( path ) ) )
+    {
+        response.SendError( 404, "Segment not found" );
+    }
+    else if ( ( !index->FindFrame( timestamp, &frameIndex ) ) || ( !index->GetEntry( frameIndex, &entry ) ) )
+    {
+        response.SendError( 404, "No image at the specified time" );
+    }
+    else
+    {
+        const uint8_t* data = segment.Map( entry.Offset + entry.HeaderSize, entry.DataSize( ) );
+
+        if ( data == nullptr )
+        {
+            response.SendError( 500, "Failed reading segment" );
+        }
+        else
+        {
+            XTraceScope trace( "Send JPEG from recording", 0 );
+
+            response.Printf( "HTTP/1.1 200 OK\r\n"
+                             "Content-Type: image/jpeg\r\n"
+                             "Content-Length: %u\r\n"
+                             "X-Timestamp: %lld\r\n"
+                             "\r\n", entry.DataSize( ), static_cast<long long>( entry.Timestamp ) );
+
+            response.Send( data, entry.DataSize( ) );
+        }
+    }
+}
+
+// Start MJPEG stream of the segment's frames captured within the requested time range
+void XRecordingsRequestHandler::StartPlayback( const string& fileName, const IWebRequest& request, IWebResponse& response )
+{
+    string                      path   = mDirectory + "/" + fileName;
+    string                      start  = request.GetVariable( "from" );
+    string                      to     = request.GetVariable( "to" );
+    string                      speed  = request.GetVariable( "speed" );
+    string                      fps    = request.GetVariable( "fps" );
+    shared_ptr<RecordingStream> stream = make_shared<RecordingStream>( );
+    XRecordingIndexEntry        entry;
+    int64_t                     from   = INT64_MIN;
+
+    stream->EndPosition = INT64_MAX;
+
+    // playback starts from the first frame, if start time is not specified
+    if ( ( !start.empty( ) ) && ( !StringToTimestamp( start, &from ) ) )
+    {
+        response.SendError( 400, "Invalid time to play images from" );
+    }
+    else if ( ( !to.empty( ) ) && ( ( !StringToTimestamp( to, &stream->EndPosition ) ) || ( stream->EndPosition < from ) ) )
+    {
+        response.SendError( 400, "Invalid time to play images to" );
+    }
+    else if ( ( !speed.empty( ) ) &&
+              ( ( sscanf( speed.c_str( ), "%f", &stream->Speed ) != 1 ) || ( stream->Speed <= 0 ) || ( stream->Speed > MAX_PLAYBACK_SPEED ) ) )
+    {
+        response.SendError( 400, "Invalid playback speed" );
+    }
+    else if ( ( !fps.empty( ) ) &&
+              ( ( sscanf( fps.c_str( ), "%f", &stream->FrameRate ) != 1 ) || ( stream->FrameRate <= 0 ) || ( stream->FrameRate > MAX_PLAYBACK_FPS ) ) )
+    {
+        response.SendError( 400, "Invalid playback frame rate" );
+    }
+    else if ( ( !( stream->Index = XRecordingIndex::Open( path ) ) ) || ( !stream->Segment.Open( path ) ) )
+    {
+        response.SendError( 404, "Segment not found" );
+    }
+    else
+    {
+        uint32_t frameIndex = 0;
+
+        // start from the frame shown at the requested time or from the first one, if the time is before the segment
+        if ( !stream->Index->FindFrame( from, &frameIndex ) )
+        {
+            frameIndex = 0;
+        }
+
+        if ( ( !stream->Index->GetEntry( frameIndex, &entry ) ) || ( entry.Timestamp > stream->EndPosition ) )
+        {
+            response.SendError( 404, "No images in the specified time range" );
+        }
+        else
+        {
+            const uint8_t* data = stream->Segment.Map( entry.Offset, entry.PartSize );
+
+            if ( data == nullptr )
+            {
+                response.SendError( 500, "Failed reading segment" );
+            }
+            else
+            {
+                XTraceScope trace( "Send MJPEG frame from recording", 0 );
+
+                stream->Playback      = true;
+                stream->StartFrame    = frameIndex;
+                stream->NextFrame     = frameIndex + 1;
+                stream->StartPosition = max( from, entry.Timestamp );
+                stream->StartTime     = steady_clock::now( );
+
+                response.Printf( "HTTP/1.1 200 OK\r\n"
+                                 "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
+                                 "Connection: close\r\n"
+                                 "Content-Type: multipart/x-mixed-replace; boundary=--myboundary\r\n"
+                                 "\r\n" );
+
+                // parts of the segment are sent as they are - they have the same format as parts of MJPEG stream
+                response.Send( data, entry.PartSize );
+
+                response.SetStreamState( stream );
+                response.SetTimer( ( stream->FrameRate > 0 ) ? static_cast<uint32_t>( 1000 / stream->FrameRate ) : mFrameInterval );
+            }
+        }
+    }
+}
+
+namespace Private
+{
+
+// Open segment file
+bool MappedSegment::Open( const string& fileName )
+{
+    struct stat info;
+
+    File = open( fileName.c_str( ), O_RDONLY | O_CLOEXEC );
+
+    if ( ( File != -1 ) && ( fstat( File, &info ) == 0 ) )
+    {
+        FileSize = static_cast<uint64_t>( info.st_size );
+    }
+
+    return ( File != -1 );
+}
+
+// Get memory of the specified piece of the file, mapping new window if needed
+const uint8_t* MappedSegment::Map( uint64_t offset, uint32_t length )
+{
+    const uint8_t* ptr = nullptr;
+
+    if ( ( length != 0 ) && ( offset + length <= FileSize ) )
+    {
+        if ( ( Window == nullptr ) || ( offset < WindowOffset ) || ( offset + length > WindowOffset + WindowSize ) )
+        {
+            uint64_t pageSize = static_cast<uint64_t>( sysconf( _SC_PAGESIZE ) );
+            void*    mapped;
+
+            Unmap( );
+
+            WindowOffset = offset - offset % pageSize;
+            WindowSize   = static_cast<size_t>( min( FileSize - WindowOffset,
+                                                     max( static_cast<uint64_t>( MAPPING_WINDOW_SIZE ), offset + length - WindowOffset ) ) );
+            mapped       = mmap( nullptr, WindowSize, PROT_READ, MAP_SHARED, File, static_cast<off_t>( WindowOffset ) );
+
+            if ( mapped != MAP_FAILED )
+            {
+                Window = static_cast<uint8_t*>( mapped );
+                // segments are mostly read from start to end
+                madvise( mapped, WindowSize, MADV_SEQUENTIAL );
+            }
+        }
+
+        if ( Window != nullptr )
+        {
+            ptr = Window + ( offset - WindowOffset );
+        }
+    }
+
+    return ptr;
+}
+
+// Unmap current window of the file
+void MappedSegment::Unmap( )
+{
+    if ( Window != nullptr )
+    {
+        munmap( Window, WindowSize );
+        Window = nullptr;
+    }
+}
+
+// Queue next pieces of segment file for sending, while client keeps up
+static void ContinueTransfer( RecordingStream* stream, IWebResponse& response )
+{
+    while ( ( !stream->Finished ) && ( response.ToSendDataLength( ) < MAX_PENDING_SIZE ) )
+    {
+        uint32_t       chunkSize = static_cast<uint32_t>( min( static_cast<uint64_t>( SEND_CHUNK_SIZE ), stream->End - stream->Position ) );
+        const uint8_t* data      = stream->Segment.Map( stream->Position, chunkSize );
+
+        if ( data == nullptr )
+        {
+            // client will see the reply is shorter than promised
+            response.CloseConnection( );
+            stream->Finished = true;
+        }
+        else
+        {
+            response.Send( data, chunkSize );
+
+            stream->Position += chunkSize;
+            stream->Finished  = ( stream->Position == stream->End );
+        }
+    }
+}
+
+// Provide next frame of MJPEG stream played from segment - the latest one captured before current playback position
+// or, if frame rate is set, the latest one due according to the number of frames played so far
+static void ContinuePlayback( RecordingStream* stream, uint32_t frameInterval, IWebResponse& response )
+{
+    steady_clock::time_point startTime = steady_clock::now( );
+    int64_t                  elapsed   = duration_cast<milliseconds>( startTime - stream->StartTime ).count( );
+    XRecordingIndexEntry     entry;
+    uint32_t                 frameIndex;
+    uint32_t                 handlingTime;
+    bool                     frameFound;
+
+    if ( stream->FrameRate > 0 )
+    {
+        frameIndex    = stream->StartFrame + static_cast<uint32_t>( elapsed * stream->FrameRate / 1000 );
+        frameIndex    = min( frameIndex, stream->Index->FramesCount( ) - 1 );
+        frameFound    = true;
+        frameInterval = static_cast<uint32_t>( 1000 / stream->FrameRate );
+    }
+    else
+    {
+        frameFound = stream->Index->FindFrame( min( stream->StartPosition + static_cast<int64_t>( elapsed * stream->Speed ),
+                                                    stream->EndPosition ), &frameIndex );
+    }
+
+    if ( ( frameFound ) && ( frameIndex >= stream->NextFrame ) && ( stream->Index->GetEntry( frameIndex, &entry ) ) &&
+         ( entry.Timestamp <= stream->EndPosition ) )
+    {
+        // don't try sending too much on slow connections - newer frame will be sent next time
+        if ( response.ToSendDataLength( ) < 2 * entry.PartSize )
+        {
+            const uint8_t* data = stream->Segment.Map( entry.Offset, entry.PartSize );
+
+            if ( data != nullptr )
+            {
+                XTraceScope trace( "Send MJPEG frame from recording", 0 );
+
+                response.Send( data, entry.PartSize );
+            }
+
+            stream->NextFrame = frameIndex + 1;
+        }
+        else
+        {
+            response.ReportSkippedFrame( );
+        }
+    }
+
+    // playback is over when there are no more frames within the requested time range
+    stream->Finished = ( ( !stream->Index->GetEntry( stream->NextFrame, &entry ) ) || ( entry.Timestamp > stream->EndPosition ) );
+
+    handlingTime = static_cast<uint32_t>( duration_cast<std::chrono::milliseconds>( steady_clock::now( ) - startTime ).count( ) );
+
+    // set new timer for further frames
+    response.SetTimer( ( stream->Finished ) ? TRANSFER_INTERVAL : ( ( handlingTime >= frameInterval ) ? 1 : frameInterval - handlingTime ) );
+}
+
+// Parse value of Range header - single range is supported only, others are ignored
+// (returns 1 if the range is found, 0 if it is ignored and -1 if it is out of the specified size)
+static int ParseRange( const string& range, uint64_t size, uint64_t* first, uint64_t* last )
+{
+    unsigned long long start;
+    unsigned long long end;
+    int                ret = 0;
+
+    if ( ( range.compare( 0, 6, "bytes=" ) == 0 ) && ( range.find( ',' ) == string::npos ) )
+    {
+        const char* spec = range.c_str( ) + 6;
+
+        if ( spec[0] == '-' )
+        {
+            // suffix range - the specified number of last bytes
+            if ( sscanf( spec + 1, "%llu", &end ) == 1 )
+            {
+                if ( ( end == 0 ) || ( size == 0 ) )
+                {
+                    ret = -1;
+                }
+                else
+                {
+                    *first = ( size > end ) ? size - end : 0;
+                    *last  = size - 1;
+                    ret    = 1;
+                }
+            }
+        }
+        else
+        {
+            int parsed = sscanf( spec, "%llu-%llu", &start, &end );
+
+            if ( parsed == 1 )
+            {
+                end = UINT64_MAX;
+            }
+
+            if ( ( parsed >= 1 ) && ( start <= end ) )
+            {
+                if ( start >= size )
+                {
+                    ret = -1;
+                }
+                else
+                {
+                    *first = start;
+                    *last  = min( static_cast<uint64_t>( end ), size - 1 );
+                    ret    = 1;
+                }
+            }
+        }
+    }
+
+    return ret;
+}
+
+} // namespace Private
@@ -0,0 +1,77 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XRECORDINGS_REQUEST_HANDLER_HPP
+#define XRECORDINGS_REQUEST_HANDLER_HPP
+
+#include <stdint.h>
+#include <string>
+#include <map>
+
+#include "XWebServer.hpp"
+
+/* ================================================================= */
+/* Web request handler providing recording segments of a camera (see */
+/* XVideoRecorder). The handler's URI provides list of segments as   */
+/* JSON, while <uri>/<segment> provides the segment file itself      */
+/* (supporting HTTP range requests), its frame captured at the       */
+/* specified time (?t=<time>) or MJPEG stream of its frames. Frames  */
+/* are played either at the pace they were captured                  */
+/* (?from=<time>&to=<time>&speed=<n>) or one by one at the specified */
+/* frame rate (?fps=<n>, for time-lapses). Frames are found using    */
+/* segment's index and sent straight from the file, without decoding */
+/* anything. (POSIX systems only.)                                   */
+/* ================================================================= */
+class XRecordingsRequestHandler : public IWebRequestHandler
+{
+public:
+    XRecordingsRequestHandler( const std::string& uri, const std::string& directory, const std::string& namePrefix,
+                               uint32_t frameRate = 30 );
+
+    void HandleHttpRequest( const IWebRequest& request, IWebResponse& response );
+    void HandleTimer( IWebResponse& response );
+
+private:
+    void SendSegmentsList( IWebResponse& response );
+    void SendSegmentFile( const std::string& fileName, const IWebRequest& request, IWebResponse& response );
+    void SendFrame( const std::string& fileName, const std::string& at, IWebResponse& response );
+    void StartPlayback( const std::string& fileName, const IWebRequest& request, IWebResponse& response );
+
+private:
+    // Summary of a segment provided by segments list, kept while segment file does not change
+    struct SegmentSummary
+    {
+        uint64_t FileSize;
+        int64_t  ModificationTime;
+        uint64_t Size;
+        uint32_t Frames;
+        int64_t  Start;
+        int64_t  End;
+    };
+
+    std::string mDirectory;
+    std::string mNamePrefix;
+    uint32_t    mFrameInterval;
+
+    // requests are handled on web server's thread only, so the cache needs no locking
+    std::map<std::string, SegmentSummary> mSegmentsCache;
+};
+
+#endif // XRECORDINGS_REQUEST_HANDLER_HPP
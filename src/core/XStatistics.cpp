@@ -0,0 +1,402 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "XStatistics.hpp"
+#include "XStringTools.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+// Upper bounds of histogram buckets in microseconds
+static const uint32_t HistogramBounds[XDurationHistogram::BucketsCount - 1] =
+{
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000
+};
+
+// Rate counters are updated about once a second
+#define RATE_WINDOW_NSEC (1000000000ll)
+
+/* ================================================================= */
+/* Implementation of XDurationHistogram                              */
+/* ================================================================= */
+
+XDurationHistogram::XDurationHistogram( ) :
+    mCount( 0 ), mSum( 0 )
+{
+    for ( int i = 0; i < BucketsCount; i++ )
+    {
+        mBuckets[i] = 0;
+    }
+}
+
+// Add duration specified in microseconds
+void XDurationHistogram::Add( uint32_t usec )
+{
+    int bucket = 0;
+
+    while ( ( bucket < BucketsCount - 1 ) && ( usec > HistogramBounds[bucket] ) )
+    {
+        bucket++;
+    }
+
+    mBuckets[bucket].fetch_add( 1, memory_order_relaxed );
+    mSum.fetch_add( usec, memory_order_relaxed );
+    mCount.fetch_add( 1, memory_order_relaxed );
+}
+
+// Add duration measured since the specified time point
+void XDurationHistogram::AddSince( steady_clock::time_point startTime )
+{
+    Add( static_cast<uint32_t>( duration_cast<microseconds>( steady_clock::now( ) - startTime ).count( ) ) );
+}
+
+// Upper bound of the bucket in microseconds
+uint32_t XDurationHistogram::BucketUpperBound( int bucket )
+{
+    return ( ( bucket >= 0 ) && ( bucket < BucketsCount - 1 ) ) ? HistogramBounds[bucket] : 0;
+}
+
+// Number of values fallen into the bucket
+uint64_t XDurationHistogram::BucketCount( int bucket ) const
+{
+    return ( ( bucket >= 0 ) && ( bucket < BucketsCount ) ) ? mBuckets[bucket].load( memory_order_relaxed ) : 0;
+}
+
+// Total number of values added and their sum
+uint64_t XDurationHistogram::Count( ) const
+{
+    return mCount.load( memory_order_relaxed );
+}
+uint64_t XDurationHistogram::Sum( ) const
+{
+    return mSum.load( memory_order_relaxed );
+}
+
+/* ================================================================= */
+/* Implementation of XRateCounter                                    */
+/* ================================================================= */
+
+static int64_t NowNanoseconds( )
+{
+    return duration_cast<nanoseconds>( steady_clock::now( ).time_since_epoch( ) ).count( );
+}
+
+XRateCounter::XRateCounter( ) :
+    mTotal( 0 ), mWindowTotal( 0 ), mWindowStart( NowNanoseconds( ) ), mRate( 0.0f )
+{
+    mWindowLock.clear( );
+}
+
+// Add the specified number of events
+void XRateCounter::Add( uint64_t count )
+{
+    uint64_t total = mTotal.fetch_add( count, memory_order_relaxed ) + count;
+    int64_t  now   = NowNanoseconds( );
+    int64_t  start = mWindowStart.load( memory_order_relaxed );
+
+    // only one of the writers closes the window, others just keep counting
+    if ( ( now - start >= RATE_WINDOW_NSEC ) && ( !mWindowLock.test_and_set( memory_order_acquire ) ) )
+    {
+        uint64_t windowTotal = mWindowTotal.load( memory_order_relaxed );
+
+        mRate.store( static_cast<float>( static_cast<double>( total - windowTotal ) * 1000000000.0 / ( now - start ) ), memory_order_relaxed );
+        mWindowTotal.store( total, memory_order_relaxed );
+        mWindowStart.store( now, memory_order_relaxed );
+
+        mWindowLock.clear( memory_order_release );
+    }
+}
+
+// Total number of events since creation
+uint64_t XRateCounter::Total( ) const
+{
+    return mTotal.load( memory_order_relaxed );
+}
+
+// Number of events per second
+double XRateCounter::Rate( ) const
+{
+    int64_t now     = NowNanoseconds( );
+    int64_t start   = mWindowStart.load( memory_order_relaxed );
+    double  rate    = mRate.load( memory_order_relaxed );
+
+    // if nothing was added for a while, the last rate is outdated - calculate it from what is available
+    if ( now - start >= 2 * RATE_WINDOW_NSEC )
+    {
+        rate = static_cast<double>( mTotal.load( memory_order_relaxed ) - mWindowTotal.load( memory_order_relaxed ) ) * 1000000000.0 / ( now - start );
+    }
+
+    return rate;
+}
+
+/* ================================================================= */
+/* Implementation of XStatisticsCollector                            */
+/* ================================================================= */
+
+// Set labels to add to all the metrics collected after
+void XStatisticsCollector::SetCommonLabels( const XStatisticsLabels& labels )
+{
+    mCommonLabels = labels;
+}
+
+// Find/add metric and add new sample to it
+XStatisticsCollector::Sample& XStatisticsCollector::AddSample( const string& name, const string& help, MetricType type, const XStatisticsLabels& labels )
+{
+    list<Metric>::iterator itMetric = mMetrics.begin( );
+
+    while ( ( itMetric != mMetrics.end( ) ) && ( itMetric->Name != name ) )
+    {
+        itMetric++;
+    }
+
+    if ( itMetric == mMetrics.end( ) )
+    {
+        Metric metric;
+
+        metric.Name = name;
+        metric.Help = help;
+        metric.Type = type;
+
+        itMetric = mMetrics.insert( mMetrics.end( ), metric );
+    }
+
+    Sample sample = { mCommonLabels, 0.0, 0, 0, vector<uint64_t>( ) };
+
+    for ( auto label : labels )
+    {
+        sample.Labels[label.first] = label.second;
+    }
+
+    itMetric->Samples.push_back( sample );
+
+    return itMetric->Samples.back( );
+}
+
+void XStatisticsCollector::AddCounter( const string& name, const string& help, uint64_t value, const XStatisticsLabels& labels )
+{
+    AddSample( name, help, MetricType::Counter, labels ).Count = value;
+}
+
+void XStatisticsCollector::AddGauge( const string& name, const string& help, double value, const XStatisticsLabels& labels )
+{
+    AddSample( name, help, MetricType::Gauge, labels ).Value = value;
+}
+
+void XStatisticsCollector::AddHistogram( const string& name, const string& help, const XDurationHistogram& histogram, const XStatisticsLabels& labels )
+{
+    Sample&  sample     = AddSample( name, help, MetricType::Histogram, labels );
+    uint64_t cumulative = 0;
+
+    // keep buckets cumulative as Prometheus wants them
+    for ( int i = 0; i < XDurationHistogram::BucketsCount; i++ )
+    {
+        cumulative += histogram.BucketCount( i );
+        sample.Buckets.push_back( cumulative );
+    }
+
+    sample.Count = histogram.Count( );
+    sample.Sum   = histogram.Sum( );
+}
+
+void XStatisticsCollector::AddRate( const string& name, const string& help, const XRateCounter& counter, const XStatisticsLabels& labels )
+{
+    AddCounter( name + "_total", help, counter.Total( ), labels );
+    AddGauge( name + "_per_second", help + " per second", counter.Rate( ), labels );
+}
+
+// Escape string so it could be put into JSON or label value
+static string EscapeString( const string& str )
+{
+    string ret = str;
+
+    StringReplace( ret, "\\", "\\\\" );
+    StringReplace( ret, "\"", "\\\"" );
+    StringReplace( ret, "\n", "\\n" );
+
+    return ret;
+}
+
+// Format histogram bucket bound in seconds
+static string BucketBoundString( int bucket )
+{
+    uint32_t bound = XDurationHistogram::BucketUpperBound( bucket );
+    char     buffer[32] = "+Inf";
+
+    if ( bound != 0 )
+    {
+        sprintf( buffer, "%g", static_cast<double>( bound ) / 1000000 );
+    }
+
+    return string( buffer );
+}
+
+static string LabelsToString( const XStatisticsLabels& labels, const char* extraName = nullptr, const string& extraValue = string( ) )
+{
+    string ret;
+
+    for ( auto label : labels )
+    {
+        ret += ( ret.empty( ) ) ? "{" : ",";
+        ret += label.first;
+        ret += "=\"";
+        ret += EscapeString( label.second );
+        ret += "\"";
+    }
+
+    if ( extraName != nullptr )
+    {
+        ret += ( ret.empty( ) ) ? "{" : ",";
+        ret += extraName;
+        ret += "=\"";
+        ret += extraValue;
+        ret += "\"";
+    }
+
+    if ( !ret.empty( ) )
+    {
+        ret += "}";
+    }
+
+    return ret;
+}
+
+// Format collected metrics as JSON
+string XStatisticsCollector::ToJson( ) const
+{
+    static const char* typeNames[] = { "counter", "gauge", "histogram" };
+    string             ret = "{\"status\":\"OK\",\"metrics\":[";
+    char               buffer[128];
+    bool               firstMetric = true;
+
+    for ( auto& metric : mMetrics )
+    {
+        bool firstSample = true;
+
+        ret += ( firstMetric ) ? "{" : ",{";
+        ret += "\"name\":\"" + metric.Name + "\",";
+        ret += "\"type\":\"";
+        ret += typeNames[static_cast<int>( metric.Type )];
+        ret += "\",\"help\":\"" + EscapeString( metric.Help ) + "\",";
+        ret += "\"samples\":[";
+
+        for ( auto& sample : metric.Samples )
+        {
+            bool firstLabel = true;
+
+            ret += ( firstSample ) ? "{" : ",{";
+            ret += "\"labels\":{";
+
+            for ( auto label : sample.Labels )
+            {
+                ret += ( firstLabel ) ? "\"" : ",\"";
+                ret += label.first + "\":\"" + EscapeString( label.second ) + "\"";
+                firstLabel = false;
+            }
+
+            ret += "},";
+
+            switch ( metric.Type )
+            {
+            case MetricType::Counter:
+                sprintf( buffer, "\"value\":%llu", static_cast<unsigned long long>( sample.Count ) );
+                ret += buffer;
+                break;
+
+            case MetricType::Gauge:
+                sprintf( buffer, "\"value\":%.3f", sample.Value );
+                ret += buffer;
+                break;
+
+            case MetricType::Histogram:
+                sprintf( buffer, "\"count\":%llu,\"sum\":%g,\"buckets\":{",
+                         static_cast<unsigned long long>( sample.Count ), static_cast<double>( sample.Sum ) / 1000000 );
+                ret += buffer;
+
+                for ( size_t i = 0; i < sample.Buckets.size( ); i++ )
+                {
+                    sprintf( buffer, "%s\"%s\":%llu", ( i == 0 ) ? "" : ",", BucketBoundString( static_cast<int>( i ) ).c_str( ),
+                             static_cast<unsigned long long>( sample.Buckets[i] ) );
+                    ret += buffer;
+                }
+
+                ret += "}";
+                break;
+            }
+
+            ret += "}";
+            firstSample = false;
+        }
+
+        ret += "]}";
+        firstMetric = false;
+    }
+
+    ret += "]}";
+
+    return ret;
+}
+
+// Format collected metrics as Prometheus text exposition format
+string XStatisticsCollector::ToPrometheus( ) const
+{
+    static const char* typeNames[] = { "counter", "gauge", "histogram" };
+    string             ret;
+    char               buffer[64];
+
+    for ( auto& metric : mMetrics )
+    {
+        ret += "# HELP " + metric.Name + " " + metric.Help + "\n";
+        ret += "# TYPE " + metric.Name + " " + typeNames[static_cast<int>( metric.Type )] + "\n";
+
+        for ( auto& sample : metric.Samples )
+        {
+            switch ( metric.Type )
+            {
+            case MetricType::Counter:
+                sprintf( buffer, " %llu\n", static_cast<unsigned long long>( sample.Count ) );
+                ret += metric.Name + LabelsToString( sample.Labels ) + buffer;
+                break;
+
+            case MetricType::Gauge:
+                sprintf( buffer, " %.3f\n", sample.Value );
+                ret += metric.Name + LabelsToString( sample.Labels ) + buffer;
+                break;
+
+            case MetricType::Histogram:
+                for ( size_t i = 0; i < sample.Buckets.size( ); i++ )
+                {
+                    sprintf( buffer, " %llu\n", static_cast<unsigned long long>( sample.Buckets[i] ) );
+                    ret += metric.Name + "_bucket" + LabelsToString( sample.Labels, "le", BucketBoundString( static_cast<int>( i ) ) ) + buffer;
+                }
+
+                sprintf( buffer, " %g\n", static_cast<double>( sample.Sum ) / 1000000 );
+                ret += metric.Name + "_sum" + LabelsToString( sample.Labels ) + buffer;
+                sprintf( buffer, " %llu\n", static_cast<unsigned long long>( sample.Count ) );
+                ret += metric.Name + "_count" + LabelsToString( sample.Labels ) + buffer;
+                break;
+            }
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,178 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XSTATISTICS_HPP
+#define XSTATISTICS_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+
+#include "XInterfaces.hpp"
+
+typedef std::map<std::string, std::string> XStatisticsLabels;
+
+/* ================================================================= */
+/* Histogram of durations with fixed exponential buckets.            */
+/* Adding values is lock free, so it can be done on hot paths.       */
+/* ================================================================= */
+class XDurationHistogram : private Uncopyable
+{
+public:
+    enum { BucketsCount = 14 };
+
+public:
+    XDurationHistogram( );
+
+    // Add duration specified in microseconds
+    void Add( uint32_t usec );
+    // Add duration measured since the specified time point
+    void AddSince( std::chrono::steady_clock::time_point startTime );
+
+    // Upper bound of the bucket in microseconds (the last bucket is unlimited and returns 0)
+    static uint32_t BucketUpperBound( int bucket );
+
+    // Number of values fallen into the bucket (not cumulative)
+    uint64_t BucketCount( int bucket ) const;
+    // Total number of values added and their sum in microseconds
+    uint64_t Count( ) const;
+    uint64_t Sum( ) const;
+
+private:
+    std::atomic<uint64_t> mBuckets[BucketsCount];
+    std::atomic<uint64_t> mCount;
+    std::atomic<uint64_t> mSum;
+};
+
+/* ================================================================= */
+/* Counter of events, which also provides rate of events per second  */
+/* ================================================================= */
+class XRateCounter : private Uncopyable
+{
+public:
+    XRateCounter( );
+
+    // Add the specified number of events
+    void Add( uint64_t count = 1 );
+
+    // Total number of events since creation
+    uint64_t Total( ) const;
+    // Number of events per second (measured over about one second window)
+    double Rate( ) const;
+
+private:
+    std::atomic<uint64_t> mTotal;
+    std::atomic<uint64_t> mWindowTotal;
+    std::atomic<int64_t>  mWindowStart;
+    std::atomic<float>    mRate;
+    std::atomic_flag      mWindowLock;
+};
+
+/* ================================================================= */
+/* Performance statistics of a video pipeline - from capturing       */
+/* video frames to encoding them as JPEGs.                           */
+/* ================================================================= */
+class XPipelineStatistics : private Uncopyable
+{
+public:
+    XRateCounter            FramesCaptured;     // frames provided by video source
+    std::atomic<uint64_t>   FramesDropped;      // frames lost by video source (gaps in frame sequence numbers)
+    std::atomic<uint64_t>   FramesDiscarded;    // stale frames discarded by video source to reduce latency
+    std::atomic<uint64_t>   FramesUnchanged;    // frames same as the previous one, which are not encoded again
+    XDurationHistogram      ConversionTime;     // time to convert native pixel format of a camera (YUYV, etc.)
+    XRateCounter            FramesEncoded;      // frames encoded as JPEG (or copied if camera provides JPEGs)
+    XRateCounter            EncodedBytes;       // size of encoded JPEG images
+    XDurationHistogram      EncodingTime;       // JPEG encoding time
+
+public:
+    XPipelineStatistics( ) : FramesDropped( 0 ), FramesDiscarded( 0 ), FramesUnchanged( 0 ) { }
+};
+
+/* ================================================================= */
+/* Collector of statistics, which formats them as JSON or text       */
+/* format used by Prometheus                                         */
+/* ================================================================= */
+class XStatisticsCollector : private Uncopyable
+{
+public:
+    XStatisticsCollector( ) { }
+
+    // Set labels to add to all the metrics collected after
+    void SetCommonLabels( const XStatisticsLabels& labels );
+
+    void AddCounter( const std::string& name, const std::string& help, uint64_t value, const XStatisticsLabels& labels = XStatisticsLabels( ) );
+    void AddGauge( const std::string& name, const std::string& help, double value, const XStatisticsLabels& labels = XStatisticsLabels( ) );
+    void AddHistogram( const std::string& name, const std::string& help, const XDurationHistogram& histogram, const XStatisticsLabels& labels = XStatisticsLabels( ) );
+
+    // Add counter and rate gauge for the specified rate counter (_total and _per_second suffixes are added to the name)
+    void AddRate( const std::string& name, const std::string& help, const XRateCounter& counter, const XStatisticsLabels& labels = XStatisticsLabels( ) );
+
+    std::string ToJson( ) const;
+    std::string ToPrometheus( ) const;
+
+private:
+    enum class MetricType
+    {
+        Counter,
+        Gauge,
+        Histogram
+    };
+
+    struct Sample
+    {
+        XStatisticsLabels       Labels;
+        double                  Value;
+        uint64_t                Count;
+        uint64_t                Sum;
+        std::vector<uint64_t>   Buckets;
+    };
+
+    struct Metric
+    {
+        std::string             Name;
+        std::string             Help;
+        MetricType              Type;
+        std::list<Sample>       Samples;
+    };
+
+    Sample& AddSample( const std::string& name, const std::string& help, MetricType type, const XStatisticsLabels& labels );
+
+private:
+    XStatisticsLabels   mCommonLabels;
+    std::list<Metric>   mMetrics;
+};
+
+/* ================================================================= */
+/* Interface of objects providing their statistics                   */
+/* ================================================================= */
+class IStatisticsProvider
+{
+public:
+    virtual ~IStatisticsProvider( ) { }
+
+    // Put current values of all statistics into the specified collector
+    virtual void CollectStatistics( XStatisticsCollector& collector ) const = 0;
+};
+
+#endif // XSTATISTICS_HPP
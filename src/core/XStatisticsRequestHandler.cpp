@@ -0,0 +1,80 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "XStatisticsRequestHandler.hpp"
+
+using namespace std;
+
+/* ================================================================= */
+/* Implementation of XStatisticsRequestHandler                       */
+/* ================================================================= */
+
+XStatisticsRequestHandler::XStatisticsRequestHandler( const string& uri ) :
+    IWebRequestHandler( uri, false ), mSync( ), mProviders( )
+{
+}
+
+// Add statistics provider
+XStatisticsRequestHandler& XStatisticsRequestHandler::AddProvider( const IStatisticsProvider* provider, const XStatisticsLabels& labels )
+{
+    lock_guard<mutex> lock( mSync );
+
+    if ( provider != nullptr )
+    {
+        mProviders.push_back( pair<const IStatisticsProvider*, XStatisticsLabels>( provider, labels ) );
+    }
+
+    return *this;
+}
+
+// Provide statistics as JSON or Prometheus text
+void XStatisticsRequestHandler::HandleHttpRequest( const IWebRequest& request, IWebResponse& response )
+{
+    XStatisticsCollector collector;
+    string               reply;
+    const char*          contentType = "application/json";
+
+    {
+        lock_guard<mutex> lock( mSync );
+
+        for ( auto provider : mProviders )
+        {
+            collector.SetCommonLabels( provider.second );
+            provider.first->CollectStatistics( collector );
+        }
+    }
+
+    if ( request.GetVariable( "format" ) == "prometheus" )
+    {
+        reply       = collector.ToPrometheus( );
+        contentType = "text/plain; version=0.0.4";
+    }
+    else
+    {
+        reply = collector.ToJson( );
+    }
+
+    response.Printf( "HTTP/1.1 200 OK\r\n"
+                     "Content-Type: %s\r\n"
+                     "Content-Length: %u\r\n"
+                     "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
+                     "\r\n", contentType, static_cast<uint32_t>( reply.length( ) ) );
+    response.Send( reinterpret_cast<const uint8_t*>( reply.c_str( ) ), reply.length( ) );
+}
@@ -0,0 +1,50 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XSTATISTICS_REQUEST_HANDLER_HPP
+#define XSTATISTICS_REQUEST_HANDLER_HPP
+
+#include <list>
+#include <mutex>
+
+#include "XStatistics.hpp"
+#include "XWebServer.hpp"
+
+/* ================================================================= */
+/* Web request handler providing statistics of the specified         */
+/* providers as JSON or Prometheus text (?format=prometheus)         */
+/* ================================================================= */
+class XStatisticsRequestHandler : public IWebRequestHandler
+{
+public:
+    XStatisticsRequestHandler( const std::string& uri );
+
+    // Add statistics provider, which must stay alive while the handler is in use; the specified labels are
+    // added to all of its statistics (to tell one camera from another, for example)
+    XStatisticsRequestHandler& AddProvider( const IStatisticsProvider* provider, const XStatisticsLabels& labels = XStatisticsLabels( ) );
+
+    void HandleHttpRequest( const IWebRequest& request, IWebResponse& response );
+
+private:
+    std::mutex                                                          mSync;
+    std::list<std::pair<const IStatisticsProvider*, XStatisticsLabels>> mProviders;
+};
+
+#endif // XSTATISTICS_REQUEST_HANDLER_HPP
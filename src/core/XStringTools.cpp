@@ -18,13 +18,16 @@
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 */
 
+#include <stdio.h>
 #include <algorithm>
 #include <functional>
+#include <chrono>
 #include <cctype>
 
 #include "XStringTools.hpp"
 
 using namespace std;
+using namespace std::chrono;
 
 // Trim spaces from the start of a string
 string& StringLTrimg( string& s )
@@ -72,3 +75,22 @@ string& StringReplace( string& s, const string& lookFor, const string& replaceWi
 
     return s;
 }
+
+// Parse time given in milliseconds since Unix epoch or, if not positive, relative to current time
+bool StringToTimestamp( const string& s, int64_t* timestamp )
+{
+    long long parsed;
+    bool      ret = ( sscanf( s.c_str( ), "%lld", &parsed ) == 1 );
+
+    if ( ret )
+    {
+        *timestamp = static_cast<int64_t>( parsed );
+
+        if ( *timestamp <= 0 )
+        {
+            *timestamp += duration_cast<milliseconds>( system_clock::now( ).time_since_epoch( ) ).count( );
+        }
+    }
+
+    return ret;
+}
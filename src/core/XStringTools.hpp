@@ -21,6 +21,7 @@
 #ifndef XSTRING_TOOLS_HPP
 #define XSTRING_TOOLS_HPP
 
+#include <stdint.h>
 #include <string>
 
 // Trim spaces from the start of a string
@@ -33,4 +34,7 @@ std::string& StringTrim( std::string& s );
 // Replace sub-string within a string
 std::string& StringReplace( std::string& s, const std::string& lookFor, const std::string& replaceWith );
 
+// Parse time given in milliseconds since Unix epoch or, if not positive, relative to current time
+bool StringToTimestamp( const std::string& s, int64_t* timestamp );
+
 #endif // XSTRING_TOOLS_HPP
@@ -0,0 +1,59 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "XTraceRequestHandler.hpp"
+
+using namespace std;
+
+/* ================================================================= */
+/* Implementation of XTraceRequestHandler                            */
+/* ================================================================= */
+
+XTraceRequestHandler::XTraceRequestHandler( const string& uri ) :
+    IWebRequestHandler( uri, false )
+{
+}
+
+// Start/Stop tracing or provide recorded events
+void XTraceRequestHandler::HandleHttpRequest( const IWebRequest& request, IWebResponse& response )
+{
+    string enable = request.GetVariable( "enable" );
+    string reply;
+
+    if ( !enable.empty( ) )
+    {
+        XTracer::Enable( enable == "1" );
+
+        reply = "{\"status\":\"OK\",\"config\":{\"enabled\":\"";
+        reply += ( XTracer::IsEnabled( ) ) ? "1" : "0";
+        reply += "\"}}";
+    }
+    else
+    {
+        reply = XTracer::ToChromeJson( );
+    }
+
+    response.Printf( "HTTP/1.1 200 OK\r\n"
+                     "Content-Type: application/json\r\n"
+                     "Content-Length: %u\r\n"
+                     "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
+                     "\r\n", static_cast<uint32_t>( reply.length( ) ) );
+    response.Send( reinterpret_cast<const uint8_t*>( reply.c_str( ) ), reply.length( ) );
+}
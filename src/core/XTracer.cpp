@@ -0,0 +1,328 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include <list>
+#include <algorithm>
+#include <mutex>
+#include <memory>
+#include <vector>
+
+#include "XTracer.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    // Number of events kept for each thread (older events are overwritten)
+    #define EVENTS_PER_THREAD (16384)
+    // Number of buffers of exited threads kept for export, before those are reused by new threads
+    #define MAX_EXITED_THREADS (4)
+
+    // Single traced event
+    struct TraceEvent
+    {
+        const char*  Name;
+        int64_t      StartTime;     // microseconds since tracer's epoch
+        uint32_t     Duration;      // microseconds
+        XTraceFlow   Flow;
+        uint64_t     FrameId;
+    };
+
+    // Ring buffer of events recorded by a thread. Only the owning thread writes into it, publishing
+    // number of written events once an event is complete (like a sequence lock). Exporting thread
+    // reads events without locking and drops those, which could be overwritten while reading.
+    class ThreadEvents : private Uncopyable
+    {
+    public:
+        mutex              NameSync;
+        uint32_t           ThreadId;
+        string             ThreadName;
+        vector<TraceEvent> Events;
+        atomic<uint64_t>   Written;     // total number of events written since thread's registration
+        atomic<uint64_t>   ClearedAt;   // events written before this one are not exported
+        atomic<bool>       Exited;      // owning thread has exited
+
+    public:
+        ThreadEvents( uint32_t threadId ) :
+            NameSync( ), ThreadId( threadId ), ThreadName( ), Events( ), Written( 0 ), ClearedAt( 0 ), Exited( false )
+        { }
+    };
+
+    // Lets events' buffer know its thread has exited, so the buffer could be reused by another thread
+    class ThreadEventsOwner
+    {
+    public:
+        ThreadEvents* Events;
+
+    public:
+        ThreadEventsOwner( ) : Events( nullptr ) { }
+
+        ~ThreadEventsOwner( )
+        {
+            if ( Events != nullptr )
+            {
+                Events->Exited = true;
+            }
+        }
+    };
+
+    // Private data shared by all threads
+    class XTracerData
+    {
+    public:
+        mutex                           Sync;
+        list<shared_ptr<ThreadEvents>>  Threads;       // ordered by registration time of their current thread
+        uint32_t                        LastThreadId;
+        steady_clock::time_point        Epoch;
+        atomic<uint64_t>                LastFrameId;
+
+    public:
+        XTracerData( ) :
+            Sync( ), Threads( ), LastThreadId( 0 ), Epoch( steady_clock::now( ) ), LastFrameId( 0 )
+        { }
+
+        static XTracerData& Instance( )
+        {
+            static XTracerData data;
+            return data;
+        }
+
+        ThreadEvents* CurrentThreadEvents( );
+    };
+
+    static thread_local ThreadEventsOwner CurrentThreadEventsOwner;
+    static thread_local uint64_t      CurrentFrameId         = 0;
+}
+
+using namespace Private;
+
+atomic<bool> XTracer::sEnabled( false );
+
+// Enable/Disable tracing
+void XTracer::Enable( bool enable )
+{
+    if ( ( enable ) && ( !sEnabled ) )
+    {
+        Clear( );
+    }
+
+    sEnabled = enable;
+}
+
+// Clear all recorded events
+void XTracer::Clear( )
+{
+    XTracerData&      data = XTracerData::Instance( );
+    lock_guard<mutex> lock( data.Sync );
+
+    for ( auto threadEvents : data.Threads )
+    {
+        threadEvents->ClearedAt = threadEvents->Written.load( );
+    }
+}
+
+// Set name of the calling thread to show in traces
+void XTracer::SetThreadName( const string& name )
+{
+    ThreadEvents*     threadEvents = XTracerData::Instance( ).CurrentThreadEvents( );
+    lock_guard<mutex> lock( threadEvents->NameSync );
+
+    threadEvents->ThreadName = name;
+}
+
+// Allocate new frame ID and make it current for the calling thread
+uint64_t XTracer::NewFrame( )
+{
+    CurrentFrameId = ++XTracerData::Instance( ).LastFrameId;
+    return CurrentFrameId;
+}
+
+// Get/Set ID of the frame processed by the calling thread
+uint64_t XTracer::CurrentFrame( )
+{
+    return CurrentFrameId;
+}
+void XTracer::SetCurrentFrame( uint64_t frameId )
+{
+    CurrentFrameId = frameId;
+}
+
+// Record complete event of the calling thread
+void XTracer::AddEvent( const char* name, steady_clock::time_point startTime, steady_clock::time_point endTime,
+                        uint64_t frameId, XTraceFlow flow )
+{
+    XTracerData&  data         = XTracerData::Instance( );
+    ThreadEvents* threadEvents = data.CurrentThreadEvents( );
+    uint64_t      written      = threadEvents->Written.load( memory_order_relaxed );
+
+    // buffer is allocated by the owning thread before any event is published, so readers never see it changing
+    if ( threadEvents->Events.empty( ) )
+    {
+        threadEvents->Events.resize( EVENTS_PER_THREAD );
+    }
+
+    // the slot may be read by exporting thread - the fence makes sure it sees the published count
+    // of events (not including this one), if it reads anything written below
+    atomic_thread_fence( memory_order_release );
+
+    TraceEvent& event = threadEvents->Events[written % EVENTS_PER_THREAD];
+
+    event.Name      = name;
+    event.StartTime = duration_cast<microseconds>( startTime - data.Epoch ).count( );
+    event.Duration  = static_cast<uint32_t>( duration_cast<microseconds>( endTime - startTime ).count( ) );
+    event.Flow      = ( frameId == 0 ) ? XTraceFlow::None : flow;
+    event.FrameId   = frameId;
+
+    threadEvents->Written.store( written + 1, memory_order_release );
+}
+
+// Get all recorded events in Chrome trace event format
+string XTracer::ToChromeJson( )
+{
+    XTracerData&      data = XTracerData::Instance( );
+    lock_guard<mutex> lock( data.Sync );
+    string            json = "{\"traceEvents\":[";
+    bool              first = true;
+    char              buffer[256];
+
+    for ( auto threadEvents : data.Threads )
+    {
+        vector<TraceEvent> events;
+        uint64_t           written = threadEvents->Written.load( memory_order_acquire );
+        uint64_t           start   = max( threadEvents->ClearedAt.load( ), ( written > EVENTS_PER_THREAD ) ? written - EVENTS_PER_THREAD : 0 );
+
+        {
+            lock_guard<mutex> nameLock( threadEvents->NameSync );
+
+            if ( !threadEvents->ThreadName.empty( ) )
+            {
+                snprintf( buffer, sizeof( buffer ), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                          ( first ) ? "\n" : ",\n", threadEvents->ThreadId, threadEvents->ThreadName.substr( 0, 64 ).c_str( ) );
+                json += buffer;
+                first = false;
+            }
+        }
+
+        // copy events while the thread may keep writing new ones
+        if ( start < written )
+        {
+            events.reserve( static_cast<size_t>( written - start ) );
+
+            for ( uint64_t i = start; i < written; i++ )
+            {
+                events.push_back( threadEvents->Events[i % EVENTS_PER_THREAD] );
+            }
+        }
+
+        // drop events, which could be overwritten while copying them
+        atomic_thread_fence( memory_order_acquire );
+
+        uint64_t writtenAfter = threadEvents->Written.load( memory_order_relaxed );
+        size_t   skip         = 0;
+
+        if ( writtenAfter >= start + EVENTS_PER_THREAD )
+        {
+            skip = static_cast<size_t>( min<uint64_t>( writtenAfter - start - EVENTS_PER_THREAD + 1, events.size( ) ) );
+        }
+
+        for ( size_t i = skip; i < events.size( ); i++ )
+        {
+            const TraceEvent& event = events[i];
+
+            json += ( first ) ? "\n" : ",\n";
+            first = false;
+
+            if ( event.Flow == XTraceFlow::None )
+            {
+                snprintf( buffer, sizeof( buffer ), "{\"name\":\"%s\",\"cat\":\"cam2web\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lld,\"dur\":%u}",
+                          event.Name, threadEvents->ThreadId, static_cast<long long>( event.StartTime ), event.Duration );
+                json += buffer;
+            }
+            else
+            {
+                snprintf( buffer, sizeof( buffer ), "{\"name\":\"%s\",\"cat\":\"cam2web\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lld,\"dur\":%u,\"args\":{\"frame\":%llu}}",
+                          event.Name, threadEvents->ThreadId, static_cast<long long>( event.StartTime ), event.Duration,
+                          static_cast<unsigned long long>( event.FrameId ) );
+                json += buffer;
+
+                // flow event binds to the enclosing slice, linking all slices of the frame
+                snprintf( buffer, sizeof( buffer ), ",\n{\"name\":\"frame\",\"cat\":\"frame\",\"ph\":\"%s\",\"bp\":\"e\",\"id\":%llu,\"pid\":1,\"tid\":%u,\"ts\":%lld}",
+                          ( event.Flow == XTraceFlow::Start ) ? "s" : "t", static_cast<unsigned long long>( event.FrameId ),
+                          threadEvents->ThreadId, static_cast<long long>( event.StartTime ) );
+                json += buffer;
+            }
+        }
+    }
+
+    json += "\n],\"displayTimeUnit\":\"ms\"}";
+
+    return json;
+}
+
+namespace Private
+{
+
+// Get events' buffer of the calling thread, registering it on first use
+ThreadEvents* XTracerData::CurrentThreadEvents( )
+{
+    if ( CurrentThreadEventsOwner.Events == nullptr )
+    {
+        lock_guard<mutex> lock( Sync );
+        size_t            exitedCount = 0;
+
+        for ( auto threadEvents : Threads )
+        {
+            if ( threadEvents->Exited )
+            {
+                exitedCount++;
+            }
+        }
+
+        // buffers are kept after threads exit, so their events could still be exported, but only a few of
+        // them - threads come and go (capture thread is started with camera), so the oldest one is reused
+        if ( exitedCount >= MAX_EXITED_THREADS )
+        {
+            auto it = find_if( Threads.begin( ), Threads.end( ), [] ( const shared_ptr<ThreadEvents>& threadEvents )
+                               { return threadEvents->Exited.load( ); } );
+            shared_ptr<ThreadEvents> threadEvents = *it;
+
+            Threads.erase( it );
+
+            threadEvents->ThreadId   = ++LastThreadId;
+            threadEvents->ThreadName.clear( );
+            threadEvents->ClearedAt  = threadEvents->Written.load( );
+            threadEvents->Exited     = false;
+
+            Threads.push_back( threadEvents );
+        }
+        else
+        {
+            Threads.push_back( make_shared<ThreadEvents>( ++LastThreadId ) );
+        }
+
+        CurrentThreadEventsOwner.Events = Threads.back( ).get( );
+    }
+
+    return CurrentThreadEventsOwner.Events;
+}
+
+} // namespace Private
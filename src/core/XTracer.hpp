@@ -0,0 +1,134 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XTRACER_HPP
+#define XTRACER_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include "XInterfaces.hpp"
+
+// How a traced event relates to the path of a video frame through the pipeline
+enum class XTraceFlow
+{
+    None  = 0,  // event is not linked to other events of the frame
+    Start = 1,  // frame enters the pipeline (capture)
+    Step  = 2   // frame goes through another stage (listeners, encoding, sending, etc.)
+};
+
+/* ================================================================= */
+/* Low overhead tracer of the video pipeline. Each thread records    */
+/* its events into own lock free ring buffer, which are exported in  */
+/* Chrome trace event format (chrome://tracing, ui.perfetto.dev).    */
+/* Events of the same frame are linked with flow events, so frame's  */
+/* path can be seen across threads.                                  */
+/* ================================================================= */
+class XTracer : private Uncopyable
+{
+private:
+    XTracer( ) { }
+
+public:
+    // Enable/Disable tracing (enabling clears all previously recorded events)
+    static void Enable( bool enable );
+    static bool IsEnabled( )
+    {
+        return sEnabled.load( std::memory_order_relaxed );
+    }
+
+    // Clear all recorded events
+    static void Clear( );
+
+    // Set name of the calling thread to show in traces
+    static void SetThreadName( const std::string& name );
+
+    // Allocate new frame ID and make it current for the calling thread
+    static uint64_t NewFrame( );
+    // Get/Set ID of the frame processed by the calling thread (0 if none)
+    static uint64_t CurrentFrame( );
+    static void SetCurrentFrame( uint64_t frameId );
+
+    // Record complete event of the calling thread. The name must be a string literal
+    // (or have static storage), since only the pointer is kept. No locks are taken,
+    // except on the first event of a thread, when its ring buffer gets registered.
+    static void AddEvent( const char* name, std::chrono::steady_clock::time_point startTime,
+                          std::chrono::steady_clock::time_point endTime, uint64_t frameId, XTraceFlow flow );
+
+    // Get all recorded events in Chrome trace event format (JSON)
+    static std::string ToChromeJson( );
+
+private:
+    static std::atomic<bool> sEnabled;
+};
+
+/* ================================================================= */
+/* Traces the scope it is declared in, if tracing is enabled         */
+/* ================================================================= */
+class XTraceScope : private Uncopyable
+{
+public:
+    // Trace the scope as part of the frame processed by the calling thread (which is only looked
+    // up if tracing is enabled, so disabled scope costs a relaxed load of the enabled flag)
+    XTraceScope( const char* name ) :
+        mName( name ), mFrameId( 0 ), mFlow( XTraceFlow::Step ), mEnabled( XTracer::IsEnabled( ) ), mStartTime( )
+    {
+        if ( mEnabled )
+        {
+            mFrameId   = XTracer::CurrentFrame( );
+            mStartTime = std::chrono::steady_clock::now( );
+        }
+    }
+
+    XTraceScope( const char* name, uint64_t frameId, XTraceFlow flow = XTraceFlow::Step ) :
+        mName( name ), mFrameId( frameId ), mFlow( flow ), mEnabled( XTracer::IsEnabled( ) ), mStartTime( )
+    {
+        if ( mEnabled )
+        {
+            mStartTime = std::chrono::steady_clock::now( );
+        }
+    }
+
+    ~XTraceScope( )
+    {
+        if ( mEnabled )
+        {
+            XTracer::AddEvent( mName, mStartTime, std::chrono::steady_clock::now( ), mFrameId, mFlow );
+        }
+    }
+
+    // Set frame the scope belongs to, if it was not known when the scope started
+    void SetFrame( uint64_t frameId, XTraceFlow flow = XTraceFlow::Step )
+    {
+        mFrameId = frameId;
+        mFlow    = flow;
+    }
+
+private:
+    const char*                             mName;
+    uint64_t                                mFrameId;
+    XTraceFlow                              mFlow;
+    bool                                    mEnabled;
+    std::chrono::steady_clock::time_point   mStartTime;
+};
+
+#endif // XTRACER_HPP
@@ -18,18 +18,30 @@
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 */
 
+#include <stdio.h>
+
 #include "XVideoFrameDecorator.hpp"
 #include "XImageDrawing.hpp"
-#include <ctime>
 
 using namespace std;
 
+// Color to fill privacy masks with
+#define PRIVACY_MASK_COLOR  { 0xFF000000 }
+
 XVideoFrameDecorator::XVideoFrameDecorator( ) :
     cameraTitle( ),
     addTimestampOverlay( false ),
     addCameraTitleOverlay( false ),
     overlayTextColor( { 0xFF000000 } ),
-    overlayBackgroundColor( { 0xFFFFFFFF } )
+    overlayBackgroundColor( { 0xFFFFFFFF } ),
+    textLayer( ),
+    textLayerText( ),
+    textLayerValid( false ),
+    textLayerTime( 0 ),
+    settingsVersion( 0 ),
+    layers( ),
+    privacyMasks( ),
+    jpegOverlay( )
 {
 
 }
@@ -37,82 +49,232 @@ XVideoFrameDecorator::XVideoFrameDecorator( ) :
 // Decorate the video frame coming from video source
 void XVideoFrameDecorator::OnNewImage( const shared_ptr<const XImage>& image )
 {
-    string  overlay;
+    // JPEG images can not be changed in place, DecorateJpeg() must be used for them
+    if ( image->Format( ) != XPixelFormat::JPEG )
+    {
+        lock_guard<mutex> lock( sync );
 
-    if ( addTimestampOverlay )
+        UpdateTextLayer( );
+        Decorate( image, 0, 0 );
+    }
+}
+
+// Put decorations on JPEG image and write the result into provided buffer
+XError XVideoFrameDecorator::DecorateJpeg( const uint8_t* jpegData, uint32_t jpegSize, uint8_t** buffer, uint32_t* bufferSize )
+{
+    lock_guard<mutex>        lock( sync );
+    vector<XJpegOverlayArea> areas;
+
+    UpdateTextLayer( );
+
+    if ( textLayer )
     {
-        std::time_t time = std::time( 0 );
-        std::tm*    now = std::localtime( &time );
-        char        buffer[32];
+        areas.push_back( XJpegOverlayArea( { 0, 0, textLayer->Width( ), textLayer->Height( ) } ) );
+    }
 
-        sprintf( buffer, "%02d/%02d/%02d %02d:%02d:%02d", now->tm_year - 100, now->tm_mon + 1, now->tm_mday,
-                                                          now->tm_hour, now->tm_min, now->tm_sec );
+    for ( const PlacedLayer& placedLayer : layers )
+    {
+        areas.push_back( XJpegOverlayArea( { placedLayer.X, placedLayer.Y, placedLayer.Layer->Width( ), placedLayer.Layer->Height( ) } ) );
+    }
 
-        overlay = buffer;
+    for ( const PrivacyMask& mask : privacyMasks )
+    {
+        areas.push_back( XJpegOverlayArea( { mask.X, mask.Y, mask.Width, mask.Height } ) );
     }
 
-    if ( ( addCameraTitleOverlay ) && ( !cameraTitle.empty( ) ) )
+    // parts of JPEG image are given as separate images, so decorations are moved by their position
+    return jpegOverlay.Apply( jpegData, jpegSize, areas,
+                              [this]( const shared_ptr<const XImage>& image, int32_t x, int32_t y ) { Decorate( image, x, y ); },
+                              buffer, bufferSize );
+}
+
+// Put privacy masks and overlay layers on the image, which is the part of video frame starting at the specified location
+void XVideoFrameDecorator::Decorate( const shared_ptr<const XImage>& image, int32_t x, int32_t y )
+{
+    for ( const PrivacyMask& mask : privacyMasks )
+    {
+        XImageDrawing::FillRectangle( image, mask.X - x, mask.Y - y, mask.X + mask.Width - 1 - x, mask.Y + mask.Height - 1 - y, PRIVACY_MASK_COLOR );
+    }
+
+    if ( textLayer )
     {
-        if ( !overlay.empty( ) )
+        // layers can not be put on YUV images, but text can be drawn on those directly
+        if ( textLayer->Draw( image, -x, -y ) == XError::UnsupportedPixelFormat )
         {
-            overlay += " :: ";
+            XImageDrawing::PutText( image, textLayerText, -x, -y, overlayTextColor, overlayBackgroundColor );
         }
+    }
 
-        overlay += cameraTitle;
+    for ( const PlacedLayer& placedLayer : layers )
+    {
+        placedLayer.Layer->Draw( image, placedLayer.X - x, placedLayer.Y - y );
     }
+}
 
-    if ( !overlay.empty( ) )
+// Render overlay text again if its settings changed or if it shows time and a new second started -
+// once a second at most
+void XVideoFrameDecorator::UpdateTextLayer( )
+{
+    std::time_t time = std::time( 0 );
+
+    if ( ( !textLayerValid ) || ( ( addTimestampOverlay ) && ( time != textLayerTime ) ) )
     {
-        XImageDrawing::PutText( image, overlay, 0, 0, overlayTextColor, overlayBackgroundColor );
+        string overlay;
+
+        if ( addTimestampOverlay )
+        {
+            std::tm* now = std::localtime( &time );
+            char     buffer[32];
+
+            snprintf( buffer, sizeof( buffer ), "%02d/%02d/%02d %02d:%02d:%02d", now->tm_year - 100, now->tm_mon + 1, now->tm_mday,
+                                                                         now->tm_hour, now->tm_min, now->tm_sec );
+
+            overlay = buffer;
+        }
+
+        if ( ( addCameraTitleOverlay ) && ( !cameraTitle.empty( ) ) )
+        {
+            if ( !overlay.empty( ) )
+            {
+                overlay += " :: ";
+            }
+
+            overlay += cameraTitle;
+        }
+
+        textLayer      = XOverlayLayer::CreateText( overlay, overlayTextColor, overlayBackgroundColor );
+        textLayerText  = overlay;
+        textLayerTime  = time;
+        textLayerValid = true;
     }
 }
 
 // Get/Set camera title
 string XVideoFrameDecorator::CameraTitle( ) const
 {
+    lock_guard<mutex> lock( sync );
     return cameraTitle;
 }
 void XVideoFrameDecorator::SetCameraTitle( const string& title )
 {
+    lock_guard<mutex> lock( sync );
     cameraTitle = title;
+    textLayerValid = false;
+    settingsVersion++;
 }
 
 // Get/Set if timestamp should be overlayed on camera images
 bool XVideoFrameDecorator::TimestampOverlay( ) const
 {
+    lock_guard<mutex> lock( sync );
     return addTimestampOverlay;
 }
 void XVideoFrameDecorator::SetTimestampOverlay( bool enabled )
 {
+    lock_guard<mutex> lock( sync );
     addTimestampOverlay = enabled;
+    textLayerValid = false;
+    settingsVersion++;
 }
 
 // Get/Set if camera's title should be overlayed on its images
 bool XVideoFrameDecorator::CameraTitleOverlay( ) const
 {
+    lock_guard<mutex> lock( sync );
     return addCameraTitleOverlay;
 }
 void XVideoFrameDecorator::SetCameraTitleOverlay( bool enabled )
 {
+    lock_guard<mutex> lock( sync );
     addCameraTitleOverlay = enabled;
+    textLayerValid = false;
+    settingsVersion++;
 }
 
 // Get/Set overlay text color
 xargb XVideoFrameDecorator::OverlayTextColor( ) const
 {
+    lock_guard<mutex> lock( sync );
     return overlayTextColor;
 }
 void XVideoFrameDecorator::SetOverlayTextColor( xargb color )
 {
+    lock_guard<mutex> lock( sync );
     overlayTextColor = color;
+    textLayerValid = false;
+    settingsVersion++;
 }
 
 // Get/Set overlay background color
 xargb XVideoFrameDecorator::OverlayBackgroundColor( ) const
 {
+    lock_guard<mutex> lock( sync );
     return overlayBackgroundColor;
 }
 void XVideoFrameDecorator::SetOverlayBackgroundColor( xargb color )
 {
+    lock_guard<mutex> lock( sync );
     overlayBackgroundColor = color;
+    textLayerValid = false;
+    settingsVersion++;
+}
+
+// Add overlay layer to put on images at the specified location
+void XVideoFrameDecorator::AddOverlayLayer( const shared_ptr<XOverlayLayer>& layer, int32_t x, int32_t y )
+{
+    if ( layer )
+    {
+        lock_guard<mutex> lock( sync );
+        layers.push_back( PlacedLayer( { layer, x, y } ) );
+        settingsVersion++;
+    }
+}
+
+// Remove all overlay layers
+void XVideoFrameDecorator::ClearOverlayLayers( )
+{
+    lock_guard<mutex> lock( sync );
+    layers.clear( );
+    settingsVersion++;
+}
+
+// Add privacy mask to hide part of images
+void XVideoFrameDecorator::AddPrivacyMask( int32_t x, int32_t y, int32_t width, int32_t height )
+{
+    if ( ( width > 0 ) && ( height > 0 ) )
+    {
+        lock_guard<mutex> lock( sync );
+        privacyMasks.push_back( PrivacyMask( { x, y, width, height } ) );
+        settingsVersion++;
+    }
+}
+
+// Remove all privacy masks
+void XVideoFrameDecorator::ClearPrivacyMasks( )
+{
+    lock_guard<mutex> lock( sync );
+    privacyMasks.clear( );
+    settingsVersion++;
+}
+
+// Check if there is anything to put on images
+bool XVideoFrameDecorator::HasDecorations( ) const
+{
+    lock_guard<mutex> lock( sync );
+    return ( ( addTimestampOverlay ) || ( ( addCameraTitleOverlay ) && ( !cameraTitle.empty( ) ) ) ||
+             ( !layers.empty( ) ) || ( !privacyMasks.empty( ) ) );
+}
+
+// Get value, which changes whenever decorations put on images change
+uint64_t XVideoFrameDecorator::DecorationsState( ) const
+{
+    lock_guard<mutex> lock( sync );
+    uint64_t          state = settingsVersion << 40;
+
+    if ( addTimestampOverlay )
+    {
+        state ^= static_cast<uint64_t>( std::time( 0 ) );
+    }
+
+    return state;
 }
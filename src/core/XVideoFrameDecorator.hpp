@@ -22,9 +22,17 @@
 #ifndef XVIDEO_FRAME_DECORATOR_HPP
 #define XVIDEO_FRAME_DECORATOR_HPP
 
+#include <mutex>
+#include <vector>
+#include <ctime>
+
 #include "IVideoSourceListener.hpp"
+#include "XOverlayLayer.hpp"
+#include "XJpegOverlay.hpp"
 
-// Class aimed to put any sort of decorations on the images coming from video source (title, time, watermark/logo, etc)
+// Class aimed to put any sort of decorations on the images coming from video source (title, time, watermark/logo,
+// privacy masks, etc). Decorations are kept as overlay layers, which are rendered again only when their content changes.
+// JPEG images can not be decorated in place - DecorateJpeg() provides their decorated copy instead.
 class XVideoFrameDecorator : public IVideoSourceListener
 {
 public:
@@ -55,12 +63,68 @@ public:
     xargb OverlayBackgroundColor( ) const;
     void SetOverlayBackgroundColor( xargb color );
 
+    // Add overlay layer (logo, watermark, any text, etc) to put on images at the specified location
+    void AddOverlayLayer( const std::shared_ptr<XOverlayLayer>& layer, int32_t x, int32_t y );
+    // Remove all overlay layers added with the above
+    void ClearOverlayLayers( );
+
+    // Add privacy mask - rectangle filled with black color to hide part of images
+    void AddPrivacyMask( int32_t x, int32_t y, int32_t width, int32_t height );
+    // Remove all privacy masks
+    void ClearPrivacyMasks( );
+
+    // Check if there is anything to put on images
+    bool HasDecorations( ) const;
+
+    // Get value, which changes whenever decorations put on images change - settings, layers, masks or
+    // time shown by timestamp overlay (so frames repeated by video source still get new time on them)
+    uint64_t DecorationsState( ) const;
+
+    /* Put decorations on JPEG image and write the result into provided buffer
+
+       Only MCUs covered by decorations are decoded, drawn on and encoded
+       again, while the rest of the image keeps its quality (see
+       XJpegOverlay). Buffer is handled same way as by
+       XJpegEncoder::EncodeToMemory().
+    */
+    XError DecorateJpeg( const uint8_t* jpegData, uint32_t jpegSize, uint8_t** buffer, uint32_t* bufferSize );
+
 private:
+    void UpdateTextLayer( );
+    void Decorate( const std::shared_ptr<const XImage>& image, int32_t x, int32_t y );
+
+private:
+    struct PlacedLayer
+    {
+        std::shared_ptr<XOverlayLayer> Layer;
+        int32_t                        X;
+        int32_t                        Y;
+    };
+
+    struct PrivacyMask
+    {
+        int32_t X;
+        int32_t Y;
+        int32_t Width;
+        int32_t Height;
+    };
+
+    mutable std::mutex sync;
+
     std::string cameraTitle;
     bool        addTimestampOverlay;
     bool        addCameraTitleOverlay;
     xargb       overlayTextColor;
     xargb       overlayBackgroundColor;
+
+    std::shared_ptr<XOverlayLayer> textLayer;       // timestamp and/or title
+    std::string                    textLayerText;
+    bool                           textLayerValid;
+    std::time_t                    textLayerTime;   // time shown by the text layer
+    uint64_t                       settingsVersion; // incremented on every change of decorations
+    std::vector<PlacedLayer>       layers;
+    std::vector<PrivacyMask>       privacyMasks;
+    XJpegOverlay                   jpegOverlay;
 };
 
 #endif // XVIDEO_FRAME_DECORATOR_HPP
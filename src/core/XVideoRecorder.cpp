@@ -0,0 +1,743 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <algorithm>
+
+#include "XVideoRecorder.hpp"
+#include "XRecordingIndex.hpp"
+#include "XTracer.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    // Size of buffers frames are collected in before writing them (bigger frames get bigger buffers)
+    #define WRITE_BUFFER_SIZE       (1024 * 1024)
+    // Alignment of write buffers (page size)
+    #define WRITE_BUFFER_ALIGNMENT  (4096)
+    // Maximum number of buffers waiting to be written - frames are dropped when there are more
+    #define MAX_QUEUED_BUFFERS      (8)
+    // Partially filled buffer is written if it is kept for this long (ms)
+    #define FLUSH_INTERVAL          (1000)
+
+    #define SEGMENT_EXTENSION       ".mjpeg"
+
+    // Buffer of frames to write into a segment
+    class WriteBuffer : private Uncopyable
+    {
+    public:
+        uint8_t*                     Data;
+        uint32_t                     Capacity;
+        uint32_t                     Size;
+        int64_t                      SegmentStart;  // timestamp of the segment's first frame
+        steady_clock::time_point     FirstFrameTime;
+        vector<XRecordingIndexEntry> Index;         // frames of the buffer (offsets are relative to its start)
+
+    public:
+        WriteBuffer( uint32_t capacity ) :
+            Data( nullptr ), Capacity( 0 ), Size( 0 ), SegmentStart( 0 ), FirstFrameTime( ), Index( )
+        {
+            capacity = ( capacity + WRITE_BUFFER_ALIGNMENT - 1 ) / WRITE_BUFFER_ALIGNMENT * WRITE_BUFFER_ALIGNMENT;
+
+            if ( posix_memalign( reinterpret_cast<void**>( &Data ), WRITE_BUFFER_ALIGNMENT, capacity ) == 0 )
+            {
+                Capacity = capacity;
+            }
+            else
+            {
+                Data = nullptr;
+            }
+        }
+
+        ~WriteBuffer( )
+        {
+            free( Data );
+        }
+    };
+
+    class XVideoRecorderData
+    {
+    public:
+        string                      Directory;
+        string                      NamePrefix;
+        atomic<uint32_t>            SegmentDuration;    // ms
+        atomic<uint32_t>            FrameInterval;      // ms
+        atomic<uint64_t>            MaxTotalSize;       // bytes
+        atomic<int64_t>             MaxAge;             // ms
+
+        mutable mutex               Sync;
+        condition_variable          BuffersQueued;
+        bool                        Running;
+        bool                        NeedToStop;
+        thread                      WriterThread;
+        unique_ptr<WriteBuffer>     CurrentBuffer;
+        deque<unique_ptr<WriteBuffer>> QueuedBuffers;
+        vector<unique_ptr<WriteBuffer>> FreeBuffers;
+        int64_t                     SegmentStart;       // segment frames are currently added to
+        int64_t                     LastTimestamp;      // timestamp of the last frame added to the segment
+
+        // owned by writer thread
+        int                         SegmentFile;
+        int                         IndexFile;
+        int64_t                     OpenSegmentStart;
+        string                      OpenSegmentName;
+        uint64_t                    SegmentOffset;
+        uint64_t                    LastWriteOffset;    // previous write, which is dropped from page cache after next one
+        uint32_t                    LastWriteSize;
+
+        atomic<uint64_t>            FramesRecorded;
+        atomic<uint64_t>            FramesDropped;
+        atomic<uint64_t>            BytesWritten;
+        atomic<uint64_t>            WriteErrors;
+        atomic<uint64_t>            SegmentsDeleted;
+        XDurationHistogram          WriteTime;
+
+    public:
+        XVideoRecorderData( const string& directory, const string& namePrefix ) :
+            Directory( directory ), NamePrefix( namePrefix ), SegmentDuration( 600 * 1000 ), FrameInterval( 0 ), MaxTotalSize( 0 ), MaxAge( 0 ),
+            Sync( ), BuffersQueued( ), Running( false ), NeedToStop( false ), WriterThread( ),
+            CurrentBuffer( ), QueuedBuffers( ), FreeBuffers( ), SegmentStart( 0 ), LastTimestamp( 0 ),
+            SegmentFile( -1 ), IndexFile( -1 ), OpenSegmentStart( 0 ), OpenSegmentName( ), SegmentOffset( 0 ), LastWriteOffset( 0 ), LastWriteSize( 0 ),
+            FramesRecorded( 0 ), FramesDropped( 0 ), BytesWritten( 0 ), WriteErrors( 0 ), SegmentsDeleted( 0 ), WriteTime( )
+        {
+            // keep directory name without trailing slash
+            while ( ( Directory.length( ) > 1 ) && ( Directory.back( ) == '/' ) )
+            {
+                Directory.pop_back( );
+            }
+        }
+
+        XError Start( );
+        void Stop( );
+        void AddFrame( const uint8_t* data, uint32_t size, int64_t timestamp );
+        bool IsFrameDue( int64_t timestamp ) const;
+        void QueueCurrentBuffer( );
+
+        void WriteBufferToSegment( WriteBuffer* buffer );
+        void WriteBufferIndex( WriteBuffer* buffer );
+        bool OpenSegment( int64_t segmentStart );
+        void CloseSegment( );
+        void CloseIndex( );
+        bool IsIndexComplete( ) const;
+        void ApplyRetention( );
+
+        static void WriterThreadHandler( XVideoRecorderData* me );
+    };
+
+    // Make sure the directory exists, creating all missing directories of the path
+    static bool CreateDirectory( const string& path )
+    {
+        struct stat info;
+        bool        ret = true;
+
+        if ( stat( path.c_str( ), &info ) != 0 )
+        {
+            size_t separator = path.find_last_of( '/' );
+
+            if ( ( separator != string::npos ) && ( separator != 0 ) )
+            {
+                ret = CreateDirectory( path.substr( 0, separator ) );
+            }
+
+            ret = ( ( ret ) && ( ( mkdir( path.c_str( ), 0755 ) == 0 ) || ( errno == EEXIST ) ) );
+        }
+        else
+        {
+            ret = S_ISDIR( info.st_mode );
+        }
+
+        return ret;
+    }
+}
+
+XVideoRecorder::XVideoRecorder( const string& directory, const string& namePrefix ) :
+    mData( new Private::XVideoRecorderData( directory, namePrefix ) )
+{
+}
+
+XVideoRecorder::~XVideoRecorder( )
+{
+    mData->Stop( );
+    delete mData;
+}
+
+// Start recording
+XError XVideoRecorder::Start( )
+{
+    return mData->Start( );
+}
+
+// Stop recording, writing all frames received so far
+void XVideoRecorder::Stop( )
+{
+    mData->Stop( );
+}
+
+// Check if recording is running
+bool XVideoRecorder::IsRecording( ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+
+    return mData->Running;
+}
+
+// Directory and name prefix of segment files
+string XVideoRecorder::Directory( ) const
+{
+    return mData->Directory;
+}
+string XVideoRecorder::NamePrefix( ) const
+{
+    return mData->NamePrefix;
+}
+
+// Get/Set duration of segment files in seconds
+uint32_t XVideoRecorder::SegmentDuration( ) const
+{
+    return mData->SegmentDuration / 1000;
+}
+void XVideoRecorder::SetSegmentDuration( uint32_t seconds )
+{
+    mData->SegmentDuration = ( seconds == 0 ) ? 1000 : seconds * 1000;
+}
+
+// Get/Set interval between recorded frames in milliseconds
+uint32_t XVideoRecorder::FrameInterval( ) const
+{
+    return mData->FrameInterval;
+}
+void XVideoRecorder::SetFrameInterval( uint32_t msec )
+{
+    mData->FrameInterval = msec;
+}
+
+// Set retention limits
+void XVideoRecorder::SetRetention( uint32_t maxSizeMb, uint32_t maxAgeHours )
+{
+    mData->MaxTotalSize = static_cast<uint64_t>( maxSizeMb ) * 1024 * 1024;
+    mData->MaxAge       = static_cast<int64_t>( maxAgeHours ) * 3600 * 1000;
+}
+
+// New encoded frame notification - queue it for writing
+void XVideoRecorder::OnEncodedFrame( const uint8_t* data, uint32_t size, int64_t timestamp )
+{
+    mData->AddFrame( data, size, timestamp );
+}
+
+// Check if a frame captured at the specified time is going to be recorded
+bool XVideoRecorder::IsFrameNeeded( int64_t timestamp ) const
+{
+    lock_guard<mutex> lock( mData->Sync );
+
+    return ( ( mData->Running ) && ( !mData->NeedToStop ) && ( mData->IsFrameDue( timestamp ) ) );
+}
+
+// Put statistics of the recorder into the specified collector
+void XVideoRecorder::CollectStatistics( XStatisticsCollector& collector ) const
+{
+    size_t queuedBuffers;
+
+    {
+        lock_guard<mutex> lock( mData->Sync );
+        queuedBuffers = mData->QueuedBuffers.size( );
+    }
+
+    collector.AddCounter( "cam2web_recorder_frames_total", "Frames recorded", mData->FramesRecorded );
+    collector.AddCounter( "cam2web_recorder_frames_dropped_total", "Frames not recorded, since disk did not keep up", mData->FramesDropped );
+    collector.AddCounter( "cam2web_recorder_written_bytes_total", "Bytes written into recording segments", mData->BytesWritten );
+    collector.AddCounter( "cam2web_recorder_write_errors_total", "Failed writes of recording segments", mData->WriteErrors );
+    collector.AddCounter( "cam2web_recorder_segments_deleted_total", "Recording segments deleted by retention policy", mData->SegmentsDeleted );
+    collector.AddGauge( "cam2web_recorder_queued_buffers", "Buffers of frames waiting to be written", static_cast<double>( queuedBuffers ) );
+    collector.AddHistogram( "cam2web_recorder_write_seconds", "Time taken to write buffers of frames", mData->WriteTime );
+}
+
+// Check if the specified file name is a name of segment file with the specified prefix
+bool XVideoRecorder::IsSegmentFileName( const string& fileName, const string& namePrefix )
+{
+    return ( ( fileName.compare( 0, namePrefix.length( ) + 1, namePrefix + "_" ) == 0 ) &&
+             ( fileName.length( ) > namePrefix.length( ) + 1 + strlen( SEGMENT_EXTENSION ) ) &&
+             ( fileName.compare( fileName.length( ) - strlen( SEGMENT_EXTENSION ), string::npos, SEGMENT_EXTENSION ) == 0 ) &&
+             ( fileName.find( '/' ) == string::npos ) );
+}
+
+namespace Private
+{
+
+// Create recordings' directory and start writer thread
+XError XVideoRecorderData::Start( )
+{
+    lock_guard<mutex> lock( Sync );
+    XError            ret = XError::Success;
+
+    if ( !Running )
+    {
+        if ( ( !CreateDirectory( Directory ) ) || ( access( Directory.c_str( ), W_OK ) != 0 ) )
+        {
+            ret = XError::IOError;
+        }
+        else
+        {
+            NeedToStop   = false;
+            Running      = true;
+            SegmentStart = 0;
+            WriterThread = thread( WriterThreadHandler, this );
+        }
+    }
+
+    return ret;
+}
+
+// Stop writer thread once it writes all queued frames
+void XVideoRecorderData::Stop( )
+{
+    {
+        lock_guard<mutex> lock( Sync );
+        NeedToStop = true;
+    }
+    BuffersQueued.notify_one( );
+
+    if ( WriterThread.joinable( ) )
+    {
+        WriterThread.join( );
+    }
+
+    lock_guard<mutex> lock( Sync );
+    Running = false;
+}
+
+// Copy frame into the current buffer, as a part of multipart stream
+void XVideoRecorderData::AddFrame( const uint8_t* data, uint32_t size, int64_t timestamp )
+{
+    lock_guard<mutex> lock( Sync );
+
+    if ( ( Running ) && ( !NeedToStop ) && ( IsFrameDue( timestamp ) ) )
+    {
+        XTraceScope trace( "Record frame" );
+        char        partHeader[128];
+        uint32_t    duration     = SegmentDuration;
+        // segments start at multiples of their duration
+        bool        newSegment   = ( ( SegmentStart == 0 ) || ( timestamp < SegmentStart ) ||
+                                     ( timestamp / duration != SegmentStart / duration ) );
+
+        if ( !newSegment )
+        {
+            // frames of a segment must stay sorted by time for its index, even if system clock goes back a bit
+            timestamp = max( timestamp, LastTimestamp );
+        }
+
+        int         headerLength = sprintf( partHeader, "--myboundary\r\n"
+                                                        "Content-Type: image/jpeg\r\n"
+                                                        "Content-Length: %u\r\n"
+                                                        "X-Timestamp: %lld\r\n"
+                                                        "\r\n", size, static_cast<long long>( timestamp ) );
+        uint32_t    partSize     = static_cast<uint32_t>( headerLength ) + size + 2;
+
+        // buffers never mix frames of different segments
+        if ( ( CurrentBuffer ) && ( ( newSegment ) || ( CurrentBuffer->Size + partSize > CurrentBuffer->Capacity ) ) )
+        {
+            QueueCurrentBuffer( );
+        }
+
+        if ( newSegment )
+        {
+            SegmentStart = timestamp;
+        }
+
+        LastTimestamp = timestamp;
+
+        if ( ( !CurrentBuffer ) && ( QueuedBuffers.size( ) < MAX_QUEUED_BUFFERS ) )
+        {
+            if ( ( !FreeBuffers.empty( ) ) && ( FreeBuffers.back( )->Capacity >= partSize ) )
+            {
+                CurrentBuffer = std::move( FreeBuffers.back( ) );
+                FreeBuffers.pop_back( );
+            }
+            else
+            {
+                CurrentBuffer.reset( new WriteBuffer( max( partSize, static_cast<uint32_t>( WRITE_BUFFER_SIZE ) ) ) );
+
+                if ( CurrentBuffer->Data == nullptr )
+                {
+                    CurrentBuffer.reset( );
+                }
+            }
+
+            if ( CurrentBuffer )
+            {
+                CurrentBuffer->Size           = 0;
+                CurrentBuffer->Index.clear( );
+                CurrentBuffer->SegmentStart   = SegmentStart;
+                CurrentBuffer->FirstFrameTime = steady_clock::now( );
+            }
+        }
+
+        if ( !CurrentBuffer )
+        {
+            FramesDropped++;
+        }
+        else
+        {
+            XRecordingIndexEntry entry = { timestamp, CurrentBuffer->Size, partSize, static_cast<uint32_t>( headerLength ) };
+            uint8_t*             ptr   = CurrentBuffer->Data + CurrentBuffer->Size;
+
+            memcpy( ptr, partHeader, headerLength );
+            memcpy( ptr + headerLength, data, size );
+            memcpy( ptr + headerLength + size, "\r\n", 2 );
+
+            CurrentBuffer->Index.push_back( entry );
+            CurrentBuffer->Size += partSize;
+            FramesRecorded++;
+        }
+    }
+}
+
+// Check if a frame captured at the specified time is due for recording - the first one within
+// the frame interval (counted since Unix epoch) is recorded only (the lock must be held)
+bool XVideoRecorderData::IsFrameDue( int64_t timestamp ) const
+{
+    uint32_t frameInterval = FrameInterval;
+
+    return ( ( frameInterval == 0 ) || ( LastTimestamp == 0 ) || ( timestamp / frameInterval != LastTimestamp / frameInterval ) );
+}
+
+// Put current buffer into the queue for writer thread (the lock must be held)
+void XVideoRecorderData::QueueCurrentBuffer( )
+{
+    if ( CurrentBuffer )
+    {
+        if ( CurrentBuffer->Size == 0 )
+        {
+            FreeBuffers.push_back( std::move( CurrentBuffer ) );
+        }
+        else
+        {
+            QueuedBuffers.push_back( std::move( CurrentBuffer ) );
+            BuffersQueued.notify_one( );
+        }
+    }
+}
+
+// Write buffer into its segment file, starting new segment if needed
+void XVideoRecorderData::WriteBufferToSegment( WriteBuffer* buffer )
+{
+    XTraceScope              trace( "Write recording", 0 );
+    steady_clock::time_point startTime = steady_clock::now( );
+
+    if ( ( SegmentFile == -1 ) || ( buffer->SegmentStart != OpenSegmentStart ) )
+    {
+        CloseSegment( );
+
+        if ( OpenSegment( buffer->SegmentStart ) )
+        {
+            ApplyRetention( );
+        }
+    }
+
+    if ( SegmentFile == -1 )
+    {
+        WriteErrors++;
+    }
+    else
+    {
+        const uint8_t* ptr  = buffer->Data;
+        uint32_t       left = buffer->Size;
+
+        while ( left != 0 )
+        {
+            ssize_t written = write( SegmentFile, ptr, left );
+
+            if ( written > 0 )
+            {
+                ptr  += written;
+                left -= static_cast<uint32_t>( written );
+            }
+            else if ( ( written < 0 ) && ( errno == EINTR ) )
+            {
+                continue;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        if ( left != 0 )
+        {
+            // don't leave partially written frames in the segment, so that its index stays valid,
+            // and reopen the segment next time (appending to it)
+            if ( ftruncate( SegmentFile, static_cast<off_t>( SegmentOffset ) ) != 0 )
+            {
+                // the index will not cover anything after the broken frame
+                CloseIndex( );
+            }
+
+            WriteErrors++;
+            CloseSegment( );
+        }
+        else
+        {
+            WriteBufferIndex( buffer );
+
+        #ifdef SYNC_FILE_RANGE_WRITE
+            // start writing new data to disk, while waiting for the previous write to complete and dropping it from
+            // page cache - recordings are not read back soon, so they should not push useful pages out of memory
+            sync_file_range( SegmentFile, SegmentOffset, buffer->Size, SYNC_FILE_RANGE_WRITE );
+
+            if ( LastWriteSize != 0 )
+            {
+                sync_file_range( SegmentFile, LastWriteOffset, LastWriteSize,
+                                 SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER );
+                posix_fadvise( SegmentFile, LastWriteOffset, LastWriteSize, POSIX_FADV_DONTNEED );
+            }
+        #endif
+
+            LastWriteOffset = SegmentOffset;
+            LastWriteSize   = buffer->Size;
+            SegmentOffset  += buffer->Size;
+            BytesWritten   += buffer->Size;
+        }
+    }
+
+    WriteTime.AddSince( startTime );
+}
+
+// Append index records of the buffer's frames (after the buffer got written into segment)
+void XVideoRecorderData::WriteBufferIndex( WriteBuffer* buffer )
+{
+    if ( IndexFile != -1 )
+    {
+        for ( XRecordingIndexEntry& entry : buffer->Index )
+        {
+            entry.Offset += SegmentOffset;
+        }
+
+        ssize_t indexSize = static_cast<ssize_t>( buffer->Index.size( ) * sizeof( XRecordingIndexEntry ) );
+
+        if ( write( IndexFile, buffer->Index.data( ), indexSize ) != indexSize )
+        {
+            // stop indexing the segment - frames not found in its index are found by parsing the segment itself
+            WriteErrors++;
+            CloseIndex( );
+        }
+    }
+}
+
+// Open segment file for the specified time of its first frame
+bool XVideoRecorderData::OpenSegment( int64_t segmentStart )
+{
+    time_t    seconds = static_cast<time_t>( segmentStart / 1000 );
+    struct tm utcTime;
+    char      name[64];
+
+    gmtime_r( &seconds, &utcTime );
+    sprintf( name, "_%04d%02d%02d_%02d%02d%02d" SEGMENT_EXTENSION, utcTime.tm_year + 1900, utcTime.tm_mon + 1, utcTime.tm_mday,
+                                                                   utcTime.tm_hour, utcTime.tm_min, utcTime.tm_sec );
+
+    OpenSegmentName  = NamePrefix + name;
+    OpenSegmentStart = segmentStart;
+    SegmentFile      = open( ( Directory + "/" + OpenSegmentName ).c_str( ), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644 );
+
+    if ( SegmentFile != -1 )
+    {
+        struct stat info;
+
+        // segment may exist already, if it was reopened after an error
+        SegmentOffset   = ( fstat( SegmentFile, &info ) == 0 ) ? static_cast<uint64_t>( info.st_size ) : 0;
+        LastWriteOffset = 0;
+        LastWriteSize   = 0;
+
+        // index of a reopened segment is continued only if it covers the whole segment
+        if ( ( SegmentOffset == 0 ) || ( IsIndexComplete( ) ) )
+        {
+            IndexFile = open( XRecordingIndex::IndexFileName( Directory + "/" + OpenSegmentName ).c_str( ),
+                              O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | ( ( SegmentOffset == 0 ) ? O_TRUNC : 0 ), 0644 );
+        }
+    }
+
+    return ( SegmentFile != -1 );
+}
+
+// Close current segment file and its index
+void XVideoRecorderData::CloseSegment( )
+{
+    if ( SegmentFile != -1 )
+    {
+        close( SegmentFile );
+        SegmentFile = -1;
+    }
+
+    CloseIndex( );
+}
+
+// Close index file of the current segment
+void XVideoRecorderData::CloseIndex( )
+{
+    if ( IndexFile != -1 )
+    {
+        close( IndexFile );
+        IndexFile = -1;
+    }
+}
+
+// Check if index file of the open segment covers all its frames
+bool XVideoRecorderData::IsIndexComplete( ) const
+{
+    int  indexFile = open( XRecordingIndex::IndexFileName( Directory + "/" + OpenSegmentName ).c_str( ), O_RDONLY | O_CLOEXEC );
+    bool ret       = false;
+
+    if ( indexFile != -1 )
+    {
+        XRecordingIndexEntry lastEntry;
+        struct stat          info;
+
+        // index must end with a complete record, which points to the end of the segment
+        ret = ( ( fstat( indexFile, &info ) == 0 ) && ( info.st_size != 0 ) && ( info.st_size % sizeof( XRecordingIndexEntry ) == 0 ) &&
+                ( pread( indexFile, &lastEntry, sizeof( lastEntry ), info.st_size - sizeof( lastEntry ) ) == sizeof( lastEntry ) ) &&
+                ( lastEntry.Offset + lastEntry.PartSize == SegmentOffset ) );
+
+        close( indexFile );
+    }
+
+    return ret;
+}
+
+// Delete oldest segments while recordings are over size/age limits
+void XVideoRecorderData::ApplyRetention( )
+{
+    uint64_t maxTotalSize = MaxTotalSize;
+    int64_t  maxAge       = MaxAge;
+
+    if ( ( maxTotalSize != 0 ) || ( maxAge != 0 ) )
+    {
+        DIR* dir = opendir( Directory.c_str( ) );
+
+        if ( dir != nullptr )
+        {
+            vector<pair<string, struct stat>> segments;
+            uint64_t                          totalSize = 0;
+            time_t                            now       = time( nullptr );
+            struct dirent*                    entry;
+            struct stat                       info;
+
+            // segments' names sort in time order
+            while ( ( entry = readdir( dir ) ) != nullptr )
+            {
+                string name = entry->d_name;
+
+                if ( ( XVideoRecorder::IsSegmentFileName( name, NamePrefix ) ) &&
+                     ( stat( ( Directory + "/" + name ).c_str( ), &info ) == 0 ) && ( S_ISREG( info.st_mode ) ) )
+                {
+                    segments.push_back( pair<string, struct stat>( name, info ) );
+                    totalSize += info.st_size;
+                }
+            }
+            closedir( dir );
+
+            sort( segments.begin( ), segments.end( ),
+                  [] ( const pair<string, struct stat>& a, const pair<string, struct stat>& b ) { return a.first < b.first; } );
+
+            for ( const auto& segment : segments )
+            {
+                bool overSize = ( ( maxTotalSize != 0 ) && ( totalSize > maxTotalSize ) );
+                bool tooOld   = ( ( maxAge != 0 ) && ( static_cast<int64_t>( now - segment.second.st_mtime ) * 1000 > maxAge ) );
+
+                // segments are checked from the oldest, so stop at the first one to keep
+                if ( ( ( !overSize ) && ( !tooOld ) ) || ( segment.first == OpenSegmentName ) )
+                {
+                    break;
+                }
+
+                if ( unlink( ( Directory + "/" + segment.first ).c_str( ) ) == 0 )
+                {
+                    unlink( XRecordingIndex::IndexFileName( Directory + "/" + segment.first ).c_str( ) );
+
+                    totalSize -= segment.second.st_size;
+                    SegmentsDeleted++;
+                }
+            }
+        }
+    }
+}
+
+// Thread writing buffers of frames into segment files
+void XVideoRecorderData::WriterThreadHandler( XVideoRecorderData* me )
+{
+    unique_lock<mutex> lock( me->Sync );
+
+    XTracer::SetThreadName( "Recorder " + me->NamePrefix );
+
+    while ( true )
+    {
+        me->BuffersQueued.wait_for( lock, milliseconds( FLUSH_INTERVAL ), [me] { return ( me->NeedToStop ) || ( !me->QueuedBuffers.empty( ) ); } );
+
+        // don't keep frames in memory for too long when they come slowly
+        if ( ( me->NeedToStop ) ||
+             ( ( me->CurrentBuffer ) && ( steady_clock::now( ) - me->CurrentBuffer->FirstFrameTime >= milliseconds( FLUSH_INTERVAL ) ) ) )
+        {
+            me->QueueCurrentBuffer( );
+        }
+
+        while ( !me->QueuedBuffers.empty( ) )
+        {
+            unique_ptr<WriteBuffer> buffer = std::move( me->QueuedBuffers.front( ) );
+
+            me->QueuedBuffers.pop_front( );
+            lock.unlock( );
+
+            me->WriteBufferToSegment( buffer.get( ) );
+
+            lock.lock( );
+
+            // only buffers of standard size are kept for reuse, so huge frames don't hold much memory
+            if ( ( buffer->Capacity == WRITE_BUFFER_SIZE ) && ( me->FreeBuffers.size( ) < MAX_QUEUED_BUFFERS ) )
+            {
+                me->FreeBuffers.push_back( std::move( buffer ) );
+            }
+        }
+
+        if ( me->NeedToStop )
+        {
+            break;
+        }
+    }
+
+    lock.unlock( );
+    me->CloseSegment( );
+}
+
+} // namespace Private
@@ -0,0 +1,101 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XVIDEO_RECORDER_HPP
+#define XVIDEO_RECORDER_HPP
+
+#include <stdint.h>
+#include <string>
+
+#include "XInterfaces.hpp"
+#include "XError.hpp"
+#include "XStatistics.hpp"
+#include "IEncodedFrameListener.hpp"
+
+namespace Private
+{
+    class XVideoRecorderData;
+}
+
+/* ================================================================= */
+/* Records encoded frames into segment files of the specified        */
+/* duration, named <prefix>_YYYYMMDD_HHMMSS.mjpeg after UTC time     */
+/* of their first frame. Segments start at multiples of their        */
+/* duration since Unix epoch (daily segments start at midnight       */
+/* UTC, for example). Segments are multipart MJPEG streams (same     */
+/* as served to MJPEG clients, with X-Timestamp header in every      */
+/* part), which only get appended, so nothing is lost if the         */
+/* process dies. Every segment gets an index file (see               */
+/* XRecordingIndex), so its frames can be found by time without      */
+/* reading the segment. If frame interval is set, only one frame     */
+/* per interval is recorded (time-lapse), while the rest are not     */
+/* even encoded for the recorder. Frames are copied into large       */
+/* buffers, which are written by the recorder's own thread, so       */
+/* encoding never waits for the disk. Frames are dropped if the      */
+/* disk does not keep up. Oldest segments are deleted when total     */
+/* size/age of recordings gets over limits.                          */
+/* (POSIX systems only.)                                             */
+/* ================================================================= */
+class XVideoRecorder : public IEncodedFrameListener, public IStatisticsProvider, private Uncopyable
+{
+public:
+    XVideoRecorder( const std::string& directory, const std::string& namePrefix );
+    ~XVideoRecorder( );
+
+    // Start recording (fails if the directory can not be created or written to)
+    XError Start( );
+    // Stop recording, writing all frames received so far
+    void Stop( );
+    // Check if recording is running
+    bool IsRecording( ) const;
+
+    // Directory and name prefix of segment files
+    std::string Directory( ) const;
+    std::string NamePrefix( ) const;
+
+    // Get/Set duration of segment files in seconds (600 by default)
+    uint32_t SegmentDuration( ) const;
+    void SetSegmentDuration( uint32_t seconds );
+
+    // Get/Set interval between recorded frames in milliseconds (0 by default - all frames are recorded)
+    uint32_t FrameInterval( ) const;
+    void SetFrameInterval( uint32_t msec );
+
+    // Set retention limits - oldest segments are deleted while total size of recordings is over
+    // the specified number of megabytes or they are older than the specified number of hours (0 - no limit)
+    void SetRetention( uint32_t maxSizeMb, uint32_t maxAgeHours );
+
+    // New encoded frame notification - queue it for writing
+    void OnEncodedFrame( const uint8_t* data, uint32_t size, int64_t timestamp ) override;
+    // Check if a frame captured at the specified time is going to be recorded
+    bool IsFrameNeeded( int64_t timestamp ) const override;
+
+    // Put statistics of the recorder into the specified collector
+    void CollectStatistics( XStatisticsCollector& collector ) const;
+
+public:
+    // Check if the specified file name is a name of segment file with the specified prefix
+    static bool IsSegmentFileName( const std::string& fileName, const std::string& namePrefix );
+
+private:
+    Private::XVideoRecorderData* mData;
+};
+
+#endif // XVIDEO_RECORDER_HPP
@@ -0,0 +1,252 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <mutex>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include "XVideoSourceDemandController.hpp"
+#include "XManualResetEvent.hpp"
+#include "XTracer.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace Private
+{
+    // Interval of checking if video source is still demanded (ms)
+    #define DEMAND_CHECK_INTERVAL (250)
+    // Shortest and longest intervals of not starting video source after its failures (ms)
+    #define RESTART_BACKOFF_MIN   (1000)
+    #define RESTART_BACKOFF_MAX   (60000)
+
+    class XVideoSourceDemandControllerData
+    {
+    public:
+        shared_ptr<IVideoSource>    VideoSource;
+        uint32_t                    IdleTimeout;
+        mutex                       Sync;
+        atomic<bool>                SourceActive;
+        bool                        SourceStopping;     // source was signalled to stop, but did not clean-up yet
+        steady_clock::time_point    LastDemandTime;
+        XManualResetEvent           NeedToStop;
+        thread                      ControlThread;
+        atomic<uint64_t>            SourceStarts;
+        atomic<uint64_t>            SourceStops;
+        atomic<uint64_t>            SourceFailures;
+        atomic<bool>                FramesDelivered;    // source provided frames since it was started last time
+        uint32_t                    RestartBackoff;     // current back-off interval (ms), 0 if the source did not fail
+        steady_clock::time_point    LastFailureTime;
+
+    public:
+        XVideoSourceDemandControllerData( const shared_ptr<IVideoSource>& videoSource, uint32_t idleTimeout ) :
+            VideoSource( videoSource ), IdleTimeout( idleTimeout ), Sync( ), SourceActive( false ), SourceStopping( false ), LastDemandTime( ),
+            NeedToStop( ), ControlThread( ), SourceStarts( 0 ), SourceStops( 0 ), SourceFailures( 0 ),
+            FramesDelivered( false ), RestartBackoff( 0 ), LastFailureTime( )
+        {
+        }
+
+        bool Demand( );
+        void StopSource( bool onlyIfIdle );
+        void RegisterFailure( );
+
+        static void ControlThreadHandler( XVideoSourceDemandControllerData* me );
+    };
+}
+
+XVideoSourceDemandController::XVideoSourceDemandController( const shared_ptr<IVideoSource>& videoSource, uint32_t idleTimeout ) :
+    mData( new Private::XVideoSourceDemandControllerData( videoSource, idleTimeout ) )
+{
+}
+
+XVideoSourceDemandController::~XVideoSourceDemandController( )
+{
+    Stop( );
+    delete mData;
+}
+
+// Start controlling video source
+void XVideoSourceDemandController::Start( )
+{
+    if ( !mData->ControlThread.joinable( ) )
+    {
+        mData->NeedToStop.Reset( );
+        mData->ControlThread = thread( Private::XVideoSourceDemandControllerData::ControlThreadHandler, mData );
+    }
+}
+
+// Stop controlling video source and stop the source itself
+void XVideoSourceDemandController::Stop( )
+{
+    if ( mData->ControlThread.joinable( ) )
+    {
+        mData->NeedToStop.Signal( );
+        mData->ControlThread.join( );
+    }
+
+    mData->StopSource( false );
+}
+
+// Let controller know video is needed now
+bool XVideoSourceDemandController::Demand( )
+{
+    return mData->Demand( );
+}
+
+// Let controller know video source provides frames
+void XVideoSourceDemandController::FrameDelivered( )
+{
+    // it is called for every frame, so the flag is not written again once set
+    if ( !mData->FramesDelivered.load( memory_order_relaxed ) )
+    {
+        mData->FramesDelivered = true;
+    }
+}
+
+// Check if video source is running at the moment
+bool XVideoSourceDemandController::IsSourceActive( ) const
+{
+    return mData->SourceActive;
+}
+
+// Time without demand, after which video source is stopped
+uint32_t XVideoSourceDemandController::IdleTimeout( ) const
+{
+    return mData->IdleTimeout;
+}
+
+// Put statistics of the controller into the specified collector
+void XVideoSourceDemandController::CollectStatistics( XStatisticsCollector& collector ) const
+{
+    collector.AddGauge( "cam2web_video_source_active", "Video source is running, since its video is demanded", ( mData->SourceActive ) ? 1 : 0 );
+    collector.AddCounter( "cam2web_video_source_starts_total", "Video source was started on demand", mData->SourceStarts );
+    collector.AddCounter( "cam2web_video_source_stops_total", "Video source was stopped, since nothing demanded it", mData->SourceStops );
+    collector.AddCounter( "cam2web_video_source_failures_total", "Video source failed to start or stopped before providing frames", mData->SourceFailures );
+}
+
+namespace Private
+{
+
+// Remember time of the demand and start video source if it is not running (or has stopped due to an error),
+// unless it failed recently. Source still stopping is not waited for - it is started by one of the next demands.
+bool XVideoSourceDemandControllerData::Demand( )
+{
+    lock_guard<mutex> lock( Sync );
+    bool              started = false;
+
+    LastDemandTime = steady_clock::now( );
+
+    // source is fine once it provides frames
+    if ( FramesDelivered )
+    {
+        RestartBackoff = 0;
+    }
+
+    if ( SourceStopping )
+    {
+        // video is needed again, while controller's thread waits for the source to stop
+        started = true;
+    }
+    else if ( ( !SourceActive ) || ( !VideoSource->IsRunning( ) ) )
+    {
+        // source stopped on its own before providing anything (device failed to open, got unplugged, etc.)
+        if ( ( SourceActive ) && ( !FramesDelivered ) )
+        {
+            SourceActive = false;
+            RegisterFailure( );
+        }
+
+        if ( ( RestartBackoff == 0 ) ||
+             ( duration_cast<milliseconds>( LastDemandTime - LastFailureTime ).count( ) >= RestartBackoff ) )
+        {
+            XTraceScope trace( "Start video source", 0 );
+
+            // make sure the source has cleaned up after previous run
+            VideoSource->WaitForStop( );
+
+            FramesDelivered = false;
+            started         = VideoSource->Start( );
+            SourceActive    = started;
+
+            if ( started )
+            {
+                SourceStarts++;
+            }
+            else
+            {
+                RegisterFailure( );
+            }
+        }
+    }
+
+    return started;
+}
+
+// Remember failure of video source and make the interval of not starting it again longer
+void XVideoSourceDemandControllerData::RegisterFailure( )
+{
+    RestartBackoff  = ( RestartBackoff == 0 ) ? RESTART_BACKOFF_MIN : min( RestartBackoff * 2, static_cast<uint32_t>( RESTART_BACKOFF_MAX ) );
+    LastFailureTime = steady_clock::now( );
+    SourceFailures++;
+}
+
+// Stop video source (if it was not demanded for idle timeout, when requested so) and wait for it to clean-up.
+// The lock is not held while waiting, so demands coming meanwhile are not blocked.
+void XVideoSourceDemandControllerData::StopSource( bool onlyIfIdle )
+{
+    unique_lock<mutex> lock( Sync );
+
+    if ( ( SourceActive ) &&
+         ( ( !onlyIfIdle ) || ( duration_cast<milliseconds>( steady_clock::now( ) - LastDemandTime ).count( ) >= IdleTimeout ) ) )
+    {
+        XTraceScope trace( "Stop video source", 0 );
+
+        VideoSource->SignalToStop( );
+
+        SourceActive   = false;
+        SourceStopping = true;
+
+        if ( onlyIfIdle )
+        {
+            SourceStops++;
+        }
+
+        lock.unlock( );
+        VideoSource->WaitForStop( );
+        lock.lock( );
+
+        SourceStopping = false;
+    }
+}
+
+// Background thread stopping video source, when it is not demanded for too long
+void XVideoSourceDemandControllerData::ControlThreadHandler( XVideoSourceDemandControllerData* me )
+{
+    XTracer::SetThreadName( "Demand controller" );
+
+    while ( !me->NeedToStop.Wait( DEMAND_CHECK_INTERVAL ) )
+    {
+        me->StopSource( true );
+    }
+}
+
+} // namespace Private
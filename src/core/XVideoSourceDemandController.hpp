@@ -0,0 +1,77 @@
+/*
+    cam2web - streaming camera to web
+
+    Copyright (C) 2017-2020, cvsandbox, cvsandbox@gmail.com
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#ifndef XVIDEO_SOURCE_DEMAND_CONTROLLER_HPP
+#define XVIDEO_SOURCE_DEMAND_CONTROLLER_HPP
+
+#include <stdint.h>
+#include <memory>
+
+#include "XInterfaces.hpp"
+#include "IVideoSource.hpp"
+#include "XStatistics.hpp"
+
+namespace Private
+{
+    class XVideoSourceDemandControllerData;
+}
+
+/* ================================================================= */
+/* Runs video source only while its video is needed. The source is  */
+/* started on first demand (a request for its images) and is stopped */
+/* by controller's thread, once nothing demanded it for the idle     */
+/* timeout. Camera's device is then closed, so it does not capture,  */
+/* convert or encode anything until the next client comes. Source    */
+/* failing to start (or stopping before it provides any frames) is   */
+/* not started again for a back-off interval, which doubles with     */
+/* every failure (up to a minute) and is reset by the first frame.   */
+/* ================================================================= */
+class XVideoSourceDemandController : public IStatisticsProvider, private Uncopyable
+{
+public:
+    XVideoSourceDemandController( const std::shared_ptr<IVideoSource>& videoSource, uint32_t idleTimeout );
+    ~XVideoSourceDemandController( );
+
+    // Start controlling video source (it is not started until demanded)
+    void Start( );
+    // Stop controlling video source and stop the source itself
+    void Stop( );
+
+    // Let controller know video is needed now. Returns true if video source had to be started (or is to be started
+    // by one of the next demands, since it is still stopping). Does not wait for the source's frames or its stop.
+    bool Demand( );
+
+    // Let controller know video source provides frames (it must be called for new frames of the source)
+    void FrameDelivered( );
+
+    // Check if video source is running at the moment
+    bool IsSourceActive( ) const;
+
+    // Time (ms) without demand, after which video source is stopped
+    uint32_t IdleTimeout( ) const;
+
+    // Put statistics of the controller into the specified collector
+    void CollectStatistics( XStatisticsCollector& collector ) const;
+
+private:
+    Private::XVideoSourceDemandControllerData* mData;
+};
+
+#endif // XVIDEO_SOURCE_DEMAND_CONTROLLER_HPP
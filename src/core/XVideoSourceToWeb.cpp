@@ -18,9 +18,14 @@
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 */
 
+#include <stdio.h>
 #include <string.h>
 #include <mutex>
 #include <chrono>
+#include <atomic>
+#include <condition_variable>
+#include <algorithm>
+#include <vector>
 
 // If we have C++14, then shared_timed_mutex is a better option for BufferGuard,
 // so it could allow one writer and multiple readers. However mongoose web server
@@ -31,6 +36,11 @@
 
 #include "XVideoSourceToWeb.hpp"
 #include "XJpegEncoder.hpp"
+#include "XJpegRequantizer.hpp"
+#include "XJpegTransformer.hpp"
+#include "XImageTransform.hpp"
+#include "XTracer.hpp"
+#include "XStringTools.hpp"
 
 using namespace std;
 using namespace std::chrono;
@@ -38,6 +48,95 @@ using namespace std::chrono;
 namespace Private
 {
     #define JPEG_BUFFER_SIZE (1024 * 1024)
+    // Frames are encoded by encoder pool while clients requested them during this time (ms)
+    #define DEMAND_TIMEOUT      (2000)
+    // Time to wait for encoder pool to encode the first frame requested after idle period (ms)
+    #define ENCODE_WAIT_TIMEOUT (1000)
+    // Time of waiting for the first frame from video source started on demand (ms) - requests get no
+    // images meanwhile (instead of the old ones), but are not blocked
+    #define WARM_START_TIMEOUT  (3000)
+    // Time (seconds) JPEG clients are asked to retry after, while video source is starting
+    #define WARM_START_RETRY    (1)
+    // Only every n-th block of image rows is hashed to find unchanged frames
+    #define HASH_SAMPLE_STEP    (4)
+
+    // Camera images are passed to encoder through triple buffer - index of the slot with the latest
+    // complete image is exchanged atomically along with the flag telling it was not taken yet
+    #define IMAGE_SLOTS_COUNT   (3)
+    #define IMAGE_SLOT_MASK     (0x03)
+    #define IMAGE_SLOT_NEW      (0x04)
+
+    // Maximum speed of playing images from history buffer
+    #define MAX_PLAYBACK_SPEED  (100.0f)
+    // Maximum number of different image views (region of interest, rotation, quality tier) provided at a time
+    #define MAX_IMAGE_VIEWS     (8)
+
+    // View of camera images requested by clients - region of interest, rotation/flip, low quality tier and/or own encoder
+    // profile. Its images are made of the encoded ones (or raw camera images, if those can be transformed and encoded)
+    // while clients keep requesting them.
+    class ImageView : private Uncopyable
+    {
+    public:
+        string               Key;           // normalized view parameters
+        bool                 LowQuality;
+        bool                 Transformed;
+        XImageTransformation Transformation;
+        bool                 Reencoded;     // raw images are encoded with own profile
+        XJpegProfile         Profile;
+        uint8_t*             JpegBuffer;
+        uint32_t             JpegBufferSize;
+        uint32_t             JpegSize;
+        uint8_t*             SpareBuffer;
+        uint32_t             SpareBufferSize;
+        uint64_t             Sequence;      // sequence number of the encoded image the view was made of
+        XError               LastError;
+        mutex                BufferGuard;
+        atomic<int64_t>      LastRequestTime; // ms since steady clock's epoch
+
+    public:
+        ImageView( const string& key, bool lowQuality, const XImageTransformation& transformation, bool reencoded, XJpegProfile profile ) :
+            Key( key ), LowQuality( lowQuality ), Transformation( transformation ), Reencoded( reencoded ), Profile( profile ),
+            JpegBuffer( nullptr ), JpegBufferSize( 0 ), JpegSize( 0 ), SpareBuffer( nullptr ), SpareBufferSize( 0 ),
+            Sequence( 0 ), LastError( XError::Success ), BufferGuard( ), LastRequestTime( 0 )
+        {
+            Transformed = ( ( transformation.Width != 0 ) || ( transformation.Height != 0 ) ||
+                            ( transformation.Rotation != XImageRotation::None ) || ( transformation.FlipHorizontal ) );
+
+            JpegBuffer = (uint8_t*) malloc( JPEG_BUFFER_SIZE );
+            if ( JpegBuffer != nullptr )
+            {
+                JpegBufferSize = JPEG_BUFFER_SIZE;
+            }
+            SpareBuffer = (uint8_t*) malloc( JPEG_BUFFER_SIZE );
+            if ( SpareBuffer != nullptr )
+            {
+                SpareBufferSize = JPEG_BUFFER_SIZE;
+            }
+        }
+
+        ~ImageView( )
+        {
+            if ( JpegBuffer != nullptr )
+            {
+                free( JpegBuffer );
+            }
+            if ( SpareBuffer != nullptr )
+            {
+                free( SpareBuffer );
+            }
+        }
+    };
+
+    // State of MJPEG stream - kept for live streams of image views and for streams played from history buffer
+    struct MjpegStreamState
+    {
+        shared_ptr<ImageView>    View;          // view provided by live stream (if any)
+        bool                     Playback;      // stream played from history buffer (the rest is for playback only)
+        int64_t                  StartPosition; // time of the first played image (ms since Unix epoch)
+        steady_clock::time_point StartTime;     // when the playback has started
+        float                    Speed;
+        uint64_t                 LastSequence;  // sequence number of the last sent image
+    };
 
     // Listener for video source events
     class VideoListener : public IVideoSourceListener
@@ -57,14 +156,19 @@ namespace Private
     {
     private:
         XVideoSourceToWebData* Owner;
+        bool                   OwnProfile;  // images are encoded with own profile, instead of the main one
+        XJpegProfile           Profile;
 
     public:
-        JpegRequestHandler( const string& uri, XVideoSourceToWebData* owner ) :
-            IWebRequestHandler( uri, false ), Owner( owner )
+        JpegRequestHandler( const string& uri, XVideoSourceToWebData* owner, bool ownProfile, XJpegProfile profile ) :
+            IWebRequestHandler( uri, false ), Owner( owner ), OwnProfile( ownProfile ), Profile( profile )
         {
         }
 
         void HandleHttpRequest( const IWebRequest& request, IWebResponse& response );
+
+    private:
+        void SendCurrentJpeg( IWebResponse& response, const shared_ptr<ImageView>& view );
     };
 
     // Web request handler providing camera images as MJPEG stream
@@ -73,60 +177,166 @@ namespace Private
     private:
         XVideoSourceToWebData* Owner;
         uint32_t               FrameInterval;
+        bool                   OwnProfile;  // images are encoded with own profile, instead of the main one
+        XJpegProfile           Profile;
 
     public:
-        MjpegRequestHandler( const string& uri, uint32_t frameRate, XVideoSourceToWebData* owner ) :
-            IWebRequestHandler( uri, false ), Owner( owner ), FrameInterval( 1000 / frameRate )
+        MjpegRequestHandler( const string& uri, uint32_t frameRate, XVideoSourceToWebData* owner, bool ownProfile, XJpegProfile profile ) :
+            IWebRequestHandler( uri, false ), Owner( owner ), FrameInterval( 1000 / frameRate ), OwnProfile( ownProfile ), Profile( profile )
         {
         }
 
         void HandleHttpRequest( const IWebRequest& request, IWebResponse& response );
         void HandleTimer( IWebResponse& response );
+
+    private:
+        void StartLiveStream( IWebResponse& response, const shared_ptr<ImageView>& view );
+        void ContinueLiveStream( IWebResponse& response, const shared_ptr<ImageView>& view );
     };
 
     // Private implementation details for the XVideoSourceToWeb
     class XVideoSourceToWebData
     {
     public:
-        volatile bool      NewImageAvailable;
         volatile bool      VideoSourceError;
         XError             InternalError;
         uint8_t*           JpegBuffer;
         uint32_t           JpegBufferSize;
         uint32_t           JpegSize;
+        uint8_t*           SpareBuffer;     // images are encoded into spare buffer, which is then swapped with JPEG buffer
+        uint32_t           SpareBufferSize;
         VideoListener      VideoSourceListener;
-        shared_ptr<XImage> CameraImage;
+        shared_ptr<XImage> ImageSlots[IMAGE_SLOTS_COUNT];
+        uint64_t           ImageSlotFrameIds[IMAGE_SLOTS_COUNT]; // trace IDs of images in slots
+        int64_t            ImageSlotTimes[IMAGE_SLOTS_COUNT];    // capture time of images (ms since Unix epoch)
+        atomic<uint32_t>   ReadySlot;       // slot with the latest complete image (+ IMAGE_SLOT_NEW flag)
+        uint32_t           WriteSlot;       // slot owned by video source's thread
+        uint32_t           ReadSlot;        // slot owned by encoder (EncodeGuard)
+        uint64_t           LastImageHash;   // hash of the last image put into triple buffer
+        bool               LastImageValid;
+        uint64_t           CameraFramesCount;   // frames received from video source
+        bool               WarmStartPending;    // video source was started on demand, but provided no frames yet
+        uint64_t           WarmStartFrames;     // frames count at the time the source was started
+        steady_clock::time_point WarmStartTime;
         string             VideoSourceErrorMessage;
         mutex              ImageGuard;
         mutex              BufferGuard;
+        mutex              EncodeGuard;
         XJpegEncoder       JpegEncoder;
+        XJpegProfile       EncoderProfile;
+        shared_ptr<XPipelineStatistics> Statistics;
+        uint64_t           JpegFrameId;     // trace ID of the last encoded frame
+        uint64_t           JpegSequence;    // number of images put into JPEG buffer so far
+        bool               JpegFromRawImage; // JPEG buffer has image of the encoder's slot encoded (not a JPEG from video source)
+
+        shared_ptr<XJpegEncoderPool> EncoderPool;
+        XEncodePriority    EncodePriority;
+        uint32_t           EncodeAffinity;
+        atomic<bool>       EncodeJobPending;
+        atomic<int64_t>    LastRequestTime; // ms since steady clock's epoch
+        mutex              JobsSync;
+        condition_variable JobsFinished;
+        uint32_t           JobsInFlight;
+
+        shared_ptr<const XMotionDetector> MotionDetector;
+        uint32_t           IdleFrameInterval;
+        atomic<int64_t>    LastEncodeTime;  // ms since steady clock's epoch
+        uint32_t           DuplicateKeepAlive;
+        shared_ptr<XVideoSourceDemandController> DemandController;
+        shared_ptr<XEncodedFrameBuffer> HistoryBuffer;
+        vector<shared_ptr<IEncodedFrameListener>> EncodedFrameListeners;
+        shared_ptr<XVideoFrameDecorator> FrameDecorator;
+
+        XJpegRequantizer   Requantizer;     // makes images of low quality tier out of the encoded ones
+        bool               LowQualityTier;
+        XJpegTransformer   Transformer;     // crops/rotates encoded images losslessly
+        XJpegEncoder       ViewEncoder;     // encodes raw images of views
+        shared_ptr<XImage> TransformedImage;
+        uint8_t*           TempBuffer;      // keeps transformed JPEG image, which is then requantized
+        uint32_t           TempBufferSize;
+        vector<shared_ptr<ImageView>> Views;
+        mutex              ViewsGuard;
 
     public:
         XVideoSourceToWebData( uint16_t jpegQuality ) :
-            NewImageAvailable( false ), VideoSourceError( false ), InternalError( XError::Success ),
-            JpegBuffer( nullptr ), JpegBufferSize( 0 ), JpegSize( 0 ), VideoSourceListener( this ),
-            CameraImage( ), VideoSourceErrorMessage( ), ImageGuard( ), BufferGuard( ),
-            JpegEncoder( jpegQuality, true )
+            VideoSourceError( false ), InternalError( XError::Success ),
+            JpegBuffer( nullptr ), JpegBufferSize( 0 ), JpegSize( 0 ), SpareBuffer( nullptr ), SpareBufferSize( 0 ),
+            VideoSourceListener( this ), ImageSlots( ), ImageSlotFrameIds( ), ImageSlotTimes( ), ReadySlot( 1 ), WriteSlot( 0 ), ReadSlot( 2 ),
+            LastImageHash( 0 ), LastImageValid( false ),
+            CameraFramesCount( 0 ), WarmStartPending( false ), WarmStartFrames( 0 ), WarmStartTime( ), VideoSourceErrorMessage( ), ImageGuard( ), BufferGuard( ), EncodeGuard( ),
+            JpegEncoder( jpegQuality, true ), EncoderProfile( XJpegProfile::LiveFast ), Statistics( make_shared<XPipelineStatistics>( ) ),
+            JpegFrameId( 0 ), JpegSequence( 0 ), JpegFromRawImage( false ),
+            EncoderPool( ), EncodePriority( XEncodePriority::Live ), EncodeAffinity( 0 ), EncodeJobPending( false ),
+            LastRequestTime( 0 ), JobsSync( ), JobsFinished( ), JobsInFlight( 0 ),
+            MotionDetector( ), IdleFrameInterval( 0 ), LastEncodeTime( 0 ), DuplicateKeepAlive( 0 ), DemandController( ), HistoryBuffer( ), EncodedFrameListeners( ),
+            FrameDecorator( ), Requantizer( ), LowQualityTier( false ), Transformer( ), ViewEncoder( jpegQuality, true ), TransformedImage( ),
+            TempBuffer( nullptr ), TempBufferSize( 0 ), Views( ), ViewsGuard( )
         {
-            // allocate initial buffer for JPEG images
+            static atomic<uint32_t> InstanceCounter( 0 );
+
+            // allocate initial buffers for JPEG images
             JpegBuffer = (uint8_t*) malloc( JPEG_BUFFER_SIZE );
             if ( JpegBuffer != nullptr )
             {
                 JpegBufferSize = JPEG_BUFFER_SIZE;
             }
+            SpareBuffer = (uint8_t*) malloc( JPEG_BUFFER_SIZE );
+            if ( SpareBuffer != nullptr )
+            {
+                SpareBufferSize = JPEG_BUFFER_SIZE;
+            }
+            TempBuffer = (uint8_t*) malloc( JPEG_BUFFER_SIZE );
+            if ( TempBuffer != nullptr )
+            {
+                TempBufferSize = JPEG_BUFFER_SIZE;
+            }
+
+            // images of different sources go to queues of different workers of encoder pool
+            EncodeAffinity = InstanceCounter++;
         }
 
         ~XVideoSourceToWebData( )
         {
+            // wait for encoder pool to finish jobs of this video source
+            {
+                unique_lock<mutex> lock( JobsSync );
+                JobsFinished.wait( lock, [this] { return JobsInFlight == 0; } );
+            }
+
             if ( JpegBuffer != nullptr )
             {
                 free( JpegBuffer );
             }
+            if ( SpareBuffer != nullptr )
+            {
+                free( SpareBuffer );
+            }
+            if ( TempBuffer != nullptr )
+            {
+                free( TempBuffer );
+            }
         }
 
         bool IsError( );
         void ReportError( IWebResponse& response );
-        void EncodeCameraImage( );
+        bool DemandVideo( );
+        void PrepareJpeg( );
+        bool IsDemanded( );
+        bool IsFrameNeededByListeners( );
+        bool IsIdle( );
+        bool IsEncodingDue( );
+        bool IsNewImageAvailable( );
+        void ScheduleEncoding( );
+        void EncodeCameraImage( XJpegEncoder& encoder );
+        bool GetImageView( const IWebRequest& request, IWebResponse& response, const XJpegProfile* profile, shared_ptr<ImageView>& view );
+        void ReportNoImage( const ImageView* view, IWebResponse& response );
+        void ReportWarmStart( IWebResponse& response );
+        bool IsViewDemanded( const ImageView* view );
+        void PrepareViewJpeg( ImageView* view );
+        void MakeViewJpeg( ImageView* view );
+        void SendHistoryJpeg( const string& at, IWebResponse& response );
+        void StartPlayback( const string& from, const string& speed, uint32_t frameInterval, IWebResponse& response );
+        void ContinuePlayback( MjpegStreamState* state, uint32_t frameInterval, IWebResponse& response );
     };
 }
 
@@ -149,13 +359,21 @@ IVideoSourceListener* XVideoSourceToWeb::VideoSourceListener( ) const
 // Create web request handler to provide camera images as JPEGs
 shared_ptr<IWebRequestHandler> XVideoSourceToWeb::CreateJpegHandler( const string& uri ) const
 {
-    return make_shared<Private::JpegRequestHandler>( uri, mData );
+    return make_shared<Private::JpegRequestHandler>( uri, mData, false, XJpegProfile::LiveFast );
+}
+shared_ptr<IWebRequestHandler> XVideoSourceToWeb::CreateJpegHandler( const string& uri, XJpegProfile profile ) const
+{
+    return make_shared<Private::JpegRequestHandler>( uri, mData, true, profile );
 }
 
 // Create web request handler to provide camera images as MJPEG stream
 shared_ptr<IWebRequestHandler> XVideoSourceToWeb::CreateMjpegHandler( const string& uri, uint32_t frameRate ) const
 {
-    return make_shared<Private::MjpegRequestHandler>( uri, frameRate, mData );
+    return make_shared<Private::MjpegRequestHandler>( uri, frameRate, mData, false, XJpegProfile::LiveFast );
+}
+shared_ptr<IWebRequestHandler> XVideoSourceToWeb::CreateMjpegHandler( const string& uri, uint32_t frameRate, XJpegProfile profile ) const
+{
+    return make_shared<Private::MjpegRequestHandler>( uri, frameRate, mData, true, profile );
 }
 
 // Get/Set JPEG quality (valid only if camera provides uncompressed images)
@@ -168,24 +386,175 @@ void XVideoSourceToWeb::SetJpegQuality( uint16_t quality )
     mData->JpegEncoder.SetQuality( quality );
 }
 
+// Get/Set profile of JPEG encoder (valid only if camera provides uncompressed images)
+XJpegProfile XVideoSourceToWeb::EncoderProfile( ) const
+{
+    return mData->EncoderProfile;
+}
+void XVideoSourceToWeb::SetEncoderProfile( XJpegProfile profile )
+{
+    mData->EncoderProfile = profile;
+    mData->JpegEncoder.SetProfile( profile );
+}
+
+// Set pool of encoders to use
+void XVideoSourceToWeb::SetEncoderPool( const shared_ptr<XJpegEncoderPool>& pool, XEncodePriority priority )
+{
+    mData->EncoderPool    = pool;
+    mData->EncodePriority = priority;
+}
+
+// Set motion detector to find if video source is idle
+void XVideoSourceToWeb::SetMotionDetector( const shared_ptr<const XMotionDetector>& detector, uint32_t idleFrameRate )
+{
+    mData->MotionDetector    = detector;
+    mData->IdleFrameInterval = ( idleFrameRate == 0 ) ? 0 : 1000 / idleFrameRate;
+}
+
+// Set interval to send unchanged image to MJPEG clients at
+void XVideoSourceToWeb::SetDuplicateKeepAlive( uint32_t keepAliveInterval )
+{
+    mData->DuplicateKeepAlive = keepAliveInterval;
+}
+
+// Set controller of video source, which is told about every request for images
+void XVideoSourceToWeb::SetDemandController( const shared_ptr<XVideoSourceDemandController>& controller )
+{
+    mData->DemandController = controller;
+}
+
+// Set decorator to put overlays/privacy masks on images before encoding them
+void XVideoSourceToWeb::SetFrameDecorator( const shared_ptr<XVideoFrameDecorator>& decorator )
+{
+    mData->FrameDecorator = decorator;
+}
+
+// Set quality of low bandwidth tier, which is made by requantizing encoded images
+void XVideoSourceToWeb::SetLowQualityTier( uint16_t quality )
+{
+    mData->LowQualityTier = ( quality != 0 );
+
+    if ( mData->LowQualityTier )
+    {
+        mData->Requantizer.SetQuality( quality );
+    }
+}
+
+// Set buffer to keep recent encoded images in
+void XVideoSourceToWeb::SetHistoryBuffer( const shared_ptr<XEncodedFrameBuffer>& historyBuffer )
+{
+    mData->HistoryBuffer = historyBuffer;
+}
+
+// Add listener of encoded images
+void XVideoSourceToWeb::AddEncodedFrameListener( const shared_ptr<IEncodedFrameListener>& listener )
+{
+    if ( listener )
+    {
+        mData->EncodedFrameListeners.push_back( listener );
+    }
+}
+
+// Get performance statistics of the video pipeline
+shared_ptr<XPipelineStatistics> XVideoSourceToWeb::Statistics( ) const
+{
+    return mData->Statistics;
+}
+
+// Put statistics of the video pipeline into the specified collector
+void XVideoSourceToWeb::CollectStatistics( XStatisticsCollector& collector ) const
+{
+    XPipelineStatistics* stats = mData->Statistics.get( );
+
+    collector.AddRate( "cam2web_frames_captured", "Frames provided by video source", stats->FramesCaptured );
+    collector.AddCounter( "cam2web_frames_dropped_total", "Frames lost by video source", stats->FramesDropped );
+    collector.AddCounter( "cam2web_frames_discarded_total", "Stale frames discarded by video source to reduce latency", stats->FramesDiscarded );
+    collector.AddCounter( "cam2web_frames_unchanged_total", "Frames same as previous ones, which were not encoded again", stats->FramesUnchanged );
+    if ( stats->ConversionTime.Count( ) != 0 )
+    {
+        collector.AddHistogram( "cam2web_conversion_seconds", "Time taken to convert camera's pixel format", stats->ConversionTime );
+    }
+    collector.AddRate( "cam2web_frames_encoded", "Frames encoded as JPEG", stats->FramesEncoded );
+    collector.AddRate( "cam2web_encoded_bytes", "Size of encoded JPEG images", stats->EncodedBytes );
+    collector.AddHistogram( "cam2web_encode_seconds", "Time taken to encode JPEG images", stats->EncodingTime );
+}
+
 namespace Private
 {
 
-// On new image from video source - make a copy of it
+// On new image from video source - make a copy of it, unless it is same as the previous one
 void VideoListener::OnNewImage( const shared_ptr<const XImage>& image )
 {
-    lock_guard<mutex> lock( Owner->ImageGuard );
+    uint64_t hash      = image->Hash( HASH_SAMPLE_STEP );
+    bool     unchanged = false;
+    XError   copyError = XError::Success;
+
+    // frame repeated by video source is still new, if it gets different decorations (time shown on it, for example)
+    if ( Owner->FrameDecorator )
+    {
+        hash ^= Owner->FrameDecorator->DecorationsState( ) * 0x9E3779B97F4A7C15ull;
+    }
+
+    unchanged = ( ( Owner->LastImageValid ) && ( hash == Owner->LastImageHash ) );
+
+    if ( Owner->DemandController )
+    {
+        Owner->DemandController->FrameDelivered( );
+    }
+
+    if ( !unchanged )
+    {
+        XTraceScope trace( "Copy frame" );
+
+        // copy into the slot nobody else uses and publish it as the latest image, taking the slot
+        // of the previous image (if encoder did not take it yet) or the one encoder is done with
+        copyError = image->CopyDataOrClone( Owner->ImageSlots[Owner->WriteSlot] );
+
+        if ( copyError == XError::Success )
+        {
+            Owner->ImageSlotFrameIds[Owner->WriteSlot] = XTracer::CurrentFrame( );
+            Owner->ImageSlotTimes[Owner->WriteSlot]    = duration_cast<milliseconds>( system_clock::now( ).time_since_epoch( ) ).count( );
+            Owner->WriteSlot = Owner->ReadySlot.exchange( Owner->WriteSlot | IMAGE_SLOT_NEW, memory_order_acq_rel ) & IMAGE_SLOT_MASK;
+        }
+
+        Owner->LastImageHash  = hash;
+        Owner->LastImageValid = ( copyError == XError::Success );
+    }
 
-    Owner->InternalError = image->CopyDataOrClone( Owner->CameraImage );
-    
-    if ( Owner->InternalError == XError::Success )
     {
-        Owner->NewImageAvailable = true;
+        lock_guard<mutex> lock( Owner->ImageGuard );
+
+        Owner->Statistics->FramesCaptured.Add( );
+        Owner->CameraFramesCount++;
+
+        if ( unchanged )
+        {
+            // previous image is encoded already or will be encoded anyway
+            Owner->Statistics->FramesUnchanged++;
+        }
+        else
+        {
+            Owner->InternalError = copyError;
+        }
+
+        // since we got an image from video source, clear any error reported by it
+        Owner->VideoSourceErrorMessage.clear( );
+        Owner->VideoSourceError = false;
     }
 
-    // since we got an image from video source, clear any error reported by it
-    Owner->VideoSourceErrorMessage.clear( );
-    Owner->VideoSourceError = false;
+    // encode the new image right away if encoder pool is used and someone needs it; images kept
+    // in history or recorded are encoded anyway (on video source's thread if there is no pool)
+    if ( ( Owner->IsNewImageAvailable( ) ) && ( Owner->IsDemanded( ) ) && ( Owner->IsEncodingDue( ) ) )
+    {
+        if ( Owner->EncoderPool )
+        {
+            Owner->ScheduleEncoding( );
+        }
+        else if ( ( Owner->HistoryBuffer ) || ( Owner->IsFrameNeededByListeners( ) ) )
+        {
+            Owner->EncodeCameraImage( Owner->JpegEncoder );
+        }
+    }
 }
 
 // An error coming from video source
@@ -197,49 +566,102 @@ void VideoListener::OnError( const string& errorMessage, bool /* fatal */ )
     Owner->VideoSourceError = true;
 }
 
-// Handle JPEG request - provide current camera image
-void JpegRequestHandler::HandleHttpRequest( const IWebRequest& /* request */, IWebResponse& response )
+// Handle JPEG request - provide current camera image (or its requested view) or the one from history
+void JpegRequestHandler::HandleHttpRequest( const IWebRequest& request, IWebResponse& response )
 {
-    if ( !Owner->IsError( ) )
+    string                at = request.GetVariable( "at" );
+    shared_ptr<ImageView> view;
+
+    if ( !at.empty( ) )
     {
-        Owner->EncodeCameraImage( );
+        Owner->SendHistoryJpeg( at, response );
+    }
+    else if ( Owner->GetImageView( request, response, ( OwnProfile ) ? &Profile : nullptr, view ) )
+    {
+        SendCurrentJpeg( response, view );
+    }
+}
+
+// Provide current camera image as JPEG
+void JpegRequestHandler::SendCurrentJpeg( IWebResponse& response, const shared_ptr<ImageView>& view )
+{
+    bool warmingUp = Owner->DemandVideo( );
+
+    if ( ( !Owner->IsError( ) ) && ( !warmingUp ) )
+    {
+        Owner->PrepareJpeg( );
+
+        if ( view )
+        {
+            Owner->PrepareViewJpeg( view.get( ) );
+        }
     }
 
     if ( Owner->IsError( ) )
     {
         Owner->ReportError( response );
     }
+    else if ( warmingUp )
+    {
+        Owner->ReportWarmStart( response );
+    }
     else
     {
-        lock_guard<mutex> lock( Owner->BufferGuard );
+        lock_guard<mutex> lock( ( view ) ? view->BufferGuard : Owner->BufferGuard );
+        const uint8_t*    jpegBuffer = ( view ) ? view->JpegBuffer : Owner->JpegBuffer;
+        uint32_t          jpegSize   = ( view ) ? view->JpegSize : Owner->JpegSize;
 
-        if ( Owner->JpegSize == 0 )
+        if ( jpegSize == 0 )
         {
-            response.SendError( 500, "No image from video source" );
+            Owner->ReportNoImage( view.get( ), response );
         }
         else
         {
+            XTraceScope trace( "Send JPEG", Owner->JpegFrameId );
+
             response.Printf( "HTTP/1.1 200 OK\r\n"
                              "Content-Type: image/jpeg\r\n"
                              "Content-Length: %u\r\n"
                              "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
-                             "\r\n",  Owner->JpegSize );
+                             "\r\n",  jpegSize );
     
-            response.Send( Owner->JpegBuffer, Owner->JpegSize );
+            response.Send( jpegBuffer, jpegSize );
         }
     }
 }
 
-// Handle MJPEG request - continuously provide camera images as MJPEG stream
-void MjpegRequestHandler::HandleHttpRequest( const IWebRequest& /* request */, IWebResponse& response )
+// Handle MJPEG request - continuously provide camera images (or their requested view) as MJPEG stream
+void MjpegRequestHandler::HandleHttpRequest( const IWebRequest& request, IWebResponse& response )
+{
+    string                from = request.GetVariable( "from" );
+    shared_ptr<ImageView> view;
+
+    if ( !from.empty( ) )
+    {
+        Owner->StartPlayback( from, request.GetVariable( "speed" ), FrameInterval, response );
+    }
+    else if ( Owner->GetImageView( request, response, ( OwnProfile ) ? &Profile : nullptr, view ) )
+    {
+        StartLiveStream( response, view );
+    }
+}
+
+// Start MJPEG stream of live camera images
+void MjpegRequestHandler::StartLiveStream( IWebResponse& response, const shared_ptr<ImageView>& view )
 {
     uint32_t handlingTime = 0;
+    bool     warmingUp    = Owner->DemandVideo( );
 
-    if ( !Owner->IsError( ) )
+    if ( ( !Owner->IsError( ) ) && ( !warmingUp ) )
     {
         steady_clock::time_point startTime = steady_clock::now( );
 
-        Owner->EncodeCameraImage( );
+        Owner->PrepareJpeg( );
+
+        if ( view )
+        {
+            Owner->PrepareViewJpeg( view.get( ) );
+        }
 
         handlingTime = static_cast<uint32_t>( duration_cast<std::chrono::milliseconds>( steady_clock::now( ) - startTime ).count( ) );
     }
@@ -248,17 +670,45 @@ void MjpegRequestHandler::HandleHttpRequest( const IWebRequest& /* request */, I
     {
         Owner->ReportError( response );
     }
+    else if ( warmingUp )
+    {
+        lock_guard<mutex> lock( ( view ) ? view->BufferGuard : Owner->BufferGuard );
+
+        // start the stream without images - timer keeps checking for the first frame of the video source
+        response.Printf( "HTTP/1.1 200 OK\r\n"
+                         "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
+                         "Connection: close\r\n"
+                         "Content-Type: multipart/x-mixed-replace; boundary=--myboundary\r\n"
+                         "\r\n" );
+
+        response.SetTimer( FrameInterval );
+        response.SetStreamTag( ( view ) ? view->Sequence : Owner->JpegSequence );
+
+        if ( view )
+        {
+            shared_ptr<MjpegStreamState> state = make_shared<MjpegStreamState>( );
+
+            state->View     = view;
+            state->Playback = false;
+
+            response.SetStreamState( state );
+        }
+    }
     else
     {
-        steady_clock::time_point startTime = steady_clock::now( );
-        lock_guard<mutex>        lock( Owner->BufferGuard );
+        steady_clock::time_point startTime  = steady_clock::now( );
+        lock_guard<mutex>        lock( ( view ) ? view->BufferGuard : Owner->BufferGuard );
+        const uint8_t*           jpegBuffer = ( view ) ? view->JpegBuffer : Owner->JpegBuffer;
+        uint32_t                 jpegSize   = ( view ) ? view->JpegSize : Owner->JpegSize;
 
-        if ( Owner->JpegSize == 0 )
+        if ( jpegSize == 0 )
         {
-            response.SendError( 500, "No image from video source" );
+            Owner->ReportNoImage( view.get( ), response );
         }
         else
         {
+            XTraceScope trace( "Send MJPEG frame", Owner->JpegFrameId );
+
             // provide first image of the MJPEG stream
             response.Printf( "HTTP/1.1 200 OK\r\n"
                              "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
@@ -269,58 +719,135 @@ void MjpegRequestHandler::HandleHttpRequest( const IWebRequest& /* request */, I
             response.Printf( "--myboundary\r\n"
                              "Content-Type: image/jpeg\r\n"
                              "Content-Length: %u\r\n"
-                             "\r\n",  Owner->JpegSize );
+                             "\r\n",  jpegSize );
     
-            response.Send( Owner->JpegBuffer, Owner->JpegSize );
+            response.Send( jpegBuffer, jpegSize );
     
             // get final request handling time
             handlingTime += static_cast<uint32_t>( duration_cast<std::chrono::milliseconds>( steady_clock::now( ) - startTime ).count( ) );
     
             // set time to provide next images
             response.SetTimer( FrameInterval );
+            response.SetStreamTag( ( view ) ? view->Sequence : Owner->JpegSequence );
+
+            if ( view )
+            {
+                shared_ptr<MjpegStreamState> state = make_shared<MjpegStreamState>( );
+
+                state->View     = view;
+                state->Playback = false;
+
+                response.SetStreamState( state );
+            }
         }
     }
 }
 
 // Timer event for then connection handling MJPEG request - provide new image
 void MjpegRequestHandler::HandleTimer( IWebResponse& response )
+{
+    shared_ptr<MjpegStreamState> state = static_pointer_cast<MjpegStreamState>( response.StreamState( ) );
+
+    if ( ( state ) && ( state->Playback ) )
+    {
+        Owner->ContinuePlayback( state.get( ), FrameInterval, response );
+    }
+    else
+    {
+        ContinueLiveStream( response, ( state ) ? state->View : shared_ptr<ImageView>( ) );
+    }
+}
+
+// Provide new image to MJPEG stream of live camera images
+void MjpegRequestHandler::ContinueLiveStream( IWebResponse& response, const shared_ptr<ImageView>& view )
 {
     uint32_t handlingTime = 0;
+    bool     warmingUp    = Owner->DemandVideo( );
 
-    if ( !Owner->IsError( ) )
+    if ( ( !Owner->IsError( ) ) && ( !warmingUp ) )
     {
         steady_clock::time_point startTime = steady_clock::now( );
 
-        Owner->EncodeCameraImage( );
+        Owner->PrepareJpeg( );
+
+        if ( view )
+        {
+            Owner->PrepareViewJpeg( view.get( ) );
+        }
 
         handlingTime = static_cast<uint32_t>( duration_cast<std::chrono::milliseconds>( steady_clock::now( ) - startTime ).count( ) );
     }
 
-    if ( ( Owner->IsError( ) ) || ( Owner->JpegSize == 0 ) )
+    if ( ( !Owner->IsError( ) ) && ( warmingUp ) )
+    {
+        // video source started on demand did not provide its first frame yet
+        response.SetTimer( FrameInterval );
+    }
+    else if ( Owner->IsError( ) )
     {
         response.CloseConnection( );
     }
     else
     {
-        steady_clock::time_point startTime = steady_clock::now( );
-        lock_guard<mutex>        lock( Owner->BufferGuard );
+        steady_clock::time_point startTime      = steady_clock::now( );
+        uint32_t                 cameraJpegSize = 0;
 
-        // don't try sending too much on slow connections - it will only create video lag
-        if ( response.ToSendDataLength( ) < 2 * Owner->JpegSize )
+        // camera image is checked under its own lock, since it is never held along with the one of a view
+        if ( view )
         {
-            // provide subsequent images of the MJPEG stream
-            response.Printf( "--myboundary\r\n"
-                             "Content-Type: image/jpeg\r\n"
-                             "Content-Length: %u\r\n"
-                             "\r\n",  Owner->JpegSize );
-            response.Send( Owner->JpegBuffer, Owner->JpegSize );
+            lock_guard<mutex> cameraLock( Owner->BufferGuard );
+            cameraJpegSize = Owner->JpegSize;
         }
 
-        // get final request handling time
-        handlingTime += static_cast<uint32_t>( duration_cast<std::chrono::milliseconds>( steady_clock::now( ) - startTime ).count( ) );
+        lock_guard<mutex>        lock( ( view ) ? view->BufferGuard : Owner->BufferGuard );
+        const uint8_t*           jpegBuffer   = ( view ) ? view->JpegBuffer : Owner->JpegBuffer;
+        uint32_t                 jpegSize     = ( view ) ? view->JpegSize : Owner->JpegSize;
+        uint64_t                 jpegSequence = ( view ) ? view->Sequence : Owner->JpegSequence;
+
+        if ( !view )
+        {
+            cameraJpegSize = jpegSize;
+        }
 
-        // set new timer for further images
-        response.SetTimer( ( handlingTime >= FrameInterval ) ? 1 : FrameInterval - handlingTime );
+        if ( cameraJpegSize == 0 )
+        {
+            // there is no image from video source at all
+            response.CloseConnection( );
+        }
+        else
+        {
+            if ( ( ( response.StreamTag( ) == jpegSequence ) && ( ( Owner->IsIdle( ) ) || ( Owner->DuplicateKeepAlive != 0 ) ) &&
+                   ( ( Owner->DuplicateKeepAlive == 0 ) || ( response.StreamTagAge( ) < Owner->DuplicateKeepAlive ) ) ) ||
+                 ( jpegSize == 0 ) )
+            {
+                // only new images are sent while nothing moves (encoded at idle rate) or if duplicates are suppressed,
+                // but timer keeps running at full rate, so new images are sent as soon as they are available (same if
+                // there is no image of the view yet)
+            }
+            // don't try sending too much on slow connections - it will only create video lag
+            else if ( response.ToSendDataLength( ) < 2 * jpegSize )
+            {
+                XTraceScope trace( "Send MJPEG frame", Owner->JpegFrameId );
+
+                // provide subsequent images of the MJPEG stream
+                response.Printf( "--myboundary\r\n"
+                                 "Content-Type: image/jpeg\r\n"
+                                 "Content-Length: %u\r\n"
+                                 "\r\n",  jpegSize );
+                response.Send( jpegBuffer, jpegSize );
+                response.SetStreamTag( jpegSequence );
+            }
+            else
+            {
+                response.ReportSkippedFrame( );
+            }
+
+            // get final request handling time
+            handlingTime += static_cast<uint32_t>( duration_cast<std::chrono::milliseconds>( steady_clock::now( ) - startTime ).count( ) );
+
+            // set new timer for further images
+            response.SetTimer( ( handlingTime >= FrameInterval ) ? 1 : FrameInterval - handlingTime );
+        }
     }
 }
 
@@ -345,64 +872,691 @@ void XVideoSourceToWebData::ReportError( IWebResponse& response )
     }
 }
 
-// Encode current camera image as JPEG
-void XVideoSourceToWebData::EncodeCameraImage( )
+// Report missing image of the requested view (or the camera image itself) as HTTP response
+void XVideoSourceToWebData::ReportNoImage( const ImageView* view, IWebResponse& response )
 {
-    if ( NewImageAvailable )
+    if ( ( view != nullptr ) && ( view->LastError == XError::ImageParametersMismatch ) )
     {
-        lock_guard<mutex> imageLock( ImageGuard );
-        lock_guard<mutex> bufferLock( BufferGuard );
+        response.SendError( 400, "Region of interest is outside of image" );
+    }
+    else if ( ( view != nullptr ) && ( view->LastError != XError::Success ) )
+    {
+        response.SendError( 500, view->LastError.ToString( ).c_str( ) );
+    }
+    else
+    {
+        response.SendError( 500, "No image from video source" );
+    }
+}
+
+// Report video source started on demand did not provide its first frame yet, asking client to retry a bit later
+void XVideoSourceToWebData::ReportWarmStart( IWebResponse& response )
+{
+    static const char* reason = "Video source is starting";
+
+    response.Printf( "HTTP/1.1 503 Service Unavailable\r\n"
+                     "Retry-After: %u\r\n"
+                     "Content-Type: text/plain\r\n"
+                     "Content-Length: %u\r\n"
+                     "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
+                     "\r\n%s", WARM_START_RETRY, static_cast<uint32_t>( strlen( reason ) ), reason );
+}
+
+// Find view of camera images requested by "roi=x,y,w,h", "rotate=<0|90|180|270>", "flip=<h|v>" and "quality=low" variables
+// (the view is left null if none of those is there). Views not requested for a while are dropped. Returns false if the
+// request is not valid, having replied with an error.
+bool XVideoSourceToWebData::GetImageView( const IWebRequest& request, IWebResponse& response, const XJpegProfile* profile, shared_ptr<ImageView>& view )
+{
+    string               roi            = request.GetVariable( "roi" );
+    string               rotate         = request.GetVariable( "rotate" );
+    string               flip           = request.GetVariable( "flip" );
+    bool                 lowQuality     = ( request.GetVariable( "quality" ) == "low" );
+    XImageTransformation transformation = { 0, 0, 0, 0, XImageRotation::None, false };
+    int                  rotation       = 0;
+    char                 extra;
+    bool                 ret            = true;
+
+    if ( ( !roi.empty( ) ) &&
+         ( ( sscanf( roi.c_str( ), "%d,%d,%d,%d%c", &transformation.X, &transformation.Y, &transformation.Width, &transformation.Height, &extra ) != 4 ) ||
+           ( transformation.X < 0 ) || ( transformation.Y < 0 ) || ( transformation.Width <= 0 ) || ( transformation.Height <= 0 ) ) )
+    {
+        response.SendError( 400, "Invalid region of interest" );
+        ret = false;
+    }
+    else if ( ( !rotate.empty( ) ) &&
+              ( ( sscanf( rotate.c_str( ), "%d%c", &rotation, &extra ) != 1 ) || ( rotation < 0 ) || ( rotation >= 360 ) || ( rotation % 90 != 0 ) ) )
+    {
+        response.SendError( 400, "Invalid rotation" );
+        ret = false;
+    }
+    else if ( ( !flip.empty( ) ) && ( flip != "h" ) && ( flip != "v" ) )
+    {
+        response.SendError( 400, "Invalid flip" );
+        ret = false;
+    }
+    else if ( ( lowQuality ) && ( !LowQualityTier ) )
+    {
+        response.SendError( 404, "Low quality tier is not enabled" );
+        ret = false;
+    }
+    else
+    {
+        // vertical flip is same as rotation by 180 degrees followed by horizontal flip
+        if ( flip == "v" )
+        {
+            rotation = ( rotation + 180 ) % 360;
+        }
+
+        transformation.Rotation       = static_cast<XImageRotation>( rotation );
+        transformation.FlipHorizontal = ( !flip.empty( ) );
+
+        bool reencoded = ( ( profile != nullptr ) && ( *profile != EncoderProfile ) );
+
+        if ( ( lowQuality ) || ( !roi.empty( ) ) || ( rotation != 0 ) || ( transformation.FlipHorizontal ) || ( reencoded ) )
+        {
+            int64_t           now = duration_cast<milliseconds>( steady_clock::now( ).time_since_epoch( ) ).count( );
+            char              key[128];
+            lock_guard<mutex> lock( ViewsGuard );
+
+            snprintf( key, sizeof( key ), "%d,%d,%d,%d/%d/%d/%d/%d", transformation.X, transformation.Y, transformation.Width, transformation.Height,
+                      rotation, ( transformation.FlipHorizontal ) ? 1 : 0, ( lowQuality ) ? 1 : 0, ( reencoded ) ? static_cast<int>( *profile ) : -1 );
+
+            // drop views nobody streams or requested recently
+            Views.erase( remove_if( Views.begin( ), Views.end( ), [now]( const shared_ptr<ImageView>& v )
+                         { return ( v.use_count( ) == 1 ) && ( now - v->LastRequestTime >= DEMAND_TIMEOUT ); } ), Views.end( ) );
+
+            for ( const shared_ptr<ImageView>& v : Views )
+            {
+                if ( v->Key == key )
+                {
+                    view = v;
+                    break;
+                }
+            }
+
+            if ( !view )
+            {
+                if ( Views.size( ) >= MAX_IMAGE_VIEWS )
+                {
+                    response.SendError( 503, "Too many image views" );
+                    ret = false;
+                }
+                else
+                {
+                    view = make_shared<ImageView>( key, lowQuality, transformation, reencoded, ( reencoded ) ? *profile : EncoderProfile );
+                    view->LastRequestTime = now;
+                    Views.push_back( view );
+                }
+            }
+        }
+    }
+
+    return ret;
+}
+
+// Let demand controller know video is needed - start video source if it was stopped, since nobody was watching it.
+// Nothing waits for the source here - returns true while the source started on demand did not provide its first
+// frame yet (for WARM_START_TIMEOUT at most), so the caller does not give out old images meanwhile.
+bool XVideoSourceToWebData::DemandVideo( )
+{
+    bool warmingUp = false;
+
+    if ( DemandController )
+    {
+        bool              started = DemandController->Demand( );
+        lock_guard<mutex> lock( ImageGuard );
+
+        if ( started )
+        {
+            if ( !WarmStartPending )
+            {
+                WarmStartPending = true;
+                WarmStartFrames  = CameraFramesCount;
+                WarmStartTime    = steady_clock::now( );
+            }
+
+            // errors of the previous run are no longer relevant
+            VideoSourceErrorMessage.clear( );
+            VideoSourceError = false;
+        }
+
+        if ( ( WarmStartPending ) &&
+             ( ( CameraFramesCount != WarmStartFrames ) || ( VideoSourceError ) ||
+               ( duration_cast<milliseconds>( steady_clock::now( ) - WarmStartTime ).count( ) >= WARM_START_TIMEOUT ) ) )
+        {
+            WarmStartPending = false;
+        }
+
+        warmingUp = WarmStartPending;
+    }
+
+    return warmingUp;
+}
+
+// Make sure JPEG buffer has the latest camera image - encode it on the calling thread or ask encoder pool to do it
+void XVideoSourceToWebData::PrepareJpeg( )
+{
+    if ( !EncoderPool )
+    {
+        if ( IsEncodingDue( ) )
+        {
+            EncodeCameraImage( JpegEncoder );
+        }
+    }
+    else
+    {
+        bool wasDemanded = IsDemanded( );
+
+        LastRequestTime = duration_cast<milliseconds>( steady_clock::now( ).time_since_epoch( ) ).count( );
+
+        // while clients keep requesting images, they are encoded as they come from video source;
+        // the first request after idle period needs to wait for the latest image to get encoded
+        if ( ( !wasDemanded ) && ( IsNewImageAvailable( ) ) )
+        {
+            unique_lock<mutex> lock( JobsSync, defer_lock );
+
+            ScheduleEncoding( );
+
+            lock.lock( );
+            JobsFinished.wait_for( lock, milliseconds( ENCODE_WAIT_TIMEOUT ), [this] { return JobsInFlight == 0; } );
+        }
+    }
+}
+
+// Check if images were requested recently or are needed for history/encoded frame listeners
+bool XVideoSourceToWebData::IsDemanded( )
+{
+    int64_t now = duration_cast<milliseconds>( steady_clock::now( ).time_since_epoch( ) ).count( );
+
+    return ( ( HistoryBuffer ) || ( now - LastRequestTime < DEMAND_TIMEOUT ) || ( IsFrameNeededByListeners( ) ) );
+}
+
+// Check if any of encoded frame listeners needs the current frame
+bool XVideoSourceToWebData::IsFrameNeededByListeners( )
+{
+    int64_t timestamp = duration_cast<milliseconds>( system_clock::now( ).time_since_epoch( ) ).count( );
+    bool    needed    = false;
+
+    for ( const shared_ptr<IEncodedFrameListener>& listener : EncodedFrameListeners )
+    {
+        if ( listener->IsFrameNeeded( timestamp ) )
+        {
+            needed = true;
+            break;
+        }
+    }
+
+    return needed;
+}
+
+// Check if video source is idle - motion detector is set and there is no motion
+bool XVideoSourceToWebData::IsIdle( )
+{
+    return ( ( MotionDetector ) && ( IdleFrameInterval != 0 ) && ( !MotionDetector->IsMotionDetected( ) ) );
+}
+
+// Check if new image needs to be encoded - always, unless video source is idle and an image was encoded recently
+bool XVideoSourceToWebData::IsEncodingDue( )
+{
+    int64_t now = duration_cast<milliseconds>( steady_clock::now( ).time_since_epoch( ) ).count( );
+
+    return ( ( !IsIdle( ) ) || ( now - LastEncodeTime >= IdleFrameInterval ) );
+}
+
+// Check if video source provided an image, which was not taken by encoder yet
+bool XVideoSourceToWebData::IsNewImageAvailable( )
+{
+    return ( ( ReadySlot.load( memory_order_acquire ) & IMAGE_SLOT_NEW ) != 0 );
+}
+
+// Submit a job to encoder pool, unless there is one waiting already (it will take the latest image anyway)
+void XVideoSourceToWebData::ScheduleEncoding( )
+{
+    if ( !EncodeJobPending.exchange( true ) )
+    {
+        {
+            lock_guard<mutex> lock( JobsSync );
+            JobsInFlight++;
+        }
+
+        EncoderPool->Submit( [this]( XJpegEncoder& encoder )
+        {
+            EncodeJobPending = false;
 
-        if ( JpegBuffer == nullptr )
+            encoder.SetQuality( JpegEncoder.Quality( ) );
+            encoder.SetProfile( EncoderProfile );
+            EncodeCameraImage( encoder );
+
+            // notify while holding the lock, so the object can not be destroyed before
+            lock_guard<mutex> lock( JobsSync );
+            JobsInFlight--;
+            JobsFinished.notify_all( );
+        }, EncodePriority, EncodeAffinity );
+    }
+}
+
+// Encode the latest camera image as JPEG into spare buffer and swap it with the one provided to clients
+void XVideoSourceToWebData::EncodeCameraImage( XJpegEncoder& encoder )
+{
+    lock_guard<mutex> encodeLock( EncodeGuard );
+
+    if ( IsNewImageAvailable( ) )
+    {
+        // take the latest image, giving the previously encoded slot back to video source
+        ReadSlot = ReadySlot.exchange( ReadSlot, memory_order_acq_rel ) & IMAGE_SLOT_MASK;
+
+        const shared_ptr<XImage>& image = ImageSlots[ReadSlot];
+        uint64_t           frameId      = ImageSlotFrameIds[ReadSlot];
+        int64_t            timestamp    = ImageSlotTimes[ReadSlot];
+        XTraceScope        trace( "Encode JPEG", frameId );
+        uint32_t           encodedSize  = 0;
+        XError             error        = XError::Success;
+
+        if ( SpareBuffer == nullptr )
         {
-            InternalError = XError::OutOfMemory;
+            error = XError::OutOfMemory;
         }
         else
         {
-            if ( CameraImage->Format( ) == XPixelFormat::JPEG )
+            steady_clock::time_point startTime = steady_clock::now( );
+
+            if ( ( image->Format( ) == XPixelFormat::JPEG ) && ( FrameDecorator ) && ( FrameDecorator->HasDecorations( ) ) )
+            {
+                uint8_t* oldSpareBuffer = SpareBuffer;
+
+                // put decorations on JPEG image without decoding/encoding all of it (buffer is re-allocated if too small)
+                encodedSize = SpareBufferSize;
+                error       = FrameDecorator->DecorateJpeg( image->Data( ), image->Width( ), &SpareBuffer, &encodedSize );
+
+                if ( SpareBuffer != oldSpareBuffer )
+                {
+                    SpareBufferSize = encodedSize;
+                    free( oldSpareBuffer );
+                }
+
+                Statistics->EncodingTime.AddSince( startTime );
+            }
+            else if ( image->Format( ) == XPixelFormat::JPEG )
             {
                 // check allocated buffer size
-                if ( JpegBufferSize < static_cast<uint32_t>( CameraImage->Width( ) ) )
+                if ( SpareBufferSize < static_cast<uint32_t>( image->Width( ) ) )
                 {
                     // make new size 10% bigger than needed
-                    uint32_t newSize = CameraImage->Width( ) + CameraImage->Width( ) / 10;
+                    uint32_t newSize = image->Width( ) + image->Width( ) / 10;
 
-                    JpegBuffer = (uint8_t*) realloc( JpegBuffer, newSize );
-                    if ( JpegBuffer != nullptr )
+                    SpareBuffer = (uint8_t*) realloc( SpareBuffer, newSize );
+                    if ( SpareBuffer != nullptr )
                     {
-                        JpegBufferSize = newSize;
+                        SpareBufferSize = newSize;
                     }
                     else
                     {
-                        InternalError = XError::OutOfMemory;
+                        error = XError::OutOfMemory;
                     }
                 }
 
-                if ( JpegBuffer != nullptr )
+                if ( SpareBuffer != nullptr )
                 {
                     // just copy JPEG data if we got already encoded image
-                    memcpy( JpegBuffer, CameraImage->Data( ), CameraImage->Width( ) );
-                    JpegSize = CameraImage->Width( );
+                    memcpy( SpareBuffer, image->Data( ), image->Width( ) );
+                    encodedSize = image->Width( );
                 }
             }
             else
             {
-                uint8_t* oldJpegBuffer = JpegBuffer;
+                uint8_t* oldSpareBuffer = SpareBuffer;
+
+                if ( FrameDecorator )
+                {
+                    FrameDecorator->OnNewImage( image );
+                }
 
                 // encode image as JPEG (buffer is re-allocated if too small by encoder)
-                JpegSize      = JpegBufferSize;
-                InternalError = JpegEncoder.EncodeToMemory( CameraImage, &JpegBuffer, &JpegSize );
+                encodedSize = SpareBufferSize;
+                error       = encoder.EncodeToMemory( image, &SpareBuffer, &encodedSize );
+
+                if ( encodedSize > SpareBufferSize )
+                {
+                    SpareBufferSize = encodedSize;
+                    free( oldSpareBuffer );
+                }
+
+                Statistics->EncodingTime.AddSince( startTime );
+            }
+
+            if ( error == XError::Success )
+            {
+                Statistics->FramesEncoded.Add( );
+                Statistics->EncodedBytes.Add( encodedSize );
+            }
+        }
+
+        {
+            lock_guard<mutex> imageLock( ImageGuard );
+            InternalError = error;
+        }
 
-                if ( JpegSize > JpegBufferSize )
+        if ( error == XError::Success )
+        {
+            lock_guard<mutex> bufferLock( BufferGuard );
+
+            swap( JpegBuffer, SpareBuffer );
+            swap( JpegBufferSize, SpareBufferSize );
+            JpegSize         = encodedSize;
+            JpegFrameId      = frameId;
+            JpegFromRawImage = ( image->Format( ) != XPixelFormat::JPEG );
+            JpegSequence++;
+
+            LastEncodeTime = duration_cast<milliseconds>( steady_clock::now( ).time_since_epoch( ) ).count( );
+        }
+
+        // JPEG buffer is swapped only by encoder, so it can be copied without holding buffer's lock
+        if ( ( error == XError::Success ) && ( HistoryBuffer ) )
+        {
+            XTraceScope trace( "Keep in history", frameId );
+
+            HistoryBuffer->Add( JpegBuffer, encodedSize, timestamp );
+        }
+
+        if ( error == XError::Success )
+        {
+            for ( const shared_ptr<IEncodedFrameListener>& listener : EncodedFrameListeners )
+            {
+                listener->OnEncodedFrame( JpegBuffer, encodedSize, timestamp );
+            }
+        }
+
+        // while clients watch views of images, those are made right away (by encoder pool, if it is used)
+        if ( error == XError::Success )
+        {
+            vector<shared_ptr<ImageView>> views;
+
+            {
+                lock_guard<mutex> viewsLock( ViewsGuard );
+                views = Views;
+            }
+
+            for ( const shared_ptr<ImageView>& view : views )
+            {
+                if ( IsViewDemanded( view.get( ) ) )
                 {
-                    JpegBufferSize = JpegSize;
-                    free( oldJpegBuffer );
+                    MakeViewJpeg( view.get( ) );
                 }
             }
         }
+    }
+}
+
+// Check if the view was requested recently
+bool XVideoSourceToWebData::IsViewDemanded( const ImageView* view )
+{
+    int64_t now = duration_cast<milliseconds>( steady_clock::now( ).time_since_epoch( ) ).count( );
 
-        NewImageAvailable = false;
+    return ( now - view->LastRequestTime < DEMAND_TIMEOUT );
+}
+
+// Make sure JPEG buffer of the view has the latest encoded image - make it if encoder did not do it yet
+void XVideoSourceToWebData::PrepareViewJpeg( ImageView* view )
+{
+    uint64_t sequence;
+    bool     isOutdated;
+
+    view->LastRequestTime = duration_cast<milliseconds>( steady_clock::now( ).time_since_epoch( ) ).count( );
+
+    {
+        lock_guard<mutex> lock( BufferGuard );
+        sequence = JpegSequence;
+    }
+    {
+        lock_guard<mutex> lock( view->BufferGuard );
+        isOutdated = ( view->Sequence != sequence );
     }
+
+    if ( isOutdated )
+    {
+        lock_guard<mutex> encodeLock( EncodeGuard );
+
+        MakeViewJpeg( view );
+    }
+}
+
+// Make image of the view out of the latest encoded one into its spare buffer and swap it with the one provided to clients
+// (encode guard must be held - JPEG buffer and encoder's image slot are changed only while holding it, so those are read
+// without buffer's lock). Raw camera images are transformed and encoded, while JPEG images are transformed losslessly
+// and/or requantized.
+void XVideoSourceToWebData::MakeViewJpeg( ImageView* view )
+{
+    if ( ( JpegSize != 0 ) && ( view->Sequence != JpegSequence ) )
+    {
+        XTraceScope trace( "Make image view", JpegFrameId );
+        uint8_t*    oldSpareBuffer = view->SpareBuffer;
+        uint32_t    viewSize       = view->SpareBufferSize;
+        XError      error          = XError::Success;
+
+        if ( ( view->SpareBuffer == nullptr ) || ( TempBuffer == nullptr ) )
+        {
+            error = XError::OutOfMemory;
+        }
+        else if ( ( ( view->Transformed ) || ( view->Reencoded ) ) && ( JpegFromRawImage ) &&
+                  ( ( !view->Transformed ) || ( XImageTransform::IsSupported( ImageSlots[ReadSlot]->Format( ), view->Transformation ) ) ) )
+        {
+            // only the region of interest is encoded, so it is cheaper than the full image
+            if ( view->Transformed )
+            {
+                error = XImageTransform::Transform( ImageSlots[ReadSlot], view->Transformation, TransformedImage );
+            }
+
+            if ( error == XError::Success )
+            {
+                ViewEncoder.SetProfile( view->Profile );
+                ViewEncoder.SetQuality( ( view->LowQuality ) ? Requantizer.Quality( ) : JpegEncoder.Quality( ) );
+                error = ViewEncoder.EncodeToMemory( ( view->Transformed ) ? TransformedImage : ImageSlots[ReadSlot], &view->SpareBuffer, &viewSize );
+            }
+        }
+        else if ( ( view->Transformed ) && ( view->LowQuality ) )
+        {
+            uint8_t* oldTempBuffer   = TempBuffer;
+            uint32_t transformedSize = TempBufferSize;
+
+            error = Transformer.Transform( JpegBuffer, JpegSize, view->Transformation, &TempBuffer, &transformedSize );
+
+            if ( TempBuffer != oldTempBuffer )
+            {
+                TempBufferSize = transformedSize;
+                free( oldTempBuffer );
+            }
+
+            if ( error == XError::Success )
+            {
+                error = Requantizer.Requantize( TempBuffer, transformedSize, &view->SpareBuffer, &viewSize );
+            }
+        }
+        else if ( view->Transformed )
+        {
+            error = Transformer.Transform( JpegBuffer, JpegSize, view->Transformation, &view->SpareBuffer, &viewSize );
+        }
+        else if ( !view->LowQuality )
+        {
+            // camera's JPEG images are not encoded again with view's own profile
+            if ( viewSize < JpegSize )
+            {
+                view->SpareBuffer = static_cast<uint8_t*>( malloc( JpegSize ) );
+                viewSize          = JpegSize;
+            }
+
+            if ( view->SpareBuffer == nullptr )
+            {
+                error = XError::OutOfMemory;
+            }
+            else
+            {
+                memcpy( view->SpareBuffer, JpegBuffer, JpegSize );
+                viewSize = JpegSize;
+            }
+        }
+        else
+        {
+            error = Requantizer.Requantize( JpegBuffer, JpegSize, &view->SpareBuffer, &viewSize );
+        }
+
+        // buffer is re-allocated by encoder/transformer/requantizer if too small
+        if ( view->SpareBuffer != oldSpareBuffer )
+        {
+            view->SpareBufferSize = viewSize;
+            free( oldSpareBuffer );
+        }
+
+        lock_guard<mutex> lock( view->BufferGuard );
+
+        if ( error == XError::Success )
+        {
+            swap( view->JpegBuffer, view->SpareBuffer );
+            swap( view->JpegBufferSize, view->SpareBufferSize );
+            view->JpegSize = viewSize;
+        }
+
+        // images failed to make are not tried again - clients keep getting the previous one
+        view->Sequence  = JpegSequence;
+        view->LastError = error;
+    }
+}
+
+// Provide JPEG image from history buffer, which was captured at (or just before) the specified time
+void XVideoSourceToWebData::SendHistoryJpeg( const string& at, IWebResponse& response )
+{
+    int64_t timestamp;
+
+    if ( !HistoryBuffer )
+    {
+        response.SendError( 404, "History buffer is not enabled" );
+    }
+    else if ( !StringToTimestamp( at, &timestamp ) )
+    {
+        response.SendError( 400, "Invalid time of image" );
+    }
+    else
+    {
+        shared_ptr<const XEncodedFrame> frame = HistoryBuffer->FindFrame( timestamp );
+
+        if ( !frame )
+        {
+            response.SendError( 404, "No image at the specified time" );
+        }
+        else
+        {
+            XTraceScope trace( "Send JPEG from history", 0 );
+
+            response.Printf( "HTTP/1.1 200 OK\r\n"
+                             "Content-Type: image/jpeg\r\n"
+                             "Content-Length: %u\r\n"
+                             "X-Timestamp: %lld\r\n"
+                             "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
+                             "\r\n", static_cast<uint32_t>( frame->Data.size( ) ), static_cast<long long>( frame->Timestamp ) );
+
+            response.Send( frame->Data.data( ), frame->Data.size( ) );
+        }
+    }
+}
+
+// Start MJPEG stream of images from history buffer, starting from the specified time
+void XVideoSourceToWebData::StartPlayback( const string& from, const string& speed, uint32_t frameInterval, IWebResponse& response )
+{
+    int64_t timestamp;
+    float   playbackSpeed = 1.0f;
+
+    if ( !HistoryBuffer )
+    {
+        response.SendError( 404, "History buffer is not enabled" );
+    }
+    else if ( !StringToTimestamp( from, &timestamp ) )
+    {
+        response.SendError( 400, "Invalid time to play images from" );
+    }
+    else if ( ( !speed.empty( ) ) &&
+              ( ( sscanf( speed.c_str( ), "%f", &playbackSpeed ) != 1 ) || ( playbackSpeed <= 0 ) || ( playbackSpeed > MAX_PLAYBACK_SPEED ) ) )
+    {
+        response.SendError( 400, "Invalid playback speed" );
+    }
+    else
+    {
+        // start from the image shown at the requested time or from the oldest one, if the time is too far back
+        shared_ptr<const XEncodedFrame> frame = HistoryBuffer->FindFrame( timestamp );
+
+        if ( !frame )
+        {
+            frame = HistoryBuffer->OldestFrame( );
+        }
+
+        if ( !frame )
+        {
+            response.SendError( 404, "No images in history buffer" );
+        }
+        else
+        {
+            shared_ptr<MjpegStreamState> state = make_shared<MjpegStreamState>( );
+            XTraceScope                  trace( "Send MJPEG frame from history", 0 );
+
+            state->Playback      = true;
+            state->StartPosition = max( timestamp, frame->Timestamp );
+            state->StartTime     = steady_clock::now( );
+            state->Speed         = playbackSpeed;
+            state->LastSequence  = frame->Sequence;
+
+            response.Printf( "HTTP/1.1 200 OK\r\n"
+                             "Cache-Control: no-store, must-revalidate\r\nPragma: no-cache\r\nExpires: 0\r\n"
+                             "Connection: close\r\n"
+                             "Content-Type: multipart/x-mixed-replace; boundary=--myboundary\r\n"
+                             "\r\n" );
+
+            response.Printf( "--myboundary\r\n"
+                             "Content-Type: image/jpeg\r\n"
+                             "Content-Length: %u\r\n"
+                             "X-Timestamp: %lld\r\n"
+                             "\r\n", static_cast<uint32_t>( frame->Data.size( ) ), static_cast<long long>( frame->Timestamp ) );
+
+            response.Send( frame->Data.data( ), frame->Data.size( ) );
+
+            response.SetStreamState( state );
+            response.SetTimer( frameInterval );
+        }
+    }
+}
+
+// Provide next image of MJPEG stream played from history buffer - the latest one captured before current playback position
+void XVideoSourceToWebData::ContinuePlayback( MjpegStreamState* state, uint32_t frameInterval, IWebResponse& response )
+{
+    steady_clock::time_point        startTime = steady_clock::now( );
+    int64_t                         position  = state->StartPosition +
+                                                static_cast<int64_t>( duration_cast<milliseconds>( startTime - state->StartTime ).count( ) * state->Speed );
+    shared_ptr<const XEncodedFrame> frame     = HistoryBuffer->NextFrame( state->LastSequence, position );
+    uint32_t                        handlingTime;
+
+    if ( frame )
+    {
+        // don't try sending too much on slow connections - newer image will be sent next time
+        if ( response.ToSendDataLength( ) < 2 * frame->Data.size( ) )
+        {
+            XTraceScope trace( "Send MJPEG frame from history", 0 );
+
+            response.Printf( "--myboundary\r\n"
+                             "Content-Type: image/jpeg\r\n"
+                             "Content-Length: %u\r\n"
+                             "X-Timestamp: %lld\r\n"
+                             "\r\n", static_cast<uint32_t>( frame->Data.size( ) ), static_cast<long long>( frame->Timestamp ) );
+
+            response.Send( frame->Data.data( ), frame->Data.size( ) );
+            state->LastSequence = frame->Sequence;
+        }
+        else
+        {
+            response.ReportSkippedFrame( );
+        }
+    }
+
+    handlingTime = static_cast<uint32_t>( duration_cast<std::chrono::milliseconds>( steady_clock::now( ) - startTime ).count( ) );
+
+    // set new timer for further images
+    response.SetTimer( ( handlingTime >= frameInterval ) ? 1 : frameInterval - handlingTime );
 }
 
 } // namespace Private
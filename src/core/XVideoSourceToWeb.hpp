@@ -27,13 +27,20 @@
 #include "XInterfaces.hpp"
 #include "IVideoSourceListener.hpp"
 #include "XWebServer.hpp"
+#include "XStatistics.hpp"
+#include "XJpegEncoderPool.hpp"
+#include "XMotionDetector.hpp"
+#include "XVideoSourceDemandController.hpp"
+#include "XEncodedFrameBuffer.hpp"
+#include "XVideoFrameDecorator.hpp"
+#include "IEncodedFrameListener.hpp"
 
 namespace Private
 {
     class XVideoSourceToWebData;
 }
 
-class XVideoSourceToWeb : private Uncopyable
+class XVideoSourceToWeb : public IStatisticsProvider, private Uncopyable
 {
 public:
     XVideoSourceToWeb( uint16_t jpegQuality = 85 );
@@ -42,16 +49,78 @@ public:
     // Get video source listener, which could be fed to some video source
     IVideoSourceListener* VideoSourceListener( ) const;
 
-    // Create web request handler to provide camera images as JPEGs
+    // Create web request handler to provide camera images as JPEGs. Requests may add "roi=x,y,w,h", "rotate=<0|90|180|270>",
+    // "flip=<h|v>" and "quality=low" (see SetLowQualityTier()) variables to get views of images, which are made only while
+    // clients request them (same for MJPEG handler). Uncompressed images are transformed before encoding, while JPEG images
+    // of video source are transformed losslessly (at MCU granularity, so region of interest is expanded to MCU boundaries).
     std::shared_ptr<IWebRequestHandler> CreateJpegHandler( const std::string& uri ) const;
 
     // Create web request handler to provide camera images as MJPEG stream
     std::shared_ptr<IWebRequestHandler> CreateMjpegHandler( const std::string& uri, uint32_t frameRate ) const;
 
+    // Create JPEG/MJPEG handlers, which provide images encoded with the specified profile. If it differs from the one
+    // of the main encoder, uncompressed images are encoded again for clients of the handler (as a view of images),
+    // while JPEG images of video source are provided as they are.
+    std::shared_ptr<IWebRequestHandler> CreateJpegHandler( const std::string& uri, XJpegProfile profile ) const;
+    std::shared_ptr<IWebRequestHandler> CreateMjpegHandler( const std::string& uri, uint32_t frameRate, XJpegProfile profile ) const;
+
     // Get/Set JPEG quality (valid only if camera provides uncompressed images)
     uint16_t JpegQuality( ) const;
     void SetJpegQuality( uint16_t quality );
 
+    // Get/Set profile of JPEG encoder (valid only if camera provides uncompressed images). It is used for
+    // everything encoded by the main encoder - MJPEG streams, history buffer, recordings, etc.
+    XJpegProfile EncoderProfile( ) const;
+    void SetEncoderProfile( XJpegProfile profile );
+
+    // Set pool of encoders to use (must be done before video source is started). By default images
+    // are encoded on web server's thread when requested. With the pool, they are encoded by its workers
+    // as soon as they come from video source, while there are clients requesting them.
+    void SetEncoderPool( const std::shared_ptr<XJpegEncoderPool>& pool, XEncodePriority priority = XEncodePriority::Live );
+
+    // Set motion detector to find if video source is idle (it must get images before this object does).
+    // While there is no motion, images are encoded and sent to MJPEG clients at the specified idle frame
+    // rate only, going back to full rate as soon as motion is detected. Idle rate of 0 disables this.
+    void SetMotionDetector( const std::shared_ptr<const XMotionDetector>& detector, uint32_t idleFrameRate );
+
+    // Set interval (ms) to send unchanged image to MJPEG clients at. With non zero interval, clients get only
+    // new images, while the last one is repeated to keep connection alive. Default is 0 - images are sent at
+    // stream's frame rate, even if unchanged. (Repeated frames of video source are never encoded again.)
+    void SetDuplicateKeepAlive( uint32_t keepAliveInterval );
+
+    // Set controller of video source, which is told about every request for images, so it runs the source
+    // only while its video is needed. Requests coming while the source is stopped wait for its first frame.
+    void SetDemandController( const std::shared_ptr<XVideoSourceDemandController>& controller );
+
+    // Set decorator to put overlays/privacy masks on images right before they are encoded (must be done before video
+    // source is started). Unlike putting decorator into chain of listeners, this works for JPEG images provided by
+    // video source - only their parts covered by decorations are decoded and encoded again. Uncompressed images
+    // are decorated on the copy made by this object, so video source's buffers don't need to be writable.
+    void SetFrameDecorator( const std::shared_ptr<XVideoFrameDecorator>& decorator );
+
+    // Set quality of low bandwidth tier (must be done before video source is started), which is provided to clients adding
+    // "quality=low" to JPEG/MJPEG requests. Images of the tier are made of the encoded ones (or the ones provided by video
+    // source as JPEGs) by requantizing their DCT coefficients, only while there are clients requesting them. Quality of 0
+    // disables the tier (default).
+    void SetLowQualityTier( uint16_t quality );
+
+    // Set buffer to keep recent encoded images in (must be done before video source is started). Images are then
+    // encoded as they come, even if nobody requests them, and can be played back by adding "at=<time>" to JPEG
+    // requests or "from=<time>&speed=<rate>" to MJPEG requests. Time is in milliseconds since Unix epoch or,
+    // if zero or negative, relative to current time.
+    void SetHistoryBuffer( const std::shared_ptr<XEncodedFrameBuffer>& historyBuffer );
+
+    // Add listener of encoded images, like video recorder (must be done before video source is started).
+    // Same as with history buffer, images are then encoded as they come, even if nobody requests them.
+    void AddEncodedFrameListener( const std::shared_ptr<IEncodedFrameListener>& listener );
+
+    // Get performance statistics of the video pipeline (can be shared with video source to report
+    // frames it dropped and pixel format conversion time)
+    std::shared_ptr<XPipelineStatistics> Statistics( ) const;
+
+    // Put statistics of the video pipeline into the specified collector
+    void CollectStatistics( XStatisticsCollector& collector ) const;
+
 private:
     Private::XVideoSourceToWebData* mData;
 };
@@ -20,6 +20,7 @@
 
 #include "XWebServer.hpp"
 #include "XManualResetEvent.hpp"
+#include "XTracer.hpp"
 
 #include <map>
 #include <list>
@@ -38,6 +39,9 @@ namespace Private
 {
     #define DEFAULT_AUTH_DOMAIN "cam2web"
 
+    class RequestHandlerData;
+    class ConnectionData;
+
     /* ================================================================= */
     /* Web request implementation using Mangoose APIs                    */
     /* ================================================================= */
@@ -120,19 +124,20 @@ namespace Private
         friend class XWebServerData;
 
     private:
+        XWebServerData*       mOwner;
         struct mg_connection* mConnection;
-        IWebRequestHandler*   mHandler;
+        RequestHandlerData*   mHandlerData;
 
     private:
-        MangooseWebResponse( struct mg_connection* connection, IWebRequestHandler* handler = nullptr ) :
-            mConnection( connection ), mHandler( handler )
+        MangooseWebResponse( XWebServerData* owner, struct mg_connection* connection, RequestHandlerData* handlerData = nullptr ) :
+            mOwner( owner ), mConnection( connection ), mHandlerData( handlerData )
         {
         }
 
         // Set handler owning this response
-        void SetHandler( IWebRequestHandler* handler )
+        void SetHandlerData( RequestHandlerData* handlerData )
         {
-            mHandler = handler;
+            mHandlerData = handlerData;
         }
 
     public:
@@ -202,11 +207,35 @@ namespace Private
 
         // Generate timer event for the connection associated with the response
         // after the specified number of milliseconds
-        void SetTimer( uint32_t msec )
-        {
-            mConnection->user_data = mHandler;
-            mg_set_timer( mConnection, mg_time( ) + (double) msec / 1000 );
-        }
+        void SetTimer( uint32_t msec );
+
+        // Let web server know a frame of a stream was not sent to a slow client
+        void ReportSkippedFrame( );
+
+        // Get/Set value associated with the streaming connection
+        uint64_t StreamTag( ) const;
+        void SetStreamTag( uint64_t tag );
+        uint32_t StreamTagAge( ) const;
+        shared_ptr<void> StreamState( ) const;
+        void SetStreamState( const shared_ptr<void>& state );
+    };
+
+    /* ================================================================= */
+    /* Statistics of a request handler                                   */
+    /* ================================================================= */
+    class RequestHandlerStatistics : private Uncopyable
+    {
+    public:
+        atomic<uint64_t>    Requests;
+        XDurationHistogram  RequestTime;
+        XDurationHistogram  TimerTime;
+        atomic<uint32_t>    ActiveStreams;
+        atomic<uint64_t>    SkippedFrames;
+
+    public:
+        RequestHandlerStatistics( ) :
+            Requests( 0 ), RequestTime( ), TimerTime( ), ActiveStreams( 0 ), SkippedFrames( 0 )
+        { }
     };
 
     /* ================================================================= */
@@ -219,14 +248,40 @@ namespace Private
         UserGroup                       AllowedUserGroup;
         steady_clock::time_point        LastAccessTime;
         bool                            WasAccessed;
+        shared_ptr<RequestHandlerStatistics> Statistics;
     public:
         RequestHandlerData( ) :
             Handler( ), AllowedUserGroup( UserGroup::Anyone ),
-            LastAccessTime( ), WasAccessed( false )
+            LastAccessTime( ), WasAccessed( false ), Statistics( make_shared<RequestHandlerStatistics>( ) )
         { }
 
         RequestHandlerData( const shared_ptr<IWebRequestHandler>& handler, UserGroup allowedUserGroup ) :
-            Handler( handler), AllowedUserGroup( allowedUserGroup )
+            Handler( handler), AllowedUserGroup( allowedUserGroup ),
+            LastAccessTime( ), WasAccessed( false ), Statistics( make_shared<RequestHandlerStatistics>( ) )
+        { }
+    };
+
+    /* ================================================================= */
+    /* Data associated with connections, which stream content by using   */
+    /* timer events (MJPEG streams, for example)                         */
+    /* ================================================================= */
+    class ConnectionData : private Uncopyable
+    {
+    public:
+        RequestHandlerData*         HandlerData;
+        bool                        TimerPending;
+        string                      RemoteAddress;
+        steady_clock::time_point    StartTime;
+        atomic<uint64_t>            SkippedFrames;
+        atomic<size_t>              PendingBytes;
+        uint64_t                    Tag;
+        steady_clock::time_point    TagTime;
+        shared_ptr<void>            State;
+
+    public:
+        ConnectionData( RequestHandlerData* handlerData, const string& remoteAddress ) :
+            HandlerData( handlerData ), TimerPending( false ), RemoteAddress( remoteAddress ),
+            StartTime( steady_clock::now( ) ), SkippedFrames( 0 ), PendingBytes( 0 ), Tag( 0 ), TagTime( StartTime ), State( )
         { }
     };
 
@@ -271,13 +326,17 @@ namespace Private
 
         UsersMap Users;
 
+        mutable mutex             StreamsSync;
+        list<ConnectionData*>     Streams;
+
     public:
         XWebServerData( const string& documentRoot, uint16_t port ) :
             DataSync( ), DocumentRoot( documentRoot ), AuthDomain( DEFAULT_AUTH_DOMAIN ), AuthMethod( Authentication::Digest ), Port( port ),
             LastAccessTime( ), WasAccessed( false ),
             EventManager( { 0 } ), ServerOptions( { 0 } ),
             ActiveDocumentRoot( nullptr ), ActiveAuthDomain( ), ActiveAuthMethod( Authentication::Digest ),
-            NeedToStop( ), IsStopped( ), StartSync( ), IsRunning( false )
+            NeedToStop( ), IsStopped( ), StartSync( ), IsRunning( false ),
+            StreamsSync( ), Streams( )
         {
             ServerOptions.enable_directory_listing = "no";
         }
@@ -304,6 +363,10 @@ namespace Private
         void SendAuthenticationRequest( struct mg_connection* con );
         UserGroup CheckAuthentication( struct http_message* msg );
 
+        ConnectionData* StartStream( struct mg_connection* connection, RequestHandlerData* handlerData );
+        void EndStream( struct mg_connection* connection );
+        void CollectStatistics( XStatisticsCollector& collector ) const;
+
         static void* pollHandler( void* param );
         static void eventHandler( struct mg_connection* connection, int event, void* param );
     };
@@ -485,6 +548,12 @@ void XWebServer::ClearUsers( )
     return mData->ClearUsers( );
 }
 
+// Put statistics of request handlers and active streams into the specified collector
+void XWebServer::CollectStatistics( XStatisticsCollector& collector ) const
+{
+    mData->CollectStatistics( collector );
+}
+
 // Calculate HA1 as defined by Digest authentication algorithm, MD5(user:domain:pass).
 string XWebServer::CalculateDigestAuthHa1( const string& user, const string& domain, const string& pass )
 {
@@ -504,6 +573,83 @@ string XWebServer::CalculateDigestAuthHa1( const string& user, const string& dom
 namespace Private
 {
 
+// Generate timer event for the connection associated with the response
+void MangooseWebResponse::SetTimer( uint32_t msec )
+{
+    ConnectionData* connectionData = mOwner->StartStream( mConnection, mHandlerData );
+
+    if ( connectionData != nullptr )
+    {
+        connectionData->TimerPending = true;
+        mg_set_timer( mConnection, mg_time( ) + (double) msec / 1000 );
+    }
+}
+
+// Let web server know a frame of a stream was not sent to a slow client
+void MangooseWebResponse::ReportSkippedFrame( )
+{
+    ConnectionData* connectionData = static_cast<ConnectionData*>( mConnection->user_data );
+
+    if ( connectionData != nullptr )
+    {
+        connectionData->SkippedFrames++;
+        connectionData->HandlerData->Statistics->SkippedFrames++;
+    }
+}
+
+// Get value associated with the streaming connection
+uint64_t MangooseWebResponse::StreamTag( ) const
+{
+    ConnectionData* connectionData = static_cast<ConnectionData*>( mConnection->user_data );
+
+    return ( connectionData != nullptr ) ? connectionData->Tag : 0;
+}
+
+// Set value associated with the streaming connection (the connection is marked as streaming one)
+void MangooseWebResponse::SetStreamTag( uint64_t tag )
+{
+    ConnectionData* connectionData = mOwner->StartStream( mConnection, mHandlerData );
+
+    if ( connectionData != nullptr )
+    {
+        connectionData->Tag     = tag;
+        connectionData->TagTime = steady_clock::now( );
+    }
+}
+
+// Milliseconds passed since stream tag was set last time
+uint32_t MangooseWebResponse::StreamTagAge( ) const
+{
+    ConnectionData* connectionData = static_cast<ConnectionData*>( mConnection->user_data );
+    uint32_t        age            = 0;
+
+    if ( connectionData != nullptr )
+    {
+        age = static_cast<uint32_t>( duration_cast<milliseconds>( steady_clock::now( ) - connectionData->TagTime ).count( ) );
+    }
+
+    return age;
+}
+
+// Get object associated with the streaming connection
+shared_ptr<void> MangooseWebResponse::StreamState( ) const
+{
+    ConnectionData* connectionData = static_cast<ConnectionData*>( mConnection->user_data );
+
+    return ( connectionData != nullptr ) ? connectionData->State : shared_ptr<void>( );
+}
+
+// Set object associated with the streaming connection (the connection is marked as streaming one)
+void MangooseWebResponse::SetStreamState( const shared_ptr<void>& state )
+{
+    ConnectionData* connectionData = mOwner->StartStream( mConnection, mHandlerData );
+
+    if ( connectionData != nullptr )
+    {
+        connectionData->State = state;
+    }
+}
+
 // Start instance of a Web server
 bool XWebServerData::Start( )
 {
@@ -796,11 +942,107 @@ void XWebServerData::ClearUsers( )
     Users.clear( );
 }
 
+// Mark the connection as the one streaming content of the specified handler
+ConnectionData* XWebServerData::StartStream( struct mg_connection* connection, RequestHandlerData* handlerData )
+{
+    ConnectionData* connectionData = static_cast<ConnectionData*>( connection->user_data );
+
+    if ( ( connectionData == nullptr ) && ( handlerData != nullptr ) )
+    {
+        char address[64];
+
+        mg_conn_addr_to_str( connection, address, sizeof( address ), MG_SOCK_STRINGIFY_REMOTE | MG_SOCK_STRINGIFY_IP | MG_SOCK_STRINGIFY_PORT );
+
+        connectionData = new ConnectionData( handlerData, address );
+        connection->user_data = connectionData;
+
+        handlerData->Statistics->ActiveStreams++;
+
+        lock_guard<mutex> lock( StreamsSync );
+        Streams.push_back( connectionData );
+    }
+
+    return connectionData;
+}
+
+// Clean-up when streaming connection gets closed
+void XWebServerData::EndStream( struct mg_connection* connection )
+{
+    ConnectionData* connectionData = static_cast<ConnectionData*>( connection->user_data );
+
+    if ( connectionData != nullptr )
+    {
+        {
+            lock_guard<mutex> lock( StreamsSync );
+            Streams.remove( connectionData );
+        }
+
+        connectionData->HandlerData->Statistics->ActiveStreams--;
+        connection->user_data = nullptr;
+
+        delete connectionData;
+    }
+}
+
+// Put statistics of request handlers and active streams into the specified collector
+void XWebServerData::CollectStatistics( XStatisticsCollector& collector ) const
+{
+    list<const RequestHandlerData*> handlers;
+    size_t                          totalPendingBytes = 0;
+
+    for ( auto& fileHandlerData : ActiveFileHandlers )
+    {
+        handlers.push_back( &fileHandlerData.second );
+    }
+    for ( auto& folderHandlerData : ActiveFolderHandlers )
+    {
+        handlers.push_back( &folderHandlerData );
+    }
+
+    for ( auto handlerData : handlers )
+    {
+        XStatisticsLabels         labels = { { "handler", handlerData->Handler->Uri( ) } };
+        RequestHandlerStatistics* stats  = handlerData->Statistics.get( );
+
+        collector.AddCounter( "cam2web_http_requests_total", "Number of HTTP requests handled", stats->Requests, labels );
+        collector.AddHistogram( "cam2web_http_request_seconds", "Time taken to handle HTTP requests", stats->RequestTime, labels );
+        collector.AddGauge( "cam2web_http_active_streams", "Number of active streaming connections", stats->ActiveStreams, labels );
+
+        // only streaming handlers make use of timers and skip frames
+        if ( stats->TimerTime.Count( ) != 0 )
+        {
+            collector.AddHistogram( "cam2web_http_stream_frame_seconds", "Time taken to provide next part of a stream", stats->TimerTime, labels );
+            collector.AddCounter( "cam2web_http_skipped_frames_total", "Number of frames not sent to slow clients", stats->SkippedFrames, labels );
+        }
+    }
+
+    {
+        lock_guard<mutex> lock( StreamsSync );
+        steady_clock::time_point now = steady_clock::now( );
+
+        for ( auto connectionData : Streams )
+        {
+            XStatisticsLabels labels = { { "handler", connectionData->HandlerData->Handler->Uri( ) }, { "client", connectionData->RemoteAddress } };
+
+            collector.AddCounter( "cam2web_stream_skipped_frames_total", "Number of frames not sent to the client", connectionData->SkippedFrames, labels );
+            collector.AddGauge( "cam2web_stream_send_buffer_bytes", "Amount of data waiting to be sent to the client", static_cast<double>( connectionData->PendingBytes ), labels );
+            collector.AddGauge( "cam2web_stream_duration_seconds", "Time since the client started streaming",
+                                static_cast<double>( duration_cast<milliseconds>( now - connectionData->StartTime ).count( ) ) / 1000, labels );
+
+            totalPendingBytes += connectionData->PendingBytes;
+        }
+    }
+
+    collector.AddGauge( "cam2web_http_send_buffer_bytes", "Amount of data waiting to be sent to all streaming clients", static_cast<double>( totalPendingBytes ) );
+}
+
 // Thread to poll web events
 void* XWebServerData::pollHandler( void* param )
 {
     XWebServerData* self = (XWebServerData*) param;
 
+    XTracer::SetThreadName( "Web server" );
+
     while ( !self->NeedToStop.Wait( 0 ) )
     {
         mg_mgr_poll( &self->EventManager, 1000 );
@@ -985,7 +1227,7 @@ void XWebServerData::eventHandler( struct mg_connection* connection, int event,
     {
         struct http_message* message = static_cast<struct http_message*>( param );
         MangooseWebRequest   request( message );
-        MangooseWebResponse  response( connection );
+        MangooseWebResponse  response( self, connection );
         string               uri = request.Uri( );
         UserGroup            authUserGroup = self->CheckAuthentication( message );
 
@@ -1006,12 +1248,23 @@ void XWebServerData::eventHandler( struct mg_connection* connection, int event,
             }
             else
             {
-                response.SetHandler( handlerData->Handler.get( ) );
+                steady_clock::time_point startTime = steady_clock::now( );
+                XTraceScope              trace( "HTTP request", 0 );
+
+                response.SetHandlerData( handlerData );
                 // handle request with the found handler
                 handlerData->Handler->HandleHttpRequest( request, response );
 
                 handlerData->WasAccessed    = true;
                 handlerData->LastAccessTime = steady_clock::now( );
+
+                handlerData->Statistics->Requests++;
+                handlerData->Statistics->RequestTime.AddSince( startTime );
+
+                if ( connection->user_data != nullptr )
+                {
+                    static_cast<ConnectionData*>( connection->user_data )->PendingBytes = connection->send_mbuf.len;
+                }
             }
         }
         else if ( self->ActiveDocumentRoot )
@@ -1027,16 +1280,26 @@ void XWebServerData::eventHandler( struct mg_connection* connection, int event,
     }
     else if ( event == MG_EV_TIMER )
     {
-        if ( connection->user_data != nullptr )
+        ConnectionData* connectionData = static_cast<ConnectionData*>( connection->user_data );
+
+        if ( ( connectionData != nullptr ) && ( connectionData->TimerPending ) )
         {
-            IWebRequestHandler* handler = static_cast<IWebRequestHandler*>( connection->user_data );
-            MangooseWebResponse response( connection, handler );
+            steady_clock::time_point startTime = steady_clock::now( );
+            XTraceScope              trace( "Stream timer", 0 );
+            MangooseWebResponse      response( self, connection, connectionData->HandlerData );
 
-            connection->user_data = nullptr;
+            connectionData->TimerPending = false;
 
-            handler->HandleTimer( response );
+            connectionData->HandlerData->Handler->HandleTimer( response );
+
+            connectionData->HandlerData->Statistics->TimerTime.AddSince( startTime );
+            connectionData->PendingBytes = connection->send_mbuf.len;
         }
     }
+    else if ( event == MG_EV_CLOSE )
+    {
+        self->EndStream( connection );
+    }
 
     if ( ( event != MG_EV_POLL ) && ( event != MG_EV_CLOSE ) )
     {
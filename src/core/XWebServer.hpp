@@ -28,6 +28,7 @@
 #include <chrono>
 
 #include "XInterfaces.hpp"
+#include "XStatistics.hpp"
 
 namespace Private
 {
@@ -91,6 +92,21 @@ public:
     // Generate timer event for the connection associated with the response
     // after the specified number of milliseconds
     virtual void SetTimer( uint32_t msec ) = 0;
+
+    // Let web server know a frame of a stream was not sent to a slow client (used for statistics only)
+    virtual void ReportSkippedFrame( ) = 0;
+
+    // Get/Set value associated with the streaming connection of the response (meaning is up to request handler,
+    // like time or ID of the last sent frame). Value is 0 until set.
+    virtual uint64_t StreamTag( ) const = 0;
+    virtual void SetStreamTag( uint64_t tag ) = 0;
+    // Milliseconds passed since stream tag was set last time (or since streaming has started)
+    virtual uint32_t StreamTagAge( ) const = 0;
+
+    // Get/Set object associated with the streaming connection, for handlers which need more than a tag
+    // to keep track of the stream (like playback position). It is released when connection is closed.
+    virtual std::shared_ptr<void> StreamState( ) const = 0;
+    virtual void SetStreamState( const std::shared_ptr<void>& state ) = 0;
 };
 
 /* ================================================================= */
@@ -147,7 +163,7 @@ private:
 /* ================================================================= */
 /* Web server class                                                  */
 /* ================================================================= */
-class XWebServer : private Uncopyable
+class XWebServer : public IStatisticsProvider, private Uncopyable
 {
 public:
     XWebServer( const std::string& documentRoot = "", uint16_t port = 8000 );
@@ -203,6 +219,9 @@ public:
     // Clear the list of users who can access the web server
     void ClearUsers( );
 
+    // Put statistics of request handlers and active streams into the specified collector
+    void CollectStatistics( XStatisticsCollector& collector ) const;
+
 public:
     // Calculate HA1 as defined by Digest authentication algorithm, MD5(user:domain:pass).
     static std::string CalculateDigestAuthHa1( const std::string& user, const std::string& domain, const std::string& pass );
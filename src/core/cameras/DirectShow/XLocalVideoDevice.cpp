@@ -34,6 +34,7 @@
 
 #include "XLocalVideoDevice.hpp"
 #include "XManualResetEvent.hpp"
+#include "XTracer.hpp"
 
 using namespace std;
 
@@ -214,6 +215,7 @@ namespace Private
         // Handle new video sample given in a buffer
         HRESULT STDMETHODCALLTYPE BufferCB( double /* sampleTime */, BYTE* pBuffer, long bufferLen )
         {
+            XTraceScope                 trace( "Capture frame", XTracer::NewFrame( ), XTraceFlow::Start );
             lock_guard<recursive_mutex> lock( mParent->Sync );
 
             assert( mWidth );
@@ -33,6 +33,7 @@
 
 #include "XRaspiCamera.hpp"
 #include "XManualResetEvent.hpp"
+#include "XTracer.hpp"
 
 using namespace std;
 
@@ -1169,6 +1170,8 @@ void XRaspiCameraData::VideoBufferCallback( MMAL_PORT_T* port, MMAL_BUFFER_HEADE
         mmal_buffer_header_mem_lock( buffer );
 
         {
+            XTraceScope trace( "Capture frame", XTracer::NewFrame( ), XTraceFlow::Start );
+
             shared_ptr<XImage> image = ( !me->JpegEncoding ) ?
                 XImage::Create( buffer->data + buffer->offset, me->FrameWidth, me->FrameHeight, me->FrameWidth * 3, XPixelFormat::RGB24 ) :
                 XImage::Create( buffer->data + buffer->offset, buffer->length, 1, buffer->length, XPixelFormat::JPEG );
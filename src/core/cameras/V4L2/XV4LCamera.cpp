@@ -18,7 +18,9 @@
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 */
 
+#include <algorithm>
 #include <map>
+#include <vector>
 #include <mutex>
 #include <thread>
 #include <chrono>
@@ -26,12 +28,18 @@
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <linux/videodev2.h>
 
 #include "XV4LCamera.hpp"
+#include "XImageConversion.hpp"
+#include "XAutoGainMapper.hpp"
 #include "XManualResetEvent.hpp"
+#include "XTracer.hpp"
 
 using namespace std;
 using namespace std::chrono;
@@ -39,6 +47,40 @@ using namespace std::chrono;
 namespace Private
 {
     #define BUFFER_COUNT        (4)
+    // Time to wait for a video frame before reporting an error (ms)
+    #define FRAME_WAIT_TIMEOUT  (2000)
+
+    // Pixel formats handled by the camera class, in the order of preference - from the cheapest to handle
+    static const struct
+    {
+        uint32_t     FourCC;
+        XPixelFormat PixelFormat;
+        const char*  Name;
+    }
+    HandledFormats[] =
+    {
+        { V4L2_PIX_FMT_MJPEG,  XPixelFormat::JPEG, "MJPEG" },
+        { V4L2_PIX_FMT_JPEG,   XPixelFormat::JPEG, "JPEG"  },
+        { V4L2_PIX_FMT_NV12,   XPixelFormat::NV12, "NV12"  },
+        { V4L2_PIX_FMT_YUV420, XPixelFormat::I420, "I420"  },
+        { V4L2_PIX_FMT_YUYV,   XPixelFormat::YUYV, "YUYV"  },
+        { V4L2_PIX_FMT_UYVY,   XPixelFormat::UYVY, "UYVY"  },
+        { V4L2_PIX_FMT_GREY,   XPixelFormat::Grayscale8,  "GREY" },
+        { V4L2_PIX_FMT_Y16,    XPixelFormat::Grayscale16, "Y16"  },
+        { V4L2_PIX_FMT_SRGGB8, XPixelFormat::BayerRGGB8,  "RGGB" },
+        { V4L2_PIX_FMT_SGRBG8, XPixelFormat::BayerGRBG8,  "GRBG" },
+        { V4L2_PIX_FMT_SGBRG8, XPixelFormat::BayerGBRG8,  "GBRG" },
+        { V4L2_PIX_FMT_SBGGR8, XPixelFormat::BayerBGGR8,  "BGGR" }
+    };
+
+    // Range of values supported by a video property
+    struct PropertyRange
+    {
+        int32_t Min;
+        int32_t Max;
+        int32_t Step;
+        int32_t Default;
+    };
 
     // Private details of the implementation
     class XV4LCameraData
@@ -52,26 +94,43 @@ namespace Private
         bool                    Running;
 
         int                     VideoFd;
+        int                     StopEventFd;
         bool                    VideoStreamingActive;
         uint8_t*                MappedBuffers[BUFFER_COUNT];
         uint32_t                MappedBufferLength[BUFFER_COUNT];
+        uint32_t                BytesPerLine;
 
         map<XVideoProperty, int32_t> PropertiesToSet;
+        mutable map<XVideoProperty, PropertyRange> KnownPropertyRanges;
+        vector<XV4LVideoFormat>      SupportedFormats;
+        XAutoGainMapper              AutoGain;
 
     public:
+        shared_ptr<XPipelineStatistics> Statistics;
         uint32_t                VideoDevice;
         uint32_t                FramesReceived;
+        uint32_t                FramesDiscarded;
         uint32_t                FrameWidth;
         uint32_t                FrameHeight;
         uint32_t                FrameRate;
+        XPixelFormat            CaptureFormat;
+        XPixelFormat            NegotiatedFormat;
+        bool                    RgbOutput;
         bool                    JpegEncoding;
+        bool                    LowLatency;
+        float                   NativeFrameRate;
+        XRateCounter            DeliveredFrames;
 
     public:
         XV4LCameraData( ) :
             Sync( ), ConfigSync( ), ControlThread( ), NeedToStop( ), Listener( nullptr ), Running( false ),
-            VideoFd( -1 ), VideoStreamingActive( false ), MappedBuffers( ), MappedBufferLength( ), PropertiesToSet( ),
+            VideoFd( -1 ), StopEventFd( -1 ), VideoStreamingActive( false ), MappedBuffers( ), MappedBufferLength( ), BytesPerLine( 0 ),
+            PropertiesToSet( ), KnownPropertyRanges( ), SupportedFormats( ), AutoGain( ),
+            Statistics( ),
             VideoDevice( 0 ),
-            FramesReceived( 0 ), FrameWidth( 640 ), FrameHeight( 480 ), FrameRate( 30 ), JpegEncoding( true )
+            FramesReceived( 0 ), FramesDiscarded( 0 ), FrameWidth( 640 ), FrameHeight( 480 ), FrameRate( 30 ),
+            CaptureFormat( XPixelFormat::Unknown ), NegotiatedFormat( XPixelFormat::Unknown ), RgbOutput( false ), JpegEncoding( true ), LowLatency( false ),
+            NativeFrameRate( 0 ), DeliveredFrames( )
         {
         }
 
@@ -89,7 +148,12 @@ namespace Private
         void SetVideoDevice( uint32_t videoDevice );
         void SetVideoSize( uint32_t width, uint32_t height );
         void SetFrameRate( uint32_t frameRate );
+        void SetCaptureFormat( XPixelFormat format );
+        void EnableRgbOutput( bool enable );
         void EnableJpegEncoding( bool enable );
+        void EnableLowLatency( bool enable );
+
+        vector<XV4LVideoFormat> GetSupportedFormats( ) const;
 
         XError SetVideoProperty( XVideoProperty property, int32_t value );
         XError GetVideoProperty( XVideoProperty property, int32_t* value ) const;
@@ -99,6 +163,11 @@ namespace Private
         bool Init( );
         void VideoCaptureLoop( );
         void Cleanup( );
+        void SaveVideoProperties( );
+
+        void EnumerateFormats( );
+        XV4LFrameSize EnumerateFrameRates( uint32_t fourCC, uint32_t width, uint32_t height );
+        uint32_t SelectFormat( );
 
     };
 }
@@ -148,12 +217,56 @@ uint32_t XV4LCamera::FramesReceived( )
     return mData->FramesReceived;
 }
 
+// Get number of stale frames discarded in low latency mode since the start of the video source
+uint32_t XV4LCamera::FramesDiscarded( )
+{
+    return mData->FramesDiscarded;
+}
+
+// Get frame rate programmed into the camera
+float XV4LCamera::NativeFrameRate( ) const
+{
+    return mData->NativeFrameRate;
+}
+
+// Get rate of frames actually provided to the listener
+float XV4LCamera::ActualFrameRate( ) const
+{
+    return static_cast<float>( mData->DeliveredFrames.Rate( ) );
+}
+
+// Get pixel format negotiated with the camera
+XPixelFormat XV4LCamera::NegotiatedFormat( ) const
+{
+    return mData->NegotiatedFormat;
+}
+
+// Get formats, frame sizes and frame rates supported by the camera
+vector<XV4LVideoFormat> XV4LCamera::SupportedFormats( ) const
+{
+    return mData->GetSupportedFormats( );
+}
+
+// Put frame rate statistics into the specified collector
+void XV4LCamera::CollectStatistics( XStatisticsCollector& collector ) const
+{
+    collector.AddGauge( "cam2web_camera_requested_fps", "Frame rate requested from camera", mData->FrameRate );
+    collector.AddGauge( "cam2web_camera_native_fps", "Frame rate set by camera driver (0 if not supported)", mData->NativeFrameRate );
+    collector.AddGauge( "cam2web_camera_fps", "Frame rate actually delivered by camera", mData->DeliveredFrames.Rate( ) );
+}
+
 // Set video source listener
 IVideoSourceListener* XV4LCamera::SetListener( IVideoSourceListener* listener )
 {
     return mData->SetListener( listener );
 }
 
+// Set statistics object to report dropped frames and pixel format conversion time to
+void XV4LCamera::SetStatistics( const shared_ptr<XPipelineStatistics>& statistics )
+{
+    mData->Statistics = statistics;
+}
+
 // Set/get video device
 uint32_t XV4LCamera::VideoDevice( ) const
 {
@@ -188,7 +301,27 @@ void XV4LCamera::SetFrameRate( uint32_t frameRate )
     mData->SetFrameRate( frameRate );
 }
 
-// Enable/Disable JPEG encoding
+// Get/Set pixel format to capture video in
+XPixelFormat XV4LCamera::CaptureFormat( ) const
+{
+    return mData->CaptureFormat;
+}
+void XV4LCamera::SetCaptureFormat( XPixelFormat format )
+{
+    mData->SetCaptureFormat( format );
+}
+
+// Enable/Disable conversion of uncompressed frames into RGB24
+bool XV4LCamera::IsRgbOutputEnabled( ) const
+{
+    return mData->RgbOutput;
+}
+void XV4LCamera::EnableRgbOutput( bool enable )
+{
+    mData->EnableRgbOutput( enable );
+}
+
+// Enable/Disable JPEG encoding by the camera
 bool XV4LCamera::IsJpegEncodingEnabled( ) const
 {
     return mData->JpegEncoding;
@@ -198,6 +331,16 @@ void XV4LCamera::EnableJpegEncoding( bool enable )
     mData->EnableJpegEncoding( enable );
 }
 
+// Enable/Disable low latency mode
+bool XV4LCamera::IsLowLatencyEnabled( ) const
+{
+    return mData->LowLatency;
+}
+void XV4LCamera::EnableLowLatency( bool enable )
+{
+    mData->EnableLowLatency( enable );
+}
+
 // Set the specified video property
 XError XV4LCamera::SetVideoProperty( XVideoProperty property, int32_t value )
 {
@@ -228,7 +371,13 @@ bool XV4LCameraData::Start( )
     {
         NeedToStop.Reset( );
         Running = true;
-        FramesReceived = 0;
+        FramesReceived   = 0;
+        FramesDiscarded  = 0;
+        NativeFrameRate  = 0;
+        NegotiatedFormat = XPixelFormat::Unknown;
+
+        // event to wake up capture thread, which waits for video frames
+        StopEventFd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
 
         ControlThread = thread( ControlThreadHanlder, this );
     }
@@ -244,6 +393,16 @@ void XV4LCameraData::SignalToStop( )
     if ( IsRunning( ) )
     {
         NeedToStop.Signal( );
+
+        if ( StopEventFd != -1 )
+        {
+            uint64_t value = 1;
+
+            if ( write( StopEventFd, &value, sizeof( value ) ) < 0 )
+            {
+                // capture thread will notice the stop signal on next frame or timeout
+            }
+        }
     }
 }
 
@@ -324,8 +483,8 @@ bool XV4LCameraData::Init( )
 
     sprintf( strVideoDevice, "/dev/video%d", VideoDevice );
 
-    // open video device
-    VideoFd = open( strVideoDevice, O_RDWR );
+    // open video device (non blocking, since capture loop waits for frames with poll())
+    VideoFd = open( strVideoDevice, O_RDWR | O_NONBLOCK );
     if ( VideoFd == -1 )
     {
         NotifyError( "Failed opening video device", true );
@@ -355,11 +514,30 @@ bool XV4LCameraData::Init( )
         }
     }
 
+    // find out what the camera supports and pick pixel format to use
+    uint32_t pixelFormat = 0;
+
+    if ( ret )
+    {
+        // formats are enumerated only once for the device, which makes restarts faster
+        if ( SupportedFormats.empty( ) )
+        {
+            EnumerateFormats( );
+        }
+
+        pixelFormat = SelectFormat( );
+        if ( pixelFormat == 0 )
+        {
+            NotifyError( ( CaptureFormat == XPixelFormat::Unknown ) ? "The camera does not support any of the handled pixel formats" :
+                                                                      "The camera does not support requested pixel format", true );
+            ret = false;
+        }
+    }
+
     // configure video format
     if ( ret )
     {
         v4l2_format videoFormat = { 0 };
-        uint32_t    pixelFormat = ( JpegEncoding ) ? V4L2_PIX_FMT_MJPEG : V4L2_PIX_FMT_YUYV;
 
         videoFormat.type                = V4L2_BUF_TYPE_VIDEO_CAPTURE;
         videoFormat.fmt.pix.width       = FrameWidth;
@@ -375,7 +553,7 @@ bool XV4LCameraData::Init( )
         }
         else if ( videoFormat.fmt.pix.pixelformat != pixelFormat )
         {
-            NotifyError( string( "The camera does not support requested format: " ) + ( ( JpegEncoding ) ? "MJPEG" : "YUYV" ), true );
+            NotifyError( "The camera does not support requested pixel format", true );
             ret = false;
         }
         else
@@ -383,6 +561,47 @@ bool XV4LCameraData::Init( )
             // update width/height in case camera does not support what was requested
             FrameWidth  = videoFormat.fmt.pix.width;
             FrameHeight = videoFormat.fmt.pix.height;
+
+            for ( const auto& handledFormat : HandledFormats )
+            {
+                if ( handledFormat.FourCC == pixelFormat )
+                {
+                    NegotiatedFormat = handledFormat.PixelFormat;
+                }
+            }
+
+            // some drivers leave bytes per line unset for packed formats
+            BytesPerLine = videoFormat.fmt.pix.bytesperline;
+            if ( BytesPerLine == 0 )
+            {
+                BytesPerLine = ( ( NegotiatedFormat == XPixelFormat::YUYV ) || ( NegotiatedFormat == XPixelFormat::UYVY ) ) ?
+                               ( ( FrameWidth + 1 ) / 2 ) * 4 :
+                               ( NegotiatedFormat == XPixelFormat::Grayscale16 ) ? FrameWidth * 2 : FrameWidth;
+            }
+        }
+    }
+
+    // set frame interval of the camera, so it does not need to be limited by the capture loop
+    if ( ret )
+    {
+        v4l2_streamparm streamParam;
+
+        memset( &streamParam, 0, sizeof( streamParam ) );
+        streamParam.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+        if ( ( ioctl( VideoFd, VIDIOC_G_PARM, &streamParam ) == 0 ) &&
+             ( ( streamParam.parm.capture.capability & V4L2_CAP_TIMEPERFRAME ) != 0 ) )
+        {
+            streamParam.parm.capture.timeperframe.numerator   = 1;
+            streamParam.parm.capture.timeperframe.denominator = FrameRate;
+
+            // not a fatal error - frame rate is limited by skipping frames then
+            if ( ( ioctl( VideoFd, VIDIOC_S_PARM, &streamParam ) == 0 ) &&
+                 ( streamParam.parm.capture.timeperframe.numerator != 0 ) )
+            {
+                NativeFrameRate = static_cast<float>( streamParam.parm.capture.timeperframe.denominator ) /
+                                  streamParam.parm.capture.timeperframe.numerator;
+            }
         }
     }
 
@@ -441,6 +660,31 @@ bool XV4LCameraData::Init( )
         }
     }
 
+    // uncompressed frames are wrapped into images directly, so make sure buffers have all the planes
+    if ( ( ret ) && ( NegotiatedFormat != XPixelFormat::JPEG ) )
+    {
+        uint32_t frameSize = BytesPerLine * FrameHeight;
+
+        if ( NegotiatedFormat == XPixelFormat::NV12 )
+        {
+            frameSize += BytesPerLine * ( ( FrameHeight + 1 ) / 2 );
+        }
+        else if ( NegotiatedFormat == XPixelFormat::I420 )
+        {
+            frameSize += ( BytesPerLine / 2 ) * ( ( FrameHeight + 1 ) / 2 ) * 2;
+        }
+
+        for ( int i = 0; i < BUFFER_COUNT; i++ )
+        {
+            if ( MappedBufferLength[i] < frameSize )
+            {
+                NotifyError( "Capture buffers are too small for the negotiated video format", true );
+                ret = false;
+                break;
+            }
+        }
+    }
+
     // enqueue capture buffers
     if ( ret )
     {
@@ -506,6 +750,9 @@ void XV4LCameraData::Cleanup( )
 {
     lock_guard<recursive_mutex> lock( ConfigSync );
 
+    // keep values of properties, so they are reported and restored if camera is started again
+    SaveVideoProperties( );
+
     // disable vide streaming
     if ( VideoStreamingActive )
     {
@@ -534,67 +781,205 @@ void XV4LCameraData::Cleanup( )
     }
 }
 
-// Helper function to decode YUYV data into RGB
-static void DecodeYuyvToRgb( const uint8_t* yuyvPtr, uint8_t* rgbPtr, int32_t width, int32_t height, int32_t rgbStride )
+// Get frame rate for the specified frame interval
+static float FrameIntervalToRate( const v4l2_fract& interval )
+{
+    return ( interval.numerator == 0 ) ? 0.0f : static_cast<float>( interval.denominator ) / interval.numerator;
+}
+
+// Enumerate pixel formats, frame sizes and frame rates supported by the opened device
+void XV4LCameraData::EnumerateFormats( )
+{
+    vector<XV4LVideoFormat> formats;
+    v4l2_fmtdesc            formatDesc;
+
+    memset( &formatDesc, 0, sizeof( formatDesc ) );
+    formatDesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+    for ( formatDesc.index = 0; ioctl( VideoFd, VIDIOC_ENUM_FMT, &formatDesc ) == 0; formatDesc.index++ )
+    {
+        XV4LVideoFormat  format;
+        v4l2_frmsizeenum frameSize;
+
+        format.FourCC      = formatDesc.pixelformat;
+        format.PixelFormat = XPixelFormat::Unknown;
+        format.Description = reinterpret_cast<const char*>( formatDesc.description );
+        format.SizeRange   = false;
+
+        for ( const auto& handledFormat : HandledFormats )
+        {
+            if ( handledFormat.FourCC == formatDesc.pixelformat )
+            {
+                format.PixelFormat = handledFormat.PixelFormat;
+            }
+        }
+
+        memset( &frameSize, 0, sizeof( frameSize ) );
+        frameSize.pixel_format = formatDesc.pixelformat;
+
+        for ( frameSize.index = 0; ioctl( VideoFd, VIDIOC_ENUM_FRAMESIZES, &frameSize ) == 0; frameSize.index++ )
+        {
+            if ( frameSize.type == V4L2_FRMSIZE_TYPE_DISCRETE )
+            {
+                format.FrameSizes.push_back( EnumerateFrameRates( formatDesc.pixelformat, frameSize.discrete.width, frameSize.discrete.height ) );
+            }
+            else
+            {
+                // stepwise/continuous range is the only item reported
+                format.FrameSizes.push_back( EnumerateFrameRates( formatDesc.pixelformat, frameSize.stepwise.min_width, frameSize.stepwise.min_height ) );
+                format.FrameSizes.push_back( EnumerateFrameRates( formatDesc.pixelformat, frameSize.stepwise.max_width, frameSize.stepwise.max_height ) );
+                format.SizeRange = true;
+                break;
+            }
+        }
+
+        formats.push_back( format );
+    }
+
+    {
+        lock_guard<recursive_mutex> lock( Sync );
+        SupportedFormats = formats;
+    }
+}
+
+// Enumerate frame rates supported for the specified pixel format and frame size
+XV4LFrameSize XV4LCameraData::EnumerateFrameRates( uint32_t fourCC, uint32_t width, uint32_t height )
 {
-    /* 
-        The code below does YUYV to RGB conversion using the next coefficients.
-        However those are multiplied by 256 to get integer calculations.
-     
-        r = y + (1.4065 * (cr - 128));
-        g = y - (0.3455 * (cb - 128)) - (0.7169 * (cr - 128));
-        b = y + (1.7790 * (cb - 128));
-    */
+    XV4LFrameSize    frameSize = { width, height, vector<float>( ) };
+    v4l2_frmivalenum frameInterval;
 
-    int r, g, b;
-    int y, u, v;
-    int z = 0;
+    memset( &frameInterval, 0, sizeof( frameInterval ) );
+    frameInterval.pixel_format = fourCC;
+    frameInterval.width        = width;
+    frameInterval.height       = height;
 
-    for ( int32_t iy = 0; iy < height; iy++ )
+    for ( frameInterval.index = 0; ioctl( VideoFd, VIDIOC_ENUM_FRAMEINTERVALS, &frameInterval ) == 0; frameInterval.index++ )
     {
-        uint8_t* rgbRow = rgbPtr + iy * rgbStride;
+        if ( frameInterval.type == V4L2_FRMIVAL_TYPE_DISCRETE )
+        {
+            frameSize.FrameRates.push_back( FrameIntervalToRate( frameInterval.discrete ) );
+        }
+        else
+        {
+            // for stepwise/continuous range, list the highest and the lowest frame rates
+            frameSize.FrameRates.push_back( FrameIntervalToRate( frameInterval.stepwise.min ) );
+            frameSize.FrameRates.push_back( FrameIntervalToRate( frameInterval.stepwise.max ) );
+            break;
+        }
+    }
+
+    return frameSize;
+}
+
+// Select pixel format to request from the camera - the one set by user or the cheapest to handle out of those,
+// which support the requested frame size and rate (returns 0 if the camera has nothing suitable)
+uint32_t XV4LCameraData::SelectFormat( )
+{
+    uint32_t selectedFormat = 0;
+    int      selectedScore  = -1;
 
-        for ( int32_t ix = 0; ix < width; ix++ )
+    for ( const auto& handledFormat : HandledFormats )
+    {
+        if ( ( ( CaptureFormat != XPixelFormat::Unknown ) && ( CaptureFormat != handledFormat.PixelFormat ) ) ||
+             ( ( CaptureFormat == XPixelFormat::Unknown ) && ( !JpegEncoding ) && ( handledFormat.PixelFormat == XPixelFormat::JPEG ) ) )
         {
-            y = ( ( z == 0 ) ? yuyvPtr[0] : yuyvPtr[2] ) << 8;
-            u = yuyvPtr[1] - 128;
-            v = yuyvPtr[3] - 128;
+            continue;
+        }
 
-            r = ( y + ( 360 * v ) ) >> 8;
-            g = ( y - ( 88  * u ) - ( 184 * v ) ) >> 8;
-            b = ( y + ( 455 * u ) ) >> 8;
+        for ( const auto& format : SupportedFormats )
+        {
+            if ( format.FourCC != handledFormat.FourCC )
+            {
+                continue;
+            }
 
-            rgbRow[RedIndex]   = (uint8_t) ( r > 255 ) ? 255 : ( ( r < 0 ) ? 0 : r );
-            rgbRow[GreenIndex] = (uint8_t) ( g > 255 ) ? 255 : ( ( g < 0 ) ? 0 : g );
-            rgbRow[BlueIndex]  = (uint8_t) ( b > 255 ) ? 255 : ( ( b < 0 ) ? 0 : b );
+            // 0 - only the format is supported, 1 - frame size is supported as well, 2 - also the frame rate
+            int score = 0;
 
-            if ( z++ )
+            for ( const auto& frameSize : format.FrameSizes )
             {
-                z = 0;
-                yuyvPtr += 4;
+                bool sizeMatch = ( ( frameSize.Width == FrameWidth ) && ( frameSize.Height == FrameHeight ) );
+
+                if ( ( format.SizeRange ) && ( format.FrameSizes.size( ) == 2 ) )
+                {
+                    sizeMatch = ( FrameWidth  >= format.FrameSizes[0].Width  ) && ( FrameWidth  <= format.FrameSizes[1].Width  ) &&
+                                ( FrameHeight >= format.FrameSizes[0].Height ) && ( FrameHeight <= format.FrameSizes[1].Height );
+                }
+
+                if ( sizeMatch )
+                {
+                    score = max( score, 1 );
+
+                    for ( float frameRate : frameSize.FrameRates )
+                    {
+                        if ( frameRate + 0.5f >= FrameRate )
+                        {
+                            score = 2;
+                        }
+                    }
+                }
             }
 
-            rgbRow += 3;
+            // formats are checked in the order of preference, so only a better score wins
+            if ( score > selectedScore )
+            {
+                selectedScore  = score;
+                selectedFormat = format.FourCC;
+            }
+        }
+    }
+
+    // devices, which don't support enumeration, are simply asked for the format
+    if ( ( selectedFormat == 0 ) && ( SupportedFormats.empty( ) ) )
+    {
+        for ( const auto& handledFormat : HandledFormats )
+        {
+            if ( ( CaptureFormat == handledFormat.PixelFormat ) ||
+                 ( ( CaptureFormat == XPixelFormat::Unknown ) && ( ( JpegEncoding ) || ( handledFormat.PixelFormat != XPixelFormat::JPEG ) ) ) )
+            {
+                selectedFormat = handledFormat.FourCC;
+                break;
+            }
         }
     }
+
+    return selectedFormat;
+}
+
+// Get formats, frame sizes and frame rates supported by the camera
+vector<XV4LVideoFormat> XV4LCameraData::GetSupportedFormats( ) const
+{
+    lock_guard<recursive_mutex> lock( Sync );
+    return SupportedFormats;
 }
 
 // Do video capture in an end-less loop until signalled to stop
 void XV4LCameraData::VideoCaptureLoop( )
 {
-    v4l2_buffer videoBuffer;
-    uint32_t    sleepTime = 0;
-    uint32_t    frameTime = 1000 / FrameRate;
-    uint32_t    handlingTime ;
-    int         ecode;
-
-    // If JPEG encoding is used, client is notified with an image wrapping a mapped buffer.
-    // If not used howver, we decode YUYV data into RGB.
+    v4l2_buffer  videoBuffer;
+    pollfd       pollFds[2];
+    nfds_t       pollFdsCount = ( StopEventFd != -1 ) ? 2 : 1;
+    uint32_t     nextSequence = 0;
+    bool         firstFrame   = true;
+    int          ecode;
+
+    // Frames are skipped if camera provides them faster than requested (setting
+    // frame interval is not supported or the requested rate is not available).
+    // Some tolerance is given for frames coming a bit earlier than expected.
+    microseconds             frameInterval( 1000000 / FrameRate );
+    microseconds             tolerance( ( NativeFrameRate >= 1.0f ) ? static_cast<int64_t>( 250000 / NativeFrameRate ) : frameInterval.count( ) / 4 );
+    bool                     limitFrameRate = ( NativeFrameRate < 0.5f ) || ( NativeFrameRate > FrameRate + 0.5f );
+    steady_clock::time_point nextFrameTime  = steady_clock::now( );
+
+    // Client is notified with an image wrapping a mapped buffer, unless uncompressed
+    // frames must be converted into RGB (16 bit grayscale frames are mapped to 8 bit).
     shared_ptr<XImage> rgbImage;
     
-    if ( !JpegEncoding )
+    if ( ( RgbOutput ) && ( NegotiatedFormat != XPixelFormat::JPEG ) && ( NegotiatedFormat != XPixelFormat::Grayscale8 ) )
     {
-        rgbImage = XImage::Allocate( FrameWidth, FrameHeight, XPixelFormat::RGB24 );
+        rgbImage = XImage::Allocate( FrameWidth, FrameHeight, ( NegotiatedFormat == XPixelFormat::Grayscale16 ) ?
+                                                              XPixelFormat::Grayscale8 : XPixelFormat::RGB24 );
+        AutoGain.Reset( );
 
         if ( !rgbImage )
         {
@@ -603,45 +988,163 @@ void XV4LCameraData::VideoCaptureLoop( )
         }
     }
 
+    XTracer::SetThreadName( "V4L capture " + to_string( VideoDevice ) );
+
+    pollFds[0].fd     = VideoFd;
+    pollFds[0].events = POLLIN;
+    pollFds[1].fd     = StopEventFd;
+    pollFds[1].events = POLLIN;
+
     // acquire images untill we've been told to stop
-    while ( !NeedToStop.Wait( sleepTime ) )
+    while ( !NeedToStop.IsSignaled( ) )
     {
-        steady_clock::time_point startTime = steady_clock::now( );
+        // wait for a new frame or a signal to stop
+        pollFds[0].revents = 0;
+        pollFds[1].revents = 0;
 
-        // dequeue buffer
-        memset( &videoBuffer, 0, sizeof( videoBuffer ) );
+        ecode = poll( pollFds, pollFdsCount, FRAME_WAIT_TIMEOUT );
 
-        videoBuffer.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        videoBuffer.memory = V4L2_MEMORY_MMAP;
-
-        ecode = ioctl( VideoFd, VIDIOC_DQBUF, &videoBuffer );
         if ( ecode < 0 )
         {
-            NotifyError( "Failed to dequeue capture buffer" );
+            if ( errno != EINTR )
+            {
+                NotifyError( "Failed waiting for video frame", true );
+                break;
+            }
+            continue;
+        }
+        else if ( ecode == 0 )
+        {
+            NotifyError( "Timeout waiting for video frame" );
+            continue;
         }
-        else
+        else if ( ( pollFds[1].revents & POLLIN ) != 0 )
         {
-            shared_ptr<XImage> image;
+            break;
+        }
+        else if ( ( pollFds[0].revents & ( POLLERR | POLLHUP | POLLNVAL ) ) != 0 )
+        {
+            NotifyError( "Video device is not available", true );
+            break;
+        }
+
+        XTraceScope trace( "Capture frame", 0 );
+        bool        gotFrame = false;
+
+        // dequeue buffer; in low latency mode keep dequeuing till driver's queue is empty,
+        // putting stale buffers back straight away, so only the newest frame is provided
+        for ( ; ; )
+        {
+            v4l2_buffer newBuffer;
+
+            memset( &newBuffer, 0, sizeof( newBuffer ) );
 
-            FramesReceived++;
+            newBuffer.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            newBuffer.memory = V4L2_MEMORY_MMAP;
 
-            if ( JpegEncoding )
+            ecode = ioctl( VideoFd, VIDIOC_DQBUF, &newBuffer );
+            if ( ecode < 0 )
             {
-                image = XImage::Create( MappedBuffers[videoBuffer.index], videoBuffer.bytesused, 1, videoBuffer.bytesused, XPixelFormat::JPEG );
+                if ( errno != EAGAIN )
+                {
+                    NotifyError( "Failed to dequeue capture buffer" );
+                }
+                break;
             }
-            else
+
+            // check for gaps in frame sequence numbers, which are caused by frames dropped by driver
+            if ( ( Statistics ) && ( !firstFrame ) && ( newBuffer.sequence > nextSequence ) )
             {
-                DecodeYuyvToRgb( MappedBuffers[videoBuffer.index], rgbImage->Data( ), FrameWidth, FrameHeight, rgbImage->Stride( ) );
-                image = rgbImage;
+                Statistics->FramesDropped += newBuffer.sequence - nextSequence;
             }
+            nextSequence = newBuffer.sequence + 1;
+            firstFrame   = false;
 
-            if ( image )
+            if ( gotFrame )
             {
-                NotifyNewImage( image );
+                ecode = ioctl( VideoFd, VIDIOC_QBUF, &videoBuffer );
+                if ( ecode < 0 )
+                {
+                    NotifyError( "Failed to requeue capture buffer" );
+                }
+
+                FramesDiscarded++;
+                if ( Statistics )
+                {
+                    Statistics->FramesDiscarded++;
+                }
             }
-            else
+
+            videoBuffer = newBuffer;
+            gotFrame    = true;
+
+            if ( !LowLatency )
             {
-                NotifyError( "Failed allocating an image" );
+                break;
+            }
+        }
+
+        if ( gotFrame )
+        {
+            steady_clock::time_point now = steady_clock::now( );
+
+            if ( ( !limitFrameRate ) || ( now + tolerance >= nextFrameTime ) )
+            {
+                shared_ptr<XImage> image;
+
+                // schedule next frame, but don't try catching up if we are behind
+                nextFrameTime += frameInterval;
+                if ( nextFrameTime + frameInterval < now )
+                {
+                    nextFrameTime = now + frameInterval;
+                }
+
+                FramesReceived++;
+                DeliveredFrames.Add( );
+                trace.SetFrame( XTracer::NewFrame( ), XTraceFlow::Start );
+
+                if ( NegotiatedFormat == XPixelFormat::JPEG )
+                {
+                    image = XImage::Create( MappedBuffers[videoBuffer.index], videoBuffer.bytesused, 1, videoBuffer.bytesused, XPixelFormat::JPEG );
+                }
+                else
+                {
+                    image = XImage::Create( MappedBuffers[videoBuffer.index], FrameWidth, FrameHeight, BytesPerLine, NegotiatedFormat );
+
+                    if ( ( image ) && ( rgbImage ) )
+                    {
+                        steady_clock::time_point conversionStartTime = steady_clock::now( );
+                        XTraceScope              convertTrace( "Convert frame" );
+
+                        if ( NegotiatedFormat == XPixelFormat::Grayscale16 )
+                        {
+                            AutoGain.Map( image, rgbImage );
+                        }
+                        else if ( XImageConversion::IsBayerFormat( NegotiatedFormat ) )
+                        {
+                            XImageConversion::BayerToRgb24( image, rgbImage );
+                        }
+                        else
+                        {
+                            XImageConversion::YuvToRgb24( image, rgbImage );
+                        }
+                        image = rgbImage;
+
+                        if ( Statistics )
+                        {
+                            Statistics->ConversionTime.AddSince( conversionStartTime );
+                        }
+                    }
+                }
+
+                if ( image )
+                {
+                    NotifyNewImage( image );
+                }
+                else
+                {
+                    NotifyError( "Failed allocating an image" );
+                }
             }
 
             // put the buffer back into the queue
@@ -651,9 +1154,6 @@ void XV4LCameraData::VideoCaptureLoop( )
                 NotifyError( "Failed to requeue capture buffer" );
             }
         }
-
-        handlingTime = static_cast<uint32_t>( duration_cast<milliseconds>( steady_clock::now( ) - startTime ).count( ) );
-        sleepTime    = ( handlingTime > frameTime ) ? 0 : ( frameTime - handlingTime );
     }
 }
 
@@ -670,6 +1170,12 @@ void XV4LCameraData::ControlThreadHanlder( XV4LCameraData* me )
     {
         lock_guard<recursive_mutex> lock( me->Sync );
         me->Running = false;
+
+        if ( me->StopEventFd != -1 )
+        {
+            close( me->StopEventFd );
+            me->StopEventFd = -1;
+        }
     }
 }
 
@@ -678,9 +1184,11 @@ void XV4LCameraData::SetVideoDevice( uint32_t videoDevice )
 {
     lock_guard<recursive_mutex> lock( Sync );
 
-    if ( !IsRunning( ) )
+    if ( ( !IsRunning( ) ) && ( VideoDevice != videoDevice ) )
     {
         VideoDevice = videoDevice;
+        SupportedFormats.clear( );
+        KnownPropertyRanges.clear( );
     }
 }
 
@@ -707,7 +1215,29 @@ void XV4LCameraData::SetFrameRate( uint32_t frameRate )
     }
 }
 
-// Enable/disable JPEG encoding
+// Set pixel format to capture video in
+void XV4LCameraData::SetCaptureFormat( XPixelFormat format )
+{
+    lock_guard<recursive_mutex> lock( Sync );
+
+    if ( !IsRunning( ) )
+    {
+        CaptureFormat = format;
+    }
+}
+
+// Enable/disable conversion of uncompressed frames into RGB24
+void XV4LCameraData::EnableRgbOutput( bool enable )
+{
+    lock_guard<recursive_mutex> lock( Sync );
+
+    if ( !IsRunning( ) )
+    {
+        RgbOutput = enable;
+    }
+}
+
+// Enable/disable JPEG encoding by the camera
 void XV4LCameraData::EnableJpegEncoding( bool enable )
 {
     lock_guard<recursive_mutex> lock( Sync );
@@ -718,6 +1248,17 @@ void XV4LCameraData::EnableJpegEncoding( bool enable )
     }
 }
 
+// Enable/disable low latency mode
+void XV4LCameraData::EnableLowLatency( bool enable )
+{
+    lock_guard<recursive_mutex> lock( Sync );
+
+    if ( !IsRunning( ) )
+    {
+        LowLatency = enable;
+    }
+}
+
 static const uint32_t nativeVideoProperties[] =
 {
     V4L2_CID_BRIGHTNESS,
@@ -781,7 +1322,17 @@ XError XV4LCameraData::GetVideoProperty( XVideoProperty property, int32_t* value
     }
     else if ( ( !Running ) || ( VideoFd == -1 ) )
     {
-        ret = XError::DeivceNotReady;
+        // provide value set while device is not running or the one it had when it was stopped
+        auto itProperty = PropertiesToSet.find( property );
+
+        if ( itProperty == PropertiesToSet.end( ) )
+        {
+            ret = XError::DeivceNotReady;
+        }
+        else
+        {
+            *value = itProperty->second;
+        }
     }
     else
     {
@@ -802,6 +1353,30 @@ XError XV4LCameraData::GetVideoProperty( XVideoProperty property, int32_t* value
     return ret;
 }
 
+// Save current values of video properties to set them again when device is re-opened
+void XV4LCameraData::SaveVideoProperties( )
+{
+    lock_guard<recursive_mutex> lock( Sync );
+
+    if ( VideoFd != -1 )
+    {
+        // same range of properties as supported by SetVideoProperty()
+        for ( int i = static_cast<int>( XVideoProperty::Brightness ); i <= static_cast<int>( XVideoProperty::Gain ); i++ )
+        {
+            XVideoProperty property = static_cast<XVideoProperty>( i );
+            v4l2_control   control;
+
+            control.id = nativeVideoProperties[i];
+
+            // values set by user, but not applied yet, are kept as they are
+            if ( ( PropertiesToSet.find( property ) == PropertiesToSet.end( ) ) && ( ioctl( VideoFd, VIDIOC_G_CTRL, &control ) == 0 ) )
+            {
+                PropertiesToSet[property] = control.value;
+            }
+        }
+    }
+}
+
 // Get range of values supported by the specified video property
 XError XV4LCameraData::GetVideoPropertyRange( XVideoProperty property, int32_t* min, int32_t* max, int32_t* step, int32_t* def ) const
 {
@@ -818,7 +1393,20 @@ XError XV4LCameraData::GetVideoPropertyRange( XVideoProperty property, int32_t*
     }
     else if ( ( !Running ) || ( VideoFd == -1 ) )
     {
-        ret = XError::DeivceNotReady;
+        // provide range found while device was running
+        auto itRange = KnownPropertyRanges.find( property );
+
+        if ( itRange == KnownPropertyRanges.end( ) )
+        {
+            ret = XError::DeivceNotReady;
+        }
+        else
+        {
+            *min  = itRange->second.Min;
+            *max  = itRange->second.Max;
+            *step = itRange->second.Step;
+            *def  = itRange->second.Default;
+        }
     }
     else
     {
@@ -846,6 +1434,8 @@ XError XV4LCameraData::GetVideoPropertyRange( XVideoProperty property, int32_t*
             *max  = queryControl.maximum;
             *step = queryControl.step;
             *def  = queryControl.default_value;
+
+            KnownPropertyRanges[property] = { *min, *max, *step, *def };
         }
         else
         {
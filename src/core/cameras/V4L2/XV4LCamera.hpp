@@ -22,9 +22,13 @@
 #define XV4L_CAMERA_HPP
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "IVideoSource.hpp"
+#include "XImage.hpp"
 #include "XInterfaces.hpp"
+#include "XStatistics.hpp"
 
 namespace Private
 {
@@ -47,8 +51,27 @@ enum class XVideoProperty
     VerticalFlip
 };
 
+// Frame size supported by camera for certain pixel format along with frame rates available for it
+struct XV4LFrameSize
+{
+    uint32_t            Width;
+    uint32_t            Height;
+    std::vector<float>  FrameRates;
+};
+
+// Pixel format supported by camera
+struct XV4LVideoFormat
+{
+    uint32_t                    FourCC;
+    XPixelFormat                PixelFormat;    // Unknown if the format cannot be handled
+    std::string                 Description;
+    std::vector<XV4LFrameSize>  FrameSizes;
+    bool                        SizeRange;      // true if frame sizes are the smallest and the biggest sizes
+                                                // of a stepwise/continuous range
+};
+
 // Class which provides access to cameras using V4L2 API (Video for Linux, v2)
-class XV4LCamera : public IVideoSource, private Uncopyable
+class XV4LCamera : public IVideoSource, public IStatisticsProvider, private Uncopyable
 {
 protected:
     XV4LCamera( );
@@ -69,10 +92,29 @@ public:
 
     // Get number of frames received since the start of the video source
     uint32_t FramesReceived( );
+    // Get number of stale frames discarded in low latency mode since the start of the video source
+    uint32_t FramesDiscarded( );
+
+    // Get frame rate programmed into the camera (0 if the camera does not support setting it).
+    // If it is higher than the requested frame rate, extra frames are skipped.
+    float NativeFrameRate( ) const;
+    // Get rate of frames actually provided to the listener (measured over about a second)
+    float ActualFrameRate( ) const;
+
+    // Get pixel format negotiated with the camera (Unknown if the camera was never started)
+    XPixelFormat NegotiatedFormat( ) const;
+    // Get formats, frame sizes and frame rates supported by the camera (enumerated when it starts)
+    std::vector<XV4LVideoFormat> SupportedFormats( ) const;
+
+    // Put frame rate statistics into the specified collector
+    void CollectStatistics( XStatisticsCollector& collector ) const;
 
     // Set video source listener returning the old one
     IVideoSourceListener* SetListener( IVideoSourceListener* listener );
 
+    // Set statistics object to report dropped frames and pixel format conversion time to
+    void SetStatistics( const std::shared_ptr<XPipelineStatistics>& statistics );
+
 public: // Set of poperties, which can be set only when device is NOT running.
         // If it is running, then setting these properties is silently ignored.
 
@@ -89,10 +131,30 @@ public: // Set of poperties, which can be set only when device is NOT running.
     uint32_t FrameRate( ) const;
     void SetFrameRate( uint32_t frameRate );
 
-    // Enable/Disable JPEG encoding
+    // Get/Set pixel format to capture video in: JPEG (MJPEG), NV12, I420, YUYV, UYVY, Grayscale8,
+    // Grayscale16 or one of the 8 bit Bayer formats. If set to Unknown (default), the format cheapest
+    // to handle is picked out of those supported by the camera for the requested video size and frame
+    // rate - MJPEG, then NV12, I420, YUYV, UYVY, followed by the grayscale and raw sensor formats.
+    XPixelFormat CaptureFormat( ) const;
+    void SetCaptureFormat( XPixelFormat format );
+
+    // Enable/Disable conversion of uncompressed frames into RGB24 (16 bit grayscale frames are mapped
+    // into 8 bit with automatic gain instead). Disabled by default, so frames are provided in camera's
+    // native format, which JPEG encoder takes directly (converting Bayer and 16 bit frames itself).
+    bool IsRgbOutputEnabled( ) const;
+    void EnableRgbOutput( bool enable );
+
+    // Enable/Disable JPEG encoding by the camera (enabled by default). Kept for compatibility - when
+    // disabled, MJPEG is skipped while picking capture format, so the cheapest uncompressed format is
+    // taken instead (set RGB output to get RGB24 frames as before). Ignored if capture format is set.
     bool IsJpegEncodingEnabled( ) const;
     void EnableJpegEncoding( bool enable );
 
+    // Enable/Disable low latency mode. When enabled, all frames ready in driver's queue are
+    // dequeued and only the newest one is provided to the listener, while others are discarded.
+    bool IsLowLatencyEnabled( ) const;
+    void EnableLowLatency( bool enable );
+
 public:
 
     // Set the specified video property. The device does not have to be running. If it is not,
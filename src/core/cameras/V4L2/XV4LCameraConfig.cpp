@@ -18,6 +18,7 @@
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 */
 
+#include <stdio.h>
 #include <map>
 #include <list>
 #include <algorithm>
@@ -201,3 +202,91 @@ map<string, string> XV4LCameraPropsInfo::GetAllProperties( ) const
     return properties;
 }
 
+// ------------------------------------------------------------------------------------------
+
+XV4LCameraInfo::XV4LCameraInfo( const shared_ptr<XV4LCamera>& camera, const PropertyMap& staticInfo ) :
+    mCamera( camera ), mStaticInfo( staticInfo )
+{
+}
+
+XError XV4LCameraInfo::GetProperty( const std::string& propertyName, std::string& value ) const
+{
+    map<string, string>                 properties = GetAllProperties( );
+    map<string, string>::const_iterator itProperty = properties.find( propertyName );
+    XError                              ret        = XError::UnknownProperty;
+
+    if ( itProperty != properties.end( ) )
+    {
+        value = itProperty->second;
+        ret   = XError::Success;
+    }
+
+    return ret;
+}
+
+map<string, string> XV4LCameraInfo::GetAllProperties( ) const
+{
+    static const map<XPixelFormat, const char*> FormatNames =
+    {
+        { XPixelFormat::JPEG, "MJPEG" },
+        { XPixelFormat::NV12, "NV12"  },
+        { XPixelFormat::I420, "I420"  },
+        { XPixelFormat::YUYV, "YUYV"  },
+        { XPixelFormat::UYVY, "UYVY"  },
+        { XPixelFormat::Grayscale8,  "GREY" },
+        { XPixelFormat::Grayscale16, "Y16"  },
+        { XPixelFormat::BayerRGGB8,  "RGGB" },
+        { XPixelFormat::BayerGRBG8,  "GRBG" },
+        { XPixelFormat::BayerGBRG8,  "GBRG" },
+        { XPixelFormat::BayerBGGR8,  "BGGR" }
+    };
+
+    map<string, string>     properties = mStaticInfo;
+    vector<XV4LVideoFormat> formats    = mCamera->SupportedFormats( );
+    XPixelFormat            format     = mCamera->NegotiatedFormat( );
+    string                  strFormats, strSizes, strRates;
+    char                    buffer[64];
+
+    sprintf( buffer, "%u", mCamera->Width( ) );
+    properties["width"] = buffer;
+    sprintf( buffer, "%u", mCamera->Height( ) );
+    properties["height"] = buffer;
+
+    auto itFormatName = FormatNames.find( format );
+    properties["format"] = ( itFormatName != FormatNames.end( ) ) ? itFormatName->second : "";
+
+    // list all formats reported by the camera, then sizes and frame rates available for the negotiated one
+    for ( const auto& supportedFormat : formats )
+    {
+        sprintf( buffer, "%c%c%c%c", supportedFormat.FourCC & 0xFF, ( supportedFormat.FourCC >> 8 ) & 0xFF,
+                                     ( supportedFormat.FourCC >> 16 ) & 0xFF, ( supportedFormat.FourCC >> 24 ) & 0xFF );
+
+        strFormats += ( ( strFormats.empty( ) ) ? "" : ", " ) + string( buffer );
+
+        if ( ( format == XPixelFormat::Unknown ) || ( supportedFormat.PixelFormat != format ) || ( !strSizes.empty( ) ) )
+        {
+            continue;
+        }
+
+        for ( const auto& frameSize : supportedFormat.FrameSizes )
+        {
+            sprintf( buffer, "%ux%u", frameSize.Width, frameSize.Height );
+            strSizes += ( ( strSizes.empty( ) ) ? "" : ( ( supportedFormat.SizeRange ) ? " - " : ", " ) ) + string( buffer );
+
+            if ( ( frameSize.Width == mCamera->Width( ) ) && ( frameSize.Height == mCamera->Height( ) ) )
+            {
+                for ( float frameRate : frameSize.FrameRates )
+                {
+                    sprintf( buffer, "%g", frameRate );
+                    strRates += ( ( strRates.empty( ) ) ? "" : ", " ) + string( buffer );
+                }
+            }
+        }
+    }
+
+    properties["formats"]    = strFormats;
+    properties["frameSizes"] = strSizes;
+    properties["frameRates"] = strRates;
+
+    return properties;
+}
@@ -53,5 +53,20 @@ private:
     std::shared_ptr<XV4LCamera> mCamera;
 };
 
+// The class is to get camera information - video size, pixel format and formats/sizes/rates supported by the camera
+class XV4LCameraInfo : public IObjectInformation
+{
+public:
+    XV4LCameraInfo( const std::shared_ptr<XV4LCamera>& camera, const PropertyMap& staticInfo = PropertyMap( ) );
+
+    XError GetProperty( const std::string& propertyName, std::string& value ) const;
+
+    std::map<std::string, std::string> GetAllProperties( ) const;
+
+private:
+    std::shared_ptr<XV4LCamera> mCamera;
+    PropertyMap                 mStaticInfo;
+};
+
 #endif // XV4L_CAMERA_CONFIG_HPP
 
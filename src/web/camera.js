@@ -1,7 +1,10 @@
 var Camera = (function ()
 {
-    var jpegUrl       = '/camera/jpeg';
-    var mjpegUrl      = '/camera/mjpeg';
+    // cameras other than the default one are selected with ?camera=<num> in page's URL
+    var cameraMatch   = /[?&]camera=(\d+)/.exec( window.location.search );
+    var baseUrl       = ( cameraMatch ) ? '/camera/' + cameraMatch[1] : '/camera';
+    var jpegUrl       = baseUrl + '/jpeg';
+    var mjpegUrl      = baseUrl + '/mjpeg';
     var mjpegMode;
     var frameInterval;
     var imageElement;
@@ -60,6 +63,7 @@ var Camera = (function ()
     };
 
     return {
-        Start: start
+        Start: start,
+        BaseUrl: baseUrl
     }
 } )( );
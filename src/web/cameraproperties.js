@@ -10,7 +10,7 @@ function setCameraProperties( variablesMap )
 {
     $.ajax( {
         type        : "POST",
-        url         : "/camera/config",
+        url         : Camera.BaseUrl + "/config",
         data        : JSON.stringify( variablesMap ),
         contentType : "application/json; charset=utf-8",
         dataType    : "json",